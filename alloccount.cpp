@@ -0,0 +1,67 @@
+#include "alloccount.h"
+
+#ifdef TESTING
+#include <cstdlib>
+#include <new>
+
+static thread_local size_t allocations = 0;
+
+size_t thread_allocation_count() {
+    return allocations;
+}
+
+static void* allocate(size_t size) {
+    allocations++;
+    void* p = malloc(size ? size : 1);
+    if (!p) throw std::bad_alloc();
+    return p;
+}
+
+static void* allocate_aligned(size_t size, std::align_val_t alignment) {
+    allocations++;
+    size_t align = (size_t)alignment;
+    // aligned_alloc要求大小是对齐的整数倍
+    void* p = aligned_alloc(align, (size + align - 1) / align * align);
+    if (!p) throw std::bad_alloc();
+    return p;
+}
+
+void* operator new(size_t size) { return allocate(size); }
+void* operator new[](size_t size) { return allocate(size); }
+void* operator new(size_t size, std::align_val_t alignment) { return allocate_aligned(size, alignment); }
+void* operator new[](size_t size, std::align_val_t alignment) { return allocate_aligned(size, alignment); }
+
+void* operator new(size_t size, const std::nothrow_t&) noexcept {
+    try {
+        return allocate(size);
+    } catch (const std::bad_alloc&) {
+        return nullptr;
+    }
+}
+
+void* operator new[](size_t size, const std::nothrow_t&) noexcept {
+    try {
+        return allocate(size);
+    } catch (const std::bad_alloc&) {
+        return nullptr;
+    }
+}
+
+void operator delete(void* p) noexcept { free(p); }
+void operator delete[](void* p) noexcept { free(p); }
+void operator delete(void* p, size_t) noexcept { free(p); }
+void operator delete[](void* p, size_t) noexcept { free(p); }
+void operator delete(void* p, std::align_val_t) noexcept { free(p); }
+void operator delete[](void* p, std::align_val_t) noexcept { free(p); }
+void operator delete(void* p, size_t, std::align_val_t) noexcept { free(p); }
+void operator delete[](void* p, size_t, std::align_val_t) noexcept { free(p); }
+void operator delete(void* p, const std::nothrow_t&) noexcept { free(p); }
+void operator delete[](void* p, const std::nothrow_t&) noexcept { free(p); }
+
+#else
+
+size_t thread_allocation_count() {
+    return 0;
+}
+
+#endif
@@ -0,0 +1,22 @@
+#ifndef _ALLOCCOUNT_H_
+#define _ALLOCCOUNT_H_
+
+#include <cstddef>
+
+// 测试用的内存分配计数
+// 测试版本（定义了TESTING）替换全局的operator new，按线程统计调用次数，测试可以断言
+// 某段代码不分配内存。标准容器和std::string都经过operator new；直接调用malloc的不计。
+// 非测试版本不替换，计数总是0。
+size_t thread_allocation_count();
+
+// 本线程自构造以来的分配次数
+class AllocationCounter {
+public:
+    AllocationCounter() : start(thread_allocation_count()) {}
+    size_t count() const { return thread_allocation_count() - start; }
+
+private:
+    size_t start;
+};
+
+#endif
@@ -0,0 +1,112 @@
+// 输出洪水下的转发对比
+// 用法: bench_fast_scroll [链路KB/s] [洪水秒数]，默认1024KB/s、2秒
+// 在80x24的伪终端上运行yes，转发到套接字对，对端按给定带宽读取（模拟远程终端）。
+// 洪水持续一段时间后向命令发送SIGINT（相当于按下Ctrl-C），报告：
+//   bytes in  - 从主端读到的字节数
+//   bytes out - 终端收到的字节数
+//   frames    - 合并模式的帧数
+//   ^C->idle  - 从发出SIGINT到终端收完最后一个字节的时间，即用户看到中断生效的延迟
+// raw为原样转发（forward_terminal），fps-N为按N帧每秒合并重绘（forward_terminal_frames）
+#include "fastscroll.h"
+#include "pseudoterm.h"
+#include "pipeline.h"
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <csignal>
+#include <string>
+#include <thread>
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/socket.h>
+
+typedef std::chrono::steady_clock Clock;
+
+struct Result {
+    long long bytes_in;
+    long long bytes_out;
+    unsigned frames;
+    double interrupt_delay;
+};
+
+static bool run(unsigned fps, double link_bytes_per_second, double flood_seconds, Result& result) {
+    int master, slave;
+    if (!open_pseudo_terminal(master, slave, false)) return false;
+    set_terminal_size(master, 24, 80);
+    int fds[2];
+    if (socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, fds) != 0) return false;
+    fcntl(fds[1], F_SETFL, O_NONBLOCK);
+
+    Pipeline command;
+    command.commands.resize(1);
+    command.commands[0].argv = {"yes", "[ 42%] Building CXX object src/CMakeFiles/module.dir/file.cpp.o"};
+    std::vector<pid_t> pids = spawn_pipeline(command, -1, slave, true);
+    close(slave);
+    if (pids.empty()) return false;
+
+    // 终端端：令牌桶限速读取
+    long long received = 0;
+    Clock::time_point last_byte;
+    std::thread reader([&]() {
+        char buffer[4096];
+        Clock::time_point start = Clock::now();
+        while (true) {
+            double allowed = std::chrono::duration<double>(Clock::now() - start).count() * link_bytes_per_second;
+            if (received >= allowed) {
+                usleep(1000);
+                continue;
+            }
+            size_t want = std::min<double>(sizeof(buffer), allowed - received + 1);
+            ssize_t n = read(fds[0], buffer, want);
+            if (n <= 0) break;
+            received += n;
+            last_byte = Clock::now();
+        }
+    });
+
+    FastScrollStats stats = {};
+    std::thread forwarder([&]() {
+        if (fps > 0) {
+            forward_terminal_frames(master, fds[1], -1, fps, &stats);
+        } else {
+            stats.bytes_in = forward_terminal(master, fds[1]);
+        }
+        close(fds[1]);
+    });
+
+    usleep((useconds_t)(flood_seconds * 1e6));
+    Clock::time_point interrupt = Clock::now();
+    kill(-pids[0], SIGINT);
+    wait_pipeline(pids);
+    forwarder.join();
+    reader.join();
+    close(fds[0]);
+    close(master);
+
+    result.bytes_in = stats.bytes_in;
+    result.bytes_out = received;
+    result.frames = stats.frames;
+    result.interrupt_delay = std::chrono::duration<double>(last_byte - interrupt).count();
+    return true;
+}
+
+int main(int argc, char* argv[]) {
+    double link = (argc > 1 ? strtod(argv[1], nullptr) : 1024) * 1024;
+    double seconds = argc > 2 ? strtod(argv[2], nullptr) : 2;
+    printf("link %.0f KB/s, flood %.1f s\n", link / 1024, seconds);
+    printf("%-8s %12s %12s %8s %10s\n", "mode", "bytes in", "bytes out", "frames", "^C->idle");
+    for (unsigned fps : {0u, 30u, 60u}) {
+        Result result;
+        if (!run(fps, link, seconds, result)) {
+            fprintf(stderr, "cannot run\n");
+            return 1;
+        }
+        std::string mode = fps ? "fps-" + std::to_string(fps) : "raw";
+        printf("%-8s %12lld %12lld %8u %9.3fs\n", mode.c_str(), result.bytes_in, result.bytes_out,
+               result.frames, result.interrupt_delay);
+        fflush(stdout);
+    }
+    return 0;
+}
@@ -0,0 +1,152 @@
+// 历史搜索性能测试
+// 用法: bench_history_search [最大条数]，默认1000000
+// 历史条数从10^4按10倍增长到最大条数，每个规模下：
+//   cold    - 索引刚开始建立时逐字输入查询串的每次按键延迟（平均/最大），含每次补入的一批
+//   backfill- 空闲时逐批补入，直到索引全部记录的总时间
+//   build   - 打开历史后在后台线程建立全部索引的时间，及其中调用线程复制记录原文的时间
+//   index   - 索引建完后逐字输入查询串时每次按键的查找延迟（平均/最大）
+//   scan    - 同样的按键用线性扫描查找的延迟，用作对照
+//   repeat  - 连续按Ctrl-R遍历匹配时每次的延迟
+#include "history.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <string>
+#include <vector>
+
+static double now_us() {
+    return std::chrono::duration<double, std::micro>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// 由常见命令、参数和文件名拼出的合成历史
+static std::string make_command(std::mt19937& rng) {
+    static const char* commands[] = {"git", "make", "ls", "cd", "grep", "vim", "cat", "docker",
+                                     "kubectl", "ssh", "python3", "cargo", "npm", "find", "tar"};
+    static const char* args[] = {"status", "commit -m", "-la", "-rn", "build", "run", "push",
+                                 "--verbose", "-j8", "logs -f", "apply -f", "install", "test",
+                                 "-name", "-xzf", "checkout", "rebase -i", "exec -it"};
+    static const char* files[] = {"src/main.cpp", "README.md", "deploy.yaml", "/var/log/syslog",
+                                  "shell.cpp", "tests/", "build/", "origin master", "Cargo.toml",
+                                  "package.json", "config/settings.py", "~/.bashrc"};
+    std::string cmd = commands[rng() % (sizeof(commands) / sizeof(commands[0]))];
+    cmd += ' ';
+    cmd += args[rng() % (sizeof(args) / sizeof(args[0]))];
+    cmd += ' ';
+    cmd += files[rng() % (sizeof(files) / sizeof(files[0]))];
+    if (rng() % 4 == 0) {
+        cmd += " #" + std::to_string(rng() % 100000);
+    }
+    return cmd;
+}
+
+static size_t scan_backward(const HistoryStore& store, const std::string& query, size_t limit) {
+    for (size_t pos = store.prev(limit); pos != HistoryStore::npos; pos = store.prev(pos)) {
+        size_t length;
+        const char* text = store.text(pos, length);
+        if (std::search(text, text + length, query.begin(), query.end()) != text + length) {
+            return pos;
+        }
+    }
+    return HistoryStore::npos;
+}
+
+struct Latency {
+    double total = 0;
+    double max = 0;
+    long count = 0;
+
+    void add(double us) {
+        total += us;
+        max = std::max(max, us);
+        count++;
+    }
+};
+
+int main(int argc, char* argv[]) {
+    size_t max_entries = argc > 1 ? strtoull(argv[1], nullptr, 10) : 1000000;
+
+    // 逐字输入的查询，包括常见、罕见和不存在的串
+    const char* queries[] = {"git commit", "deploy.yaml", "#4242", "kubectl logs", "zzz-nothing",
+                             "rebase -i origin"};
+
+    printf("%10s %22s %12s %18s %22s %22s %14s\n", "entries", "cold avg/max(us)", "backfill(ms)",
+           "build copy/all(ms)", "index avg/max(us)", "scan avg/max(us)", "repeat avg(us)");
+    for (size_t entries = 10000; entries <= max_entries; entries *= 10) {
+        HistoryOptions options;
+        options.max_entries = 0;
+        options.dedup = HistoryOptions::KEEP_ALL;
+        HistoryStore store(options);
+        std::mt19937 rng(42);
+        for (size_t i = 0; i < entries; i++) {
+            store.append(make_command(rng));
+        }
+
+        // 索引未建完时找不到的查询返回npos，找到的一定是最近的匹配
+        HistoryIndex index;
+        index.sync(store);
+        Latency cold;
+        double start;
+        for (const char* query : queries) {
+            std::string typed;
+            for (const char* p = query; *p; p++) {
+                typed += *p;
+                start = now_us();
+                size_t a = index.search_backward(store, typed, store.end());
+                cold.add(now_us() - start);
+                if (a != HistoryStore::npos && a != scan_backward(store, typed, store.end())) {
+                    fprintf(stderr, "mismatch for '%s'\n", typed.c_str());
+                    return 1;
+                }
+            }
+        }
+
+        start = now_us();
+        while (!index.complete(store)) {
+            index.extend(store);
+        }
+        double backfill = now_us() - start;
+
+        HistoryIndex background;
+        start = now_us();
+        background.build(store);
+        double copy = now_us() - start;
+        background.wait_build();
+        double build = now_us() - start;
+
+        Latency indexed, scanned, repeat;
+        for (const char* query : queries) {
+            std::string typed;
+            for (const char* p = query; *p; p++) {
+                typed += *p;
+                start = now_us();
+                size_t a = index.search_backward(store, typed, store.end());
+                indexed.add(now_us() - start);
+
+                start = now_us();
+                size_t b = scan_backward(store, typed, store.end());
+                scanned.add(now_us() - start);
+                if (a != b) {
+                    fprintf(stderr, "mismatch for '%s'\n", typed.c_str());
+                    return 1;
+                }
+            }
+            // 连续Ctrl-R最多100次
+            size_t pos = store.end();
+            for (int i = 0; i < 100; i++) {
+                start = now_us();
+                pos = index.search_backward(store, query, pos);
+                repeat.add(now_us() - start);
+                if (pos == HistoryStore::npos) break;
+            }
+        }
+
+        printf("%10zu %11.2f/%-10.1f %12.1f %8.1f/%-9.1f %11.2f/%-10.1f %11.2f/%-10.1f %14.2f\n", entries,
+               cold.total / cold.count, cold.max, backfill / 1000, copy / 1000, build / 1000,
+               indexed.total / indexed.count,
+               indexed.max, scanned.total / scanned.count, scanned.max, repeat.total / repeat.count);
+    }
+    return 0;
+}
@@ -0,0 +1,57 @@
+// 粘贴大段输入的处理速度
+// 用法: bench_paste [KB数]，默认1024
+// 会话模式的Shell（输出写入/dev/null）收到一段不含换行的可打印文本：
+//   typed  - 每次送入一个字节，相当于逐键输入，每个字节走一遍状态机、查找提示并写出
+//   paste  - 按1KB分块送入（与终端一次读到的量相近），可打印的连续字节整段插入和回显
+// 各运行五次取最快的一次，报告吞吐量和写出次数
+#include "shell.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <fcntl.h>
+#include <unistd.h>
+
+typedef std::chrono::steady_clock Clock;
+
+static double run(const std::string& text, size_t chunk, int out_fd) {
+    Shell shell(nullptr, out_fd);
+    // 几条历史，输入时有提示可查
+    const char history[] = "jobs\rhash -r\rhistory\r";
+    shell.feed_input(history, sizeof(history) - 1);
+    Clock::time_point start = Clock::now();
+    for (size_t i = 0; i < text.size(); i += chunk) {
+        shell.feed_input(text.data() + i, std::min(chunk, text.size() - i));
+    }
+    return std::chrono::duration<double>(Clock::now() - start).count();
+}
+
+int main(int argc, char* argv[]) {
+    size_t kilobytes = argc > 1 ? strtoull(argv[1], nullptr, 10) : 1024;
+    // 像粘贴的脚本片段：单词、参数和标点
+    std::string text;
+    for (int i = 0; text.size() < kilobytes * 1024; i++) {
+        text += "grep -rn --include=*.cpp 'session_" + std::to_string(i) + "' src/ | sort -u; ";
+    }
+    text.resize(kilobytes * 1024);
+
+    int out_fd = open("/dev/null", O_WRONLY | O_CLOEXEC);
+    if (out_fd < 0) return 1;
+    const char* MODES[] = {"typed", "paste"};
+    const size_t CHUNKS[] = {1, 1024};
+    double best[2] = {0, 0};
+    for (int round = 0; round < 5; round++) {
+        for (int mode = 0; mode < 2; mode++) {
+            double seconds = run(text, CHUNKS[mode], out_fd);
+            if (best[mode] == 0 || seconds < best[mode]) best[mode] = seconds;
+        }
+    }
+    printf("%-8s %10s %10s %10s\n", "mode", "KB", "MB/s", "speedup");
+    for (int mode = 0; mode < 2; mode++) {
+        printf("%-8s %10zu %10.1f %9.1fx\n", MODES[mode], kilobytes, text.size() / 1048576.0 / best[mode],
+               best[0] / best[mode]);
+    }
+    close(out_fd);
+    return 0;
+}
@@ -0,0 +1,92 @@
+// 管道执行性能测试
+// 用法: bench_pipeline [字节数]，默认1GiB
+// 对2~5级管道分别测试：
+//   sh      - system()交给/bin/sh执行
+//   native  - spawn_pipeline直接执行
+//   splice  - shell位于数据通路上，用tee/splice把输出同时送往终端和旁路
+//   copy    - shell位于数据通路上，用read/write在用户空间复制
+#include "pipeline.h"
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <fcntl.h>
+#include <unistd.h>
+
+static double now_seconds() {
+    return std::chrono::duration<double>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// 构造 head -c N /dev/zero | cat | ... 共stages级
+static Pipeline make_pipeline(int stages, long long bytes) {
+    Pipeline p;
+    p.commands.push_back({{"head", "-c", std::to_string(bytes), "/dev/zero"}, ""});
+    for (int i = 1; i < stages; i++) {
+        p.commands.push_back({{"cat"}, ""});
+    }
+    return p;
+}
+
+static std::string make_command(int stages, long long bytes) {
+    std::string cmd = "head -c " + std::to_string(bytes) + " /dev/zero";
+    for (int i = 1; i < stages; i++) {
+        cmd += " | cat";
+    }
+    return cmd + " > /dev/null";
+}
+
+// 旁路输出时shell的用户空间复制实现，用作对照
+static long long copy_tee(int in_fd, int out_fd, int tap_fd) {
+    static char buffer[64 * 1024];
+    long long total = 0;
+    ssize_t n;
+    while ((n = read(in_fd, buffer, sizeof(buffer))) > 0) {
+        if (write(out_fd, buffer, n) != n || write(tap_fd, buffer, n) != n) return -1;
+        total += n;
+    }
+    return total;
+}
+
+static void report(int stages, const char* mode, long long bytes, double seconds) {
+    printf("%6d  %-8s %10.3f %12.1f\n", stages, mode, seconds, bytes / seconds / (1024.0 * 1024.0));
+    fflush(stdout);
+}
+
+int main(int argc, char** argv) {
+    long long bytes = (argc > 1) ? atoll(argv[1]) : (1LL << 30);
+    int null_fd = open("/dev/null", O_WRONLY | O_CLOEXEC);
+    int tap_fd = open("/dev/null", O_WRONLY | O_CLOEXEC);
+
+    printf("bytes per run: %lld\n", bytes);
+    printf("%6s  %-8s %10s %12s\n", "stages", "mode", "seconds", "MiB/s");
+
+    for (int stages = 2; stages <= 5; stages++) {
+        double start = now_seconds();
+        if (system(make_command(stages, bytes).c_str()) != 0) return 1;
+        report(stages, "sh", bytes, now_seconds() - start);
+
+        Pipeline pipeline = make_pipeline(stages, bytes);
+        start = now_seconds();
+        wait_pipeline(spawn_pipeline(pipeline, -1, null_fd));
+        report(stages, "native", bytes, now_seconds() - start);
+
+        for (int use_splice = 1; use_splice >= 0; use_splice--) {
+            int out[2];
+            if (pipe2(out, O_CLOEXEC) != 0) return 1;
+            start = now_seconds();
+            std::vector<pid_t> pids = spawn_pipeline(pipeline, -1, out[1]);
+            close(out[1]);
+            long long moved = use_splice ? tee_splice_all(out[0], null_fd, tap_fd)
+                                         : copy_tee(out[0], null_fd, tap_fd);
+            wait_pipeline(pids);
+            close(out[0]);
+            if (moved != bytes) {
+                fprintf(stderr, "short transfer: %lld\n", moved);
+                return 1;
+            }
+            report(stages, use_splice ? "splice" : "copy", bytes, now_seconds() - start);
+        }
+    }
+    return 0;
+}
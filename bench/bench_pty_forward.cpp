@@ -0,0 +1,141 @@
+// 命令输出转发吞吐量测试
+// 用法: bench_pty_forward [MB数]，默认256
+// 运行大量输出的命令（cat大文件、yes | head -c），把输出转发到目标：
+//   pipe       - 命令写管道，splice_all转发（非伪终端模式的会话）
+//   pty-splice - 命令写伪终端从端，forward_terminal经中间管道splice转发
+//   pty-copy   - 命令写伪终端从端，16KB缓冲区read/write转发（逐块经过用户空间）
+// 目标为/dev/null或由另一线程读取的管道（模拟终端连接），报告吞吐量和转发线程的CPU时间
+#include "pseudoterm.h"
+#include "pipeline.h"
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cerrno>
+#include <string>
+#include <thread>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/resource.h>
+
+typedef std::chrono::steady_clock Clock;
+
+static double thread_cpu_seconds() {
+    struct rusage usage;
+    getrusage(RUSAGE_THREAD, &usage);
+    return usage.ru_utime.tv_sec + usage.ru_stime.tv_sec +
+           (usage.ru_utime.tv_usec + usage.ru_stime.tv_usec) / 1e6;
+}
+
+static long long copy_forward(int in_fd, int out_fd) {
+    char buffer[16384];
+    long long total = 0;
+    while (true) {
+        ssize_t n = read(in_fd, buffer, sizeof(buffer));
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) break;
+        total += n;
+        for (ssize_t done = 0; done < n;) {
+            ssize_t w = write(out_fd, buffer + done, n - done);
+            if (w <= 0) return total;
+            done += w;
+        }
+    }
+    return total;
+}
+
+// 运行一次，返回转发的字节数，seconds和cpu为耗时和转发线程的CPU时间
+static long long run(const Pipeline& command, const char* mode, int out_fd, double& seconds, double& cpu) {
+    int read_fd, write_fd;
+    bool pty = strcmp(mode, "pipe") != 0;
+    if (pty) {
+        // 与shell一样使用规范模式的从端，\n转为\r\n，转发的字节数比管道多
+        if (!open_pseudo_terminal(read_fd, write_fd, false)) return -1;
+    } else {
+        int fds[2];
+        if (pipe2(fds, O_CLOEXEC) != 0) return -1;
+        fcntl(fds[1], F_SETPIPE_SZ, 1 << 20);
+        read_fd = fds[0];
+        write_fd = fds[1];
+    }
+
+    Clock::time_point start = Clock::now();
+    std::vector<pid_t> pids = spawn_pipeline(command, -1, write_fd);
+    close(write_fd);
+    double cpu_start = thread_cpu_seconds();
+    long long total;
+    if (strcmp(mode, "pty-splice") == 0) {
+        total = forward_terminal(read_fd, out_fd);
+    } else if (strcmp(mode, "pty-copy") == 0) {
+        fcntl(read_fd, F_SETFL, fcntl(read_fd, F_GETFL) & ~O_NONBLOCK);
+        total = copy_forward(read_fd, out_fd);
+    } else {
+        total = splice_all(read_fd, out_fd);
+    }
+    cpu = thread_cpu_seconds() - cpu_start;
+    wait_pipeline(pids);
+    seconds = std::chrono::duration<double>(Clock::now() - start).count();
+    close(read_fd);
+    return total;
+}
+
+int main(int argc, char* argv[]) {
+    size_t megabytes = argc > 1 ? strtoull(argv[1], nullptr, 10) : 256;
+    std::string size = std::to_string(megabytes << 20);
+
+    // 80列的文本行
+    std::string path = "/tmp/bench_pty_forward_" + std::to_string(getpid()) + ".txt";
+    {
+        std::string line(79, 'x');
+        line += '\n';
+        std::string block;
+        while (block.size() < (1 << 20)) block += line;
+        FILE* f = fopen(path.c_str(), "w");
+        if (!f) return 1;
+        for (size_t i = 0; i < megabytes; i++) fwrite(block.data(), 1, 1 << 20, f);
+        fclose(f);
+    }
+
+    Pipeline cat_file;
+    cat_file.commands.resize(1);
+    cat_file.commands[0].argv = {"cat", path};
+    Pipeline yes_head;
+    yes_head.commands.resize(2);
+    yes_head.commands[0].argv = {"yes"};
+    yes_head.commands[1].argv = {"head", "-c", size};
+
+    printf("%-14s %-10s %-12s %10s %10s %10s\n", "command", "target", "mode", "MB", "MB/s", "fwd cpu%");
+    for (auto* command : {&cat_file, &yes_head}) {
+        const char* name = command == &cat_file ? "cat file" : "yes | head";
+        for (const char* target : {"/dev/null", "pipe"}) {
+            for (const char* mode : {"pipe", "pty-splice", "pty-copy"}) {
+                // 管道目标由另一线程以64KB读取，模拟终端连接的对端
+                int out_fd;
+                int sink[2] = {-1, -1};
+                std::thread reader;
+                if (strcmp(target, "pipe") == 0) {
+                    if (pipe2(sink, O_CLOEXEC) != 0) return 1;
+                    fcntl(sink[1], F_SETPIPE_SZ, 1 << 20);
+                    out_fd = sink[1];
+                    reader = std::thread([fd = sink[0]]() {
+                        static char buffer[65536];
+                        while (read(fd, buffer, sizeof(buffer)) > 0) {
+                        }
+                    });
+                } else {
+                    out_fd = open("/dev/null", O_WRONLY | O_CLOEXEC);
+                }
+                double seconds = 0, cpu = 0;
+                long long total = run(*command, mode, out_fd, seconds, cpu);
+                close(out_fd);
+                if (reader.joinable()) reader.join();
+                if (sink[0] >= 0) close(sink[0]);
+                printf("%-14s %-10s %-12s %10.1f %10.1f %10.1f\n", name, target, mode,
+                       total / 1048576.0, total / 1048576.0 / seconds, 100.0 * cpu / seconds);
+                fflush(stdout);
+            }
+        }
+    }
+    unlink(path.c_str());
+    return 0;
+}
@@ -0,0 +1,144 @@
+// 会话录制的开销和定位速度
+// 用法: bench_recording [MB数]，默认64
+// 命令（cat带颜色的日志）写伪终端从端，forward_terminal转发到由另一线程读空的管道：
+//   none     - 不录制
+//   recorded - 旁路接到SessionRecorder，录制线程写文件并维护屏幕模型
+// 报告命令输出转发完的吞吐量、录制相对不录制的开销（交替各运行十次，取最快的一次），
+// 以及之后建模线程追上、写出索引所用的时间。墙钟时间受机器上其他负载影响较大，
+// 同时报告转发期间本进程和cat用掉的CPU时间（也取最少的一次），作为更稳定的开销。
+// 之后在这份录制上随机定位，与从头重放到结尾的时间比较
+#include "recording.h"
+#include "pseudoterm.h"
+#include "pipeline.h"
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <thread>
+#include <random>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/resource.h>
+
+typedef std::chrono::steady_clock Clock;
+
+// 本进程和已回收的子进程用掉的CPU时间
+static double cpu_seconds() {
+    double seconds = 0;
+    for (int who : {RUSAGE_SELF, RUSAGE_CHILDREN}) {
+        struct rusage usage;
+        getrusage(who, &usage);
+        seconds += usage.ru_utime.tv_sec + usage.ru_stime.tv_sec +
+                   (usage.ru_utime.tv_usec + usage.ru_stime.tv_usec) / 1e6;
+    }
+    return seconds;
+}
+
+// 运行一次cat，返回输出转发完的耗时，cpu为其间用掉的CPU时间，catch_up为之后关闭录制的耗时
+static double run(const Pipeline& command, SessionRecorder* recorder, long long& total, double& cpu,
+                  double& catch_up) {
+    int master, slave;
+    if (!open_pseudo_terminal(master, slave, false)) return -1;
+    int sink[2];
+    if (pipe2(sink, O_CLOEXEC) != 0) return -1;
+    fcntl(sink[1], F_SETPIPE_SZ, 1 << 20);
+    std::thread reader([fd = sink[0]]() {
+        static char buffer[65536];
+        while (read(fd, buffer, sizeof(buffer)) > 0) {
+        }
+    });
+
+    Clock::time_point start = Clock::now();
+    double cpu_start = cpu_seconds();
+    std::vector<pid_t> pids = spawn_pipeline(command, -1, slave);
+    close(slave);
+    total = forward_terminal(master, sink[1], recorder ? recorder->tap_fd() : -1);
+    wait_pipeline(pids);
+    Clock::time_point done = Clock::now();
+    cpu = cpu_seconds() - cpu_start;
+    double seconds = std::chrono::duration<double>(done - start).count();
+    if (recorder) recorder->close();
+    catch_up = std::chrono::duration<double>(Clock::now() - done).count();
+    close(sink[1]);
+    reader.join();
+    close(sink[0]);
+    close(master);
+    return seconds;
+}
+
+int main(int argc, char* argv[]) {
+    size_t megabytes = argc > 1 ? strtoull(argv[1], nullptr, 10) : 64;
+    std::string path = "/tmp/bench_recording_" + std::to_string(getpid());
+    {
+        // 带颜色的日志行，像编译或测试的输出
+        std::string block;
+        for (int i = 0; block.size() < (1 << 20); i++) {
+            block += "\033[32m[" + std::to_string(100000 + i) + "]\033[0m \033[1mINFO\033[0m worker-" +
+                     std::to_string(i % 16) + ": processed request " + std::to_string(i * 7919) +
+                     " in 12ms\n";
+        }
+        FILE* f = fopen((path + ".txt").c_str(), "w");
+        if (!f) return 1;
+        for (size_t i = 0; i < megabytes; i++) fwrite(block.data(), 1, block.size(), f);
+        fclose(f);
+    }
+    Pipeline cat_file;
+    cat_file.commands.resize(1);
+    cat_file.commands[0].argv = {"cat", path + ".txt"};
+
+    // 两种方式交替运行，机器负载的波动对两者的影响相近
+    const char* MODES[] = {"none", "recorded"};
+    double best[2] = {0, 0};
+    double best_cpu[2] = {0, 0};
+    double best_catch_up[2] = {0, 0};
+    long long total = 0;
+    for (int round = 0; round < 10; round++) {
+        for (int mode = 0; mode < 2; mode++) {
+            SessionRecorder recorder(24, 80);
+            if (mode == 1 && !recorder.open(path + ".rec")) return 1;
+            double cpu = 0, catch_up = 0;
+            double seconds = run(cat_file, mode == 1 ? &recorder : nullptr, total, cpu, catch_up);
+            if (seconds <= 0) return 1;
+            if (best[mode] == 0 || seconds < best[mode]) {
+                best[mode] = seconds;
+                best_catch_up[mode] = catch_up;
+            }
+            if (best_cpu[mode] == 0 || cpu < best_cpu[mode]) best_cpu[mode] = cpu;
+        }
+    }
+    printf("%-10s %10s %10s %10s %10s %10s %10s\n", "mode", "MB", "MB/s", "overhead", "cpu",
+           "cpu over", "catch-up");
+    for (int mode = 0; mode < 2; mode++) {
+        printf("%-10s %10.1f %10.1f %9.1f%% %9.3fs %9.1f%% %9.3fs\n", MODES[mode], total / 1048576.0,
+               total / 1048576.0 / best[mode], 100.0 * (best[mode] - best[0]) / best[0], best_cpu[mode],
+               100.0 * (best_cpu[mode] - best_cpu[0]) / best_cpu[0], best_catch_up[mode]);
+    }
+
+    SessionPlayer player;
+    if (!player.open(path + ".rec")) return 1;
+    struct stat st;
+    stat((path + ".rec").c_str(), &st);
+    printf("\nrecording: %.1f MB, %zu keyframes, %.3fs\n", st.st_size / 1048576.0, player.keyframe_count(),
+           player.duration_us() / 1e6);
+
+    // 从头重放到结尾，相当于没有索引时定位到最后
+    Clock::time_point start = Clock::now();
+    Screen screen(player.rows(), player.cols());
+    SessionPlayer::Event event;
+    while (player.next(event)) {
+        if (event.type == 'o') screen.feed(event.data);
+    }
+    double full = std::chrono::duration<double>(Clock::now() - start).count();
+
+    std::mt19937_64 random(1);
+    const int SEEKS = 100;
+    start = Clock::now();
+    for (int i = 0; i < SEEKS; i++) player.seek(random() % (player.duration_us() + 1), screen);
+    double seek = std::chrono::duration<double>(Clock::now() - start).count() / SEEKS;
+    printf("full replay %.1f ms, seek %.3f ms (average of %d)\n", full * 1e3, seek * 1e3, SEEKS);
+
+    unlink((path + ".txt").c_str());
+    unlink((path + ".rec").c_str());
+    return 0;
+}
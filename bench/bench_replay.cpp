@@ -0,0 +1,90 @@
+// 无终端回放的输入处理吞吐量
+// 用法: bench_replay [录制文件...]，没有参数时回放几种合成的会话
+// 全部以最快速度回放，报告：
+//   keys    - 事件数（按键或一次粘贴）
+//   keys/s  - 每秒处理的事件数
+//   B/key   - 每个事件的输出字节数
+// 合成会话只运行hash -r这样的内建命令，测量的是行编辑而不是命令的启动
+#include "replay.h"
+#include <cstdio>
+#include <string>
+#include <vector>
+
+static const char* LINE = "git commit -m 'fix the parser for long lines'";
+static const int ROUNDS = 200;
+
+// 输入一行后用退格清掉
+static InputRecording typing() {
+    InputRecording recording;
+    std::string line = LINE;
+    for (int round = 0; round < ROUNDS; round++) {
+        for (char c : line) recording.append(0, &c, 1);
+        for (size_t i = 0; i < line.size(); i++) recording.append(0, "\b");
+    }
+    return recording;
+}
+
+// 在行中左右移动、插入和删除
+static InputRecording editing() {
+    InputRecording recording;
+    recording.append(0, LINE);
+    for (int round = 0; round < ROUNDS; round++) {
+        for (int i = 0; i < 20; i++) recording.append(0, "\033[D");
+        for (char c : std::string("quickly ")) recording.append(0, &c, 1);
+        for (int i = 0; i < 8; i++) recording.append(0, "\b");
+        for (int i = 0; i < 20; i++) recording.append(0, "\033[C");
+    }
+    return recording;
+}
+
+// 在历史中上下翻
+static InputRecording history() {
+    InputRecording recording;
+    for (int i = 0; i < 20; i++) recording.append(0, "hash" + std::string(i + 1, ' ') + "-r\r");
+    for (int round = 0; round < ROUNDS; round++) {
+        for (int i = 0; i < 10; i++) recording.append(0, "\033[A");
+        for (int i = 0; i < 10; i++) recording.append(0, "\033[B");
+    }
+    return recording;
+}
+
+// 整段粘贴后清掉
+static InputRecording paste() {
+    InputRecording recording;
+    std::string text;
+    while (text.size() < 900) text += "for f in *.cpp; do grep -n 'TODO' \"$f\"; done | sort | uniq -c ";
+    for (int round = 0; round < ROUNDS / 10; round++) {
+        recording.append(0, text);
+        for (size_t i = 0; i < text.size(); i++) recording.append(0, "\b");
+    }
+    return recording;
+}
+
+static void report(const char* name, const InputRecording& recording) {
+    ReplayOptions options;
+    options.speed = 0;
+    ReplayReport result = replay_input(recording, options);
+    printf("%-24s %8zu %12.0f %8.1f %9.3fs\n", name, result.keystrokes, result.keystrokes_per_second(),
+           result.output_bytes_per_keystroke(), result.seconds);
+    fflush(stdout);
+}
+
+int main(int argc, char* argv[]) {
+    printf("%-24s %8s %12s %8s %10s\n", "session", "keys", "keys/s", "B/key", "time");
+    if (argc > 1) {
+        for (int i = 1; i < argc; i++) {
+            InputRecording recording;
+            if (!recording.load(argv[i])) {
+                fprintf(stderr, "cannot read recording %s\n", argv[i]);
+                return 1;
+            }
+            report(argv[i], recording);
+        }
+        return 0;
+    }
+    report("typing", typing());
+    report("editing", editing());
+    report("history", history());
+    report("paste", paste());
+    return 0;
+}
@@ -0,0 +1,146 @@
+// 屏幕状态机吞吐量测试
+// 用法: bench_screen [每份语料MB数]，默认32
+// 程序生成几类典型的终端输出作为语料，按64KB分块送入80x24的Screen，取3次中最快的一次：
+//   plain     - 80列纯文本行（cat文本文件）
+//   ls-color  - 每个文件名带SGR颜色（ls --color）
+//   build-log - 长行自动换行，夹杂粗体和颜色（编译输出）
+//   redraw    - 全屏程序的重绘：定位、擦除、逐段变色、滚动区域（top/htop）
+//   box       - DEC画线字符集绘制的边框（dialog/mc）
+//   utf8      - 中文和带重音的拉丁字母
+#include "screen.h"
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+typedef std::chrono::steady_clock Clock;
+
+static std::string plain_corpus(size_t size) {
+    std::string out;
+    unsigned n = 0;
+    while (out.size() < size) {
+        std::string line = "line " + std::to_string(n++) + ": ";
+        while (line.size() < 79) line += (char)('a' + (line.size() * 7 + n) % 26);
+        out += line + "\r\n";
+    }
+    return out;
+}
+
+static std::string ls_corpus(size_t size) {
+    static const char* colors[] = {"01;34", "01;32", "01;36", "00", "01;31", "40;33;01"};
+    std::string out;
+    unsigned n = 0;
+    while (out.size() < size) {
+        for (int column = 0; column < 4; column++, n++) {
+            out += "\033[";
+            out += colors[n % 6];
+            out += "m";
+            out += "file_" + std::to_string(n) + ".txt";
+            out += "\033[0m    ";
+        }
+        out += "\r\n";
+    }
+    return out;
+}
+
+static std::string build_corpus(size_t size) {
+    std::string out;
+    unsigned n = 0;
+    while (out.size() < size) {
+        out += "g++ -O2 -Wall -Wextra -std=c++17 -I../include -I../src -DNDEBUG -c ../src/module_" +
+               std::to_string(n) + ".cpp -o CMakeFiles/project.dir/src/module_" + std::to_string(n) + ".cpp.o\r\n";
+        if (n % 5 == 0) {
+            out += "\033[1m../src/module_" + std::to_string(n) + ".cpp:42:13:\033[m \033[1;35mwarning:\033[m "
+                   "unused variable '\033[1mresult\033[m' [\033[1;35m-Wunused-variable\033[m]\r\n";
+        }
+        out += "[ " + std::to_string(n % 100) + "%] \033[32mBuilding CXX object\033[0m\r\n";
+        n++;
+    }
+    return out;
+}
+
+static std::string redraw_corpus(size_t size) {
+    std::string out;
+    unsigned n = 0;
+    while (out.size() < size) {
+        // 标题栏、滚动区域内的进程列表、底部状态栏
+        out += "\033[H\033[7m top - " + std::to_string(n) + " up 10 days, load average: 0.52, 0.58, 0.59 \033[K\033[m";
+        out += "\033[3;22r";
+        for (unsigned row = 3; row <= 22; row++) {
+            out += "\033[" + std::to_string(row) + ";1H";
+            out += "\033[1m" + std::to_string(1000 + row * 7 + n % 13) + "\033[m root      20   0 ";
+            out += "\033[32m" + std::to_string((row * 31 + n) % 9999) + "\033[m  ";
+            out += "\033[33m" + std::to_string((row + n) % 100) + ".0\033[m  S  process_" + std::to_string(row);
+            out += "\033[K";
+        }
+        out += "\033[r\033[24;1H\033[44;37m F1Help F2Setup F3Search F9Kill F10Quit\033[K\033[m";
+        n++;
+    }
+    return out;
+}
+
+static std::string box_corpus(size_t size) {
+    std::string out;
+    unsigned n = 0;
+    while (out.size() < size) {
+        out += "\033[H\033(0lqqqqqqqqqqqqqqqqqqqqqqqqqqqqqqqqqqqqqqqqqqqqqqqqqqqqqqqqqqqqqqqqqqqqqqqqqqk\033(B";
+        for (unsigned row = 2; row < 24; row++) {
+            out += "\033[" + std::to_string(row) + ";1H\033(0x\033(B item " + std::to_string(row + n) +
+                   "\033[" + std::to_string(row) + ";80H\033(0x\033(B";
+        }
+        out += "\033[24;1H\033(0mqqqqqqqqqqqqqqqqqqqqqqqqqqqqqqqqqqqqqqqqqqqqqqqqqqqqqqqqqqqqqqqqqqqqqqqqqqqqqj\033(B";
+        n++;
+    }
+    return out;
+}
+
+static std::string utf8_corpus(size_t size) {
+    std::string out;
+    while (out.size() < size) {
+        out += "终端模拟器把输出字节流解释为屏幕内容 café naïve résumé 日本語のテキスト\r\n";
+    }
+    return out;
+}
+
+int main(int argc, char* argv[]) {
+    size_t megabytes = argc > 1 ? strtoull(argv[1], nullptr, 10) : 32;
+    size_t size = megabytes << 20;
+    struct Corpus {
+        const char* name;
+        std::string data;
+    };
+    std::vector<Corpus> corpora = {
+        {"plain", plain_corpus(size)},
+        {"ls-color", ls_corpus(size)},
+        {"build-log", build_corpus(size)},
+        {"redraw", redraw_corpus(size)},
+        {"box", box_corpus(size)},
+        {"utf8", utf8_corpus(size)},
+    };
+
+    const size_t CHUNK = 65536;
+    printf("%-10s %10s %10s %12s\n", "corpus", "MB", "MB/s", "ESC/KB");
+    for (const auto& corpus : corpora) {
+        size_t escapes = 0;
+        for (char c : corpus.data) escapes += c == '\033';
+        double best = 1e9;
+        unsigned checksum = 0;
+        for (int round = 0; round < 3; round++) {
+            Screen screen(24, 80);
+            Clock::time_point start = Clock::now();
+            for (size_t offset = 0; offset < corpus.data.size(); offset += CHUNK) {
+                size_t n = std::min(CHUNK, corpus.data.size() - offset);
+                screen.feed(corpus.data.data() + offset, n);
+            }
+            double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+            best = std::min(best, seconds);
+            checksum += screen.cell(0, 0).ch + screen.cursor_row();  // 防止被优化掉
+        }
+        double mb = corpus.data.size() / 1048576.0;
+        printf("%-10s %10.1f %10.1f %12.1f\n", corpus.name, mb, mb / best,
+               escapes * 1024.0 / corpus.data.size());
+        if (checksum == 0xFFFFFFFF) printf("\n");
+    }
+    return 0;
+}
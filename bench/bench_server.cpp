@@ -0,0 +1,205 @@
+// 多会话服务的按键回显延迟测试（负载生成器）
+// 用法: bench_server [最大会话数] [工作线程数] [每会话按键间隔ms]，默认4000、CPU数、20
+// 会话数从1按10倍增长到最大会话数，每个规模下所有会话以固定间隔交替发送可打印字符和
+// 退格，记录从发出按键到收到回显的时间（每个会话同时只有一个未回显的按键）：
+//   keys/s   - 全部会话每秒的按键数
+//   p50/p99/max - 回显延迟（微秒）
+//   KB/会话  - 建立会话前后进程常驻内存之差除以会话数
+#include "server.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <queue>
+#include <string>
+#include <thread>
+#include <vector>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+typedef std::chrono::steady_clock Clock;
+
+struct Client {
+    int fd;
+    bool waiting;               // 有未回显的按键
+    unsigned typed;             // 当前行长度，交替输入和退格
+    Clock::time_point sent;
+};
+
+static long rss_kb() {
+    FILE* f = fopen("/proc/self/status", "r");
+    if (!f) return 0;
+    char line[256];
+    long kb = 0;
+    while (fgets(line, sizeof(line), f)) {
+        if (strncmp(line, "VmRSS:", 6) == 0) kb = atol(line + 6);
+    }
+    fclose(f);
+    return kb;
+}
+
+static int connect_to(const std::string& path) {
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    struct sockaddr_un addr = {};
+    addr.sun_family = AF_UNIX;
+    path.copy(addr.sun_path, path.length());
+    if (fd < 0 || connect(fd, (struct sockaddr*)&addr, sizeof(addr)) != 0) {
+        if (fd >= 0) close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+// 读到提示符为止
+static bool wait_prompt(int fd) {
+    std::string received;
+    while (received.find("$ ") == std::string::npos) {
+        struct pollfd pfd = {fd, POLLIN, 0};
+        if (poll(&pfd, 1, 5000) <= 0) return false;
+        char buffer[256];
+        ssize_t n = read(fd, buffer, sizeof(buffer));
+        if (n <= 0) return false;
+        received.append(buffer, n);
+    }
+    return true;
+}
+
+// 一个驱动线程负责一部分会话：按时间表发送按键，用epoll等待回显
+static void drive(std::vector<Client>& clients, std::chrono::milliseconds interval,
+                  Clock::time_point stop, std::vector<double>& latencies) {
+    int ep = epoll_create1(EPOLL_CLOEXEC);
+    for (size_t i = 0; i < clients.size(); i++) {
+        struct epoll_event ev = {};
+        ev.events = EPOLLIN;
+        ev.data.u64 = i;
+        epoll_ctl(ep, EPOLL_CTL_ADD, clients[i].fd, &ev);
+    }
+
+    // 各会话的首次按键在一个间隔内均匀错开
+    typedef std::pair<Clock::time_point, size_t> Due;
+    std::priority_queue<Due, std::vector<Due>, std::greater<Due>> schedule;
+    Clock::time_point start = Clock::now();
+    for (size_t i = 0; i < clients.size(); i++) {
+        schedule.push({start + interval * i / clients.size(), i});
+    }
+
+    struct epoll_event events[256];
+    char buffer[4096];
+    while (true) {
+        Clock::time_point now = Clock::now();
+        if (now >= stop) break;
+        while (!schedule.empty() && schedule.top().first <= now) {
+            size_t i = schedule.top().second;
+            schedule.pop();
+            Client& client = clients[i];
+            if (client.waiting) {
+                // 上一个按键还没有回显，推迟到下一个间隔
+                schedule.push({now + interval, i});
+                continue;
+            }
+            char key = client.typed < 16 ? 'a' + client.typed : '\b';
+            client.typed = client.typed < 16 ? client.typed + 1 : (client.typed == 31 ? 0 : client.typed + 1);
+            client.sent = Clock::now();
+            client.waiting = true;
+            if (write(client.fd, &key, 1) != 1) return;
+            schedule.push({client.sent + interval, i});
+        }
+
+        int timeout = 1;
+        if (!schedule.empty()) {
+            auto wait = std::chrono::duration_cast<std::chrono::milliseconds>(schedule.top().first - Clock::now());
+            timeout = std::max<long>(0, std::min<long>(wait.count(), 10));
+        }
+        int n = epoll_wait(ep, events, 256, timeout);
+        Clock::time_point received = Clock::now();
+        for (int e = 0; e < n; e++) {
+            Client& client = clients[events[e].data.u64];
+            while (read(client.fd, buffer, sizeof(buffer)) == (ssize_t)sizeof(buffer)) {
+            }
+            if (client.waiting) {
+                client.waiting = false;
+                latencies.push_back(std::chrono::duration<double, std::micro>(received - client.sent).count());
+            }
+        }
+    }
+    close(ep);
+}
+
+int main(int argc, char* argv[]) {
+    size_t max_sessions = argc > 1 ? strtoull(argv[1], nullptr, 10) : 4000;
+    size_t worker_count = argc > 2 ? strtoull(argv[2], nullptr, 10) : 0;
+    int interval_ms = argc > 3 ? atoi(argv[3]) : 20;
+
+    // 每个会话在两端各占一个描述符
+    struct rlimit limit;
+    if (getrlimit(RLIMIT_NOFILE, &limit) == 0) {
+        limit.rlim_cur = limit.rlim_max;
+        setrlimit(RLIMIT_NOFILE, &limit);
+        size_t usable = limit.rlim_cur > 64 ? (limit.rlim_cur - 64) / 2 : 0;
+        if (max_sessions > usable) {
+            fprintf(stderr, "RLIMIT_NOFILE %lu allows %zu sessions\n", (unsigned long)limit.rlim_cur, usable);
+            max_sessions = usable;
+        }
+    }
+
+    std::string path = "/tmp/bench_server_" + std::to_string(getpid()) + ".sock";
+    size_t drivers = std::max(1u, std::thread::hardware_concurrency() / 4);
+
+    printf("%10s %8s %10s %10s %10s %10s %10s\n", "sessions", "workers", "keys/s", "p50(us)",
+           "p99(us)", "max(us)", "KB/session");
+    std::vector<size_t> counts;
+    for (size_t n = 1; n < max_sessions; n *= 10) counts.push_back(n);
+    counts.push_back(max_sessions);
+
+    for (size_t count : counts) {
+        ShellServer server(worker_count);
+        if (!server.listen(path)) {
+            fprintf(stderr, "cannot listen on %s\n", path.c_str());
+            return 1;
+        }
+        server.start();
+
+        long before = rss_kb();
+        std::vector<std::vector<Client>> groups(std::min(drivers, count));
+        for (size_t i = 0; i < count; i++) {
+            int fd = connect_to(path);
+            if (fd < 0 || !wait_prompt(fd)) {
+                fprintf(stderr, "session %zu failed\n", i);
+                return 1;
+            }
+            groups[i % groups.size()].push_back({fd, false, 0, Clock::time_point()});
+        }
+        long after = rss_kb();
+
+        const auto duration = std::chrono::seconds(2);
+        Clock::time_point stop = Clock::now() + duration;
+        std::vector<std::vector<double>> latencies(groups.size());
+        std::vector<std::thread> threads;
+        for (size_t g = 0; g < groups.size(); g++) {
+            threads.emplace_back(drive, std::ref(groups[g]), std::chrono::milliseconds(interval_ms),
+                                 stop, std::ref(latencies[g]));
+        }
+        for (auto& thread : threads) thread.join();
+
+        std::vector<double> all;
+        for (auto& list : latencies) all.insert(all.end(), list.begin(), list.end());
+        std::sort(all.begin(), all.end());
+        auto percentile = [&all](double p) {
+            return all.empty() ? 0.0 : all[std::min(all.size() - 1, (size_t)(all.size() * p))];
+        };
+        printf("%10zu %8zu %10.0f %10.1f %10.1f %10.1f %10.1f\n", count, server.worker_count(),
+               all.size() / std::chrono::duration<double>(duration).count(), percentile(0.5),
+               percentile(0.99), all.empty() ? 0.0 : all.back(), (double)(after - before) / count);
+
+        for (auto& group : groups) {
+            for (auto& client : group) close(client.fd);
+        }
+        server.stop();
+    }
+    return 0;
+}
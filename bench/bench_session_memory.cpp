@@ -0,0 +1,144 @@
+// 会话内存占用测试
+// 用法: bench_session_memory [会话数]，默认10000
+// 建立大量会话模式的Shell（输出写入/dev/null），分别用默认堆和共用的内存池
+// （与ShellServer的工作线程相同）分配会话状态，在以下阶段统计每个会话的：
+//   allocs   - 经operator new的堆分配次数（内存池向上游申请的大块也计入）
+//   bytes    - 堆分配的字节数（未释放的净增量）
+//   rss(KB)  - 进程常驻内存的增量
+// 阶段：construct为刚建立，typed为输入一行50字符的命令，history为再执行20条内建命令。
+#include "shell.h"
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory_resource>
+#include <new>
+#include <string>
+#include <vector>
+#include <fcntl.h>
+#include <spawn.h>
+#include <unistd.h>
+#include <sys/wait.h>
+
+static size_t heap_allocs = 0;
+static long long heap_bytes = 0;
+
+// 统计全部堆分配，分配长度存放在块前面以便释放时扣除
+void* operator new(size_t n) {
+    size_t* p = (size_t*)malloc(n + 16);
+    if (!p) throw std::bad_alloc();
+    *p = n;
+    heap_allocs++;
+    heap_bytes += n;
+    return (char*)p + 16;
+}
+
+void operator delete(void* ptr) noexcept {
+    if (!ptr) return;
+    size_t* p = (size_t*)((char*)ptr - 16);
+    heap_bytes -= *p;
+    free(p);
+}
+
+void operator delete(void* ptr, size_t) noexcept {
+    operator delete(ptr);
+}
+
+// std::pmr::new_delete_resource使用带对齐的版本，块头保持16字节对齐即可覆盖常见的对齐要求
+void* operator new(size_t n, std::align_val_t) {
+    return operator new(n);
+}
+
+void operator delete(void* ptr, std::align_val_t) noexcept {
+    operator delete(ptr);
+}
+
+void operator delete(void* ptr, size_t, std::align_val_t) noexcept {
+    operator delete(ptr);
+}
+
+static long rss_kb() {
+    FILE* f = fopen("/proc/self/status", "r");
+    if (!f) return 0;
+    char line[256];
+    long kb = 0;
+    while (fgets(line, sizeof(line), f)) {
+        if (strncmp(line, "VmRSS:", 6) == 0) kb = atol(line + 6);
+    }
+    fclose(f);
+    return kb;
+}
+
+struct Snapshot {
+    size_t allocs;
+    long long bytes;
+    long rss;
+
+    static Snapshot take() { return {heap_allocs, heap_bytes, rss_kb()}; }
+};
+
+static void report(const char* mode, const char* phase, const Snapshot& before, size_t sessions) {
+    Snapshot now = Snapshot::take();
+    printf("%6s %10s %10.1f %10.1f %10.2f\n", mode, phase,
+           (double)(now.allocs - before.allocs) / sessions,
+           (double)(now.bytes - before.bytes) / sessions,
+           (double)(now.rss - before.rss) / sessions);
+}
+
+static void run(const char* mode, std::pmr::memory_resource* resource, size_t sessions, int out_fd) {
+    std::vector<Shell*> shells;
+    shells.reserve(sessions);
+    Snapshot start = Snapshot::take();
+
+    for (size_t i = 0; i < sessions; i++) {
+        shells.push_back(new Shell(nullptr, out_fd, resource));
+    }
+    report(mode, "construct", start, sessions);
+
+    const char line[] = "grep -rn --include=*.cpp session_state src/ | less";
+    for (Shell* shell : shells) {
+        shell->feed_input(line, sizeof(line) - 1);
+    }
+    report(mode, "typed", start, sessions);
+
+    // 清空输入行后执行内建命令，每条都不同，全部进入历史
+    for (Shell* shell : shells) {
+        for (size_t k = 0; k < sizeof(line) - 1; k++) shell->feed_input("\b", 1);
+        for (int k = 0; k < 20; k++) {
+            std::string cmd = (k % 2 ? "jobs " : "history ") + std::to_string(k) + "\r";
+            shell->feed_input(cmd.data(), cmd.size());
+        }
+    }
+    report(mode, "history", start, sessions);
+
+    for (Shell* shell : shells) delete shell;
+}
+
+int main(int argc, char* argv[]) {
+    size_t sessions = argc > 1 ? strtoull(argv[1], nullptr, 10) : 10000;
+    if (argc > 2) {
+        // 子进程：只运行一种方式
+        int out_fd = open("/dev/null", O_WRONLY | O_CLOEXEC);
+        if (strcmp(argv[2], "pool") == 0) {
+            std::pmr::unsynchronized_pool_resource pool;
+            run("pool", &pool, sessions, out_fd);
+        } else {
+            run("heap", std::pmr::get_default_resource(), sessions, out_fd);
+        }
+        close(out_fd);
+        return 0;
+    }
+
+    printf("sizeof(Shell) = %zu\n", sizeof(Shell));
+    printf("%6s %10s %10s %10s %10s\n", "mode", "phase", "allocs", "bytes", "rss(KB)");
+    fflush(stdout);
+    // 每种方式在单独的进程中运行，常驻内存的增量互不影响
+    std::string count = std::to_string(sessions);
+    for (const char* mode : {"heap", "pool"}) {
+        char* child_argv[] = {argv[0], (char*)count.c_str(), (char*)mode, nullptr};
+        pid_t pid;
+        if (posix_spawn(&pid, argv[0], nullptr, nullptr, child_argv, environ) == 0) {
+            waitpid(pid, nullptr, 0);
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,100 @@
+// 慢速链路上的交互性能
+// 用法: bench_slow_link [--predict] [场景...]，场景为typing、history、edit、paste，默认全部
+// 在每种模拟链路上运行脚本化的编辑会话，报告：
+//   keys    - 按键次数（粘贴算一次）
+//   B/key   - 每次按键的回应字节数
+//   redraws - 整行重绘的次数
+//   echo    - 按键到回显收完的平均和最大时间
+//   local   - 在本地立即显示了预测回显的按键数（--predict时客户端总是显示预测）
+// 打字按每键120ms的间隔连续发送，不等回显；其余场景逐键发送并等待回应
+#include "slowlink.h"
+#include "predict.h"
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+
+struct Link {
+    const char* name;
+    LinkProfile profile;
+};
+
+static const Link LINKS[] = {
+    {"serial-9600", LinkProfile::serial(9600)},
+    {"modem-56k", {5600, 100}},
+    {"satellite", {64 * 1024, 300}},
+    {"lan", {0, 0}},
+};
+
+static const char* LINE = "git commit -m 'fix the parser for long lines'";
+
+// 准备好历史记录，不计入测量
+static void prepare_history(SlowLinkSession& session) {
+    for (const char* command : {"echo first", "ls -l /tmp", "true", "echo the last one"}) {
+        session.press(std::string(command) + "\r");
+    }
+}
+
+// 运行一个场景，返回测量的第一个按键
+static size_t run(SlowLinkSession& session, const std::string& scenario) {
+    if (scenario == "typing") {
+        size_t first = session.keystroke_count();
+        session.type(LINE, 120);
+        session.wait_idle(60000);
+        return first;
+    }
+    if (scenario == "history") {
+        prepare_history(session);
+        size_t first = session.keystroke_count();
+        for (int i = 0; i < 4; i++) session.press("\033[A");
+        for (int i = 0; i < 3; i++) session.press("\033[B");
+        return first;
+    }
+    if (scenario == "edit") {
+        session.type(LINE, 0);
+        session.wait_idle(60000);
+        size_t first = session.keystroke_count();
+        for (int i = 0; i < 20; i++) session.press("\033[D");
+        for (char c : std::string("quickly ")) session.press(std::string(1, c));
+        for (int i = 0; i < 4; i++) session.press("\033[3~");
+        for (int i = 0; i < 3; i++) session.press("\b");
+        return first;
+    }
+    // paste：一次送达的一段文本
+    size_t first = session.keystroke_count();
+    session.press("for f in *.cpp; do grep -n 'TODO' \"$f\" | sed -e 's/^/'\"$f\"': /'; done | sort | uniq -c");
+    return first;
+}
+
+int main(int argc, char* argv[]) {
+    std::vector<std::string> scenarios;
+    bool predict = false;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--predict") == 0) {
+            predict = true;
+        } else {
+            scenarios.push_back(argv[i]);
+        }
+    }
+    if (scenarios.empty()) scenarios = {"typing", "history", "edit", "paste"};
+
+    printf("%-8s %-12s %6s %8s %8s %10s %10s %6s\n", "scenario", "link", "keys", "B/key", "redraws", "echo avg", "echo max",
+           "local");
+    for (const std::string& scenario : scenarios) {
+        for (const Link& link : LINKS) {
+            PredictiveEcho echo(24, 80, PredictMode::ALWAYS);
+            SlowLinkSession session(link.profile, 24, 80, predict ? &echo : nullptr);
+            if (!session.ok()) {
+                fprintf(stderr, "cannot open pseudo terminal\n");
+                return 1;
+            }
+            size_t first = run(session, scenario);
+            LinkReport report = session.report(first);
+            printf("%-8s %-12s %6zu %8.1f %8u %8.1fms %8.1fms %6u\n", scenario.c_str(), link.name,
+                   report.keystrokes, report.bytes_per_keystroke(), report.redraws,
+                   report.mean_echo_ms, report.max_echo_ms, report.predicted);
+            fflush(stdout);
+        }
+    }
+    return 0;
+}
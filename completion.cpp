@@ -0,0 +1,508 @@
+#include "completion.h"
+#include <algorithm>
+
+// 两个字符串的最长公共前缀长度
+static size_t common_length(const std::string& a, const std::string& b) {
+    size_t n = 0;
+    while (n < a.size() && n < b.size() && a[n] == b[n]) n++;
+    return n;
+}
+
+PrefixTrie::PrefixTrie() {
+    clear();
+}
+
+void PrefixTrie::clear() {
+    nodes.clear();
+    nodes.push_back({{}, 0, 0});
+}
+
+int32_t PrefixTrie::child(uint32_t node, unsigned char c) const {
+    // 按无符号字符排序，与std::string的比较顺序一致
+    const auto& children = nodes[node].children;
+    auto it = std::lower_bound(children.begin(), children.end(), std::make_pair(c, (uint32_t)0));
+    if (it == children.end() || it->first != c) return -1;
+    return (int32_t)it->second;
+}
+
+int32_t PrefixTrie::find_node(const std::string& prefix) const {
+    int32_t node = 0;
+    for (char c : prefix) {
+        node = child(node, c);
+        if (node < 0) return -1;
+    }
+    return node;
+}
+
+void PrefixTrie::insert(const std::string& word) {
+    std::vector<uint32_t> path;
+    path.reserve(word.size() + 1);
+    uint32_t node = 0;
+    path.push_back(node);
+    for (char c : word) {
+        int32_t next = child(node, c);
+        if (next < 0) {
+            next = (int32_t)nodes.size();
+            nodes.push_back({{}, 0, 0});  // 先添加再取引用，push_back可能使引用失效
+            auto& children = nodes[node].children;
+            auto it = std::lower_bound(children.begin(), children.end(),
+                                       std::make_pair((unsigned char)c, (uint32_t)0));
+            children.insert(it, {(unsigned char)c, (uint32_t)next});
+        }
+        node = (uint32_t)next;
+        path.push_back(node);
+    }
+    if (nodes[node].terminal++ == 0) {
+        for (uint32_t n : path) nodes[n].words++;
+    }
+}
+
+void PrefixTrie::remove(const std::string& word) {
+    std::vector<uint32_t> path;
+    int32_t node = 0;
+    path.push_back(0);
+    for (char c : word) {
+        node = child(node, c);
+        if (node < 0) return;
+        path.push_back(node);
+    }
+    if (nodes[node].terminal == 0) return;
+    // 节点不回收，words为0的子树在遍历时跳过
+    if (--nodes[node].terminal == 0) {
+        for (uint32_t n : path) nodes[n].words--;
+    }
+}
+
+bool PrefixTrie::contains(const std::string& word) const {
+    int32_t node = find_node(word);
+    return node >= 0 && nodes[node].terminal > 0;
+}
+
+void PrefixTrie::collect(uint32_t node, std::string& word, size_t& skip, size_t limit,
+                         std::vector<std::string>& out) const {
+    if (nodes[node].terminal > 0) {
+        if (skip > 0) {
+            skip--;
+        } else {
+            out.push_back(word);
+        }
+    }
+    for (const auto& c : nodes[node].children) {
+        if (out.size() >= limit) return;
+        const Node& next = nodes[c.second];
+        if (next.words == 0) continue;
+        if (skip >= next.words) {
+            skip -= next.words;  // 整个子树都在本页之前，不必进入
+            continue;
+        }
+        word += (char)c.first;
+        collect(c.second, word, skip, limit, out);
+        word.pop_back();
+    }
+}
+
+CompletionResult PrefixTrie::complete(const std::string& prefix, size_t offset, size_t limit) const {
+    CompletionResult result;
+    result.total = 0;
+    int32_t node = find_node(prefix);
+    if (node < 0 || nodes[node].words == 0) return result;
+    result.total = nodes[node].words;
+
+    // 沿唯一的分支向下延伸得到公共前缀
+    result.common = prefix;
+    uint32_t n = (uint32_t)node;
+    while (nodes[n].terminal == 0) {
+        int32_t only = -1;
+        unsigned char only_char = 0;
+        for (const auto& c : nodes[n].children) {
+            if (nodes[c.second].words == 0) continue;
+            if (only >= 0) {
+                only = -2;
+                break;
+            }
+            only = (int32_t)c.second;
+            only_char = c.first;
+        }
+        if (only < 0) break;
+        result.common += (char)only_char;
+        n = (uint32_t)only;
+    }
+
+    if (limit > 0) {
+        std::string word = prefix;
+        size_t skip = offset;
+        collect((uint32_t)node, word, skip, limit, result.candidates);
+    }
+    return result;
+}
+
+#ifdef __linux__
+
+#include <cerrno>
+#include <cstdlib>
+#include <climits>
+#include <dirent.h>
+#include <unistd.h>
+#include <sys/inotify.h>
+#include <sys/stat.h>
+
+// 影响目录列表的事件
+#define DIRINDEX_EVENTS (IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO | \
+                         IN_DELETE_SELF | IN_MOVE_SELF | IN_ONLYDIR)
+
+// 目录的规范路径，作为缓存的键（同一目录的不同写法共用一份列表和一个inotify监视）
+static std::string resolve_dir(const std::string& dir) {
+    char resolved[PATH_MAX];
+    if (realpath(dir.c_str(), resolved) == nullptr) return "";
+    return resolved;
+}
+
+static bool entry_less(const DirIndex::Entry& entry, const std::string& name) {
+    return entry.name < name;
+}
+
+DirIndex::DirIndex(size_t max_dirs) :
+    max_dirs(max_dirs),
+    inotify_fd(-1),
+    loads(0) {
+}
+
+DirIndex::~DirIndex() {
+    if (inotify_fd >= 0) {
+        close(inotify_fd);
+    }
+}
+
+bool DirIndex::load(const std::string& dir, Listing& listing) {
+    DIR* d = opendir(dir.c_str());
+    if (!d) return false;
+    loads++;
+
+    // inotify实例在第一次读取目录时才创建
+    if (inotify_fd < 0) {
+        inotify_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    }
+    // 先建立监视再读取，读取期间发生的变化不会丢失（重复的事件按名字去重）
+    listing.wd = inotify_fd >= 0 ? inotify_add_watch(inotify_fd, dir.c_str(), DIRINDEX_EVENTS) : -1;
+    listing.entries.clear();
+    struct dirent* ent;
+    while ((ent = readdir(d)) != nullptr) {
+        if (ent->d_name[0] == '.' &&
+            (ent->d_name[1] == '\0' || (ent->d_name[1] == '.' && ent->d_name[2] == '\0'))) {
+            continue;
+        }
+        listing.entries.push_back({ent->d_name, ent->d_type});
+    }
+    closedir(d);
+    std::sort(listing.entries.begin(), listing.entries.end(),
+              [](const Entry& a, const Entry& b) { return a.name < b.name; });
+    if (listing.wd >= 0) {
+        wd_dirs[listing.wd] = dir;
+    }
+    return true;
+}
+
+void DirIndex::touch(const std::string& dir) {
+    auto it = std::find(lru.begin(), lru.end(), dir);
+    if (it != lru.begin() && it != lru.end()) {
+        lru.splice(lru.begin(), lru, it);
+    }
+}
+
+void DirIndex::drop(const std::string& dir) {
+    auto it = dirs.find(dir);
+    if (it == dirs.end()) return;
+    if (it->second.wd >= 0) {
+        wd_dirs.erase(it->second.wd);
+        inotify_rm_watch(inotify_fd, it->second.wd);
+    }
+    dirs.erase(it);
+    lru.remove(dir);
+}
+
+void DirIndex::evict() {
+    // 从最久未使用的一端淘汰，固定的目录（PATH）保留
+    for (auto it = lru.rbegin(); it != lru.rend() && dirs.size() > max_dirs;) {
+        std::string dir = *it;
+        ++it;
+        if (!dirs[dir].pinned) {
+            drop(dir);
+            it = lru.rbegin();
+        }
+    }
+}
+
+const std::vector<DirIndex::Entry>* DirIndex::listing(const std::string& dir, bool pinned) {
+    std::string key = resolve_dir(dir);
+    if (key.empty()) return nullptr;
+
+    auto it = dirs.find(key);
+    if (it != dirs.end()) {
+        it->second.pinned = it->second.pinned || pinned;
+        touch(key);
+        // 没能监视的目录（inotify实例或监视数达到上限）收不到变化，每次重新读取
+        if (it->second.wd < 0 && !load(key, it->second)) {
+            drop(key);
+            return nullptr;
+        }
+        return &it->second.entries;
+    }
+
+    Listing listing;
+    listing.pinned = pinned;
+    if (!load(key, listing)) return nullptr;
+    auto& stored = dirs[key] = std::move(listing);
+    lru.push_front(key);
+    evict();
+    return &stored.entries;
+}
+
+bool DirIndex::watched(const std::string& dir) const {
+    auto it = dirs.find(dir);
+    return it != dirs.end() && it->second.wd >= 0;
+}
+
+void DirIndex::unpin_all() {
+    for (auto& dir : dirs) {
+        dir.second.pinned = false;
+    }
+    evict();
+}
+
+std::vector<DirIndex::Change> DirIndex::sync() {
+    std::vector<Change> changes;
+    if (inotify_fd < 0) return changes;
+
+    bool overflow = false;
+    alignas(struct inotify_event) char buffer[8192];
+    while (true) {
+        ssize_t len = read(inotify_fd, buffer, sizeof(buffer));
+        if (len < 0 && errno == EINTR) continue;
+        if (len <= 0) break;
+
+        for (char* p = buffer; p < buffer + len;) {
+            struct inotify_event* event = (struct inotify_event*)p;
+            p += sizeof(struct inotify_event) + event->len;
+
+            if (event->mask & IN_Q_OVERFLOW) {
+                overflow = true;
+                continue;
+            }
+            auto wd_it = wd_dirs.find(event->wd);
+            if (wd_it == wd_dirs.end()) continue;  // 已淘汰目录的残留事件
+            std::string dir = wd_it->second;
+            Listing& listing = dirs[dir];
+
+            if (event->mask & (IN_DELETE_SELF | IN_MOVE_SELF | IN_IGNORED)) {
+                // 目录本身消失，全部条目视为删除
+                for (const auto& entry : listing.entries) {
+                    changes.push_back({dir, entry.name, entry.type, false});
+                }
+                drop(dir);
+                continue;
+            }
+            if (event->len == 0) continue;
+
+            std::string name = event->name;
+            auto pos = std::lower_bound(listing.entries.begin(), listing.entries.end(),
+                                        name, entry_less);
+            bool exists = pos != listing.entries.end() && pos->name == name;
+            if (event->mask & (IN_CREATE | IN_MOVED_TO)) {
+                if (!exists) {
+                    // 新建的非目录项类型未知（可能是指向目录的符号链接），需要时再stat
+                    unsigned char type = (event->mask & IN_ISDIR) ? DT_DIR : DT_UNKNOWN;
+                    listing.entries.insert(pos, {name, type});
+                    changes.push_back({dir, name, type, true});
+                }
+            } else if (event->mask & (IN_DELETE | IN_MOVED_FROM)) {
+                if (exists) {
+                    changes.push_back({dir, name, pos->type, false});
+                    listing.entries.erase(pos);
+                }
+            }
+        }
+    }
+
+    if (overflow) {
+        // 事件丢失时重新读取所有目录，以删除旧条目、添加新条目的形式通知
+        for (auto& dir : dirs) {
+            for (const auto& entry : dir.second.entries) {
+                changes.push_back({dir.first, entry.name, entry.type, false});
+            }
+            if (dir.second.wd >= 0) {
+                wd_dirs.erase(dir.second.wd);
+            }
+            if (!load(dir.first, dir.second)) {
+                dir.second.entries.clear();
+                dir.second.wd = -1;
+            }
+            for (const auto& entry : dir.second.entries) {
+                changes.push_back({dir.first, entry.name, entry.type, true});
+            }
+        }
+    }
+    return changes;
+}
+
+Completer::Completer() :
+    path_watched(true) {
+    path_value = "\n";  // 不可能的PATH值，首次使用时建立命令索引
+}
+
+void Completer::set_builtins(const std::vector<std::string>& names) {
+    // 命令索引尚未建立时只记下名字，建立索引时一并加入
+    bool built = path_value != "\n";
+    if (built) {
+        for (const auto& name : builtins) commands.remove(name);
+    }
+    builtins = names;
+    if (built) {
+        for (const auto& name : builtins) commands.insert(name);
+    }
+}
+
+void Completer::rebuild_commands() {
+    commands.clear();
+    dir_index.unpin_all();
+    path_dirs.clear();
+    path_watched = true;
+
+    const char* path = getenv("PATH");
+    path_value = path ? path : "";
+    size_t start = 0;
+    while (start <= path_value.size()) {
+        size_t end = path_value.find(':', start);
+        if (end == std::string::npos) end = path_value.size();
+        std::string dir = path_value.substr(start, end - start);
+        start = end + 1;
+
+        std::string key = resolve_dir(dir.empty() ? "." : dir);
+        if (key.empty() || std::find(path_dirs.begin(), path_dirs.end(), key) != path_dirs.end()) {
+            continue;
+        }
+        // PATH目录固定在缓存中，保证前缀树与目录内容一致
+        const std::vector<DirIndex::Entry>* entries = dir_index.listing(key, true);
+        if (!entries) continue;
+        path_dirs.push_back(key);
+        path_watched = path_watched && dir_index.watched(key);
+        for (const auto& entry : *entries) {
+            if (entry.type != DT_DIR) commands.insert(entry.name);
+        }
+    }
+    for (const auto& name : builtins) {
+        commands.insert(name);
+    }
+}
+
+void Completer::sync() {
+    // PATH目录有没能监视的，前缀树无法增量更新，每次重建
+    const char* path = getenv("PATH");
+    if (path_value != (path ? path : "") || !path_watched) {
+        dir_index.sync();  // 丢弃旧PATH下的事件
+        rebuild_commands();
+        return;
+    }
+    // 把PATH目录中的增删同步到前缀树
+    for (const auto& change : dir_index.sync()) {
+        if (change.type == DT_DIR) continue;
+        if (std::find(path_dirs.begin(), path_dirs.end(), change.dir) == path_dirs.end()) continue;
+        if (change.added) {
+            commands.insert(change.name);
+        } else {
+            commands.remove(change.name);
+        }
+    }
+}
+
+CompletionResult Completer::complete_command(const std::string& prefix, size_t offset, size_t limit) {
+    sync();
+    return commands.complete(prefix, offset, limit);
+}
+
+bool Completer::is_directory(const std::string& dir, const DirIndex::Entry& entry) const {
+    if (entry.type == DT_DIR) return true;
+    if (entry.type != DT_UNKNOWN && entry.type != DT_LNK) return false;
+    struct stat st;
+    return stat((dir + "/" + entry.name).c_str(), &st) == 0 && S_ISDIR(st.st_mode);
+}
+
+CompletionResult Completer::complete_file(const std::string& word, size_t offset, size_t limit) {
+    sync();
+    CompletionResult result;
+    result.total = 0;
+
+    size_t slash = word.rfind('/');
+    std::string dir_part = slash == std::string::npos ? "" : word.substr(0, slash + 1);
+    std::string base = word.substr(dir_part.size());
+    std::string dir = dir_part.empty() ? "." : dir_part;
+
+    const std::vector<DirIndex::Entry>* entries = dir_index.listing(dir);
+    if (!entries) return result;
+
+    // 有序列表中以base开头的条目是连续的一段，用二分查找定位
+    auto first = std::lower_bound(entries->begin(), entries->end(), base, entry_less);
+    auto last = first;
+    if (base.empty()) {
+        last = entries->end();
+    } else {
+        std::string upper = base;
+        upper.back()++;  // 前缀的后继，字符溢出时退化为线性查找
+        if (upper.back() != 0) {
+            last = std::lower_bound(first, entries->end(), upper, entry_less);
+        } else {
+            while (last != entries->end() && last->name.compare(0, base.size(), base) == 0) ++last;
+        }
+    }
+
+    // base不以'.'开头时不补全隐藏文件，隐藏文件在区间内同样是连续的一段
+    std::vector<std::pair<size_t, size_t>> ranges;
+    size_t begin = first - entries->begin();
+    size_t end = last - entries->begin();
+    if (base.empty()) {
+        size_t hidden_begin = std::lower_bound(entries->begin(), entries->end(), std::string("."),
+                                               entry_less) - entries->begin();
+        size_t hidden_end = std::lower_bound(entries->begin(), entries->end(), std::string("/"),
+                                             entry_less) - entries->begin();
+        ranges.push_back({begin, hidden_begin});
+        ranges.push_back({hidden_end, end});
+    } else {
+        ranges.push_back({begin, end});
+    }
+    const std::string* first_name = nullptr;
+    const std::string* last_name = nullptr;
+    for (const auto& range : ranges) {
+        if (range.first >= range.second) continue;
+        result.total += range.second - range.first;
+        if (!first_name) first_name = &(*entries)[range.first].name;
+        last_name = &(*entries)[range.second - 1].name;
+    }
+    if (result.total == 0) return result;
+
+    // 有序区间的公共前缀就是首尾两项的公共前缀，O(1)得到
+    result.common = dir_part + first_name->substr(0, common_length(*first_name, *last_name));
+
+    if (result.total == 1) {
+        // 唯一匹配时补全完整名字，目录加上'/'
+        const auto& range = ranges[0].first < ranges[0].second ? ranges[0] : ranges.back();
+        const DirIndex::Entry& entry = (*entries)[range.first];
+        result.common = dir_part + entry.name + (is_directory(dir, entry) ? "/" : "");
+    }
+
+    // 只为本页的候选判断是否为目录，大目录中也只做有限次stat
+    size_t skip = offset;
+    for (const auto& range : ranges) {
+        size_t count = range.second > range.first ? range.second - range.first : 0;
+        if (skip >= count) {
+            skip -= count;
+            continue;
+        }
+        for (size_t i = range.first + skip; i < range.second && result.candidates.size() < limit; i++) {
+            const DirIndex::Entry& entry = (*entries)[i];
+            result.candidates.push_back(dir_part + entry.name + (is_directory(dir, entry) ? "/" : ""));
+        }
+        skip = 0;
+    }
+    return result;
+}
+
+#endif
@@ -0,0 +1,137 @@
+#ifndef _COMPLETION_H_
+#define _COMPLETION_H_
+
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+
+// 补全结果
+struct CompletionResult {
+    std::vector<std::string> candidates;  // 本页候选（按字典序）
+    size_t total;                         // 全部匹配的数量
+    std::string common;                   // 全部匹配的最长公共前缀
+};
+
+// 前缀树，节点存放在连续数组中，子节点按字符排序
+// 每个节点记录子树中的单词数，前缀匹配总数和分页跳过都不需要遍历整个子树
+class PrefixTrie {
+public:
+    PrefixTrie();
+
+    // 插入/删除单词，同一单词可以插入多次（引用计数），全部删除后才消失
+    void insert(const std::string& word);
+    void remove(const std::string& word);
+    void clear();
+
+    bool contains(const std::string& word) const;
+    size_t size() const { return nodes[0].words; }
+
+    // 按字典序返回以prefix开头的第offset个起最多limit个单词
+    CompletionResult complete(const std::string& prefix, size_t offset, size_t limit) const;
+
+private:
+    struct Node {
+        std::vector<std::pair<unsigned char, uint32_t>> children;  // (字符, 节点下标)，按字符排序
+        uint32_t terminal;  // 以此节点结尾的单词的引用计数
+        uint32_t words;     // 子树中不同单词的数量
+    };
+    std::vector<Node> nodes;
+
+    int32_t child(uint32_t node, unsigned char c) const;
+    int32_t find_node(const std::string& prefix) const;
+    void collect(uint32_t node, std::string& word, size_t& skip, size_t limit,
+                 std::vector<std::string>& out) const;
+};
+
+#ifdef __linux__
+
+#include <list>
+#include <unordered_map>
+
+// 目录列表缓存
+// 每个目录读取一次后保持有序列表，之后由inotify事件增量插入/删除，Tab时不再readdir；
+// 没能监视的目录每次访问时重新读取
+class DirIndex {
+public:
+    struct Entry {
+        std::string name;
+        unsigned char type;   // readdir的d_type，DT_UNKNOWN/DT_LNK需要时再stat
+    };
+
+    // 目录内容变化通知：added为true表示新增，否则为删除
+    struct Change {
+        std::string dir;
+        std::string name;
+        unsigned char type;
+        bool added;
+    };
+
+    explicit DirIndex(size_t max_dirs = 64);
+    ~DirIndex();
+
+    // 取得目录的有序列表，首次访问时读取；pinned的目录不会被淘汰
+    const std::vector<Entry>* listing(const std::string& dir, bool pinned = false);
+
+    // 目录（规范路径）已读取且在监视中，变化会由sync报告
+    bool watched(const std::string& dir) const;
+
+    // 取消全部目录的固定（PATH变化时）
+    void unpin_all();
+
+    // 处理挂起的inotify事件，返回变化列表
+    std::vector<Change> sync();
+
+    // 读取目录的次数，用于测试缓存命中
+    unsigned long load_count() const { return loads; }
+
+private:
+    struct Listing {
+        std::vector<Entry> entries;  // 按名字排序
+        int wd;
+        bool pinned;
+    };
+    std::unordered_map<std::string, Listing> dirs;
+    std::unordered_map<int, std::string> wd_dirs;   // 监视描述符到目录
+    std::list<std::string> lru;                     // 最近使用的目录在前
+    size_t max_dirs;
+    int inotify_fd;
+    unsigned long loads;
+
+    bool load(const std::string& dir, Listing& listing);
+    void evict();
+    void drop(const std::string& dir);
+    void touch(const std::string& dir);
+};
+
+// 补全引擎：命令名来自PATH目录（前缀树）和内建命令，文件名来自目录列表缓存
+class Completer {
+public:
+    Completer();
+
+    void set_builtins(const std::vector<std::string>& names);
+
+    // 补全命令名
+    CompletionResult complete_command(const std::string& prefix, size_t offset, size_t limit);
+
+    // 补全文件名，word可以包含目录部分，候选为完整的word形式，目录以'/'结尾
+    CompletionResult complete_file(const std::string& word, size_t offset, size_t limit);
+
+    unsigned long load_count() const { return dir_index.load_count(); }
+
+private:
+    PrefixTrie commands;
+    DirIndex dir_index;
+    std::vector<std::string> builtins;
+    std::string path_value;                // 建立命令索引时的PATH值
+    std::vector<std::string> path_dirs;
+    bool path_watched;                     // PATH目录都在监视中，前缀树可以增量更新
+
+    void sync();
+    void rebuild_commands();
+    bool is_directory(const std::string& dir, const DirIndex::Entry& entry) const;
+};
+
+#endif
+
+#endif
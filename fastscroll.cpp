@@ -0,0 +1,383 @@
+#include "fastscroll.h"
+#include <algorithm>
+#include <cstdio>
+
+#ifdef __linux__
+#include <cerrno>
+#include <chrono>
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include "pipeline.h"
+#include "pseudoterm.h"
+#endif
+
+static const Screen::Cell BLANK = {' ', 0, 0, 0};
+
+// 终端上的一段相同格子短于此长度时直接重写，否则用光标定位跳过
+#define SKIP_RUN 8
+
+FrameRenderer::FrameRenderer(unsigned rows, unsigned cols) :
+    model(rows, cols),
+    shown((size_t)model.rows() * model.cols(), BLANK),
+    shown_row(0),
+    shown_col(0),
+    shown_cursor(true),
+    shown_scrolls(0),
+    need_full(true),
+    term_row(0),
+    term_col(0),
+    term_pen(BLANK) {
+}
+
+void FrameRenderer::resize(unsigned rows, unsigned cols) {
+    model.resize(rows, cols);
+    shown.assign((size_t)model.rows() * model.cols(), BLANK);
+    need_full = true;
+}
+
+bool FrameRenderer::changed() const {
+    return need_full || model.any_dirty() || model.cursor_row() != shown_row ||
+           model.cursor_col() != shown_col || model.cursor_visible() != shown_cursor;
+}
+
+void append_sgr(std::string& out, const Screen::Cell& cell) {
+    static const struct {
+        uint16_t bit;
+        char code;
+    } ATTR_CODES[] = {
+        {Screen::BOLD, '1'}, {Screen::DIM, '2'}, {Screen::ITALIC, '3'}, {Screen::UNDERLINE, '4'},
+        {Screen::BLINK, '5'}, {Screen::REVERSE, '7'}, {Screen::INVISIBLE, '8'}, {Screen::STRIKE, '9'},
+    };
+    // 总是从默认属性开始设置，不需要逐项关闭
+    out += "\033[0";
+    for (const auto& item : ATTR_CODES) {
+        if (cell.attrs & item.bit) {
+            out += ';';
+            out += item.code;
+        }
+    }
+    char color[16];
+    if (cell.attrs & Screen::FG_COLOR) {
+        if (cell.fg < 8) snprintf(color, sizeof(color), ";%d", 30 + cell.fg);
+        else if (cell.fg < 16) snprintf(color, sizeof(color), ";%d", 90 + cell.fg - 8);
+        else snprintf(color, sizeof(color), ";38;5;%d", cell.fg);
+        out += color;
+    }
+    if (cell.attrs & Screen::BG_COLOR) {
+        if (cell.bg < 8) snprintf(color, sizeof(color), ";%d", 40 + cell.bg);
+        else if (cell.bg < 16) snprintf(color, sizeof(color), ";%d", 100 + cell.bg - 8);
+        else snprintf(color, sizeof(color), ";48;5;%d", cell.bg);
+        out += color;
+    }
+    out += 'm';
+}
+
+void append_utf8(std::string& out, uint32_t ch) {
+    if (ch < 0x80) {
+        out += (char)ch;
+    } else if (ch < 0x800) {
+        out += (char)(0xC0 | (ch >> 6));
+        out += (char)(0x80 | (ch & 0x3F));
+    } else if (ch < 0x10000) {
+        out += (char)(0xE0 | (ch >> 12));
+        out += (char)(0x80 | ((ch >> 6) & 0x3F));
+        out += (char)(0x80 | (ch & 0x3F));
+    } else {
+        out += (char)(0xF0 | (ch >> 18));
+        out += (char)(0x80 | ((ch >> 12) & 0x3F));
+        out += (char)(0x80 | ((ch >> 6) & 0x3F));
+        out += (char)(0x80 | (ch & 0x3F));
+    }
+}
+
+void FrameRenderer::set_pen(std::string& out, const Screen::Cell& cell) {
+    if (cell.fg == term_pen.fg && cell.bg == term_pen.bg && cell.attrs == term_pen.attrs) return;
+    append_sgr(out, cell);
+    term_pen = cell;
+}
+
+void FrameRenderer::move_to(std::string& out, unsigned row, unsigned col) {
+    if (row == term_row && col == term_col) return;
+    if (row == term_row && col == 0) {
+        out += '\r';
+    } else {
+        char seq[32];
+        if (col == 0) snprintf(seq, sizeof(seq), "\033[%uH", row + 1);
+        else snprintf(seq, sizeof(seq), "\033[%u;%uH", row + 1, col + 1);
+        out += seq;
+    }
+    term_row = row;
+    term_col = col;
+}
+
+void FrameRenderer::put_cell(std::string& out, const Screen::Cell& cell) {
+    set_pen(out, cell);
+    append_utf8(out, cell.ch);
+    // 写满最后一列后终端等待换行，位置视为不确定，下次必须绝对定位
+    term_col++;
+}
+
+void FrameRenderer::draw_row(std::string& out, unsigned row) {
+    unsigned cols = model.cols();
+    const Screen::Cell* now = model.line(row);
+    Screen::Cell* old = &shown[(size_t)row * cols];
+
+    unsigned first = 0;
+    while (first < cols && now[first] == old[first]) first++;
+    if (first == cols) return;
+    unsigned last = cols;
+    while (now[last - 1] == old[last - 1]) last--;
+    // 行尾的默认空白用EL清除
+    unsigned end = cols;
+    while (end > first && now[end - 1] == BLANK) end--;
+    unsigned stop = last > end ? end : last;
+
+    unsigned col = first;
+    while (col < stop) {
+        if (now[col] == old[col]) {
+            unsigned run = col;
+            while (run < stop && now[run] == old[run]) run++;
+            if (run - col >= SKIP_RUN || run == stop) {
+                col = run;
+                continue;
+            }
+        }
+        // 宽字符只有右半边变化时从左半边重写，右半边不单独输出
+        if (now[col].ch == Screen::WIDE_TAIL && col > 0) col--;
+        move_to(out, row, col);
+        put_cell(out, now[col]);
+        col++;
+        if (col < cols && now[col].ch == Screen::WIDE_TAIL) {
+            term_col++;
+            col++;
+        }
+    }
+    if (last > end) {
+        move_to(out, row, end);
+        set_pen(out, BLANK);
+        out += "\033[K";
+    }
+    std::copy(now, now + cols, old);
+}
+
+void FrameRenderer::render(std::string& out, bool full) {
+    unsigned rows = model.rows();
+    unsigned cols = model.cols();
+    term_row = shown_row;
+    term_col = shown_col;
+    if (full || need_full) {
+        // 复位终端上可能由命令设置过的状态：属性、插入模式、原点模式、滚动区域、字符集
+        out += "\030\033[0m\033[4l\033[?6l\033[r\033(B\017\033[H\033[2J";
+        std::fill(shown.begin(), shown.end(), BLANK);
+        term_pen = BLANK;
+        term_row = term_col = 0;
+        shown_cursor = !model.cursor_visible();
+        need_full = false;
+        full = true;
+    } else {
+        uint64_t scrolls = model.scroll_count() - shown_scrolls;
+        if (scrolls > 0 && scrolls < rows) {
+            // 终端同样整屏上滚，移入的行为默认空白
+            move_to(out, rows - 1, 0);
+            set_pen(out, BLANK);
+            out.append(scrolls, '\n');
+            std::rotate(shown.begin(), shown.begin() + scrolls * cols, shown.end());
+            std::fill(shown.end() - scrolls * cols, shown.end(), BLANK);
+        }
+    }
+    shown_scrolls = model.scroll_count();
+
+    for (unsigned row = 0; row < rows; row++) {
+        if (full || model.row_dirty(row)) draw_row(out, row);
+    }
+    model.clear_dirty();
+
+    move_to(out, model.cursor_row(), model.cursor_col());
+    if (model.cursor_visible() != shown_cursor) {
+        out += model.cursor_visible() ? "\033[?25h" : "\033[?25l";
+        shown_cursor = model.cursor_visible();
+    }
+    shown_row = model.cursor_row();
+    shown_col = model.cursor_col();
+}
+
+#ifdef __linux__
+
+typedef std::chrono::steady_clock Clock;
+
+#define FRAME_READ_SIZE (64 * 1024)  // 每次从主端读取的长度
+#define FRAME_READS 16               // 每轮最多读取的次数，之后先处理输出
+#define FLOOD_SCREENS 4              // 一个帧间隔内超过这么多屏的输出视为洪水
+#define LINK_POLL_MS 5               // 终端连接的内核缓冲区未送完时，检查的间隔
+
+static bool write_all(int fd, const char* data, size_t len) {
+    while (len > 0) {
+        ssize_t n = write(fd, data, len);
+        if (n < 0 && errno == EINTR) continue;
+        if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            struct pollfd pfd = {fd, POLLOUT, 0};
+            poll(&pfd, 1, -1);
+            continue;
+        }
+        if (n <= 0) return false;
+        data += n;
+        len -= n;
+    }
+    return true;
+}
+
+// 已写入但对端还未取走的字节数（套接字、终端），不支持时为0
+static int queued_output(int fd) {
+    int queued = 0;
+    return ioctl(fd, TIOCOUTQ, &queued) == 0 ? queued : 0;
+}
+
+// 写出data中offset之后的部分，写满时返回，输出失效返回false
+static bool write_pending(int fd, const std::string& data, size_t& offset, long long& written) {
+    while (offset < data.size()) {
+        ssize_t n = write(fd, data.data() + offset, data.size() - offset);
+        if (n < 0 && errno == EINTR) continue;
+        if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) return true;
+        if (n <= 0) return false;
+        offset += n;
+        written += n;
+    }
+    return true;
+}
+
+long long forward_terminal_frames(int master, int out_fd, int tap_fd, unsigned fps,
+                                  FastScrollStats* stats, int stop_fd) {
+    static thread_local char buffer[FRAME_READ_SIZE];
+    FastScrollStats local;
+    if (!stats) stats = &local;
+    *stats = FastScrollStats();
+
+    unsigned short rows = 24;
+    unsigned short cols = 80;
+    get_terminal_size(master, rows, cols);
+    FrameRenderer renderer(rows, cols);
+    Clock::duration interval = std::chrono::microseconds(1000000 / std::max(fps, 1u));
+    fcntl(master, F_SETFL, fcntl(master, F_GETFL) | O_NONBLOCK);
+
+    std::string pending;        // 待写往终端的数据
+    size_t sent = 0;            // 其中已写出的部分
+    bool framing = false;
+    bool eof = false;
+    bool finished = false;      // 合并模式结束时已恢复默认属性
+    size_t window_bytes = 0;    // 当前帧间隔内读到的字节数
+    Clock::time_point window_start = Clock::now();
+    Clock::time_point last_frame = window_start - interval;
+    bool stopping = false;      // 已收到停止通知，只再收已到达的输出
+    Clock::time_point last_input;
+    Clock::time_point drain_until;
+
+    while (true) {
+        if (out_fd >= 0 && sent < pending.size() &&
+            !write_pending(out_fd, pending, sent, stats->bytes_out)) {
+            out_fd = -1;  // 终端失效，之后只读空主端
+        }
+        if (out_fd < 0 || sent == pending.size()) {
+            pending.clear();
+            sent = 0;
+        }
+
+        Clock::time_point now = Clock::now();
+        bool frame_due = framing && out_fd >= 0 && pending.empty() && renderer.changed() &&
+                         (eof || now - last_frame >= interval);
+        // 上一帧（包括内核缓冲区中的部分）已送达才画下一帧，链路慢时中间的画面被跳过；
+        // 主端关闭后立即画最后一帧，作业要等本线程结束才算完成，不能依赖终端读走积压
+        bool link_busy = frame_due && !eof && queued_output(out_fd) > 0;
+        if (frame_due && !link_busy) {
+            unsigned short r, c;
+            if (get_terminal_size(master, r, c) && (r != rows || c != cols)) {
+                rows = r;
+                cols = c;
+                renderer.resize(rows, cols);
+            }
+            renderer.render(pending);
+            stats->frames++;
+            last_frame = now;
+            continue;
+        }
+        if (eof && !link_busy && (pending.empty() || out_fd < 0)) {
+            if (framing && out_fd >= 0 && !finished) {
+                pending = "\033[0m";
+                finished = true;
+                continue;
+            }
+            break;
+        }
+
+        struct pollfd fds[3];
+        nfds_t count = 0;
+        if (!eof) fds[count++] = {master, POLLIN, 0};
+        if (out_fd >= 0 && !pending.empty()) fds[count++] = {out_fd, POLLOUT, 0};
+        nfds_t stop_index = count;
+        if (!eof && !stopping && stop_fd >= 0) fds[count++] = {stop_fd, POLLIN, 0};
+        int timeout = -1;
+        if (link_busy) {
+            timeout = LINK_POLL_MS;
+        } else if (framing && out_fd >= 0 && pending.empty() && renderer.changed()) {
+            auto wait = std::chrono::ceil<std::chrono::milliseconds>(last_frame + interval - now);
+            timeout = wait.count() > 0 ? (int)wait.count() : 0;
+        }
+        if (stopping && (timeout < 0 || timeout > PUMP_DRAIN_IDLE_MS)) timeout = PUMP_DRAIN_IDLE_MS;
+        if (poll(fds, count, timeout) < 0 && errno != EINTR) break;
+        if (eof) continue;
+        if (stop_index < count && (fds[stop_index].revents & POLLIN)) {
+            stopping = true;
+            last_input = Clock::now();
+            drain_until = last_input + std::chrono::milliseconds(PUMP_DRAIN_LIMIT_MS);
+        }
+
+        for (int i = 0; i < FRAME_READS; i++) {
+            ssize_t n = read(master, buffer, sizeof(buffer));
+            if (n < 0 && errno == EINTR) continue;
+            if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) break;
+            if (n <= 0) {
+                eof = true;  // EIO：从端已全部关闭且读空
+                break;
+            }
+            stats->bytes_in += n;
+            if (stopping) last_input = Clock::now();
+            if (tap_fd >= 0 && !write_all(tap_fd, buffer, n)) tap_fd = -1;
+            renderer.feed(buffer, n);
+            if (!framing) {
+                pending.append(buffer, n);
+                window_bytes += n;
+            }
+        }
+        if (stopping && !eof) {
+            // 输入空闲或到期后按主端关闭处理：画最后一帧后结束
+            now = Clock::now();
+            eof = now - last_input >= std::chrono::milliseconds(PUMP_DRAIN_IDLE_MS) || now >= drain_until;
+        }
+        if (framing) continue;
+
+        // 原样转发，先尽量写出，再判断是否来不及显示
+        if (out_fd >= 0 && sent < pending.size() &&
+            !write_pending(out_fd, pending, sent, stats->bytes_out)) {
+            out_fd = -1;
+        }
+        now = Clock::now();
+        size_t screen = (size_t)rows * cols;
+        if (out_fd >= 0 && (window_bytes > FLOOD_SCREENS * screen || pending.size() - sent > screen)) {
+            // 放弃积压，整屏重绘，之后按帧发送
+            framing = true;
+            stats->coalesced = true;
+            pending.clear();
+            sent = 0;
+            renderer.render(pending, true);
+            stats->frames++;
+            last_frame = now;
+        } else if (now - window_start >= interval) {
+            window_start = now;
+            window_bytes = 0;
+        }
+    }
+    return stats->bytes_in;
+}
+
+#endif
@@ -0,0 +1,77 @@
+#ifndef _FASTSCROLL_H_
+#define _FASTSCROLL_H_
+
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+#include "screen.h"
+
+// 把终端的当前属性设为cell的属性的SGR序列，从默认属性开始设置
+void append_sgr(std::string& out, const Screen::Cell& cell);
+// 追加码点的UTF-8编码
+void append_utf8(std::string& out, uint32_t ch);
+
+// 差异重绘
+// 输出先送入屏幕模型，render()生成把终端从上次发出的画面变成当前画面的最短序列：
+// 整屏滚动在终端上同样用换行滚动，之后只重写有变化的格子，行尾变为空白时用EL清除。
+// 终端须为UTF-8，绘制期间滚动区域为整屏（第一次绘制会设置）。
+class FrameRenderer {
+public:
+    FrameRenderer(unsigned rows = 24, unsigned cols = 80);
+
+    void feed(const char* data, size_t len) { model.feed(data, len); }
+    void feed(const std::string& data) { model.feed(data); }
+    const Screen& screen() const { return model; }
+
+    // 改变大小，下一次render整屏重绘
+    void resize(unsigned rows, unsigned cols);
+
+    // 当前画面与上次发出的是否不同
+    bool changed() const;
+
+    // 把差异追加到out；full为true时（或resize后）先清屏再整屏绘制，
+    // 此时以CAN开头，终止终端上可能未完成的转义序列
+    void render(std::string& out, bool full = false);
+
+private:
+    Screen model;
+    std::vector<Screen::Cell> shown;    // 终端上的画面
+    unsigned shown_row;                 // 终端上的光标
+    unsigned shown_col;
+    bool shown_cursor;
+    uint64_t shown_scrolls;             // 上次绘制时模型的整屏滚动计数
+    bool need_full;
+
+    // 绘制过程中终端的光标和当前属性
+    unsigned term_row;
+    unsigned term_col;                  // 等于列数时表示停在行尾等待换行，位置不确定
+    Screen::Cell term_pen;
+
+    void set_pen(std::string& out, const Screen::Cell& cell);
+    void move_to(std::string& out, unsigned row, unsigned col);
+    void put_cell(std::string& out, const Screen::Cell& cell);
+    void draw_row(std::string& out, unsigned row);
+};
+
+#ifdef __linux__
+
+// 合并转发的统计
+struct FastScrollStats {
+    long long bytes_in;     // 从主端读到的字节数
+    long long bytes_out;    // 写往终端的字节数
+    unsigned frames;        // 差异帧数
+    bool coalesced;         // 是否进入过合并模式
+};
+
+// 与forward_terminal相同，但输出洪水时改为按帧率合并重绘
+// 平时原样转发（同时送入屏幕模型）；一个帧间隔内读到超过一屏的数据，或终端积压超过一屏时，
+// 丢弃积压、整屏重绘，之后每帧只发送差异，终端来不及接收时跳过中间帧，直到主端关闭。
+// 主端总是尽快读空，命令不会因终端慢而阻塞，中断后终端最多再收一帧。旁路得到完整的原始输出。
+// 屏幕模型的大小跟随主端的窗口大小。stop_fd通知停止后的处理与forward_terminal相同
+long long forward_terminal_frames(int master, int out_fd, int tap_fd, unsigned fps,
+                                  FastScrollStats* stats = nullptr, int stop_fd = -1);
+
+#endif
+
+#endif
@@ -0,0 +1,888 @@
+#include "history.h"
+#include <cstring>
+#include <cstddef>
+#include <algorithm>
+#include <unordered_set>
+
+#ifdef __linux__
+#include <cerrno>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+#define HISTORY_MAGIC "SHHIST01"
+
+static const size_t HEADER_SIZE = 64;           // 文件头长度，之后是第一条记录
+static const size_t MEMORY_CAPACITY = 256;      // 内存模式的初始长度，之后按倍增长
+static const size_t FILE_CAPACITY = 64 * 1024;  // 新建文件的初始长度
+static const size_t ERASE_INTERVAL = 256;       // ERASE_ALL模式下每追加这么多条整理一次
+
+// 文件头，end为已提交的日志末尾，追加记录后以一次8字节对齐写入更新
+struct HistoryHeader {
+    char magic[8];
+    uint64_t end;
+};
+
+// 记录：头部、内容（补齐到4字节）、尾部长度
+struct RecordHead {
+    uint32_t length;
+    uint32_t seq;       // 序号，条数由首尾两条的序号相减得到
+    uint32_t checksum;
+};
+
+static size_t record_size(size_t length) {
+    return sizeof(RecordHead) + ((length + 3) & ~(size_t)3) + sizeof(uint32_t);
+}
+
+static uint32_t record_checksum(const char* data, size_t length, uint32_t seq) {
+    // FNV-1a
+    uint32_t hash = 2166136261u ^ seq;
+    for (size_t i = 0; i < length; i++) {
+        hash = (hash ^ (unsigned char)data[i]) * 16777619u;
+    }
+    return hash;
+}
+
+static uint32_t trailer_at(const char* base, size_t end) {
+    uint32_t length;
+    memcpy(&length, base + end - sizeof(uint32_t), sizeof(length));
+    return length;
+}
+
+static void put_record(char* dst, const char* data, size_t length, uint32_t seq) {
+    RecordHead head = {(uint32_t)length, seq, record_checksum(data, length, seq)};
+    size_t size = record_size(length);
+    memcpy(dst, &head, sizeof(head));
+    memcpy(dst + sizeof(head), data, length);
+    memset(dst + sizeof(head) + length, 0, size - sizeof(head) - length - sizeof(uint32_t));
+    memcpy(dst + size - sizeof(uint32_t), &head.length, sizeof(uint32_t));
+}
+
+static void put_header(char* dst, uint64_t end) {
+    HistoryHeader header;
+    memcpy(header.magic, HISTORY_MAGIC, sizeof(header.magic));
+    header.end = end;
+    memset(dst, 0, HEADER_SIZE);
+    memcpy(dst, &header, sizeof(header));
+}
+
+// 从日志[HEADER_SIZE, end)中按选项挑出保留的记录，写成一份新的日志（序号从0开始）
+static void build_compacted(const char* base, size_t end, const HistoryOptions& options,
+                            std::vector<char>& out, uint32_t& next_seq) {
+    std::vector<size_t> kept;  // 从新到旧
+    std::unordered_set<std::string> seen;
+    const char* last_text = nullptr;
+    size_t last_length = 0;
+    size_t pos = end;
+    size_t total = HEADER_SIZE;
+    while (pos > HEADER_SIZE && (options.max_entries == 0 || kept.size() < options.max_entries)) {
+        pos -= record_size(trailer_at(base, pos));
+        const RecordHead* head = (const RecordHead*)(base + pos);
+        const char* text = base + pos + sizeof(RecordHead);
+        if (options.dedup == HistoryOptions::ERASE_ALL) {
+            if (!seen.insert(std::string(text, head->length)).second) continue;
+        } else if (options.dedup == HistoryOptions::IGNORE_CONSECUTIVE && last_text &&
+                   last_length == head->length && memcmp(last_text, text, last_length) == 0) {
+            continue;
+        }
+        last_text = text;
+        last_length = head->length;
+        kept.push_back(pos);
+        total += record_size(head->length);
+    }
+
+    out.assign(total, 0);
+    put_header(out.data(), total);
+    size_t offset = HEADER_SIZE;
+    next_seq = 0;
+    for (auto it = kept.rbegin(); it != kept.rend(); ++it) {
+        const RecordHead* head = (const RecordHead*)(base + *it);
+        put_record(out.data() + offset, base + *it + sizeof(RecordHead), head->length, next_seq++);
+        offset += record_size(head->length);
+    }
+}
+
+const size_t HistoryStore::npos;
+
+HistoryStore::HistoryStore(const HistoryOptions& options, std::pmr::memory_resource* resource) :
+    options(options),
+    memory(resource),
+    base(nullptr),
+    capacity(0),
+    view_end(HEADER_SIZE),
+    appends(0),
+    compactions(0),
+    fd(-1),
+    compact_done(false),
+    compact_ok(false),
+    compact_snapshot(0),
+    compact_size(0),
+    compact_seq(0),
+    compact_dev(0),
+    compact_ino(0) {
+    memory.assign(MEMORY_CAPACITY, 0);
+    put_header(memory.data(), HEADER_SIZE);
+    base = memory.data();
+    capacity = memory.size();
+}
+
+HistoryStore::~HistoryStore() {
+    wait_compaction();
+    close_file();
+}
+
+size_t HistoryStore::begin() const {
+    return HEADER_SIZE;
+}
+
+size_t HistoryStore::next(size_t pos) const {
+    if (pos >= view_end) return view_end;
+    return pos + record_size(((const RecordHead*)(base + pos))->length);
+}
+
+size_t HistoryStore::prev(size_t pos) const {
+    if (pos <= HEADER_SIZE || pos > view_end) return npos;
+    return pos - record_size(trailer_at(base, pos));
+}
+
+const char* HistoryStore::text(size_t pos, size_t& length) const {
+    length = ((const RecordHead*)(base + pos))->length;
+    return base + pos + sizeof(RecordHead);
+}
+
+std::string HistoryStore::at(size_t pos) const {
+    size_t length;
+    const char* data = text(pos, length);
+    return std::string(data, length);
+}
+
+size_t HistoryStore::size() const {
+    if (view_end == HEADER_SIZE) return 0;
+    const RecordHead* first = (const RecordHead*)(base + HEADER_SIZE);
+    const RecordHead* last = (const RecordHead*)(base + prev(view_end));
+    return (size_t)(last->seq - first->seq) + 1;
+}
+
+bool HistoryStore::valid_record(size_t pos, size_t limit) const {
+    if (pos < HEADER_SIZE || pos + sizeof(RecordHead) > limit) return false;
+    const RecordHead* head = (const RecordHead*)(base + pos);
+    if (head->length > limit - pos) return false;
+    size_t size = record_size(head->length);
+    if (pos + size > limit || trailer_at(base, pos + size) != head->length) return false;
+    return record_checksum(base + pos + sizeof(RecordHead), head->length, head->seq) == head->checksum;
+}
+
+// 文件头中的提交位置不可信时，从头逐条校验找到最后一条完整的记录
+size_t HistoryStore::recover() {
+    size_t pos = HEADER_SIZE;
+    while (valid_record(pos, capacity)) {
+        pos += record_size(((const RecordHead*)(base + pos))->length);
+    }
+    return pos;
+}
+
+void HistoryStore::write_record(size_t pos, const char* data, size_t length, uint32_t seq) {
+    put_record(base + pos, data, length, seq);
+}
+
+bool HistoryStore::ensure_capacity(size_t need) {
+    if (need <= capacity) return true;
+    size_t size = capacity * 2;
+    while (size < need) size *= 2;
+
+    if (fd < 0) {
+        memory.resize(size);
+        base = memory.data();
+        capacity = size;
+        return true;
+    }
+#ifdef __linux__
+    // 其他shell可能已经把文件扩得更大，不能截短
+    struct stat st;
+    if (fstat(fd, &st) != 0) return false;
+    if ((size_t)st.st_size > size) size = st.st_size;
+    if ((size_t)st.st_size < size && ftruncate(fd, size) != 0) return false;
+    void* addr = mremap(base, capacity, size, MREMAP_MAYMOVE);
+    if (addr == MAP_FAILED) return false;
+    base = (char*)addr;
+    capacity = size;
+    return true;
+#else
+    return false;
+#endif
+}
+
+bool HistoryStore::append(std::string_view line) {
+    if (compact_done.load(std::memory_order_acquire)) {
+        finish_compaction();
+    }
+    lock();
+
+    if (options.dedup != HistoryOptions::KEEP_ALL && view_end > HEADER_SIZE) {
+        size_t length;
+        const char* last = text(prev(view_end), length);
+        if (length == line.length() && memcmp(last, line.data(), length) == 0) {
+            unlock();
+            return false;
+        }
+    }
+
+    uint32_t seq = 0;
+    if (view_end > HEADER_SIZE) {
+        seq = ((const RecordHead*)(base + prev(view_end)))->seq + 1;
+    }
+    size_t size = record_size(line.length());
+    if (!ensure_capacity(view_end + size)) {
+        unlock();
+        return false;
+    }
+    write_record(view_end, line.data(), line.length(), seq);
+    view_end += size;
+    // 记录写完后才提交，崩溃时最多丢失这一条
+    __atomic_store_n(&((HistoryHeader*)base)->end, (uint64_t)view_end, __ATOMIC_RELEASE);
+    unlock();
+
+    appends++;
+    bool over_limit = options.max_entries > 0 &&
+                      this->size() > options.max_entries + options.max_entries / 4;
+    bool erase_due = options.dedup == HistoryOptions::ERASE_ALL && appends >= ERASE_INTERVAL;
+    if ((over_limit || erase_due) && !compactor.joinable()) {
+        start_compaction();
+    }
+    return true;
+}
+
+void HistoryStore::start_compaction() {
+    if (fd < 0) {
+        // 内存模式直接整理
+        std::vector<char> out;
+        uint32_t next_seq;
+        build_compacted(base, view_end, options, out, next_seq);
+        view_end = out.size();
+        if (out.size() < MEMORY_CAPACITY) out.resize(MEMORY_CAPACITY);
+        memory.assign(out.begin(), out.end());
+        base = memory.data();
+        capacity = memory.size();
+        appends = 0;
+        compactions++;
+        return;
+    }
+#ifdef __linux__
+    // 新文件用mkstemp在同一目录下创建（rename不跨文件系统），共用历史文件的多个shell
+    // 同时整理时各写各的文件，不会互相截断或删除
+    struct stat st;
+    if (fstat(fd, &st) != 0) return;
+    std::string tmp = path + ".compactXXXXXX";
+    int out_fd = mkostemp(&tmp[0], O_CLOEXEC);
+    if (out_fd < 0) return;
+    compact_path = tmp;
+    compact_dev = st.st_dev;
+    compact_ino = st.st_ino;
+
+    // 快照之前的日志不会再改变，后台线程用自己的只读映射读取，不受主线程扩容影响
+    compact_snapshot = view_end;
+    compact_ok = false;
+    compact_done.store(false);
+    int src = fd;
+    size_t snapshot = view_end;
+    HistoryOptions opts = options;
+    compactor = std::thread([this, src, snapshot, out_fd, opts]() {
+        void* addr = mmap(nullptr, snapshot, PROT_READ, MAP_SHARED, src, 0);
+        if (addr != MAP_FAILED) {
+            std::vector<char> out;
+            uint32_t next_seq;
+            build_compacted((const char*)addr, snapshot, opts, out, next_seq);
+            munmap(addr, snapshot);
+
+            bool ok = true;
+            for (size_t done = 0; ok && done < out.size();) {
+                ssize_t n = write(out_fd, out.data() + done, out.size() - done);
+                if (n < 0 && errno == EINTR) continue;
+                ok = n > 0;
+                if (ok) done += n;
+            }
+            ok = ok && fsync(out_fd) == 0;
+            compact_size = out.size();
+            compact_seq = next_seq;
+            compact_ok = ok;
+        }
+        close(out_fd);
+        compact_done.store(true, std::memory_order_release);
+    });
+#endif
+}
+
+void HistoryStore::finish_compaction() {
+    if (!compactor.joinable()) return;
+    compactor.join();
+    compact_done.store(false);
+#ifdef __linux__
+    if (!compact_ok || fd < 0 || !lock()) {
+        discard_compaction();
+        return;
+    }
+    // 持锁后再确认历史文件仍是整理所依据的那个：其他shell先换入了新文件时（lock已改用
+    // 新文件），本次整理作废。换入文件的shell同样持有这个锁，检查之后到rename之前不会变
+    struct stat current, mapped;
+    if (stat(path.c_str(), &current) != 0 || fstat(fd, &mapped) != 0 ||
+        (uint64_t)current.st_dev != compact_dev || (uint64_t)current.st_ino != compact_ino ||
+        current.st_dev != mapped.st_dev || current.st_ino != mapped.st_ino ||
+        view_end < compact_snapshot) {
+        discard_compaction();
+        unlock();
+        return;
+    }
+
+    // 整理期间追加的记录（包括其他shell追加的）接到新文件末尾
+    std::vector<char> delta;
+    for (size_t pos = compact_snapshot; pos < view_end; pos = next(pos)) {
+        size_t length;
+        const char* data = text(pos, length);
+        size_t offset = delta.size();
+        delta.resize(offset + record_size(length));
+        put_record(delta.data() + offset, data, length, compact_seq++);
+    }
+    int out_fd = ::open(compact_path.c_str(), O_WRONLY | O_CLOEXEC);
+    uint64_t end = compact_size + delta.size();
+    bool ok = out_fd >= 0 &&
+              pwrite(out_fd, delta.data(), delta.size(), compact_size) == (ssize_t)delta.size() &&
+              pwrite(out_fd, &end, sizeof(end), offsetof(HistoryHeader, end)) == sizeof(end) &&
+              fsync(out_fd) == 0;
+    if (out_fd >= 0) close(out_fd);
+
+    // rename是原子的，崩溃时文件要么是旧日志要么是完整的新日志
+    if (!ok || rename(compact_path.c_str(), path.c_str()) != 0) {
+        discard_compaction();
+        unlock();
+        return;
+    }
+    compact_path.clear();
+    // 关闭旧文件同时释放锁，等待中的其他shell发现文件已替换后重新打开
+    std::string file = path;
+    close_file();
+    open(file);
+    appends = 0;
+#endif
+}
+
+// 删除未换入的新文件
+void HistoryStore::discard_compaction() {
+#ifdef __linux__
+    if (!compact_path.empty()) {
+        unlink(compact_path.c_str());
+        compact_path.clear();
+    }
+#endif
+}
+
+void HistoryStore::wait_compaction() {
+    if (compactor.joinable()) {
+        finish_compaction();
+    }
+}
+
+bool HistoryStore::lock() {
+#ifdef __linux__
+    while (fd >= 0) {
+        while (flock(fd, LOCK_EX) != 0) {
+            if (errno != EINTR) return false;
+        }
+        // 其他shell整理后替换了文件，改用新文件
+        struct stat current, mapped;
+        if (stat(path.c_str(), &current) == 0 && fstat(fd, &mapped) == 0 &&
+            (current.st_ino != mapped.st_ino || current.st_dev != mapped.st_dev)) {
+            if (compactor.joinable()) {
+                compactor.join();
+                compact_done.store(false);
+                discard_compaction();
+            }
+            // open使整理次数加一，之前取得的位置和建立的索引随之失效
+            std::string file = path;
+            close_file();
+            if (!open(file)) return false;
+            continue;
+        }
+
+        // 接上其他shell追加的记录
+        uint64_t end = __atomic_load_n(&((HistoryHeader*)base)->end, __ATOMIC_ACQUIRE);
+        if (end > capacity) {
+            map_file();
+        }
+        if (end > view_end && end <= capacity) {
+            view_end = end;
+        }
+        return true;
+    }
+#endif
+    return fd < 0;
+}
+
+void HistoryStore::unlock() {
+#ifdef __linux__
+    if (fd >= 0) {
+        flock(fd, LOCK_UN);
+    }
+#endif
+}
+
+bool HistoryStore::map_file() {
+#ifdef __linux__
+    struct stat st;
+    if (fstat(fd, &st) != 0) return false;
+    void* addr = mmap(nullptr, st.st_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (addr == MAP_FAILED) return false;
+    if (base && base != memory.data()) {
+        munmap(base, capacity);
+    }
+    base = (char*)addr;
+    capacity = st.st_size;
+    return true;
+#else
+    return false;
+#endif
+}
+
+void HistoryStore::close_file() {
+#ifdef __linux__
+    if (fd < 0) return;
+    if (base && base != memory.data()) {
+        munmap(base, capacity);
+    }
+    close(fd);
+    fd = -1;
+#endif
+    memory.assign(MEMORY_CAPACITY, 0);
+    put_header(memory.data(), HEADER_SIZE);
+    base = memory.data();
+    capacity = memory.size();
+    view_end = HEADER_SIZE;
+}
+
+bool HistoryStore::open(const std::string& file) {
+#ifdef __linux__
+    if (compactor.joinable()) {
+        compactor.join();
+        compact_done.store(false);
+        discard_compaction();
+    }
+    close_file();
+    path = file;
+    appends = 0;
+    // 换了文件（包括整理后换入的），之前的位置全部失效
+    compactions++;
+
+    fd = ::open(file.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0600);
+    if (fd < 0) return false;
+    while (flock(fd, LOCK_EX) != 0 && errno == EINTR) {
+    }
+
+    // 新文件：写入文件头并预留空间
+    struct stat st;
+    bool ok = fstat(fd, &st) == 0;
+    if (ok && st.st_size == 0) {
+        char header[HEADER_SIZE];
+        put_header(header, HEADER_SIZE);
+        ok = ftruncate(fd, FILE_CAPACITY) == 0 &&
+             pwrite(fd, header, HEADER_SIZE, 0) == (ssize_t)HEADER_SIZE;
+    } else if (ok && (size_t)st.st_size < HEADER_SIZE) {
+        ok = false;
+    }
+
+    // 映射后只校验文件头和最后一条记录，启动时间与条数无关
+    char* memory_base = base;
+    ok = ok && map_file();
+    if (ok && memcmp(base, HISTORY_MAGIC, 8) != 0) {
+        ok = false;
+    }
+    if (!ok) {
+        if (base != memory_base) {
+            munmap(base, capacity);
+            base = memory_base;
+            capacity = memory.size();
+        }
+        close(fd);
+        fd = -1;
+        return false;
+    }
+
+    HistoryHeader* header = (HistoryHeader*)base;
+    size_t end = header->end;
+    bool consistent = end >= HEADER_SIZE && end <= capacity;
+    if (consistent && end > HEADER_SIZE) {
+        size_t length = trailer_at(base, end);
+        consistent = length < end && record_size(length) <= end - HEADER_SIZE &&
+                     valid_record(end - record_size(length), end);
+    }
+    if (!consistent) {
+        end = recover();
+        __atomic_store_n(&header->end, (uint64_t)end, __ATOMIC_RELEASE);
+    }
+    view_end = end;
+    flock(fd, LOCK_UN);
+    return true;
+#else
+    (void)file;
+    return false;
+#endif
+}
+
+// 每次查询最多补入子串索引的记录数，约0.3毫秒，保证按键延迟在1毫秒以内
+static const size_t HISTORY_INDEX_BUDGET = 256;
+
+HistoryIndex::HistoryIndex() :
+    low(HistoryStore::npos),
+    high(HistoryStore::npos),
+    compactions(0),
+    build_done(false),
+    build_cancel(false),
+    built_low(HistoryStore::npos) {
+}
+
+HistoryIndex::~HistoryIndex() {
+    stop_build();
+}
+
+void HistoryIndex::clear() {
+    stop_build();
+    newer.clear();
+    older.clear();
+    low = high = HistoryStore::npos;
+}
+
+void HistoryIndex::stop_build() {
+    if (!builder.joinable()) return;
+    build_cancel = true;
+    builder.join();
+    built = Segment();
+}
+
+void HistoryIndex::build(const HistoryStore& store) {
+    clear();
+    sync(store);
+    // 复制现有记录的原文，建立线程不访问日志：追加时日志可能重新映射
+    std::vector<size_t> positions;
+    std::vector<size_t> offsets;
+    std::string texts;
+    for (size_t pos = store.prev(low); pos != HistoryStore::npos; pos = store.prev(pos)) {
+        size_t length;
+        const char* text = store.text(pos, length);
+        positions.push_back(pos);
+        offsets.push_back(texts.size());
+        texts.append(text, length);
+    }
+    if (positions.empty()) return;
+    offsets.push_back(texts.size());
+    built_low = positions.back();
+    build_done = false;
+    build_cancel = false;
+    builder = std::thread([this, positions = std::move(positions), offsets = std::move(offsets),
+                           texts = std::move(texts)]() {
+        for (size_t i = 0; i < positions.size(); i++) {
+            if (i % 1024 == 0 && build_cancel.load(std::memory_order_relaxed)) return;
+            built.add(texts.data() + offsets[i], offsets[i + 1] - offsets[i], positions[i]);
+        }
+        build_done.store(true, std::memory_order_release);
+    });
+}
+
+void HistoryIndex::wait_build() {
+    adopt_build(true);
+}
+
+// 后台建立完成后换入，它与查询期间逐批补入的部分起点相同、覆盖全部更早的记录
+void HistoryIndex::adopt_build(bool wait) {
+    if (!builder.joinable() || (!wait && !build_done.load(std::memory_order_acquire))) return;
+    builder.join();
+    older = std::move(built);
+    built = Segment();
+    low = built_low;
+}
+
+void HistoryIndex::Segment::clear() {
+    positions.clear();
+    for (auto& row : bigrams) {
+        for (auto& list : row) {
+            list.clear();
+        }
+    }
+    trigrams.clear();
+}
+
+void HistoryIndex::Segment::add(const char* text, size_t length, size_t pos) {
+    if (bigrams.empty()) {
+        bigrams.resize(256);
+    }
+    // 同一条记录中重复的n元组只记一次，表尾就是当前序号
+    uint32_t id = positions.size();
+    for (size_t i = 0; i < length; i++) {
+        std::vector<std::vector<uint32_t>>& row = bigrams[(unsigned char)text[i]];
+        if (row.empty()) row.resize(256);
+        std::vector<uint32_t>& list = row[i + 1 < length ? (unsigned char)text[i + 1] : 0];
+        if (list.empty() || list.back() != id) list.push_back(id);
+    }
+    for (size_t i = 0; i + 2 < length; i++) {
+        uint32_t key = ((unsigned char)text[i] << 16) | ((unsigned char)text[i + 1] << 8) |
+                       (unsigned char)text[i + 2];
+        std::vector<uint32_t>& list = trigrams[key];
+        if (list.empty() || list.back() != id) list.push_back(id);
+    }
+    positions.push_back(pos);
+}
+
+void HistoryIndex::sync(const HistoryStore& store) {
+    // 整理后日志位置全部改变
+    if (store.compaction_count() != compactions || (high != HistoryStore::npos && high > store.end())) {
+        clear();
+        compactions = store.compaction_count();
+    }
+    if (high == HistoryStore::npos) {
+        // 从日志末尾开始，更早的记录查询时再补
+        low = high = store.end();
+        return;
+    }
+    adopt_build(false);
+    for (; high != store.end(); high = store.next(high)) {
+        size_t length;
+        const char* text = store.text(high, length);
+        newer.add(text, length, high);
+    }
+}
+
+// 向更早的记录补入最多count条，直到已索引区间的起点不大于until，返回补入的条数
+size_t HistoryIndex::backfill(const HistoryStore& store, size_t count, size_t until) {
+    size_t added = 0;
+    for (; added < count && low > until; added++) {
+        low = store.prev(low);
+        size_t length;
+        const char* text = store.text(low, length);
+        older.add(text, length, low);
+    }
+    return added;
+}
+
+void HistoryIndex::extend(const HistoryStore& store) {
+    if (low == HistoryStore::npos) return;
+    adopt_build(false);
+    backfill(store, HISTORY_INDEX_BUDGET, store.begin());
+}
+
+bool HistoryIndex::Segment::matches(const HistoryStore& store, uint32_t id,
+                                    std::string_view query) const {
+    size_t length;
+    const char* text = store.text(positions[id], length);
+    return std::search(text, text + length, query.begin(), query.end()) != text + length;
+}
+
+size_t HistoryIndex::Segment::search(const HistoryStore& store, std::string_view query, size_t limit,
+                                     bool backward, bool descending) const {
+    if (positions.empty()) return HistoryStore::npos;
+    // 序号区间[0, bound)为位置小于limit（descending时为不小于limit）的记录，
+    // down为true时取其中最大的序号，否则取[bound, n)中最小的
+    uint32_t bound;
+    if (descending) {
+        bound = std::partition_point(positions.begin(), positions.end(),
+                                     [limit](size_t pos) { return pos >= limit; }) - positions.begin();
+    } else {
+        bound = std::lower_bound(positions.begin(), positions.end(), limit) - positions.begin();
+    }
+    bool down = backward != descending;
+
+    // 在一个倒排表中取区间内最近的序号，没有时返回false
+    auto nearest = [&](const std::vector<uint32_t>& list, uint32_t& id) {
+        auto it = std::lower_bound(list.begin(), list.end(), bound);
+        if (down) {
+            if (it == list.begin()) return false;
+            id = *(it - 1);
+        } else {
+            if (it == list.end()) return false;
+            id = *it;
+        }
+        return true;
+    };
+
+    const unsigned char* q = (const unsigned char*)query.data();
+    bool found = false;
+    uint32_t best = 0;
+    if (query.length() <= 2) {
+        // 二元组命中即为子串命中；单个字符取以它开头的全部二元组中最近的一个
+        const std::vector<std::vector<uint32_t>>& row = bigrams[q[0]];
+        if (row.empty()) return HistoryStore::npos;
+        unsigned first = query.length() == 2 ? q[1] : 0;
+        unsigned last = query.length() == 2 ? q[1] : 255;
+        for (unsigned key = first; key <= last; key++) {
+            uint32_t id;
+            if (!nearest(row[key], id)) continue;
+            if (!found || (down ? id > best : id < best)) best = id;
+            found = true;
+        }
+        return found ? positions[best] : HistoryStore::npos;
+    }
+
+    // 查询中每个三元组都必须出现，任何一个没有倒排表就不可能命中
+    std::vector<const std::vector<uint32_t>*> lists;
+    for (size_t i = 0; i + 2 < query.length(); i++) {
+        auto it = trigrams.find((q[i] << 16) | (q[i + 1] << 8) | q[i + 2]);
+        if (it == trigrams.end()) return HistoryStore::npos;
+        lists.push_back(&it->second);
+    }
+    std::sort(lists.begin(), lists.end(),
+              [](const std::vector<uint32_t>* a, const std::vector<uint32_t>* b) {
+                  return a->size() < b->size();
+              });
+
+    // 沿最短的倒排表取候选，先用其余倒排表过滤，再核对原文（三元组都出现不保证相邻）
+    const std::vector<uint32_t>& shortest = *lists[0];
+    auto it = std::lower_bound(shortest.begin(), shortest.end(), bound);
+    while (down ? it != shortest.begin() : it != shortest.end()) {
+        uint32_t id = down ? *--it : *it++;
+        bool candidate = true;
+        for (size_t i = 1; i < lists.size() && candidate; i++) {
+            candidate = std::binary_search(lists[i]->begin(), lists[i]->end(), id);
+        }
+        if (candidate && matches(store, id, query)) {
+            return positions[id];
+        }
+    }
+    return HistoryStore::npos;
+}
+
+size_t HistoryIndex::search(const HistoryStore& store, std::string_view query, size_t limit,
+                            bool backward) {
+    if (query.empty() || low == HistoryStore::npos) return HistoryStore::npos;
+    adopt_build(false);
+    size_t budget = HISTORY_INDEX_BUDGET;
+    if (!backward && limit < low) {
+        // 起点之后尚未索引的记录比已索引的都早，先补到起点
+        budget -= backfill(store, budget, limit);
+        if (limit < low) return HistoryStore::npos;
+    }
+    size_t found;
+    if (backward) {
+        found = newer.search(store, query, limit, true, false);
+        if (found == HistoryStore::npos) found = older.search(store, query, limit, true, true);
+        if (found == HistoryStore::npos && budget > 0 && low != store.begin()) {
+            backfill(store, budget, store.begin());
+            found = older.search(store, query, limit, true, true);
+        }
+    } else {
+        found = older.search(store, query, limit, false, true);
+        if (found == HistoryStore::npos) found = newer.search(store, query, limit, false, false);
+    }
+    return found;
+}
+
+size_t HistoryIndex::search_backward(const HistoryStore& store, std::string_view query, size_t limit) {
+    return search(store, query, limit, true);
+}
+
+size_t HistoryIndex::search_forward(const HistoryStore& store, std::string_view query, size_t limit) {
+    return search(store, query, limit, false);
+}
+
+// 每次查询最多补入前缀索引的记录数，保证按键延迟有上限
+static const size_t PREFIX_INDEX_BUDGET = 16384;
+
+HistoryPrefixIndex::HistoryPrefixIndex() :
+    low(HistoryStore::npos),
+    high(HistoryStore::npos),
+    compactions(0) {
+    clear();
+}
+
+void HistoryPrefixIndex::clear() {
+    nodes.assign(1, Node{0, 0, 0, {}});
+    low = high = HistoryStore::npos;
+}
+
+void HistoryPrefixIndex::sync(const HistoryStore& store) {
+    if (store.compaction_count() != compactions || (high != HistoryStore::npos && high > store.end())) {
+        clear();
+        compactions = store.compaction_count();
+    }
+    if (high == HistoryStore::npos) {
+        // 从日志末尾开始，更早的记录查询时再补
+        low = high = store.end();
+        return;
+    }
+    for (; high != store.end(); high = store.next(high)) {
+        insert(store, high);
+    }
+}
+
+void HistoryPrefixIndex::insert(const HistoryStore& store, size_t pos) {
+    size_t length;
+    const char* text = store.text(pos, length);
+    uint32_t node = 0;
+    size_t i = 0;
+    while (true) {
+        if (pos > nodes[node].latest) nodes[node].latest = pos;
+        if (i == length) return;
+
+        unsigned char c = text[i];
+        auto& children = nodes[node].children;
+        auto it = std::lower_bound(children.begin(), children.end(), std::make_pair(c, (uint32_t)0));
+        if (it == children.end() || it->first != c) {
+            uint32_t leaf = nodes.size();
+            children.insert(it, {c, leaf});
+            nodes.push_back(Node{pos, (uint32_t)i, (uint32_t)(length - i), {}});
+            return;
+        }
+
+        uint32_t child = it->second;
+        size_t label_length;
+        const char* label = store.text(nodes[child].latest, label_length) + nodes[child].depth;
+        size_t k = 0;
+        while (k < nodes[child].length && i + k < length && label[k] == text[i + k]) k++;
+        if (k < nodes[child].length) {
+            // 在边的中间分叉（或记录在此结束），拆成两段
+            uint32_t middle = nodes.size();
+            Node split{nodes[child].latest, nodes[child].depth, (uint32_t)k, {}};
+            split.children.push_back({(unsigned char)label[k], child});
+            it->second = middle;
+            nodes[child].depth += k;
+            nodes[child].length -= k;
+            nodes.push_back(std::move(split));
+            child = middle;
+        }
+        node = child;
+        i += k;
+    }
+}
+
+size_t HistoryPrefixIndex::find(const HistoryStore& store, std::string_view prefix) const {
+    uint32_t node = 0;
+    size_t i = 0;
+    while (i < prefix.length()) {
+        const auto& children = nodes[node].children;
+        unsigned char c = prefix[i];
+        auto it = std::lower_bound(children.begin(), children.end(), std::make_pair(c, (uint32_t)0));
+        if (it == children.end() || it->first != c) return HistoryStore::npos;
+
+        node = it->second;
+        size_t label_length;
+        const char* label = store.text(nodes[node].latest, label_length) + nodes[node].depth;
+        for (size_t k = 0; k < nodes[node].length && i < prefix.length(); k++, i++) {
+            if (label[k] != prefix[i]) return HistoryStore::npos;
+        }
+    }
+    return nodes[node].latest;
+}
+
+size_t HistoryPrefixIndex::lookup(const HistoryStore& store, std::string_view prefix) {
+    if (prefix.empty() || low == HistoryStore::npos) return HistoryStore::npos;
+    size_t found = find(store, prefix);
+    size_t budget = PREFIX_INDEX_BUDGET;
+    while (found == HistoryStore::npos && low != store.begin() && budget > 0) {
+        // 向更早的记录补一批，批量不宜太小，否则每批都要重新查找
+        for (size_t batch = std::min(budget, (size_t)1024); batch > 0 && low != store.begin(); batch--) {
+            low = store.prev(low);
+            insert(store, low);
+            budget--;
+        }
+        found = find(store, prefix);
+    }
+    return found;
+}
@@ -0,0 +1,207 @@
+#ifndef _HISTORY_H_
+#define _HISTORY_H_
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <memory_resource>
+#include <atomic>
+#include <thread>
+#include <unordered_map>
+#include <cstdint>
+#include <cstddef>
+
+// 历史记录选项
+struct HistoryOptions {
+    // 重复命令的处理方式
+    enum Dedup {
+        KEEP_ALL,           // 全部保留
+        IGNORE_CONSECUTIVE, // 与上一条相同时不记录（bash的ignoredups）
+        ERASE_ALL           // 另外在整理时删除较早的重复项（bash的erasedups）
+    };
+
+    size_t max_entries = 100000;    // 保留的最大条数，0表示不限
+    Dedup dedup = IGNORE_CONSECUTIVE;
+};
+
+// 历史记录存储
+// 数据是只追加的日志：文件头之后依次存放记录，每条记录首尾都有长度，可以从任意
+// 一条向前或向后走，不需要偏移数组。打开文件时只映射并校验最后一条记录，与条数无关。
+// 用位置（记录在日志中的偏移）访问记录，end()表示最后一条之后，即新输入的命令行。
+//
+// 追加时先写入记录再更新文件头中的提交位置，中途崩溃只会丢失未提交的一条。
+// 条数超过上限时在后台线程把保留的记录写入新文件，完成后在下一次追加时换入，
+// 整理会使之前取得的位置失效。未打开文件（或非Linux平台）时记录只保存在内存中。
+class HistoryStore {
+public:
+    static const size_t npos = (size_t)-1;
+
+    // 内存模式的日志从resource分配（多会话服务中由会话所在工作线程的内存池提供）
+    explicit HistoryStore(const HistoryOptions& options = HistoryOptions(),
+                          std::pmr::memory_resource* resource = std::pmr::get_default_resource());
+    ~HistoryStore();
+
+    // 打开（不存在时创建）历史文件，已有的内存记录被替换；失败返回false，仍可在内存中使用
+    bool open(const std::string& path);
+
+    // 追加一条记录，按去重规则被忽略时返回false
+    bool append(std::string_view line);
+
+    size_t size() const;
+    bool empty() const { return view_end == begin(); }
+
+    // 遍历：begin()为最早的记录，prev在最早的记录上返回npos
+    size_t begin() const;
+    size_t end() const { return view_end; }
+    size_t next(size_t pos) const;
+    size_t prev(size_t pos) const;
+
+    // 记录内容，直接指向映射区，在下一次append之前有效
+    const char* text(size_t pos, size_t& length) const;
+    std::string at(size_t pos) const;
+
+    // 等待进行中的整理完成并换入
+    void wait_compaction();
+    // 日志被替换的次数（整理、打开或改用其他shell换入的文件），变化后之前取得的位置失效
+    unsigned long compaction_count() const { return compactions; }
+
+private:
+    HistoryOptions options;
+    std::pmr::vector<char> memory;  // 内存模式下的日志
+    char* base;                     // 日志起始地址（映射区或memory）
+    size_t capacity;                // 可用长度
+    size_t view_end;                // 已提交的日志末尾
+    size_t appends;                 // 上次整理后追加的条数
+    unsigned long compactions;
+    std::string path;
+    int fd;                         // 历史文件，-1表示内存模式
+
+    // 后台整理
+    std::thread compactor;
+    std::atomic<bool> compact_done;
+    bool compact_ok;
+    size_t compact_snapshot;        // 整理开始时的日志末尾
+    size_t compact_size;            // 新文件中已写入的长度
+    uint32_t compact_seq;           // 新文件中下一条记录的序号
+    std::string compact_path;       // 新文件，与历史文件同目录、各shell不同名
+    uint64_t compact_dev;           // 整理所依据的历史文件
+    uint64_t compact_ino;
+
+    bool ensure_capacity(size_t need);
+    void write_record(size_t pos, const char* data, size_t length, uint32_t seq);
+    bool valid_record(size_t pos, size_t limit) const;
+    size_t recover();
+    void start_compaction();
+    void finish_compaction();
+    void discard_compaction();
+    void close_file();
+    bool map_file();
+    bool lock();
+    void unlock();
+};
+
+// 历史记录的子串搜索索引（Ctrl-R/Ctrl-S）
+// 按记录序号建立二元组和三元组的倒排表，表内序号递增：一到两个字符的查询直接在
+// 倒排表上二分查找，更长的查询沿最短的三元组倒排表向前或向后取候选再核对原文。
+// 与HistoryPrefixIndex一样从最新的记录向更早的记录逐步建立：第一次sync时的日志末尾把
+// 索引分为两段，之后追加的记录按时间顺序编号，更早的记录查询时按时间倒序补入，每次查询
+// 补索引的记录数有上限。已索引的总是最新的一段，向后查找在其中找到的匹配就是全部记录中
+// 最近的；找不到（或向前查找的起点尚未索引）时返回npos，由complete()区分是否确实没有。
+// 打开历史文件后可以用build在后台线程为已有的记录建立索引，建完后下一次sync、查询或
+// extend时换入，之后的查询不必再补。日志整理后清空重来。
+class HistoryIndex {
+public:
+    HistoryIndex();
+    ~HistoryIndex();
+
+    // 加入新追加的记录，日志整理后清空重来
+    void sync(const HistoryStore& store);
+    void clear();
+
+    // 查找位置小于limit的最后一条包含query的记录，找不到（或本次补索引的预算内未找到）
+    // 返回HistoryStore::npos
+    size_t search_backward(const HistoryStore& store, std::string_view query, size_t limit);
+    // 查找位置不小于limit的第一条包含query的记录
+    size_t search_forward(const HistoryStore& store, std::string_view query, size_t limit);
+
+    // 向更早的记录补索引一批，空闲时调用，使之后的查询不必再补
+    void extend(const HistoryStore& store);
+    // 清空后在后台线程索引现有的全部记录；期间查询照常逐批补入，建完后整段换入
+    void build(const HistoryStore& store);
+    // 等待后台建立完成并换入
+    void wait_build();
+    // 是否已索引全部记录
+    bool complete(const HistoryStore& store) const { return low == store.begin(); }
+    size_t size() const { return newer.positions.size() + older.positions.size(); }
+
+private:
+    // 一段记录的倒排表，序号从0开始：newer中位置随序号递增，older中随序号递减
+    struct Segment {
+        std::vector<size_t> positions;                   // 记录序号到日志位置
+        // 依次以两个字节为下标，行尾的字节与0组成二元组；每一行用到时才分配，第一次查询
+        // 不必一次分配整张表
+        std::vector<std::vector<std::vector<uint32_t>>> bigrams;
+        std::unordered_map<uint32_t, std::vector<uint32_t>> trigrams;
+
+        void clear();
+        void add(const char* text, size_t length, size_t pos);
+        bool matches(const HistoryStore& store, uint32_t id, std::string_view query) const;
+        size_t search(const HistoryStore& store, std::string_view query, size_t limit,
+                      bool backward, bool descending) const;
+    };
+    Segment newer;              // 第一次sync之后追加的记录，[start, high)
+    Segment older;              // 向更早补入的记录，[low, start)
+    size_t low;                 // 已索引区间[low, high)
+    size_t high;
+    unsigned long compactions;  // 建立索引时日志的整理次数
+
+    // 后台建立：built覆盖[built_low, 开始时的日志末尾)，只由建立线程访问，完成后才换入
+    std::thread builder;
+    std::atomic<bool> build_done;
+    std::atomic<bool> build_cancel;
+    Segment built;
+    size_t built_low;
+
+    size_t backfill(const HistoryStore& store, size_t count, size_t until);
+    void adopt_build(bool wait);
+    void stop_build();
+    size_t search(const HistoryStore& store, std::string_view query, size_t limit, bool backward);
+};
+
+// 历史记录的前缀索引（自动提示）
+// 压缩前缀树，边上的字符串不单独保存，而是引用经过该边的记录原文；每个节点记录子树中
+// 最新的记录，查询"以prefix开头的最近一条记录"只需沿prefix走一遍，O(prefix长度)。
+// 索引从最新的记录向更早的记录逐步建立：已索引的总是最新的一段，在其中找到的匹配
+// 就是全部记录中最近的，找不到时每次查询再补索引一批，打开大的历史文件无需预先建立。
+class HistoryPrefixIndex {
+public:
+    HistoryPrefixIndex();
+
+    // 加入新追加的记录，日志整理后清空重来
+    void sync(const HistoryStore& store);
+    void clear();
+
+    // 最近一条以prefix开头的记录，找不到（或本次补索引的预算内未找到）返回HistoryStore::npos
+    size_t lookup(const HistoryStore& store, std::string_view prefix);
+
+    // 是否已索引全部记录
+    bool complete(const HistoryStore& store) const { return low == store.begin(); }
+    size_t node_count() const { return nodes.size(); }
+
+private:
+    struct Node {
+        size_t latest;          // 子树中最新记录的位置，边上的字符串取自这条记录
+        uint32_t depth;         // 边在记录中的起始偏移
+        uint32_t length;        // 边的长度
+        std::vector<std::pair<unsigned char, uint32_t>> children;  // 按首字符排序
+    };
+    std::vector<Node> nodes;    // nodes[0]为根
+    size_t low;                 // 已索引区间[low, high)
+    size_t high;
+    unsigned long compactions;
+
+    void insert(const HistoryStore& store, size_t pos);
+    size_t find(const HistoryStore& store, std::string_view prefix) const;
+};
+
+#endif
@@ -0,0 +1,109 @@
+#include "inputrecord.h"
+#include <cstring>
+
+static const char MAGIC[4] = {'S', 'H', 'I', 'N'};
+static const uint8_t VERSION = 1;
+
+static void put_varint(std::string& out, uint64_t value) {
+    while (value >= 0x80) {
+        out += (char)(value | 0x80);
+        value >>= 7;
+    }
+    out += (char)value;
+}
+
+static bool get_varint(const std::string& in, size_t& pos, uint64_t& value) {
+    value = 0;
+    for (unsigned shift = 0; pos < in.size() && shift < 64; shift += 7) {
+        uint8_t byte = in[pos++];
+        value |= (uint64_t)(byte & 0x7F) << shift;
+        if (!(byte & 0x80)) return true;
+    }
+    return false;
+}
+
+static void encode_event(std::string& out, uint64_t delay_us, const char* data, size_t len) {
+    put_varint(out, delay_us);
+    put_varint(out, len);
+    out.append(data, len);
+}
+
+bool InputRecording::load(const std::string& path) {
+    clear();
+    FILE* file = fopen(path.c_str(), "rb");
+    if (!file) return false;
+    std::string content;
+    char buffer[65536];
+    size_t n;
+    while ((n = fread(buffer, 1, sizeof(buffer), file)) > 0) content.append(buffer, n);
+    fclose(file);
+
+    if (content.size() < 5 || memcmp(content.data(), MAGIC, 4) != 0 || (uint8_t)content[4] != VERSION) {
+        return false;
+    }
+    // 录制中断时最后一个事件可能不完整，丢弃它
+    size_t pos = 5;
+    while (pos < content.size()) {
+        uint64_t delay, length;
+        if (!get_varint(content, pos, delay) || !get_varint(content, pos, length) ||
+            length > content.size() - pos) {
+            break;
+        }
+        append(delay, content.data() + pos, length);
+        pos += length;
+    }
+    return true;
+}
+
+bool InputRecording::save(const std::string& path) const {
+    std::string out(MAGIC, 4);
+    out += (char)VERSION;
+    for (const Event& event : events) encode_event(out, event.delay_us, bytes(event), event.length);
+    FILE* file = fopen(path.c_str(), "wb");
+    if (!file) return false;
+    bool ok = fwrite(out.data(), 1, out.size(), file) == out.size();
+    return fclose(file) == 0 && ok;
+}
+
+void InputRecording::append(uint64_t delay_us, const char* bytes, size_t len) {
+    events.push_back({delay_us, data.size(), len});
+    data.append(bytes, len);
+}
+
+void InputRecording::clear() {
+    events.clear();
+    data.clear();
+}
+
+uint64_t InputRecording::duration_us() const {
+    uint64_t total = 0;
+    for (const Event& event : events) total += event.delay_us;
+    return total;
+}
+
+bool InputRecorder::open(const std::string& path) {
+    close();
+    file = fopen(path.c_str(), "wb");
+    if (!file) return false;
+    fwrite(MAGIC, 1, 4, file);
+    fputc(VERSION, file);
+    fflush(file);
+    last = std::chrono::steady_clock::now();
+    return true;
+}
+
+void InputRecorder::close() {
+    if (file) fclose(file);
+    file = nullptr;
+}
+
+void InputRecorder::record(const char* data, size_t len) {
+    if (!file) return;
+    auto now = std::chrono::steady_clock::now();
+    uint64_t delay = std::chrono::duration_cast<std::chrono::microseconds>(now - last).count();
+    last = now;
+    std::string event;
+    encode_event(event, delay, data, len);
+    fwrite(event.data(), 1, event.size(), file);
+    fflush(file);
+}
@@ -0,0 +1,63 @@
+#ifndef _INPUTRECORD_H_
+#define _INPUTRECORD_H_
+
+#include <string>
+#include <vector>
+#include <cstdio>
+#include <cstdint>
+#include <cstddef>
+#include <chrono>
+
+// 输入录制文件
+// 记录写入kbd_fifo的原始字节和到达间隔，每次写入（一个按键或一次粘贴）是一个事件。
+// 文件格式：文件头"SHIN"和版本号1，之后逐个事件：距上一事件的微秒数、字节数
+// （都是LEB128变长整数）和原始字节。典型的按键事件只占3到4字节
+class InputRecording {
+public:
+    // 一个事件
+    struct Event {
+        uint64_t delay_us;  // 距上一事件（第一个事件为录制开始）的时间
+        size_t offset;      // 在data中的位置
+        size_t length;
+    };
+
+    bool load(const std::string& path);
+    bool save(const std::string& path) const;
+
+    // 追加一个事件，用于生成合成的会话
+    void append(uint64_t delay_us, const char* data, size_t len);
+    void append(uint64_t delay_us, const std::string& data) { append(delay_us, data.data(), data.size()); }
+    void clear();
+
+    size_t size() const { return events.size(); }
+    const Event& event(size_t index) const { return events[index]; }
+    const char* bytes(const Event& event) const { return data.data() + event.offset; }
+    size_t total_bytes() const { return data.size(); }
+    uint64_t duration_us() const;
+
+private:
+    std::vector<Event> events;
+    std::string data;
+};
+
+// 录制器：边输入边追加到文件，每个事件后刷新，进程异常退出时已有的记录仍然完整
+class InputRecorder {
+public:
+    InputRecorder() : file(nullptr) {}
+    ~InputRecorder() { close(); }
+    InputRecorder(const InputRecorder&) = delete;
+    InputRecorder& operator=(const InputRecorder&) = delete;
+
+    bool open(const std::string& path);
+    void close();
+    bool is_open() const { return file != nullptr; }
+
+    // 记录一次写入fifo的数据，只由写入fifo的线程调用
+    void record(const char* data, size_t len);
+
+private:
+    FILE* file;
+    std::chrono::steady_clock::time_point last;
+};
+
+#endif
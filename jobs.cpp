@@ -0,0 +1,264 @@
+#include "jobs.h"
+
+#ifdef __linux__
+
+#include <cerrno>
+#include <csignal>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/eventfd.h>
+#include <sys/syscall.h>
+#include <sys/wait.h>
+
+// 打开进程的pidfd，内核不支持时返回-1，由定期的waitpid检查兜底
+static int open_pidfd(pid_t pid) {
+#ifdef SYS_pidfd_open
+    return (int)syscall(SYS_pidfd_open, pid, 0);
+#else
+    (void)pid;
+    return -1;
+#endif
+}
+
+PumpControl::PumpControl() :
+    fd(eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK)),
+    stopped(false),
+    finished(false) {
+}
+
+PumpControl::~PumpControl() {
+    if (fd >= 0) close(fd);
+}
+
+void PumpControl::stop() {
+    if (stopped || fd < 0) return;
+    stopped = true;
+    uint64_t one = 1;
+    while (write(fd, &one, sizeof(one)) < 0 && errno == EINTR) {
+    }
+}
+
+JobTable::JobTable() :
+    foreground_id(0),
+    current_id(0),
+    last_sweep(std::chrono::steady_clock::now()) {
+}
+
+// 回收析构时剩余的作业：等待宽限期后对仍未退出的进程组发SIGKILL，再回收进程、结束搬运线程
+static void reap_jobs(std::list<Job>& jobs, int grace_ms) {
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(grace_ms);
+    bool alive = true;
+    while (alive) {
+        alive = false;
+        for (auto& job : jobs) {
+            for (auto& proc : job.processes) {
+                if (proc.state == JobState::DONE) continue;
+                pid_t r = waitpid(proc.pid, nullptr, WNOHANG);
+                if (r == proc.pid || (r < 0 && errno == ECHILD)) {
+                    proc.state = JobState::DONE;
+                } else {
+                    alive = true;
+                }
+            }
+        }
+        if (!alive) break;
+        if (std::chrono::steady_clock::now() >= deadline) {
+            for (auto& job : jobs) {
+                for (auto& proc : job.processes) {
+                    if (proc.state != JobState::DONE) {
+                        kill(-job.pgid, SIGKILL);
+                        break;
+                    }
+                }
+            }
+            break;
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    for (auto& job : jobs) {
+        for (auto& proc : job.processes) {
+            if (proc.state != JobState::DONE) {
+                while (waitpid(proc.pid, nullptr, 0) < 0 && errno == EINTR) {
+                }
+            }
+            if (proc.pidfd >= 0) close(proc.pidfd);
+        }
+        if (job.pump_control) job.pump_control->stop();
+        if (job.pump.joinable()) job.pump.join();
+        if (job.terminal >= 0) close(job.terminal);
+    }
+}
+
+JobTable::~JobTable() {
+    if (jobs.empty()) return;
+    // 与交互式shell退出时一样挂断剩余作业。回收交给后台线程：忽略SIGHUP的作业或占着
+    // 输出管道的子进程不会阻塞析构所在的线程（多会话服务中是整个工作线程）
+    for (auto& job : jobs) {
+        kill(-job.pgid, SIGHUP);
+        kill(-job.pgid, SIGCONT);
+    }
+    std::thread([jobs = std::move(jobs)]() mutable {
+        reap_jobs(jobs, REAP_GRACE_MS);
+    }).detach();
+}
+
+Job& JobTable::add(const std::vector<pid_t>& pids, const std::string& command,
+                   bool foreground, std::thread pump, int terminal,
+                   std::shared_ptr<PumpControl> control) {
+    int id = jobs.empty() ? 1 : jobs.back().id + 1;
+    jobs.emplace_back();
+    Job& job = jobs.back();
+    job.id = id;
+    job.pgid = pids.empty() ? 0 : pids[0];
+    for (pid_t pid : pids) {
+        job.processes.push_back({pid, open_pidfd(pid), JobState::RUNNING});
+    }
+    job.status = 0;
+    job.state = JobState::RUNNING;
+    job.command = command;
+    job.pump = std::move(pump);
+    job.pump_control = std::move(control);
+    job.terminal = terminal;
+
+    current_id = id;
+    if (foreground) foreground_id = id;
+    return job;
+}
+
+Job* JobTable::find(int id) {
+    bool want_current = (id <= 0);
+    if (want_current) {
+        id = current_id;
+    }
+    for (auto& job : jobs) {
+        if (job.id == id) return &job;
+    }
+    // 当前作业已结束时取最近的作业
+    if (want_current && !jobs.empty()) {
+        return &jobs.back();
+    }
+    return nullptr;
+}
+
+void JobTable::signal(Job& job, int sig) {
+    kill(-job.pgid, sig);
+    if (sig != SIGCONT) {
+        last_sweep = std::chrono::steady_clock::time_point();  // 下次poll立即检查是否已暂停
+    } else {
+        for (auto& proc : job.processes) {
+            if (proc.state == JobState::STOPPED) proc.state = JobState::RUNNING;
+        }
+        job.state = job_state(job);
+    }
+}
+
+// 回收单个进程的状态变化
+void JobTable::update_process(Job& job, size_t index) {
+    JobProcess& proc = job.processes[index];
+    if (proc.state == JobState::DONE) return;
+
+    int status = 0;
+    pid_t r = waitpid(proc.pid, &status, WNOHANG | WUNTRACED | WCONTINUED);
+    if (r == 0 || (r < 0 && errno == EINTR)) return;
+
+    if (r < 0 || WIFEXITED(status) || WIFSIGNALED(status)) {
+        proc.state = JobState::DONE;
+        if (proc.pidfd >= 0) {
+            close(proc.pidfd);
+            proc.pidfd = -1;
+        }
+        if (index == job.processes.size() - 1) {
+            job.status = status;
+        }
+    } else if (WIFSTOPPED(status)) {
+        proc.state = JobState::STOPPED;
+    } else if (WIFCONTINUED(status)) {
+        proc.state = JobState::RUNNING;
+    }
+}
+
+// 进程已全部退出：通知搬运线程停止，返回它是否已结束（之后join不会阻塞）
+bool JobTable::pump_finished(Job& job) {
+    if (!job.pump.joinable() || !job.pump_control) return true;
+    job.pump_control->stop();
+    return job.pump_control->done();
+}
+
+// 全部退出为DONE，有进程运行为RUNNING，否则为STOPPED
+JobState JobTable::job_state(const Job& job) const {
+    bool all_done = true;
+    for (const auto& proc : job.processes) {
+        if (proc.state == JobState::RUNNING) return JobState::RUNNING;
+        if (proc.state != JobState::DONE) all_done = false;
+    }
+    return all_done ? JobState::DONE : JobState::STOPPED;
+}
+
+std::vector<JobEvent> JobTable::poll() {
+    std::vector<JobEvent> events;
+    if (jobs.empty()) return events;
+
+    // 进程退出由pidfd可读感知；暂停/继续没有pidfd通知，定期用waitpid全量检查
+    auto now = std::chrono::steady_clock::now();
+    auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(
+        now - last_sweep).count();
+    bool sweep = elapsed >= SWEEP_INTERVAL_MS;
+    if (sweep) last_sweep = now;
+
+    std::vector<struct pollfd> fds;
+    bool draining = false;      // 有进程已全部退出、等搬运线程结束的作业
+    for (const auto& job : jobs) {
+        for (const auto& proc : job.processes) {
+            if (proc.pidfd >= 0) fds.push_back({proc.pidfd, POLLIN, 0});
+        }
+        if (job_state(job) == JobState::DONE) draining = true;
+    }
+    int ready = fds.empty() ? 0 : ::poll(fds.data(), fds.size(), 0);
+    if (ready <= 0 && !sweep && !draining) return events;
+
+    size_t fd_index = 0;
+    for (auto it = jobs.begin(); it != jobs.end();) {
+        Job& job = *it;
+        for (size_t i = 0; i < job.processes.size(); i++) {
+            bool readable = false;
+            if (job.processes[i].pidfd >= 0) {
+                readable = (fds[fd_index++].revents & POLLIN) != 0;
+            }
+            if (readable || sweep) {
+                update_process(job, i);
+            }
+        }
+
+        JobState state = job_state(job);
+        if (state == JobState::DONE && !pump_finished(job)) {
+            // 先让搬运线程送完已到达的输出，提示符不会插到命令输出的前面
+            ++it;
+            continue;
+        }
+        if (state == job.state) {
+            ++it;
+            continue;
+        }
+        job.state = state;
+        events.push_back({job.id, state, job.status, job.id == foreground_id, job.command});
+
+        if (state == JobState::RUNNING) {
+            ++it;
+            continue;
+        }
+        if (job.id == foreground_id) {
+            foreground_id = 0;
+        }
+        if (state == JobState::STOPPED) {
+            current_id = job.id;
+            ++it;
+        } else {
+            if (job.pump.joinable()) job.pump.join();
+            if (job.terminal >= 0) close(job.terminal);
+            it = jobs.erase(it);
+        }
+    }
+    return events;
+}
+
+#endif
@@ -0,0 +1,122 @@
+#ifndef _JOBS_H_
+#define _JOBS_H_
+
+#ifdef __linux__
+
+#include <atomic>
+#include <list>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+#include <chrono>
+#include <sys/types.h>
+
+// 作业状态
+enum class JobState {
+    RUNNING,    // 运行中
+    STOPPED,    // 已暂停（Ctrl+Z）
+    DONE        // 全部进程已退出
+};
+
+// 搬运线程的控制
+// 作业的进程全部退出后，作业表通知搬运线程停止：后台的孙进程可能还占着管道写端或伪终端从端，
+// 搬运线程等不到EOF。搬运线程收完已到达的输出后调用finish，作业表在之后的poll中回收它、
+// 报告作业结束，输入线程不等待搬运线程
+class PumpControl {
+public:
+    PumpControl();
+    ~PumpControl();
+    PumpControl(const PumpControl&) = delete;
+    PumpControl& operator=(const PumpControl&) = delete;
+
+    // 搬运线程与输入一起等待（见pipeline.h的InputWait），可读表示应停止；创建失败时为-1，只能等EOF
+    int stop_fd() const { return fd; }
+    void stop();
+    // 搬运线程结束前调用
+    void finish() { finished = true; }
+    bool done() const { return finished; }
+
+private:
+    int fd;                     // eventfd
+    bool stopped;
+    std::atomic<bool> finished;
+};
+
+// 作业中的一个进程
+struct JobProcess {
+    pid_t pid;
+    int pidfd;                  // 进程退出时可读，-1表示已回收或内核不支持
+    JobState state;
+};
+
+// 一个作业对应一条管道命令，所有进程在同一个进程组中
+struct Job {
+    int id;                     // 作业号（%n）
+    pid_t pgid;                 // 进程组ID（第一级进程的pid）
+    std::vector<JobProcess> processes;  // 各级进程
+    int status;                 // 最后一级的退出状态（waitpid格式）
+    JobState state;
+    std::string command;        // 原始命令行
+    std::thread pump;           // shell位于数据通路时的搬运线程
+    std::shared_ptr<PumpControl> pump_control;  // 搬运线程的控制，nullptr表示它只等子进程
+    int terminal;               // 命令运行的伪终端主端，-1表示没有
+};
+
+// 状态变化通知
+struct JobEvent {
+    int id;
+    JobState state;
+    int status;
+    bool foreground;            // 变化前是否为前台作业
+    std::string command;
+};
+
+// 作业表
+// 用pidfd感知进程退出，不依赖进程级的SIGCHLD处理，多个Shell实例可以共存
+// 析构时挂断剩余作业并交给后台线程回收，不等待它们退出
+class JobTable {
+public:
+    JobTable();
+    ~JobTable();
+
+    // 登记新作业，pids[0]为进程组长
+    // terminal为命令运行的伪终端主端，搬运线程结束后由作业表关闭
+    // 有control时，进程全部退出后通知搬运线程停止，等它结束才报告作业结束
+    Job& add(const std::vector<pid_t>& pids, const std::string& command,
+             bool foreground, std::thread pump = std::thread(), int terminal = -1,
+             std::shared_ptr<PumpControl> control = nullptr);
+
+    // 查找作业，id<=0表示当前作业（最近启动或暂停的作业）
+    Job* find(int id);
+
+    bool has_foreground() const { return foreground_id != 0; }
+    Job* foreground() { return foreground_id ? find(foreground_id) : nullptr; }
+    void set_foreground(int id) { foreground_id = id; }
+
+    // 向作业的整个进程组发送信号
+    void signal(Job& job, int sig);
+
+    // 非阻塞地检查作业状态，返回发生变化的作业，已结束的作业从表中移除
+    std::vector<JobEvent> poll();
+
+    const std::list<Job>& list() const { return jobs; }
+    size_t size() const { return jobs.size(); }
+
+private:
+    std::list<Job> jobs;        // 按作业号递增排列
+    int foreground_id;          // 前台作业号，0表示没有
+    int current_id;             // 当前作业号（fg/bg的默认目标）
+    std::chrono::steady_clock::time_point last_sweep;  // 上次waitpid全量检查时间
+
+    static const int SWEEP_INTERVAL_MS = 50;  // 全量检查间隔（捕获外部发来的暂停/继续）
+    static const int REAP_GRACE_MS = 1000;    // 析构后等待剩余作业响应SIGHUP的时间，之后SIGKILL
+
+    void update_process(Job& job, size_t index);
+    bool pump_finished(Job& job);
+    JobState job_state(const Job& job) const;
+};
+
+#endif
+
+#endif
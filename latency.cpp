@@ -0,0 +1,176 @@
+#include "latency.h"
+#include <cstdio>
+
+LatencyHistogram::LatencyHistogram() {
+    reset();
+}
+
+// 小于2*SUB_BUCKETS的值各占一个桶；更大的值右移到[SUB_BUCKETS, 2*SUB_BUCKETS)，
+// 移位数决定所在的组，余下的高位决定组内的桶
+size_t LatencyHistogram::bucket_of(uint64_t ns) {
+    if (ns < 2 * SUB_BUCKETS) return ns;
+    unsigned shift = 63 - __builtin_clzll(ns) - SUB_BITS;
+    return shift * SUB_BUCKETS + (ns >> shift);
+}
+
+uint64_t LatencyHistogram::bucket_high(size_t index) {
+    if (index < 2 * SUB_BUCKETS) return index;
+    unsigned shift = index / SUB_BUCKETS - 1;
+    uint64_t low = (uint64_t)(index - shift * SUB_BUCKETS) << shift;
+    return low + (((uint64_t)1 << shift) - 1);
+}
+
+void LatencyHistogram::record(uint64_t ns) {
+    buckets[bucket_of(ns)].fetch_add(1, std::memory_order_relaxed);
+    sum.fetch_add(ns, std::memory_order_relaxed);
+    uint64_t old = maximum.load(std::memory_order_relaxed);
+    while (ns > old && !maximum.compare_exchange_weak(old, ns, std::memory_order_relaxed)) {
+    }
+    total.fetch_add(1, std::memory_order_relaxed);
+}
+
+void LatencyHistogram::reset() {
+    for (auto& bucket : buckets) bucket.store(0, std::memory_order_relaxed);
+    total.store(0, std::memory_order_relaxed);
+    sum.store(0, std::memory_order_relaxed);
+    maximum.store(0, std::memory_order_relaxed);
+}
+
+double LatencyHistogram::mean() const {
+    uint64_t n = count();
+    return n == 0 ? 0 : (double)sum.load(std::memory_order_relaxed) / n;
+}
+
+uint64_t LatencyHistogram::percentile(double p) const {
+    // 记录可能正在进行，以各桶的合计为准
+    uint64_t n = 0;
+    for (const auto& bucket : buckets) n += bucket.load(std::memory_order_relaxed);
+    if (n == 0) return 0;
+    uint64_t rank = (uint64_t)(p / 100.0 * n + 0.5);
+    if (rank < 1) rank = 1;
+    if (rank > n) rank = n;
+    uint64_t seen = 0;
+    for (size_t i = 0; i < BUCKETS; i++) {
+        seen += buckets[i].load(std::memory_order_relaxed);
+        if (seen >= rank) {
+            uint64_t high = bucket_high(i);
+            uint64_t top = max();
+            return high < top ? high : top;
+        }
+    }
+    return max();
+}
+
+std::atomic<bool> LatencyTrace::on(false);
+
+LatencyTrace& LatencyTrace::instance() {
+    static LatencyTrace trace;
+    return trace;
+}
+
+LatencyTrace::LatencyTrace() : stamp_in(0), stamp_out(0), in_flight_count(0) {
+}
+
+void LatencyTrace::enable(bool enabled) {
+    on.store(enabled, std::memory_order_relaxed);
+}
+
+void LatencyTrace::reset() {
+    for (auto& histogram : histograms) histogram.reset();
+}
+
+void LatencyTrace::enqueued(uint32_t end, uint64_t captured, uint64_t written) {
+    histogram(LatencyStage::CAPTURE).record(written - captured);
+    uint32_t in = stamp_in.load(std::memory_order_relaxed);
+    if (in - stamp_out.load(std::memory_order_acquire) >= STAMPS) return;
+    stamps[in & (STAMPS - 1)] = {end, captured, written};
+    stamp_in.store(in + 1, std::memory_order_release);
+}
+
+void LatencyTrace::dequeued(uint32_t out) {
+    uint64_t now = LatencyTrace::now();
+    uint32_t pos = stamp_out.load(std::memory_order_relaxed);
+    uint32_t in = stamp_in.load(std::memory_order_acquire);
+    // fifo的位置会回绕，按差值比较
+    while (pos != in && (int32_t)(stamps[pos & (STAMPS - 1)].end - out) <= 0) {
+        const Stamp& stamp = stamps[pos & (STAMPS - 1)];
+        histogram(LatencyStage::QUEUE).record(now - stamp.written);
+        if (in_flight_count < IN_FLIGHT) in_flight[in_flight_count++] = stamp.captured;
+        pos++;
+    }
+    stamp_out.store(pos, std::memory_order_release);
+}
+
+void LatencyTrace::echoed() {
+    uint64_t now = LatencyTrace::now();
+    for (size_t i = 0; i < in_flight_count; i++) {
+        histogram(LatencyStage::END_TO_END).record(now - in_flight[i]);
+    }
+    in_flight_count = 0;
+}
+
+static const char* const STAGE_NAMES[] = {
+    "capture->enqueue", "enqueue->dequeue", "parse", "render", "flush", "key->echo"
+};
+
+// 按大小选单位
+static void format_duration(char* buffer, size_t size, uint64_t ns) {
+    if (ns < 1000) {
+        snprintf(buffer, size, "%lluns", (unsigned long long)ns);
+    } else if (ns < 1000000) {
+        snprintf(buffer, size, "%.1fus", ns / 1e3);
+    } else if (ns < 1000000000) {
+        snprintf(buffer, size, "%.1fms", ns / 1e6);
+    } else {
+        snprintf(buffer, size, "%.2fs", ns / 1e9);
+    }
+}
+
+std::string LatencyTrace::report() const {
+    std::string out = enabled() ? "latency tracing: on\n" : "latency tracing: off\n";
+    char line[128];
+    snprintf(line, sizeof(line), "%-18s %8s %9s %9s %9s %9s %9s\n",
+             "stage", "count", "mean", "p50", "p90", "p99", "max");
+    out += line;
+    for (size_t i = 0; i < (size_t)LatencyStage::COUNT; i++) {
+        const LatencyHistogram& h = histograms[i];
+        char mean[16], p50[16], p90[16], p99[16], top[16];
+        format_duration(mean, sizeof(mean), (uint64_t)h.mean());
+        format_duration(p50, sizeof(p50), h.percentile(50));
+        format_duration(p90, sizeof(p90), h.percentile(90));
+        format_duration(p99, sizeof(p99), h.percentile(99));
+        format_duration(top, sizeof(top), h.max());
+        snprintf(line, sizeof(line), "%-18s %8llu %9s %9s %9s %9s %9s\n", STAGE_NAMES[i],
+                 (unsigned long long)h.count(), mean, p50, p90, p99, top);
+        out += line;
+    }
+    return out;
+}
+
+bool StageTimer::start(LatencyStage stage) {
+    if (active || !LatencyTrace::enabled()) return false;
+    active = true;
+    current = stage;
+    last = LatencyTrace::now();
+    for (auto& time : spent) time = 0;
+    return true;
+}
+
+LatencyStage StageTimer::change(LatencyStage stage) {
+    uint64_t now = LatencyTrace::now();
+    LatencyStage previous = current;
+    spent[(size_t)current] += now - last;
+    last = now;
+    current = stage;
+    return previous;
+}
+
+void StageTimer::finish() {
+    if (!active) return;
+    change(LatencyStage::COUNT);
+    LatencyTrace& trace = LatencyTrace::instance();
+    for (LatencyStage stage : {LatencyStage::PARSE, LatencyStage::RENDER, LatencyStage::FLUSH}) {
+        trace.histogram(stage).record(spent[(size_t)stage]);
+    }
+    active = false;
+}
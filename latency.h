@@ -0,0 +1,129 @@
+#ifndef _LATENCY_H_
+#define _LATENCY_H_
+
+#include <atomic>
+#include <chrono>
+#include <string>
+#include <cstdint>
+#include <cstddef>
+
+// 按键延迟的测量阶段
+enum class LatencyStage {
+    CAPTURE,    // 取得按键到写入fifo
+    QUEUE,      // 写入fifo到shell读出
+    PARSE,      // 输入解码
+    RENDER,     // 行编辑和回显的编码
+    FLUSH,      // 写出回显
+    END_TO_END, // 取得按键到回显写出
+    COUNT
+};
+
+// HDR风格的延迟直方图，单位纳秒
+// 对数-线性分桶：每个2的幂区间等分为16个桶，相对误差不超过1/16，覆盖全部uint64范围。
+// 计数都是原子变量，多个线程可以同时记录，不加锁
+class LatencyHistogram {
+public:
+    LatencyHistogram();
+
+    void record(uint64_t ns);
+    void reset();
+
+    uint64_t count() const { return total.load(std::memory_order_relaxed); }
+    uint64_t max() const { return maximum.load(std::memory_order_relaxed); }
+    double mean() const;
+    // 百分位数（0-100）：所在桶的上界，不超过最大值；没有样本时为0
+    uint64_t percentile(double p) const;
+
+private:
+    static const unsigned SUB_BITS = 4;
+    static const size_t SUB_BUCKETS = 1 << SUB_BITS;
+    static const size_t BUCKETS = (64 - SUB_BITS + 1) * SUB_BUCKETS;
+
+    std::atomic<uint64_t> buckets[BUCKETS];
+    std::atomic<uint64_t> total;
+    std::atomic<uint64_t> sum;
+    std::atomic<uint64_t> maximum;
+
+    static size_t bucket_of(uint64_t ns);
+    static uint64_t bucket_high(size_t index);
+};
+
+// 按键延迟跟踪
+// 打开后，终端输入线程为每次写入fifo的按键记下取得和写入的时间，放入时间戳队列，
+// shell读出fifo时按读到的位置取回，之后测量解码、渲染、写出各阶段，回显写出后
+// 得到端到端的延迟，都计入各阶段的直方图。关闭时各处只检查一个标志
+class LatencyTrace {
+public:
+    static LatencyTrace& instance();
+
+    static bool enabled() { return on.load(std::memory_order_relaxed); }
+    void enable(bool enabled);
+    void reset();
+
+    static uint64_t now() {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+
+    LatencyHistogram& histogram(LatencyStage stage) { return histograms[(size_t)stage]; }
+    // 各阶段的样本数和百分位数，供stats命令显示
+    std::string report() const;
+
+    // 写入端：一组按键写入fifo之前调用，end为写入后fifo的in（写入前算出）。
+    // 时间戳先于按键可见，读出端读到这组按键时总能取回它
+    void enqueued(uint32_t end, uint64_t captured, uint64_t written);
+    // 读出端：读出fifo后调用，out为读出后fifo的out，取回此前写入的按键的时间戳
+    void dequeued(uint32_t out);
+    // 读出端：读出的按键处理完、回显写出后调用
+    void echoed();
+
+private:
+    LatencyTrace();
+
+    // 一组按键的时间戳
+    struct Stamp {
+        uint32_t end;
+        uint64_t captured;
+        uint64_t written;
+    };
+
+    static const size_t STAMPS = 256;   // 2的幂，队列满时丢弃新的时间戳
+    static const size_t IN_FLIGHT = 64;
+
+    static std::atomic<bool> on;
+    LatencyHistogram histograms[(size_t)LatencyStage::COUNT];
+    // 单写单读的时间戳队列
+    Stamp stamps[STAMPS];
+    std::atomic<uint32_t> stamp_in;
+    std::atomic<uint32_t> stamp_out;
+    // 已读出、回显尚未写出的按键的取得时间，只由读出端访问
+    uint64_t in_flight[IN_FLIGHT];
+    size_t in_flight_count;
+};
+
+// 一次输入处理中各阶段的计时
+// switch_to把上次切换以来的时间计入当前阶段并切换到新阶段，finish把各阶段累计的时间
+// 记入直方图。start时跟踪关闭则不计时，之后的调用只检查一个成员
+class StageTimer {
+public:
+    StageTimer() : active(false), current(LatencyStage::COUNT), last(0), spent() {}
+
+    // 开始计时，已在计时中（嵌套调用）或跟踪关闭时返回false
+    bool start(LatencyStage stage);
+    // 切换阶段，返回之前的阶段
+    LatencyStage switch_to(LatencyStage stage) {
+        if (!active || stage == current) return current;
+        return change(stage);
+    }
+    void finish();
+
+private:
+    bool active;
+    LatencyStage current;
+    uint64_t last;
+    uint64_t spent[(size_t)LatencyStage::COUNT];
+
+    LatencyStage change(LatencyStage stage);
+};
+
+#endif
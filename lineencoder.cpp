@@ -0,0 +1,230 @@
+#include "lineencoder.h"
+#include <cstring>
+#include <cstdio>
+#include <cstdint>
+#include <algorithm>
+
+static const size_t UNAVAILABLE = SIZE_MAX;
+
+TerminalCaps TerminalCaps::xterm() {
+    return {true, true, true, true, true, true};
+}
+
+TerminalCaps TerminalCaps::vt220() {
+    return {true, false, true, true, true, true};
+}
+
+TerminalCaps TerminalCaps::vt102() {
+    return {true, false, false, true, false, true};
+}
+
+TerminalCaps TerminalCaps::vt100() {
+    return {true, false, false, false, false, true};
+}
+
+TerminalCaps TerminalCaps::dumb() {
+    return {false, false, false, false, false, false};
+}
+
+TerminalCaps TerminalCaps::from_term(const char* term) {
+    if (!term || !*term) return xterm();
+    if (strcmp(term, "dumb") == 0) return dumb();
+    if (strncmp(term, "vt100", 5) == 0 || strcmp(term, "vt101") == 0) return vt100();
+    if (strncmp(term, "vt102", 5) == 0) return vt102();
+    if (strncmp(term, "vt2", 3) == 0 || strncmp(term, "vt3", 3) == 0 || strncmp(term, "vt4", 3) == 0) {
+        return vt220();
+    }
+    return xterm();
+}
+
+size_t EditLine::text_offset(size_t column) const {
+    if (!widths) return column < text.size() ? column : text.size();
+    if (column >= widths[text.size()]) return text.size();
+    // 列号表不减，簇内的字节与簇的开头同列，找到的是该列开始的簇
+    return std::lower_bound(widths, widths + text.size(), (uint32_t)column) - widths;
+}
+
+void EditLine::append(std::pmr::string& out, size_t from, size_t to) const {
+    if (from < prompt.size()) {
+        size_t end = to < prompt.size() ? to : prompt.size();
+        out.append(prompt.data() + from, end - from);
+        from = end;
+    }
+    if (from < to) {
+        size_t begin = text_offset(from - prompt.size());
+        out.append(text.data() + begin, text_offset(to - prompt.size()) - begin);
+    }
+}
+
+size_t EditLine::bytes(size_t from, size_t to) const {
+    size_t count = 0;
+    if (from < prompt.size()) {
+        size_t end = to < prompt.size() ? to : prompt.size();
+        count = end > from ? end - from : 0;
+        from = end;
+    }
+    if (from < to) count += text_offset(to - prompt.size()) - text_offset(from - prompt.size());
+    return count;
+}
+
+static size_t digits(size_t n) {
+    size_t count = 1;
+    while (n >= 10) {
+        n /= 10;
+        count++;
+    }
+    return count;
+}
+
+// ESC[n加结束字符的长度，n为1时省略
+static size_t csi_cost(size_t n) {
+    return n == 1 ? 3 : 3 + digits(n);
+}
+
+static void append_csi(std::pmr::string& out, size_t n, char final) {
+    char seq[32];
+    if (n == 1) {
+        snprintf(seq, sizeof(seq), "\033[%c", final);
+    } else {
+        snprintf(seq, sizeof(seq), "\033[%zu%c", n, final);
+    }
+    out += seq;
+}
+
+LineEncoder::Method LineEncoder::choose_move(const EditLine& line, size_t from, size_t to, size_t& cost) const {
+    cost = 0;
+    if (from == to) return NONE;
+    Method best = NONE;
+    cost = UNAVAILABLE;
+    auto consider = [&](Method method, size_t method_cost) {
+        if (method_cost < cost) {
+            cost = method_cost;
+            best = method;
+        }
+    };
+    size_t n = from > to ? from - to : to - from;
+    if (to < from) {
+        consider(BACKSPACE, n);
+    } else if (to <= line.size()) {
+        consider(REPRINT, line.bytes(from, to));
+    }
+    if (caps.cursor_moves) consider(CSI_MOVE, csi_cost(n));
+    if (caps.column_address) consider(COLUMN, csi_cost(to + 1));
+    if (to <= line.size()) consider(CARRIAGE, 1 + line.bytes(0, to));
+    if (best == NONE) {
+        // 终端什么都不支持又无法重印时仍用CUF
+        best = CSI_MOVE;
+        cost = csi_cost(n);
+    }
+    return best;
+}
+
+LineEncoder::Method LineEncoder::choose_clear(size_t count, size_t& cost) const {
+    Method best = SPACES;
+    cost = count;   // 空格之后还要移回，由调用者计入
+    if (caps.erase_line && 3 < cost) {
+        best = ERASE_LINE;
+        cost = 3;
+    }
+    if (caps.erase_chars && csi_cost(count) < cost) {
+        best = ERASE_CHARS;
+        cost = csi_cost(count);
+    }
+    return best;
+}
+
+size_t LineEncoder::move_cost(const EditLine& line, size_t from, size_t to) const {
+    size_t cost;
+    choose_move(line, from, to, cost);
+    return cost;
+}
+
+void LineEncoder::move(std::pmr::string& out, const EditLine& line, size_t from, size_t to) const {
+    size_t cost;
+    switch (choose_move(line, from, to, cost)) {
+        case NONE:
+            break;
+        case BACKSPACE:
+            out.append(from - to, '\b');
+            break;
+        case CSI_MOVE:
+            append_csi(out, from > to ? from - to : to - from, from > to ? 'D' : 'C');
+            break;
+        case COLUMN:
+            append_csi(out, to + 1, 'G');
+            break;
+        case CARRIAGE:
+            out += '\r';
+            line.append(out, 0, to);
+            break;
+        case REPRINT:
+            line.append(out, from, to);
+            break;
+        default:
+            break;
+    }
+}
+
+size_t LineEncoder::insert_cost(const EditLine& line, size_t cursor, size_t count) const {
+    size_t end = cursor + count;
+    if (end >= line.size()) return line.bytes(cursor, end);
+    size_t reprint = line.bytes(cursor, line.size()) + move_cost(line, line.size(), end);
+    size_t ich = caps.insert_chars ? csi_cost(count) + line.bytes(cursor, end) : UNAVAILABLE;
+    return reprint < ich ? reprint : ich;
+}
+
+void LineEncoder::insert(std::pmr::string& out, const EditLine& line, size_t cursor, size_t count) const {
+    size_t end = cursor + count;
+    if (end < line.size()) {
+        size_t reprint = line.bytes(cursor, line.size()) + move_cost(line, line.size(), end);
+        if (caps.insert_chars && csi_cost(count) + line.bytes(cursor, end) <= reprint) {
+            // 终端右移行尾腾出位置，再写入新字符
+            append_csi(out, count, '@');
+            line.append(out, cursor, end);
+            return;
+        }
+        // 重印新字符和行尾，移回插入内容之后
+        line.append(out, cursor, line.size());
+        move(out, line, line.size(), end);
+        return;
+    }
+    line.append(out, cursor, end);
+}
+
+size_t LineEncoder::erase_cost(const EditLine& line, size_t cursor, size_t count) const {
+    size_t end = line.size();
+    size_t clear_cost;
+    Method clear = choose_clear(count, clear_cost);
+    size_t after = clear == SPACES ? end + count : end;
+    size_t reprint = line.bytes(cursor, end) + clear_cost + move_cost(line, after, cursor);
+    size_t dch = caps.delete_chars && cursor < end ? csi_cost(count) : UNAVAILABLE;
+    return reprint < dch ? reprint : dch;
+}
+
+void LineEncoder::erase(std::pmr::string& out, const EditLine& line, size_t cursor, size_t count) const {
+    if (count == 0) return;
+    size_t end = line.size();
+    size_t clear_cost;
+    Method clear = choose_clear(count, clear_cost);
+    size_t after = clear == SPACES ? end + count : end;
+    size_t reprint = line.bytes(cursor, end) + clear_cost + move_cost(line, after, cursor);
+    if (caps.delete_chars && cursor < end && csi_cost(count) <= reprint) {
+        // 终端左移行尾，末尾补空白
+        append_csi(out, count, 'P');
+        return;
+    }
+    // 重印行尾，擦除多出的count列，移回光标
+    line.append(out, cursor, end);
+    switch (clear) {
+        case ERASE_LINE:
+            out += "\033[K";
+            break;
+        case ERASE_CHARS:
+            append_csi(out, count, 'X');
+            break;
+        default:
+            out.append(count, ' ');
+            break;
+    }
+    move(out, line, after, cursor);
+}
@@ -0,0 +1,91 @@
+#ifndef _LINEENCODER_H_
+#define _LINEENCODER_H_
+
+#include <string>
+#include <string_view>
+#include <memory_resource>
+#include <cstddef>
+#include <cstdint>
+
+// 终端支持的编辑序列
+struct TerminalCaps {
+    bool cursor_moves;      // CUB/CUF（ESC[nD、ESC[nC）
+    bool column_address;    // CHA（ESC[nG）
+    bool insert_chars;      // ICH（ESC[n@）
+    bool delete_chars;      // DCH（ESC[nP）
+    bool erase_chars;       // ECH（ESC[nX）
+    bool erase_line;        // EL（ESC[K）
+
+    static TerminalCaps xterm();    // xterm及兼容终端（linux控制台、screen、tmux等），全部支持
+    static TerminalCaps vt220();    // 没有CHA
+    static TerminalCaps vt102();    // 另外没有ICH、ECH
+    static TerminalCaps vt100();    // 另外没有DCH
+    static TerminalCaps dumb();     // 只有退格和回车
+    // 按TERM环境变量选择，未知或为空时按xterm
+    static TerminalCaps from_term(const char* term);
+};
+
+// 屏幕上的编辑行：提示符后接命令行，整行在一个屏幕行内
+// widths为空时命令行每字节占一列；否则widths[i]为命令行前i个字节的列数（见LineWidths），
+// 列号只落在字符的开头
+struct EditLine {
+    std::string_view prompt;
+    std::string_view text;
+    const uint32_t* widths = nullptr;
+
+    size_t size() const { return prompt.size() + (widths ? widths[text.size()] : text.size()); }
+    // 追加[from, to)列的内容
+    void append(std::pmr::string& out, size_t from, size_t to) const;
+    // [from, to)列内容的字节数，即重印的代价
+    size_t bytes(size_t from, size_t to) const;
+
+private:
+    // 命令行第column列（不含提示符）的字节偏移
+    size_t text_offset(size_t column) const;
+};
+
+// 行编辑的输出编码
+// 对每种编辑按终端能力比较各种写法的字节数，选最短的：光标移动在退格、CUB/CUF、CHA、
+// 回车后重印之间选择，右移可以直接重印经过的字符；插入在ICH与重印行尾之间选择；
+// 删除在DCH与重印行尾再擦除（EL、ECH或空格）之间选择。用于串口等按字节计费的慢速链路。
+// 列号从0开始，包括提示符
+class LineEncoder {
+public:
+    explicit LineEncoder(const TerminalCaps& caps = TerminalCaps::xterm()) : caps(caps) {}
+
+    void set_caps(const TerminalCaps& caps) { this->caps = caps; }
+    const TerminalCaps& terminal_caps() const { return caps; }
+
+    // 光标从from列移到to列，from可以在行内容之外（如提示文字的末尾）
+    void move(std::pmr::string& out, const EditLine& line, size_t from, size_t to) const;
+    // line已在cursor列插入了count个字符，光标在cursor列；完成后光标停在插入内容之后
+    void insert(std::pmr::string& out, const EditLine& line, size_t cursor, size_t count) const;
+    // line已删除cursor列起的count个字符，光标在cursor列；完成后光标仍在cursor列
+    void erase(std::pmr::string& out, const EditLine& line, size_t cursor, size_t count) const;
+
+    // 各操作的字节数，不生成输出
+    size_t move_cost(const EditLine& line, size_t from, size_t to) const;
+    size_t insert_cost(const EditLine& line, size_t cursor, size_t count) const;
+    size_t erase_cost(const EditLine& line, size_t cursor, size_t count) const;
+
+private:
+    TerminalCaps caps;
+
+    enum Method {
+        NONE,
+        BACKSPACE,      // 退格
+        CSI_MOVE,       // CUB/CUF
+        COLUMN,         // CHA
+        CARRIAGE,       // 回车后重印到目标列
+        REPRINT,        // 重印经过的字符（右移）
+        INSERT_CHARS,   // ICH
+        DELETE_CHARS,   // DCH
+        ERASE_LINE,     // EL
+        ERASE_CHARS,    // ECH
+        SPACES          // 空格覆盖
+    };
+    Method choose_move(const EditLine& line, size_t from, size_t to, size_t& cost) const;
+    Method choose_clear(size_t count, size_t& cost) const;
+};
+
+#endif
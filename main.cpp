@@ -1,7 +1,25 @@
 #include <thread>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <cstring>
+#ifdef __linux__
+#include <unistd.h>
+#include <termios.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include "server.h"
+#include "pseudoterm.h"
+#include "predict.h"
+#endif
 #include "term.h"
 #include "shell.h"
 #include "fifo.h"
+#include "latency.h"
+#include "tracer.h"
+#include "replay.h"
+#include "recording.h"
 
 // 共享的FIFO缓冲区
 #define FIFO_SIZE 1024
@@ -12,13 +30,216 @@ void term_thread_func() {
     term_capture_input(&kbd_fifo);  // 传入FIFO指针
 }
 
-int main() {
+// 退出时把按键延迟的统计写到标准错误
+static void dump_latency_stats() {
+    fputs(LatencyTrace::instance().report().c_str(), stderr);
+}
+
+#ifdef SHELL_TRACE
+// 退出时导出事件跟踪的文件
+static std::string trace_file;
+
+static void dump_trace() {
+    Tracer::write_chrome_trace(trace_file);
+}
+#endif
+
+#ifdef __linux__
+// 服务模式：shell --server <套接字路径> [工作线程数]
+// 客户端可用 socat -,raw,echo=0 UNIX-CONNECT:<套接字路径> 连接
+static int run_server(const char* path, size_t workers) {
+    ShellServer server(workers);
+    if (!server.listen(path)) {
+        fprintf(stderr, "cannot listen on %s\n", path);
+        return 1;
+    }
+    server.start();
+    while (true) {
+        pause();
+    }
+    return 0;
+}
+
+// 客户端模式：shell --connect <套接字路径> [--predict=always|never]
+// 连接服务的会话，按键在本地预测显示，默认在往返时间较长时才显示
+static int run_client(const char* path, PredictMode mode) {
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    struct sockaddr_un addr = {};
+    addr.sun_family = AF_UNIX;
+    strncpy(addr.sun_path, path, sizeof(addr.sun_path) - 1);
+    if (fd < 0 || connect(fd, (struct sockaddr*)&addr, sizeof(addr)) != 0) {
+        fprintf(stderr, "cannot connect to %s\n", path);
+        return 1;
+    }
+    unsigned short rows = 24;
+    unsigned short cols = 80;
+    get_terminal_size(STDOUT_FILENO, rows, cols);
+    struct termios saved;
+    bool raw = tcgetattr(STDIN_FILENO, &saved) == 0;
+    if (raw) {
+        struct termios mode = saved;
+        cfmakeraw(&mode);
+        tcsetattr(STDIN_FILENO, TCSANOW, &mode);
+    }
+    PredictiveEcho echo(rows, cols, mode);
+    run_predictive_client(STDIN_FILENO, STDOUT_FILENO, fd, echo);
+    if (raw) tcsetattr(STDIN_FILENO, TCSANOW, &saved);
+    close(fd);
+    return 0;
+}
+
+// 回放模式：shell --replay <录制文件> [倍速|max]
+// 在无终端的shell上回放录制的输入，shell的输出丢弃，报告吞吐量
+static int run_replay(const char* path, const char* speed) {
+    InputRecording recording;
+    if (!recording.load(path)) {
+        fprintf(stderr, "cannot read recording %s\n", path);
+        return 1;
+    }
+    ReplayOptions options;
+    if (speed) options.speed = strcmp(speed, "max") == 0 ? 0 : strtod(speed, nullptr);
+    ReplayReport report = replay_input(recording, options);
+    printf("%zu keystrokes, %zu bytes in, %zu bytes out in %.3fs\n", report.keystrokes,
+           report.input_bytes, report.output_bytes, report.seconds);
+    printf("%.0f keystrokes/s, %.1f output bytes/keystroke%s\n", report.keystrokes_per_second(),
+           report.output_bytes_per_keystroke(), report.completed ? "" : " (commands still running)");
+    return 0;
+}
+
+// 播放会话录制：shell --play <录制文件> [起始秒]
+// 先定位到起始时刻（从之前最近的关键帧重放），之后按录制时的间隔输出
+static int run_play(const char* path, const char* from) {
+    SessionPlayer player;
+    if (!player.open(path)) {
+        fprintf(stderr, "cannot read recording %s\n", path);
+        return 1;
+    }
+    uint64_t start_us = from ? (uint64_t)(strtod(from, nullptr) * 1e6) : 0;
+    std::string screen;
+    player.seek(start_us, screen);
+    fwrite(screen.data(), 1, screen.size(), stdout);
+    fflush(stdout);
+    auto start = std::chrono::steady_clock::now();
+    SessionPlayer::Event event;
+    while (player.next(event)) {
+        if (event.type != 'o') continue;
+        std::this_thread::sleep_until(start + std::chrono::microseconds(event.time_us - start_us));
+        fwrite(event.data.data(), 1, event.data.size(), stdout);
+        fflush(stdout);
+    }
+    return 0;
+}
+
+// 导出为asciinema格式：shell --export-cast <录制文件> <输出文件>
+static int run_export_cast(const char* path, const char* out) {
+    SessionPlayer player;
+    if (!player.open(path) || !player.export_asciicast(out)) {
+        fprintf(stderr, "cannot export %s to %s\n", path, out);
+        return 1;
+    }
+    return 0;
+}
+#endif
+
+int main(int argc, char* argv[]) {
+#ifdef __linux__
+    if (argc > 2 && strcmp(argv[1], "--server") == 0) {
+        return run_server(argv[2], argc > 3 ? strtoul(argv[3], nullptr, 10) : 0);
+    }
+    if (argc > 2 && strcmp(argv[1], "--connect") == 0) {
+        PredictMode mode = PredictMode::ADAPTIVE;
+        if (argc > 3 && strcmp(argv[3], "--predict=always") == 0) mode = PredictMode::ALWAYS;
+        if (argc > 3 && strcmp(argv[3], "--predict=never") == 0) mode = PredictMode::NEVER;
+        return run_client(argv[2], mode);
+    }
+    if (argc > 2 && strcmp(argv[1], "--replay") == 0) {
+        return run_replay(argv[2], argc > 3 ? argv[3] : nullptr);
+    }
+    if (argc > 2 && strcmp(argv[1], "--play") == 0) {
+        return run_play(argv[2], argc > 3 ? argv[3] : nullptr);
+    }
+    if (argc > 3 && strcmp(argv[1], "--export-cast") == 0) {
+        return run_export_cast(argv[2], argv[3]);
+    }
+    // shell --pty：每条命令运行在新建的伪终端上，输出经shell转发
+    // shell --fast-scroll[=帧率]：同时在输出洪水时合并重绘，默认每秒30帧
+    bool pty_mode = false;
+    unsigned fast_scroll = 0;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--pty") == 0) {
+            pty_mode = true;
+        } else if (strncmp(argv[i], "--fast-scroll", 13) == 0) {
+            pty_mode = true;
+            fast_scroll = argv[i][13] == '=' ? strtoul(argv[i] + 14, nullptr, 10) : 30;
+        }
+    }
+#else
+    (void)argc;
+    (void)argv;
+#endif
+    // shell --trace-latency：记录按键到回显各阶段的延迟，用stats命令查看，退出时输出
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--trace-latency") == 0) {
+            LatencyTrace::instance().enable(true);
+            atexit(dump_latency_stats);
+        }
+#ifdef SHELL_TRACE
+        // shell --trace=<文件>：记录事件，退出时导出为Chrome跟踪JSON（也可用trace命令导出）
+        if (strncmp(argv[i], "--trace=", 8) == 0) {
+            trace_file = argv[i] + 8;
+            Tracer::enable(true);
+            atexit(dump_trace);
+        }
+#endif
+    }
+    // shell --record-input=<文件>：录制终端输入，供--replay回放
+    static InputRecorder recorder;
+    for (int i = 1; i < argc; i++) {
+        if (strncmp(argv[i], "--record-input=", 15) == 0) {
+            if (recorder.open(argv[i] + 15)) {
+                term_record_input(&recorder);
+            } else {
+                fprintf(stderr, "cannot record to %s\n", argv[i] + 15);
+            }
+        }
+    }
+#ifdef __linux__
+    // shell --record-session=<文件>：录制写到终端的全部输出，带关键帧索引，可以定位回放
+    unsigned short rows = 24;
+    unsigned short cols = 80;
+    get_terminal_size(STDOUT_FILENO, rows, cols);
+    static SessionRecorder session(rows, cols);
+    for (int i = 1; i < argc; i++) {
+        if (strncmp(argv[i], "--record-session=", 17) == 0 && !session.open(argv[i] + 17)) {
+            fprintf(stderr, "cannot record to %s\n", argv[i] + 17);
+        }
+    }
+#endif
+
     // 初始化FIFO
     fifo_init(&kbd_fifo, kbd_buffer, FIFO_SIZE);
 
     // 创建shell实例
     Shell shell(&kbd_fifo);
 
+    // 历史文件放在用户主目录下
+    const char* home = getenv("HOME");
+    if (!home) home = getenv("USERPROFILE");
+    if (home) {
+        shell.open_history(std::string(home) + "/.shell_history");
+    }
+#ifdef __linux__
+    // 同一用户的各个会话共享最近的历史
+    shell.attach_shared_history("/shell-history-" + std::to_string(getuid()));
+    shell.set_pty_mode(pty_mode);
+    shell.set_fast_scroll(fast_scroll);
+    if (session.is_open()) {
+        shell.set_output_tap(session.tap_fd(), true);
+        shell.set_window_listener([](unsigned short rows, unsigned short cols) { session.resize(rows, cols); });
+    }
+#endif
+    shell.set_terminal_caps(TerminalCaps::from_term(getenv("TERM")));
+
     // 创建两个线程
     std::thread term_thread(term_thread_func);  // 终端输入线程
     std::thread shell_thread(&Shell::process_input, &shell);  // shell处理线程
@@ -0,0 +1,155 @@
+#include "pathcache.h"
+
+#ifdef __linux__
+
+#include <cerrno>
+#include <cstdlib>
+#include <unistd.h>
+#include <sys/inotify.h>
+#include <sys/stat.h>
+
+// 影响命令解析结果的目录事件
+#define PATHCACHE_EVENTS (IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO | \
+                          IN_ATTRIB | IN_DELETE_SELF | IN_MOVE_SELF | IN_ONLYDIR)
+
+PathCache::PathCache() :
+    path_value("\n"),  // 不可能的PATH值，首次使用时才建立监视，不用的实例不占inotify实例
+    inotify_fd(-1),
+    watching(false),
+    probes(0) {
+}
+
+PathCache::~PathCache() {
+    if (inotify_fd >= 0) {
+        close(inotify_fd);
+    }
+}
+
+void PathCache::rewatch() {
+    table.clear();
+    for (int wd : watches) {
+        if (wd >= 0) inotify_rm_watch(inotify_fd, wd);
+    }
+    watches.clear();
+    dirs.clear();
+    if (inotify_fd < 0) {
+        inotify_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    }
+
+    const char* path = getenv("PATH");
+    path_value = path ? path : "";
+
+    // 空的PATH分量表示当前目录
+    size_t start = 0;
+    while (true) {
+        size_t end = path_value.find(':', start);
+        std::string dir = path_value.substr(start, end == std::string::npos ? end : end - start);
+        dirs.push_back(dir.empty() ? "." : dir);
+        if (end == std::string::npos) break;
+        start = end + 1;
+    }
+
+    // 不存在的目录无法监视，之后在其中新建的命令不会使缓存失效（与bash的hash一致）；
+    // 存在的目录监视不上（inotify实例或监视数达到上限）时不缓存，否则记录永远不会失效
+    watching = inotify_fd >= 0;
+    for (const auto& dir : dirs) {
+        int wd = -1;
+        if (inotify_fd >= 0 && dir[0] == '/') {
+            wd = inotify_add_watch(inotify_fd, dir.c_str(), PATHCACHE_EVENTS);
+            if (wd < 0 && errno != ENOENT && errno != ENOTDIR && errno != EACCES) watching = false;
+        }
+        watches.push_back(wd);
+    }
+}
+
+void PathCache::sync() {
+    // PATH变化后整体失效，逐字节比较的代价远小于一次stat；
+    // 监视不全时每次重试，其他实例释放了inotify资源后恢复缓存
+    const char* path = getenv("PATH");
+    if (path_value != (path ? path : "") || !watching) {
+        rewatch();
+        return;
+    }
+
+    bool lost_watch = false;
+    alignas(struct inotify_event) char buffer[4096];
+    while (true) {
+        ssize_t len = read(inotify_fd, buffer, sizeof(buffer));
+        if (len < 0 && errno == EINTR) continue;
+        if (len <= 0) break;  // EAGAIN：没有挂起的事件
+
+        for (char* p = buffer; p < buffer + len;) {
+            struct inotify_event* event = (struct inotify_event*)p;
+            p += sizeof(struct inotify_event) + event->len;
+
+            // 重新建立监视前的旧描述符上残留的事件
+            bool current = false;
+            for (int wd : watches) {
+                if (wd == event->wd) current = true;
+            }
+            if (!current && !(event->mask & IN_Q_OVERFLOW)) continue;
+
+            if (event->mask & (IN_DELETE_SELF | IN_MOVE_SELF | IN_IGNORED)) {
+                // 目录本身消失，监视随之失效，稍后重新建立
+                lost_watch = true;
+            } else if (event->mask & IN_Q_OVERFLOW) {
+                // 事件丢失，无法确定影响范围
+                table.clear();
+            } else if (event->len > 0) {
+                // 新建文件可能遮蔽后面目录中的同名命令，删除/移走可能使记录失效，
+                // 两种情况都只影响同名的一条记录
+                table.erase(event->name);
+            }
+        }
+    }
+    if (lost_watch) {
+        rewatch();
+    }
+}
+
+std::string PathCache::search(const std::string& name) {
+    probes++;
+    for (const auto& dir : dirs) {
+        std::string candidate = dir + "/" + name;
+        struct stat st;
+        if (stat(candidate.c_str(), &st) == 0 && S_ISREG(st.st_mode) &&
+            access(candidate.c_str(), X_OK) == 0) {
+            return candidate;
+        }
+    }
+    return "";
+}
+
+std::string PathCache::lookup(const std::string& name) {
+    if (name.empty()) return "";
+    if (name.find('/') != std::string::npos) return name;
+
+    sync();
+    auto it = table.find(name);
+    if (it != table.end()) {
+        it->second.hits++;
+        return it->second.path;
+    }
+
+    std::string path = search(name);
+    // 相对目录（如"."）的结果随当前目录变化，不缓存
+    if (!path.empty() && path[0] == '/' && watching) {
+        table[name] = {path, 1};
+    }
+    return path;
+}
+
+bool PathCache::forget(const std::string& name) {
+    return table.erase(name) > 0;
+}
+
+void PathCache::clear() {
+    table.clear();
+}
+
+const std::unordered_map<std::string, PathCache::Entry>& PathCache::entries() {
+    sync();
+    return table;
+}
+
+#endif
@@ -0,0 +1,56 @@
+#ifndef _PATHCACHE_H_
+#define _PATHCACHE_H_
+
+#ifdef __linux__
+
+#include <string>
+#include <vector>
+#include <unordered_map>
+
+// 命令路径缓存（对应bash的hash表）
+// 记录命令名到绝对路径的映射，避免每次执行都沿$PATH逐个目录stat
+// 用inotify监视PATH中的目录，目录内容变化时只失效对应名字的记录，PATH变化时整体清空
+class PathCache {
+public:
+    // 缓存记录
+    struct Entry {
+        std::string path;   // 解析出的绝对路径
+        unsigned hits;      // 使用次数
+    };
+
+    PathCache();
+    ~PathCache();
+
+    // 解析命令名，返回可执行文件路径，找不到返回空串
+    // 含'/'的名字不经过PATH，原样返回
+    std::string lookup(const std::string& name);
+
+    // 从缓存中删除一个名字，不存在返回false
+    bool forget(const std::string& name);
+
+    // 清空缓存（hash -r）
+    void clear();
+
+    // 当前缓存内容（会先处理挂起的失效事件）
+    const std::unordered_map<std::string, Entry>& entries();
+
+    // 沿PATH探测文件系统的次数，用于测试缓存命中
+    unsigned long probe_count() const { return probes; }
+
+private:
+    std::unordered_map<std::string, Entry> table;
+    std::string path_value;             // 建立监视时的PATH值
+    std::vector<std::string> dirs;      // PATH拆分出的目录
+    std::vector<int> watches;           // 与dirs对应的inotify监视描述符，-1表示未监视
+    int inotify_fd;
+    bool watching;                      // PATH中存在的目录都已监视，可以缓存
+    unsigned long probes;
+
+    void sync();                        // 检查PATH变化并处理inotify事件
+    void rewatch();                     // 按当前PATH重新建立监视
+    std::string search(const std::string& name);
+};
+
+#endif
+
+#endif
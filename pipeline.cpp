@@ -0,0 +1,360 @@
+#include "pipeline.h"
+#include <algorithm>
+#include <cstring>
+#ifdef __linux__
+#include <fcntl.h>
+#include <poll.h>
+#include <spawn.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/uio.h>
+#include <sys/wait.h>
+#include <cerrno>
+#endif
+
+// 需要交给/bin/sh处理的未加引号字符
+static bool is_shell_special(char c) {
+    return strchr("<>;&$`*?[](){}~#!", c) != nullptr;
+}
+
+// 结束当前单词，加入命令参数列表
+static void end_word(Command& cmd, std::string& word, bool& has_word) {
+    if (has_word) {
+        cmd.argv.push_back(word);
+        word.clear();
+        has_word = false;
+    }
+}
+
+// 解析命令行为管道结构
+bool parse_pipeline(const std::string& line, Pipeline& out) {
+    out.commands.clear();
+    out.background = false;
+
+    Command current;
+    std::string word;
+    bool has_word = false;  // 区分空字符串参数('')和没有参数
+
+    for (size_t i = 0; i < line.length(); i++) {
+        char c = line[i];
+
+        if (c == '\'') {  // 单引号内全部按字面处理
+            size_t end = line.find('\'', i + 1);
+            if (end == std::string::npos) return false;
+            word.append(line, i + 1, end - i - 1);
+            has_word = true;
+            i = end;
+        } else if (c == '"') {  // 双引号内只处理反斜杠转义
+            size_t j = i + 1;
+            for (; j < line.length() && line[j] != '"'; j++) {
+                char d = line[j];
+                if (d == '$' || d == '`') return false;  // 变量和命令替换交给/bin/sh
+                if (d == '\\' && j + 1 < line.length() && strchr("\"\\$`", line[j + 1])) {
+                    d = line[++j];
+                }
+                word += d;
+            }
+            if (j >= line.length()) return false;  // 未闭合的双引号
+            has_word = true;
+            i = j;
+        } else if (c == '\\') {
+            if (i + 1 >= line.length()) return false;
+            word += line[++i];
+            has_word = true;
+        } else if (c == ' ' || c == '\t') {
+            end_word(current, word, has_word);
+        } else if (c == '|') {
+            end_word(current, word, has_word);
+            if (current.argv.empty()) return false;  // "| a" 或 "a || b"
+            out.commands.push_back(std::move(current));
+            current = Command();
+        } else if (c == '&') {
+            // 只接受行尾的单个'&'，"a && b"和"a & b"交给/bin/sh
+            if (line.find_first_not_of(" \t", i + 1) != std::string::npos) return false;
+            out.background = true;
+            break;
+        } else if (is_shell_special(c)) {
+            return false;
+        } else {
+            word += c;
+            has_word = true;
+        }
+    }
+
+    end_word(current, word, has_word);
+    if (current.argv.empty()) return false;  // 空命令或以'|'结尾
+    out.commands.push_back(std::move(current));
+
+    // 环境变量赋值（VAR=x cmd）交给/bin/sh
+    for (const auto& cmd : out.commands) {
+        if (cmd.argv[0].find('=') != std::string::npos) return false;
+    }
+    return true;
+}
+
+#ifdef __linux__
+
+#define PIPELINE_PIPE_SIZE (1 << 20)   // 管道缓冲区大小，加大以减少上下文切换
+#define PIPELINE_CHUNK_SIZE (1 << 20)  // 单次splice的最大长度
+#define PIPELINE_COPY_SIZE (64 * 1024) // 回退到read/write时的缓冲区大小
+
+extern char** environ;
+
+// 创建管道，两端都设置O_CLOEXEC，子进程只会看到dup2到0/1的那一端
+static bool create_pipe(int fds[2]) {
+    if (pipe2(fds, O_CLOEXEC) != 0) {
+        return false;
+    }
+    fcntl(fds[1], F_SETPIPE_SZ, PIPELINE_PIPE_SIZE);  // 尽力而为，失败不影响功能
+    return true;
+}
+
+static void close_fd(int& fd) {
+    if (fd >= 0) {
+        close(fd);
+        fd = -1;
+    }
+}
+
+std::vector<pid_t> spawn_pipeline(const Pipeline& pipeline, int in_fd, int out_fd,
+                                  bool new_group, int err_fd) {
+    std::vector<pid_t> pids;
+    size_t n = pipeline.commands.size();
+    if (n == 0) return pids;
+
+    // 子进程恢复shell自身忽略的信号的默认处理
+    posix_spawnattr_t attr;
+    posix_spawnattr_init(&attr);
+    sigset_t default_signals;
+    sigemptyset(&default_signals);
+    for (int sig : {SIGPIPE, SIGINT, SIGQUIT, SIGTSTP, SIGTTIN, SIGTTOU}) {
+        sigaddset(&default_signals, sig);
+    }
+    posix_spawnattr_setsigdefault(&attr, &default_signals);
+    short flags = POSIX_SPAWN_SETSIGDEF;
+    if (new_group) {
+        flags |= POSIX_SPAWN_SETPGROUP;
+        posix_spawnattr_setpgroup(&attr, 0);  // 第一级成为组长
+    }
+    posix_spawnattr_setflags(&attr, flags);
+
+    int prev_read = -1;  // 上一级管道的读端
+    bool failed = false;
+
+    for (size_t i = 0; i < n && !failed; i++) {
+        int pipe_fds[2] = {-1, -1};
+        bool last = (i == n - 1);
+        if (!last && !create_pipe(pipe_fds)) {
+            failed = true;
+            break;
+        }
+
+        int stage_in = (i == 0) ? in_fd : prev_read;
+        int stage_out = last ? out_fd : pipe_fds[1];
+
+        posix_spawn_file_actions_t actions;
+        posix_spawn_file_actions_init(&actions);
+        if (stage_in >= 0) posix_spawn_file_actions_adddup2(&actions, stage_in, STDIN_FILENO);
+        if (stage_out >= 0) posix_spawn_file_actions_adddup2(&actions, stage_out, STDOUT_FILENO);
+        if (err_fd >= 0) posix_spawn_file_actions_adddup2(&actions, err_fd, STDERR_FILENO);
+
+        // 构造以nullptr结尾的argv
+        std::vector<char*> argv;
+        for (const auto& arg : pipeline.commands[i].argv) {
+            argv.push_back(const_cast<char*>(arg.c_str()));
+        }
+        argv.push_back(nullptr);
+
+        // 调用者已解析路径时直接执行，省去posix_spawnp沿PATH的逐个尝试
+        const std::string& path = pipeline.commands[i].path;
+        pid_t pid;
+        int err = path.empty()
+            ? posix_spawnp(&pid, argv[0], &actions, &attr, argv.data(), environ)
+            : posix_spawn(&pid, path.c_str(), &actions, &attr, argv.data(), environ);
+        if (err == 0) {
+            pids.push_back(pid);
+            if (new_group && i == 0) {
+                posix_spawnattr_setpgroup(&attr, pid);  // 后续各级加入同一进程组
+            }
+        } else {
+            failed = true;
+        }
+        posix_spawn_file_actions_destroy(&actions);
+
+        // 父进程不再需要已交给子进程的管道端
+        close_fd(prev_read);
+        close_fd(pipe_fds[1]);
+        prev_read = pipe_fds[0];
+    }
+    close_fd(prev_read);
+    posix_spawnattr_destroy(&attr);
+
+    if (failed) {
+        // 前面已启动的进程可能在读终端或已被SIGTTIN停止，等不到EOF，先杀掉再回收
+        if (new_group && !pids.empty()) {
+            kill(-pids[0], SIGKILL);
+        } else {
+            for (pid_t pid : pids) kill(pid, SIGKILL);
+        }
+        wait_pipeline(pids);
+        pids.clear();
+    }
+    return pids;
+}
+
+int wait_pipeline(const std::vector<pid_t>& pids) {
+    int status = 0;
+    for (pid_t pid : pids) {
+        int s = 0;
+        while (waitpid(pid, &s, 0) < 0 && errno == EINTR) {
+        }
+        status = s;
+    }
+    return status;
+}
+
+// 用write写出整个缓冲区
+static bool copy_buffer(int out_fd, const char* data, size_t len) {
+    while (len > 0) {
+        ssize_t n = write(out_fd, data, len);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return false;
+        data += n;
+        len -= n;
+    }
+    return true;
+}
+
+// 用read/write搬运最多len字节，len为0表示直到EOF
+static long long copy_fd(int in_fd, int out_fd, long long len) {
+    static thread_local char buffer[PIPELINE_COPY_SIZE];
+    long long total = 0;
+    while (len == 0 || total < len) {
+        size_t want = sizeof(buffer);
+        if (len != 0 && (long long)want > len - total) want = (size_t)(len - total);
+        ssize_t n = read(in_fd, buffer, want);
+        if (n < 0 && errno == EINTR) continue;
+        if (n < 0) return -1;
+        if (n == 0) break;
+        if (!copy_buffer(out_fd, buffer, n)) return -1;
+        total += n;
+    }
+    return total;
+}
+
+// 用splice搬运最多len字节（len为0表示直到EOF），不支持splice时回退到copy_fd
+static long long splice_fd(int in_fd, int out_fd, long long len) {
+    long long total = 0;
+    while (len == 0 || total < len) {
+        size_t want = PIPELINE_CHUNK_SIZE;
+        if (len != 0 && (long long)want > len - total) want = (size_t)(len - total);
+        ssize_t n = splice(in_fd, nullptr, out_fd, nullptr, want, SPLICE_F_MOVE | SPLICE_F_MORE);
+        if (n < 0 && errno == EINTR) continue;
+        if (n < 0 && errno == EINVAL) {
+            // 两端都不是管道或目标不支持splice，剩余部分走用户空间
+            long long rest = copy_fd(in_fd, out_fd, len == 0 ? 0 : len - total);
+            return rest < 0 ? -1 : total + rest;
+        }
+        if (n < 0) return -1;
+        if (n == 0) break;
+        total += n;
+    }
+    return total;
+}
+
+long long splice_all(int in_fd, int out_fd) {
+    return splice_fd(in_fd, out_fd, 0);
+}
+
+long long tee_splice_all(int in_pipe, int out_fd, int tap_fd, int stop_fd) {
+    int mid[2];
+    if (!create_pipe(mid)) return -1;
+
+    InputWait input(stop_fd);
+    long long total = 0;
+    while (input.wait(in_pipe)) {
+        // 复制管道中的页到中间管道，不消耗in_pipe的数据
+        ssize_t n = tee(in_pipe, mid[1], PIPELINE_CHUNK_SIZE, 0);
+        if (n < 0 && errno == EINTR) continue;
+        if (n < 0 && errno == EINVAL) {
+            // in_pipe不是管道，无法tee
+            close(mid[0]);
+            close(mid[1]);
+            return -1;
+        }
+        if (n < 0) break;
+        if (n == 0) break;  // 写端全部关闭且已读空
+
+        // 先送往主输出，再把复制的同样n字节送往旁路
+        if (splice_fd(in_pipe, out_fd, n) != n || splice_fd(mid[0], tap_fd, n) != n) {
+            total = -1;
+            break;
+        }
+        total += n;
+    }
+    close(mid[0]);
+    close(mid[1]);
+    return total;
+}
+
+bool write_to_pipe(int pipe_fd, const char* data, size_t len) {
+    if (len == 0) return true;
+
+    // vmsplice只引用页面而不复制，调用者的缓冲区随后可能被释放重用，
+    // 所以先放入独立的匿名映射，挂入管道后立即解除映射，页面由管道持有直到被读走
+    size_t page = (size_t)sysconf(_SC_PAGESIZE);
+    size_t map_len = (len + page - 1) / page * page;
+    char* pages = (char*)mmap(nullptr, map_len, PROT_READ | PROT_WRITE,
+                              MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (pages == MAP_FAILED) {
+        return copy_buffer(pipe_fd, data, len);
+    }
+    memcpy(pages, data, len);
+
+    bool ok = true;
+    size_t done = 0;
+    while (done < len) {
+        struct iovec iov = {pages + done, len - done};
+        ssize_t n = vmsplice(pipe_fd, &iov, 1, SPLICE_F_GIFT);
+        if (n < 0 && errno == EINTR) continue;
+        if (n < 0 && errno == EINVAL) {
+            ok = copy_buffer(pipe_fd, pages + done, len - done);  // 不是管道，普通写入
+            break;
+        }
+        if (n <= 0) {
+            ok = false;
+            break;
+        }
+        done += n;
+    }
+    munmap(pages, map_len);
+    return ok;
+}
+
+bool InputWait::wait(int in_fd) {
+    typedef std::chrono::steady_clock Clock;
+    while (true) {
+        if (stopping) {
+            // 只再等已到达的数据：空闲一段时间或到期后结束
+            long long left = std::chrono::duration_cast<std::chrono::milliseconds>(
+                deadline - Clock::now()).count();
+            if (left <= 0) return false;
+            struct pollfd pfd = {in_fd, POLLIN, 0};
+            int r = poll(&pfd, 1, (int)std::min<long long>(left, PUMP_DRAIN_IDLE_MS));
+            if (r < 0 && errno == EINTR) continue;
+            return r != 0;
+        }
+        struct pollfd fds[2] = {{in_fd, POLLIN, 0}, {stop_fd, POLLIN, 0}};
+        int r = poll(fds, stop_fd >= 0 ? 2 : 1, -1);
+        if (r < 0 && errno == EINTR) continue;
+        if (r < 0) return true;  // 由随后的读取报告错误
+        if (stop_fd >= 0 && (fds[1].revents & POLLIN)) {
+            stopping = true;
+            deadline = Clock::now() + std::chrono::milliseconds(PUMP_DRAIN_LIMIT_MS);
+        }
+        if (fds[0].revents) return true;
+    }
+}
+
+#endif
@@ -0,0 +1,76 @@
+#ifndef _PIPELINE_H_
+#define _PIPELINE_H_
+
+#include <string>
+#include <vector>
+#include <cstddef>
+#ifdef __linux__
+#include <chrono>
+#include <sys/types.h>
+#endif
+
+// 单条命令（管道中的一级）
+struct Command {
+    std::vector<std::string> argv;  // 参数列表，argv[0]为命令名
+    std::string path;               // 已解析的可执行文件路径，为空时沿PATH查找
+};
+
+// 管道命令 a | b | c
+struct Pipeline {
+    std::vector<Command> commands;  // 按顺序排列的各级命令
+    bool background = false;        // 以'&'结尾，后台执行
+};
+
+// 解析命令行为管道结构
+// 只支持普通单词、引号、反斜杠转义、'|'和结尾的'&'，遇到重定向、变量、通配符等
+// 需要/bin/sh处理的语法时返回false，由调用者回退到system()
+bool parse_pipeline(const std::string& line, Pipeline& out);
+
+#ifdef __linux__
+// 启动管道中的全部命令，各级之间用pipe2连接
+// in_fd/out_fd为第一级的标准输入和最后一级的标准输出，-1表示继承
+// new_group为true时全部进程放入以第一级pid为ID的新进程组（作业控制）
+// err_fd为各级的标准错误，-1表示继承
+// 成功返回各级进程的pid，任意一级启动失败时返回空列表（已启动的会被回收）
+std::vector<pid_t> spawn_pipeline(const Pipeline& pipeline, int in_fd = -1, int out_fd = -1,
+                                  bool new_group = false, int err_fd = -1);
+
+// 等待管道全部进程结束，返回最后一级的退出状态（waitpid格式）
+int wait_pipeline(const std::vector<pid_t>& pids);
+
+// 把in_fd的全部数据搬运到out_fd，直到in_fd读到EOF
+// 任意一端为管道时使用splice在内核中搬运，不支持时回退到read/write
+// 返回搬运的字节数，出错返回-1
+long long splice_all(int in_fd, int out_fd);
+
+// 把管道in_pipe的数据同时送往out_fd和tap_fd，直到EOF或stop_fd（见InputWait）通知停止
+// 用tee复制管道页再splice到两端，数据不经过用户空间
+long long tee_splice_all(int in_pipe, int out_fd, int tap_fd, int stop_fd = -1);
+
+// 把用户空间缓冲区写入管道（内建命令位于管道一端时使用）
+// 使用vmsplice把页挂入管道，失败时回退到write；返回后data即可释放
+bool write_to_pipe(int pipe_fd, const char* data, size_t len);
+
+#define PUMP_DRAIN_IDLE_MS 10     // 通知停止后，输入空闲这么久即认为已到达的数据已读完
+#define PUMP_DRAIN_LIMIT_MS 100   // 通知停止后最多再读这么久
+
+// 搬运线程等待输入可读
+// 作业的进程全部退出后stop_fd变为可读（见jobs.h的PumpControl）：后台的孙进程可能还占着
+// 管道写端或伪终端从端，等不到EOF，此后只再收已到达的数据
+class InputWait {
+public:
+    explicit InputWait(int stop_fd) : stop_fd(stop_fd), stopping(false) {}
+
+    // 等待in_fd可读、EOF或出错，返回false表示应结束搬运
+    bool wait(int in_fd);
+    // 已收到停止通知
+    bool draining() const { return stopping; }
+
+private:
+    int stop_fd;            // -1表示只等EOF
+    bool stopping;
+    std::chrono::steady_clock::time_point deadline;
+};
+#endif
+
+#endif
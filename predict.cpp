@@ -0,0 +1,404 @@
+#include "predict.h"
+#include "fastscroll.h"
+#include "pseudoterm.h"
+#include <algorithm>
+#include <cstdio>
+
+#ifdef __linux__
+#include <cerrno>
+#include <csignal>
+#include <poll.h>
+#include <unistd.h>
+#endif
+
+static const Screen::Cell BLANK = {' ', 0, 0, 0};
+
+#define SHOW_RTT_MS 30          // 自适应模式下往返时间超过此值才显示预测
+#define EXPIRY_MIN_MS 500       // 显示中的预测至少等这么久才判为错误
+#define EXPIRY_SLACK_MS 250
+#define UNCONFIRMED_EXPIRY_MS 5000  // 还没有往返时间样本时的超时
+#define FREEZE_UNKNOWN_MS 1000  // 没有往返时间样本时，无法预测的按键之后暂停的时间
+
+PredictiveEcho::PredictiveEcho(unsigned rows, unsigned cols, PredictMode mode) :
+    server(rows, cols),
+    mode(mode),
+    base_row(0),
+    base_col(0),
+    base_scrolls(0),
+    anchor_row(0),
+    anchor_scrolls(0),
+    left_limit(0),
+    anchored(false),
+    displayed(false),
+    shown_row(0),
+    shown_col(0),
+    srtt(-1),
+    confident(false),
+    confirmed_count(0),
+    mispredicted_count(0),
+    escape_len(0) {
+}
+
+void PredictiveEcho::resize(unsigned rows, unsigned cols, std::string& out) {
+    erase(out);
+    server.resize(rows, cols);
+    ops.clear();
+    anchored = false;
+}
+
+void PredictiveEcho::keystroke(const char* data, size_t len, std::string& out) {
+    Clock::time_point now = Clock::now();
+    for (size_t i = 0; i < len; i++) {
+        char c = data[i];
+        if (escape_len > 0) {
+            escape[escape_len++] = c;
+            if (escape_len == 2 && c != '[') {
+                freeze(now);
+                escape_len = 0;
+            } else if (escape_len > 2 && c >= 0x40 && c <= 0x7E) {
+                // 只预测不带参数的左右方向键
+                if (escape_len == 3 && c == 'D') handle_key(LEFT, 0, now);
+                else if (escape_len == 3 && c == 'C') handle_key(RIGHT, 0, now);
+                else freeze(now);
+                escape_len = 0;
+            } else if (escape_len == sizeof(escape)) {
+                freeze(now);
+                escape_len = 0;
+            }
+            continue;
+        }
+        if (c == '\033') {
+            escape[0] = c;
+            escape_len = 1;
+        } else if (c >= 0x20 && c < 0x7F) {
+            handle_key(INSERT, c, now);
+        } else if (c == '\b') {
+            handle_key(BACKSPACE, 0, now);
+        } else {
+            freeze(now);
+        }
+    }
+    refresh(out);
+}
+
+void PredictiveEcho::server_output(const char* data, size_t len, std::string& out) {
+    // 终端上须是shell认为的画面，输出才能原样转发
+    erase(out);
+    out.append(data, len);
+    server.feed(data, len);
+    reconcile(Clock::now());
+    refresh(out);
+}
+
+void PredictiveEcho::tick(std::string& out) {
+    reconcile(Clock::now());
+    refresh(out);
+}
+
+void PredictiveEcho::freeze(Clock::time_point now) {
+    double hold = srtt >= 0 ? srtt * 1.25 + 20 : FREEZE_UNKNOWN_MS;
+    frozen_until = now + std::chrono::microseconds((long long)(hold * 1000));
+    frozen_at = now;
+}
+
+bool PredictiveEcho::on_base_row() const {
+    return server.cursor_row() == base_row && server.scroll_count() == base_scrolls;
+}
+
+void PredictiveEcho::rebase() {
+    base_row = server.cursor_row();
+    base_col = server.cursor_col();
+    base_scrolls = server.scroll_count();
+    const Screen::Cell* line = server.line(base_row);
+    base.assign(line, line + server.cols());
+}
+
+void PredictiveEcho::handle_key(OpKind kind, char ch, Clock::time_point now) {
+    if (now < frozen_until) return;
+    if (!server.between_sequences() || !server.plain_output()) {
+        freeze(now);
+        return;
+    }
+    if (ops.empty() || !on_base_row()) {
+        ops.clear();
+        rebase();
+    }
+    if (!anchored || anchor_row != base_row || anchor_scrolls != base_scrolls) {
+        anchored = true;
+        anchor_row = base_row;
+        anchor_scrolls = base_scrolls;
+        left_limit = base_col;
+    }
+    Prediction prediction = start();
+    for (const Op& op : ops) apply(prediction, op);
+    Op op = {kind, ch, now};
+    if (!apply(prediction, op)) {
+        freeze(now);
+        return;
+    }
+    ops.push_back(op);
+}
+
+PredictiveEcho::Prediction PredictiveEcho::start() const {
+    return {base, base_col, base_col, true};
+}
+
+bool PredictiveEcho::apply(Prediction& prediction, const Op& op) const {
+    std::vector<Screen::Cell>& cells = prediction.cells;
+    unsigned cols = cells.size();
+    unsigned& cursor = prediction.cursor;
+    switch (op.kind) {
+        case INSERT:
+            // 不预测换行
+            if (cursor + 1 >= cols) return prediction.valid = false;
+            cells.insert(cells.begin() + cursor, {(uint32_t)(unsigned char)op.ch, 0, 0, Screen::UNDERLINE});
+            // 宽字符的右半边移出行尾时，留下的左半边也清掉
+            if (cells.back().ch == Screen::WIDE_TAIL) cells[cols - 1] = BLANK;
+            cells.pop_back();
+            prediction.low = std::min(prediction.low, cursor);
+            cursor++;
+            break;
+        case BACKSPACE: {
+            // 宽字符整个删除、整个跳过
+            unsigned width = cursor >= 2 && cells[cursor - 1].ch == Screen::WIDE_TAIL ? 2 : 1;
+            if (cursor < left_limit + width) return prediction.valid = false;
+            cursor -= width;
+            cells.erase(cells.begin() + cursor, cells.begin() + cursor + width);
+            cells.insert(cells.end(), width, BLANK);
+            prediction.low = std::min(prediction.low, cursor);
+            break;
+        }
+        case LEFT: {
+            unsigned width = cursor >= 2 && cells[cursor - 1].ch == Screen::WIDE_TAIL ? 2 : 1;
+            if (cursor < left_limit + width) return prediction.valid = false;
+            cursor -= width;
+            break;
+        }
+        case RIGHT: {
+            // 只在文字中右移；行尾或不同属性的内容（如暗色的自动提示）上右移的效果无法预测
+            unsigned width = cursor + 1 < cols && cells[cursor + 1].ch == Screen::WIDE_TAIL ? 2 : 1;
+            if (cursor + width >= cols || cursor == 0 || cells[cursor].ch == ' ') return prediction.valid = false;
+            uint16_t mask = ~(uint16_t)Screen::UNDERLINE;
+            if ((cells[cursor].attrs & mask) != (cells[cursor - 1].attrs & mask)) return prediction.valid = false;
+            cursor += width;
+            break;
+        }
+    }
+    return true;
+}
+
+bool PredictiveEcho::matches(const Prediction& prediction) const {
+    if (server.cursor_col() != prediction.cursor) return false;
+    const Screen::Cell* line = server.line(base_row);
+    for (unsigned col = prediction.low; col < prediction.cursor; col++) {
+        if (line[col].ch != prediction.cells[col].ch) return false;
+    }
+    return true;
+}
+
+void PredictiveEcho::reconcile(Clock::time_point now) {
+    if (ops.empty()) return;
+    if (!on_base_row()) {
+        // shell已转到别处（回车、命令输出等），剩余的预测作废
+        ops.clear();
+        return;
+    }
+
+    // 找出画面与之一致的最后一个按键
+    Prediction prediction = start();
+    size_t done = 0;
+    for (size_t i = 0; i < ops.size(); i++) {
+        if (!apply(prediction, ops[i])) break;
+        if (matches(prediction)) done = i + 1;
+    }
+    if (done > 0) {
+        double rtt = std::chrono::duration<double, std::milli>(now - ops[done - 1].sent).count();
+        srtt = srtt < 0 ? rtt : srtt * 0.875 + rtt * 0.125;
+        confirmed_count += done;
+        confident = true;
+        ops.erase(ops.begin(), ops.begin() + done);
+        rebase();
+    }
+
+    if (ops.empty()) return;
+    double expiry = UNCONFIRMED_EXPIRY_MS;
+    if (confident && srtt >= 0) expiry = std::max(2 * srtt + EXPIRY_SLACK_MS, (double)EXPIRY_MIN_MS);
+    if (std::chrono::duration<double, std::milli>(now - ops.front().sent).count() > expiry) {
+        // 之后按过无法预测的键时，不一致可能是那个键造成的，不算预测错误
+        if (frozen_at < ops.front().sent) {
+            mispredicted_count++;
+            confident = false;
+        }
+        ops.clear();
+    }
+}
+
+bool PredictiveEcho::should_show() const {
+    if (mode == PredictMode::ALWAYS) return true;
+    return mode == PredictMode::ADAPTIVE && confident && srtt >= SHOW_RTT_MS;
+}
+
+void PredictiveEcho::refresh(std::string& out) {
+    // 终端正处在shell输出的转义序列中间时不能插入，等下一段输出
+    if (!server.between_sequences()) return;
+    if (ops.empty() || !should_show() || !on_base_row() || !server.plain_output()) {
+        erase(out);
+        return;
+    }
+    draw(out);
+}
+
+// 把终端光标移到row行col列
+static void append_position(std::string& out, unsigned row, unsigned col) {
+    char seq[32];
+    snprintf(seq, sizeof(seq), "\033[%u;%uH", row + 1, col + 1);
+    out += seq;
+}
+
+void PredictiveEcho::draw(std::string& out) {
+    Prediction prediction = start();
+    for (const Op& op : ops) {
+        if (!apply(prediction, op)) {
+            erase(out);
+            return;
+        }
+    }
+    // low左边是当前画面，之后是预测
+    unsigned cols = server.cols();
+    const Screen::Cell* line = server.line(base_row);
+    std::vector<Screen::Cell> want(line, line + cols);
+    std::copy(prediction.cells.begin() + prediction.low, prediction.cells.end(), want.begin() + prediction.low);
+    if (displayed && shown_row != base_row) erase(out);
+
+    const Screen::Cell& server_pen = server.current_pen();
+    Screen::Cell pen = server_pen;
+    unsigned col_now = displayed ? shown_col : server.cursor_col();
+    for (unsigned col = 0; col < cols; col++) {
+        const Screen::Cell& have = displayed ? shown[col] : line[col];
+        if (want[col] == have) continue;
+        // 宽字符从左半边输出，右半边随之显示
+        if (want[col].ch == Screen::WIDE_TAIL && col > 0) col--;
+        if (col != col_now) append_position(out, base_row, col);
+        if (want[col].attrs != pen.attrs || want[col].fg != pen.fg || want[col].bg != pen.bg) {
+            append_sgr(out, want[col]);
+            pen = want[col];
+        }
+        append_utf8(out, want[col].ch);
+        if (col + 1 < cols && want[col + 1].ch == Screen::WIDE_TAIL) col++;
+        col_now = col + 1;
+    }
+    if (col_now != prediction.cursor) append_position(out, base_row, prediction.cursor);
+    if (pen.attrs != server_pen.attrs || pen.fg != server_pen.fg || pen.bg != server_pen.bg) {
+        append_sgr(out, server_pen);
+    }
+    shown = want;
+    shown_row = base_row;
+    shown_col = prediction.cursor;
+    displayed = true;
+}
+
+void PredictiveEcho::erase(std::string& out) {
+    if (!displayed) return;
+    displayed = false;
+    unsigned cols = std::min<unsigned>(server.cols(), shown.size());
+    if (shown_row >= server.rows()) return;
+    const Screen::Cell* line = server.line(shown_row);
+    const Screen::Cell& server_pen = server.current_pen();
+    Screen::Cell pen = server_pen;
+    unsigned col_now = shown_col;
+    for (unsigned col = 0; col < cols; col++) {
+        if (shown[col] == line[col]) continue;
+        if (line[col].ch == Screen::WIDE_TAIL && col > 0) col--;
+        if (col != col_now) append_position(out, shown_row, col);
+        if (line[col].attrs != pen.attrs || line[col].fg != pen.fg || line[col].bg != pen.bg) {
+            append_sgr(out, line[col]);
+            pen = line[col];
+        }
+        append_utf8(out, line[col].ch);
+        if (col + 1 < cols && line[col + 1].ch == Screen::WIDE_TAIL) col++;
+        col_now = col + 1;
+    }
+    if (shown_row != server.cursor_row() || col_now != server.cursor_col()) {
+        append_position(out, server.cursor_row(), server.cursor_col());
+    }
+    if (pen.attrs != server_pen.attrs || pen.fg != server_pen.fg || pen.bg != server_pen.bg) {
+        append_sgr(out, server_pen);
+    }
+}
+
+#ifdef __linux__
+
+#define TICK_MS 20      // 有未确认的预测时检查超时的间隔
+
+static bool write_all(int fd, const char* data, size_t len) {
+    while (len > 0) {
+        ssize_t n = write(fd, data, len);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return false;
+        data += n;
+        len -= n;
+    }
+    return true;
+}
+
+static volatile sig_atomic_t window_changes = 0;
+
+static void count_window_change(int) {
+    window_changes = window_changes + 1;
+}
+
+void run_predictive_client(int in_fd, int out_fd, int connection, PredictiveEcho& echo) {
+    char buffer[4096];
+    std::string out;
+    // 屏幕模型从空白的画面开始，终端也清屏并回到左上角，预测才画在正确的位置
+    static const char CLEAR[] = "\033[H\033[2J";
+    echo.server_output(CLEAR, sizeof(CLEAR) - 1, out);
+    if (!write_all(out_fd, out.data(), out.size())) return;
+
+    // 终端大小变化只记录次数，在循环中同步到屏幕模型。SIGWINCH只在ppoll等待期间放开，
+    // 检查之后、等待之前到达的信号也会使ppoll立即返回
+    struct sigaction action = {}, saved_action;
+    action.sa_handler = count_window_change;
+    sigaction(SIGWINCH, &action, &saved_action);
+    sigset_t winch, saved_mask;
+    sigemptyset(&winch);
+    sigaddset(&winch, SIGWINCH);
+    sigprocmask(SIG_BLOCK, &winch, &saved_mask);
+    sig_atomic_t window_changes_seen = window_changes;
+    const struct timespec tick = {0, TICK_MS * 1000000L};
+    while (true) {
+        out.clear();
+        if (window_changes != window_changes_seen) {
+            window_changes_seen = window_changes;
+            unsigned short rows, cols;
+            if (get_terminal_size(out_fd, rows, cols)) echo.resize(rows, cols, out);
+            if (!write_all(out_fd, out.data(), out.size())) break;
+            out.clear();
+        }
+        struct pollfd fds[2] = {{in_fd, POLLIN, 0}, {connection, POLLIN, 0}};
+        if (ppoll(fds, 2, echo.pending() ? &tick : nullptr, &saved_mask) < 0) {
+            if (errno == EINTR) continue;
+            break;
+        }
+        if (fds[0].revents) {
+            ssize_t n = read(in_fd, buffer, sizeof(buffer));
+            if (n <= 0) break;
+            // 先显示预测，再送出按键
+            echo.keystroke(buffer, n, out);
+            if (!write_all(out_fd, out.data(), out.size())) break;
+            out.clear();
+            if (!write_all(connection, buffer, n)) break;
+        }
+        if (fds[1].revents) {
+            ssize_t n = read(connection, buffer, sizeof(buffer));
+            if (n <= 0) break;
+            echo.server_output(buffer, n, out);
+        }
+        echo.tick(out);
+        if (!write_all(out_fd, out.data(), out.size())) break;
+    }
+    sigprocmask(SIG_SETMASK, &saved_mask, nullptr);
+    sigaction(SIGWINCH, &saved_action, nullptr);
+}
+
+#endif
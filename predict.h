@@ -0,0 +1,127 @@
+#ifndef _PREDICT_H_
+#define _PREDICT_H_
+
+#include <string>
+#include <vector>
+#include <deque>
+#include <chrono>
+#include <cstddef>
+#include "screen.h"
+
+// 预测显示的方式
+enum class PredictMode {
+    NEVER,      // 只核对预测，不显示
+    ADAPTIVE,   // 往返时间较长且最近的预测得到确认时显示
+    ALWAYS      // 总是显示
+};
+
+// 客户端的预测回显
+// 位于用户终端与到shell的连接之间：按键在送出的同时按行编辑的效果预测显示（加下划线），
+// 不等shell的回显。shell的输出送入屏幕模型（即没有预测时终端上应有的画面），
+// 转发前先撤下显示中的预测，转发后把尚未确认的预测叠加在新画面上重新显示。
+// 预测的按键：可打印ASCII（在光标处插入）、退格、左右方向键，只作用于光标所在行。
+// 画面与某个按键之后的预测一致时，它及之前的按键得到确认，同时得到一个往返时间样本；
+// 超时未确认则全部撤销，之后重新积累确认后才显示。其他按键（回车、Tab、控制键等）
+// 的效果无法预测，之后约一个往返时间内不再预测。
+class PredictiveEcho {
+public:
+    explicit PredictiveEcho(unsigned rows = 24, unsigned cols = 80, PredictMode mode = PredictMode::ADAPTIVE);
+
+    void set_mode(PredictMode mode) { this->mode = mode; }
+    // 终端大小变化，撤下全部预测
+    void resize(unsigned rows, unsigned cols, std::string& out);
+
+    // 用户的按键，在送往shell的同时调用，需要立即写到终端的内容追加到out
+    void keystroke(const char* data, size_t len, std::string& out);
+    // 收到shell的输出，写到终端的内容（包括输出本身）追加到out
+    void server_output(const char* data, size_t len, std::string& out);
+    // 定时调用（间隔几十毫秒），撤下超时的预测
+    void tick(std::string& out);
+
+    // 是否有未确认的预测，有时需要定时调用tick
+    bool pending() const { return !ops.empty(); }
+    bool showing() const { return displayed; }
+    // 平滑的往返时间，没有样本时为负
+    double rtt_ms() const { return srtt; }
+    unsigned confirmed() const { return confirmed_count; }
+    unsigned mispredicted() const { return mispredicted_count; }
+    // 没有预测时终端上的画面
+    const Screen& screen() const { return server; }
+
+private:
+    typedef std::chrono::steady_clock Clock;
+
+    enum OpKind { INSERT, BACKSPACE, LEFT, RIGHT };
+
+    // 一次预测的按键
+    struct Op {
+        OpKind kind;
+        char ch;
+        Clock::time_point sent;
+    };
+
+    // 光标行在一组按键之后的样子
+    struct Prediction {
+        std::vector<Screen::Cell> cells;
+        unsigned cursor;
+        unsigned low;           // 被改动的最左列
+        bool valid;             // 按键都可以预测
+    };
+
+    Screen server;
+    PredictMode mode;
+    std::deque<Op> ops;
+
+    // 预测的基础：ops中的按键都还没被shell处理时的光标行
+    std::vector<Screen::Cell> base;
+    unsigned base_row;
+    unsigned base_col;
+    uint64_t base_scrolls;
+
+    // 本行可编辑部分的左端：第一次在本行按键时光标的位置，退格和左移不越过它
+    unsigned anchor_row;
+    uint64_t anchor_scrolls;
+    unsigned left_limit;
+    bool anchored;
+
+    // 终端上显示的预测
+    bool displayed;
+    std::vector<Screen::Cell> shown;
+    unsigned shown_row;
+    unsigned shown_col;
+
+    Clock::time_point frozen_until;    // 无法预测的按键之后暂停预测
+    Clock::time_point frozen_at;       // 最后一个无法预测的按键，其前的预测超时不算预测错误
+    double srtt;
+    bool confident;                     // 最近一次超时之后得到过确认
+    unsigned confirmed_count;
+    unsigned mispredicted_count;
+
+    // 按键解析：方向键的转义序列可能跨调用
+    char escape[8];
+    size_t escape_len;
+
+    void handle_key(OpKind kind, char ch, Clock::time_point now);
+    void freeze(Clock::time_point now);
+    bool on_base_row() const;
+    void rebase();
+    Prediction start() const;
+    bool apply(Prediction& prediction, const Op& op) const;
+    bool matches(const Prediction& prediction) const;
+    void reconcile(Clock::time_point now);
+    bool should_show() const;
+    void erase(std::string& out);
+    void draw(std::string& out);
+    void refresh(std::string& out);
+};
+
+#ifdef __linux__
+
+// 预测回显的客户端：把in_fd的按键转发到连接connection，连接的输出转发到out_fd，
+// 二者都经过echo，直到连接或输入关闭。in_fd应已设为原始模式。开始时清屏，
+// 运行期间out_fd所在终端的大小变化（SIGWINCH）同步到echo
+void run_predictive_client(int in_fd, int out_fd, int connection, PredictiveEcho& echo);
+
+#endif
+
+#endif
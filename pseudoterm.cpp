@@ -0,0 +1,198 @@
+#include "pseudoterm.h"
+#include "pipeline.h"
+
+#ifdef __linux__
+
+#include <cerrno>
+#include <cstdlib>
+#include <fcntl.h>
+#include <poll.h>
+#include <termios.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+
+#define TERMINAL_PIPE_SIZE (1 << 20)   // 中间管道大小
+#define TERMINAL_COPY_SIZE (64 * 1024) // 不支持splice时的缓冲区大小
+// 单次从主端splice的长度：行规程每次只交出几KB，请求过长时内核按长度预先分配页面反而更慢
+#define TERMINAL_READ_SIZE (16 * 1024)
+
+bool open_pseudo_terminal(int& master, int& slave, bool raw, std::string* name) {
+    master = posix_openpt(O_RDWR | O_NOCTTY | O_CLOEXEC);
+    if (master < 0) return false;
+    char path[64];
+    if (grantpt(master) != 0 || unlockpt(master) != 0 || ptsname_r(master, path, sizeof(path)) != 0) {
+        close(master);
+        return false;
+    }
+    slave = open(path, O_RDWR | O_NOCTTY | O_CLOEXEC);
+    if (slave < 0) {
+        close(master);
+        return false;
+    }
+    if (raw) {
+        struct termios tio;
+        if (tcgetattr(slave, &tio) == 0) {
+            cfmakeraw(&tio);
+            tcsetattr(slave, TCSANOW, &tio);
+        }
+    }
+    fcntl(master, F_SETFL, fcntl(master, F_GETFL) | O_NONBLOCK);
+    if (name) *name = path;
+    return true;
+}
+
+bool set_terminal_size(int fd, unsigned short rows, unsigned short cols) {
+    struct winsize size = {};
+    size.ws_row = rows;
+    size.ws_col = cols;
+    return ioctl(fd, TIOCSWINSZ, &size) == 0;
+}
+
+bool get_terminal_size(int fd, unsigned short& rows, unsigned short& cols) {
+    struct winsize size;
+    if (ioctl(fd, TIOCGWINSZ, &size) != 0 || size.ws_row == 0 || size.ws_col == 0) {
+        return false;
+    }
+    rows = size.ws_row;
+    cols = size.ws_col;
+    return true;
+}
+
+// 一个输出端，fd为-1表示已失效，写往它的数据被丢弃
+struct TerminalOutput {
+    int fd;
+    bool use_splice;        // 目标不支持splice时改用write
+};
+
+static void wait_fd(int fd, short events) {
+    struct pollfd pfd = {fd, events, 0};
+    poll(&pfd, 1, -1);
+}
+
+static void write_output(TerminalOutput& out, const char* data, size_t len) {
+    while (out.fd >= 0 && len > 0) {
+        ssize_t n = write(out.fd, data, len);
+        if (n < 0 && errno == EINTR) continue;
+        if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            wait_fd(out.fd, POLLOUT);
+            continue;
+        }
+        if (n <= 0) {
+            out.fd = -1;
+            break;
+        }
+        data += n;
+        len -= n;
+    }
+}
+
+// 把管道中的len字节送往输出
+static void drain_pipe(int pipe_fd, TerminalOutput& out, size_t len) {
+    static thread_local char buffer[TERMINAL_COPY_SIZE];
+    while (len > 0) {
+        if (out.fd >= 0 && out.use_splice) {
+            ssize_t n = splice(pipe_fd, nullptr, out.fd, nullptr, len, SPLICE_F_MOVE | SPLICE_F_MORE);
+            if (n > 0) {
+                len -= n;
+                continue;
+            }
+            if (n < 0 && errno == EINTR) continue;
+            if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+                wait_fd(out.fd, POLLOUT);
+                continue;
+            }
+            if (n < 0 && errno == EINVAL) {
+                out.use_splice = false;
+            } else {
+                out.fd = -1;
+            }
+        }
+        // 经用户空间搬运，输出失效时读出丢弃
+        ssize_t n = read(pipe_fd, buffer, len < sizeof(buffer) ? len : sizeof(buffer));
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return;
+        write_output(out, buffer, n);
+        len -= n;
+    }
+}
+
+// 送出中间管道中的len字节，有旁路时先tee一份到旁路管道
+static void flush_pipe(int pipe_fd, int tap_pipe[2], size_t len, TerminalOutput& out, TerminalOutput& tap) {
+    while (len > 0) {
+        ssize_t copied = 0;
+        if (tap.fd >= 0) {
+            copied = tee(pipe_fd, tap_pipe[1], len, 0);
+            if (copied < 0 && errno == EINTR) continue;
+            if (copied <= 0) tap.fd = -1;
+        }
+        size_t chunk = copied > 0 ? (size_t)copied : len;
+        drain_pipe(pipe_fd, out, chunk);
+        if (copied > 0) drain_pipe(tap_pipe[0], tap, chunk);
+        len -= chunk;
+    }
+}
+
+static bool create_pipe(int fds[2]) {
+    if (pipe2(fds, O_CLOEXEC) != 0) return false;
+    fcntl(fds[1], F_SETPIPE_SZ, TERMINAL_PIPE_SIZE);  // 尽力而为，失败时容量为默认的64KB
+    return true;
+}
+
+long long forward_terminal(int master, int out_fd, int tap_fd, int stop_fd) {
+    static thread_local char buffer[TERMINAL_COPY_SIZE];
+    TerminalOutput out = {out_fd, true};
+    TerminalOutput tap = {tap_fd, true};
+    int mid[2] = {-1, -1};
+    int tap_pipe[2] = {-1, -1};
+    bool use_splice = create_pipe(mid) && (tap_fd < 0 || create_pipe(tap_pipe));
+    size_t capacity = use_splice ? (size_t)fcntl(mid[1], F_GETPIPE_SZ) : 0;
+
+    // 主端非阻塞：读空时先送出已攒的数据，连续的大量输出攒成大块再写
+    fcntl(master, F_SETFL, fcntl(master, F_GETFL) | O_NONBLOCK);
+    InputWait input(stop_fd);
+    long long total = 0;
+    size_t pending = 0;     // 中间管道中尚未送出的字节数
+    while (!input.draining() || input.wait(master)) {
+        ssize_t n;
+        if (use_splice) {
+            size_t want = capacity - pending < TERMINAL_READ_SIZE ? capacity - pending : TERMINAL_READ_SIZE;
+            n = splice(master, nullptr, mid[1], nullptr, want, SPLICE_F_MOVE);
+            if (n < 0 && errno == EINVAL && pending == 0) {
+                use_splice = false;  // 内核不支持从终端splice
+                continue;
+            }
+        } else {
+            n = read(master, buffer, sizeof(buffer));
+        }
+        if (n < 0 && errno == EINTR) continue;
+        if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            if (pending > 0) {
+                flush_pipe(mid[0], tap_pipe, pending, out, tap);
+                pending = 0;
+            } else if (!input.wait(master)) {
+                break;
+            }
+            continue;
+        }
+        if (n <= 0) break;  // EIO：从端已全部关闭且读空
+        total += n;
+        if (use_splice) {
+            pending += n;
+            if (pending >= capacity / 2) {
+                flush_pipe(mid[0], tap_pipe, pending, out, tap);
+                pending = 0;
+            }
+        } else {
+            write_output(out, buffer, n);
+            write_output(tap, buffer, n);
+        }
+    }
+    if (pending > 0) flush_pipe(mid[0], tap_pipe, pending, out, tap);
+
+    for (int fd : {mid[0], mid[1], tap_pipe[0], tap_pipe[1]}) {
+        if (fd >= 0) close(fd);
+    }
+    return total;
+}
+
+#endif
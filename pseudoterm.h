@@ -0,0 +1,29 @@
+#ifndef _PSEUDOTERM_H_
+#define _PSEUDOTERM_H_
+
+#ifdef __linux__
+
+#include <string>
+
+// 打开一个伪终端对，主端为非阻塞
+// raw为true时从端设为原始模式（按键和回显由shell处理，如服务的PTY会话）；
+// 否则保持默认的规范模式（回显、行编辑、\n转\r\n），供命令作为它的终端使用
+// 成功返回true，name非空时填入从端路径
+bool open_pseudo_terminal(int& master, int& slave, bool raw, std::string* name = nullptr);
+
+// 设置伪终端的窗口大小（主端或从端均可）
+bool set_terminal_size(int fd, unsigned short rows, unsigned short cols);
+
+// 读取终端的窗口大小，不是终端或大小未设置时返回false
+bool get_terminal_size(int fd, unsigned short& rows, unsigned short& cols);
+
+// 把主端的输出搬运到out_fd，tap_fd>=0时同时复制一份，直到从端全部关闭或stop_fd通知停止
+// （见pipeline.h的InputWait）
+// 数据经中间管道用splice/tee在内核中搬运，不经过用户空间；out_fd为非阻塞时写满等待可写，
+// 任一输出出错后不再写它，但继续读空主端，命令不会因终端写满而挂起
+// 返回从主端读到的字节数
+long long forward_terminal(int master, int out_fd, int tap_fd = -1, int stop_fd = -1);
+
+#endif
+
+#endif
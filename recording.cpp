@@ -0,0 +1,678 @@
+#include "recording.h"
+#include <algorithm>
+#include <cstring>
+#include <ctime>
+#ifdef __linux__
+#include <cerrno>
+#include <fcntl.h>
+#include <poll.h>
+#include <pthread.h>
+#include <sched.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#endif
+
+static const char MAGIC[4] = {'S', 'H', 'R', 'C'};
+static const char INDEX_MAGIC[4] = {'S', 'H', 'R', 'I'};
+static const uint8_t VERSION = 1;
+static const size_t FOOTER_SIZE = 12;      // 索引偏移和INDEX_MAGIC
+
+#define KEYFRAME_BYTES (1 << 20)    // 默认关键帧间隔，定位时最多重放这么多输出
+#define KEYFRAME_MS 10000
+#define FILE_BUFFER_SIZE (256 * 1024)
+#define WRITE_DELAY_MS 100          // 批没攒够时，有记录后过这么久也写入
+#define PENDING_LIMIT (16 << 20)    // 写入线程落后超过这么多时由调用者自己写，限制内存
+#define TAP_PIPE_SIZE (1 << 20)     // 录制线程来不及时，先由管道吸收突发的输出
+#define MODEL_IDLE_MS 50            // 输出停下这么久后建模线程才开始追赶
+#define MODEL_BACKLOG (256 << 20)   // 持续输出时，落后超过这么多也开始追赶，限制关闭时的等待
+#define MODEL_BATCH (4 << 20)
+
+static void put_varint(std::string& out, uint64_t value) {
+    while (value >= 0x80) {
+        out += (char)(value | 0x80);
+        value >>= 7;
+    }
+    out += (char)value;
+}
+
+static bool read_varint(FILE* file, uint64_t& position, uint64_t& value) {
+    value = 0;
+    for (unsigned shift = 0; shift < 64; shift += 7) {
+        int byte = fgetc(file);
+        if (byte == EOF) return false;
+        position++;
+        value |= (uint64_t)(byte & 0x7F) << shift;
+        if (!(byte & 0x80)) return true;
+    }
+    return false;
+}
+
+// 从position读一条记录，不超过limit；time为上一条记录的时间，读出后更新
+static bool read_record(FILE* file, uint64_t& position, uint64_t limit, uint64_t& time,
+                        SessionPlayer::Event& event) {
+    if (position >= limit) return false;
+    int type = fgetc(file);
+    if (type == EOF) return false;
+    position++;
+    uint64_t delta, rows = 0, cols = 0, frame_time = 0, resume = 0, length = 0;
+    if (!read_varint(file, position, delta)) return false;
+    if (type == 'r' || type == 'k') {
+        if (!read_varint(file, position, rows) || !read_varint(file, position, cols)) return false;
+    }
+    if (type == 'k') {
+        if (!read_varint(file, position, frame_time) || !read_varint(file, position, resume)) return false;
+    }
+    if (type == 'o' || type == 'k') {
+        if (!read_varint(file, position, length) || length > limit - position) return false;
+    } else if (type != 'r') {
+        return false;
+    }
+    event.data.resize(length);
+    if (length > 0 && fread(&event.data[0], 1, length, file) != length) return false;
+    position += length;
+    time += delta;
+    event.type = type;
+    event.time_us = time;
+    event.rows = rows;
+    event.cols = cols;
+    event.frame_time_us = frame_time;
+    event.resume_offset = resume;
+    return true;
+}
+
+SessionRecorder::SessionRecorder(unsigned rows, unsigned cols)
+    : model_waiting(false),
+      writer_waiting(false),
+      file(nullptr),
+      file_offset(0),
+      flushed_offset(0),
+      last_time_us(0),
+      output_time_us(0),
+      output_bytes(0),
+      keyframe_bytes(KEYFRAME_BYTES),
+      keyframe_ms(KEYFRAME_MS),
+      closing(false),
+      initial_rows(rows),
+      initial_cols(cols),
+      renderer(rows, cols),
+      model_offset(0),
+      model_time(0),
+      bytes_since_keyframe(0),
+      last_keyframe_us(0) {
+#ifdef __linux__
+    tap[0] = tap[1] = -1;
+#endif
+}
+
+SessionRecorder::~SessionRecorder() {
+    close();
+}
+
+bool SessionRecorder::open(const std::string& path) {
+    close();
+    std::lock_guard<std::mutex> guard(lock);
+    file = fopen(path.c_str(), "wb");
+    if (!file) return false;
+    setvbuf(file, nullptr, _IONBF, 0);  // 记录已在批中攒好，不再经stdio缓冲复制一次
+    // 建模线程另外打开一次，读回已写入的记录
+    FILE* reader = fopen(path.c_str(), "rb");
+    if (!reader) {
+        fclose(file);
+        file = nullptr;
+        return false;
+    }
+    start = Clock::now();
+    file_offset = flushed_offset = 0;
+    last_time_us = output_time_us = 0;
+    output_bytes = 0;
+    index.clear();
+
+    record.assign(MAGIC, 4);
+    record += (char)VERSION;
+    put_varint(record, initial_rows);
+    put_varint(record, initial_cols);
+    put_varint(record, (uint64_t)time(nullptr));
+    fwrite(record.data(), 1, record.size(), file);
+    file_offset = flushed_offset = record.size();
+    pending.clear();
+
+    renderer = FrameRenderer(initial_rows, initial_cols);
+    model_offset = file_offset;
+    model_time = 0;
+    bytes_since_keyframe = 0;
+    last_keyframe_us = 0;
+    fseek(reader, model_offset, SEEK_SET);
+    indexer = std::thread(&SessionRecorder::index_loop, this, reader);
+    writer = std::thread(&SessionRecorder::write_loop, this);
+    return true;
+}
+
+void SessionRecorder::close() {
+#ifdef __linux__
+    // 先停止录制线程，管道中剩余的输出照常记录
+    if (tap[1] >= 0) {
+        ::close(tap[1]);
+        tap_thread.join();
+        ::close(tap[0]);
+        tap[0] = tap[1] = -1;
+    }
+#endif
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        if (!file) return;
+        closing = true;
+        wake.notify_one();
+        writer_wake.notify_one();
+    }
+    writer.join();
+    indexer.join();
+
+    std::lock_guard<std::mutex> order(file_lock);
+    std::lock_guard<std::mutex> guard(lock);
+    uint64_t index_offset = file_offset;
+    record.assign(1, 'i');
+    put_varint(record, output_time_us);
+    put_varint(record, index.size());
+    IndexEntry previous = {0, 0};
+    for (const IndexEntry& entry : index) {
+        put_varint(record, entry.time_us - previous.time_us);
+        put_varint(record, entry.offset - previous.offset);
+        previous = entry;
+    }
+    for (int i = 0; i < 8; i++) record += (char)(index_offset >> (i * 8));
+    record.append(INDEX_MAGIC, 4);
+    append(record);
+    fwrite(pending.data(), 1, pending.size(), file);
+    pending.clear();
+    fclose(file);
+    file = nullptr;
+    closing = false;
+}
+
+void SessionRecorder::set_keyframe_interval(size_t bytes, unsigned ms) {
+    std::lock_guard<std::mutex> guard(lock);
+    keyframe_bytes = bytes;
+    keyframe_ms = ms;
+}
+
+uint64_t SessionRecorder::now_us() const {
+    return std::chrono::duration_cast<std::chrono::microseconds>(Clock::now() - start).count();
+}
+
+void SessionRecorder::append(const char* data, size_t len) {
+    pending.append(data, len);
+    file_offset += len;
+}
+
+void SessionRecorder::begin_record(char type, uint64_t time_us) {
+    record.assign(1, type);
+    put_varint(record, time_us - last_time_us);
+    last_time_us = time_us;
+}
+
+// 把批写入文件后才交给建模线程，它读回的总是完整的记录。
+// 调用者持有file_lock；写文件时不持有lock，编码新记录不必等待磁盘
+void SessionRecorder::write_pending() {
+    uint64_t end;
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        if (pending.empty() || !file) return;
+        pending.swap(writing);
+        end = file_offset;
+    }
+    fwrite(writing.data(), 1, writing.size(), file);
+    writing.clear();
+    std::lock_guard<std::mutex> guard(lock);
+    flushed_offset = end;
+    if (model_waiting) wake.notify_one();
+}
+
+// 写入线程：批攒够或有记录后过了WRITE_DELAY_MS把它写入文件，关闭时写完剩下的再退出
+void SessionRecorder::write_loop() {
+#ifdef __linux__
+    // 只用空闲的CPU，不与会话争抢
+    struct sched_param param = {};
+    pthread_setschedparam(pthread_self(), SCHED_IDLE, &param);
+#endif
+    std::unique_lock<std::mutex> guard(lock);
+    while (true) {
+        if (!closing && pending.empty()) {
+            // 没有输出的会话上不定时醒来
+            writer_waiting = true;
+            writer_wake.wait(guard);
+            writer_waiting = false;
+            continue;
+        }
+        if (!closing && pending.size() < FILE_BUFFER_SIZE) {
+            writer_waiting = true;
+            writer_wake.wait_for(guard, std::chrono::milliseconds(WRITE_DELAY_MS));
+            writer_waiting = false;
+        }
+        bool stop = closing;
+        guard.unlock();
+        {
+            std::lock_guard<std::mutex> order(file_lock);
+            write_pending();
+        }
+        guard.lock();
+        if (stop) break;
+    }
+}
+
+// 批从空变为非空或已攒够时，唤醒等待的写入线程
+void SessionRecorder::notify_writer(size_t before) {
+    if (writer_waiting && (before == 0 || pending.size() >= FILE_BUFFER_SIZE)) writer_wake.notify_one();
+}
+
+void SessionRecorder::write(const char* data, size_t len) {
+    if (len == 0) return;
+    std::unique_lock<std::mutex> guard(lock);
+    if (!file) return;
+    size_t before = pending.size();
+    output_time_us = now_us();
+    begin_record('o', output_time_us);
+    put_varint(record, len);
+    append(record);
+    append(data, len);
+    output_bytes += len;
+    if (pending.size() < PENDING_LIMIT) {
+        notify_writer(before);
+        return;
+    }
+    // 写入线程一直没有机会运行
+    guard.unlock();
+    std::lock_guard<std::mutex> order(file_lock);
+    write_pending();
+}
+
+void SessionRecorder::resize(unsigned rows, unsigned cols) {
+    std::lock_guard<std::mutex> guard(lock);
+    if (!file) return;
+    size_t before = pending.size();
+    output_time_us = now_us();
+    begin_record('r', output_time_us);
+    put_varint(record, rows);
+    put_varint(record, cols);
+    append(record);
+    notify_writer(before);
+}
+
+void SessionRecorder::flush() {
+    std::lock_guard<std::mutex> order(file_lock);
+    write_pending();
+}
+
+// 建模线程：按顺序读回记录送入屏幕模型，到间隔时追加关键帧；关闭时追上全部记录再退出。
+// 大量输出期间不与会话争抢CPU，等输出停下再追赶
+void SessionRecorder::index_loop(FILE* reader) {
+#ifdef __linux__
+    // 只用空闲的CPU，不与会话争抢
+    struct sched_param param = {};
+    pthread_setschedparam(pthread_self(), SCHED_IDLE, &param);
+#endif
+    SessionPlayer::Event event;
+    while (true) {
+        uint64_t end, interval_bytes, interval_us;
+        {
+            std::unique_lock<std::mutex> guard(lock);
+            while (!closing) {
+                if (flushed_offset == model_offset) {
+                    model_waiting = true;
+                    wake.wait(guard);
+                    model_waiting = false;
+                    continue;
+                }
+                uint64_t quiet_us = now_us() - output_time_us;
+                if (quiet_us >= MODEL_IDLE_MS * 1000 || flushed_offset - model_offset >= MODEL_BACKLOG) break;
+                wake.wait_for(guard, std::chrono::microseconds(MODEL_IDLE_MS * 1000 - quiet_us));
+            }
+            if (flushed_offset == model_offset) {
+                // 已追上：自己追加的关键帧也写入文件后才退出
+                if (pending.empty()) break;
+                guard.unlock();
+                {
+                    std::lock_guard<std::mutex> order(file_lock);
+                    write_pending();
+                }
+                guard.lock();
+            }
+            end = flushed_offset;
+            interval_bytes = keyframe_bytes;
+            interval_us = (uint64_t)keyframe_ms * 1000;
+        }
+        // 每处理一批重新检查，追赶期间又开始大量输出时先让出
+        uint64_t batch_end = model_offset + MODEL_BATCH;
+        clearerr(reader);
+        while (model_offset < std::min(end, batch_end) &&
+               read_record(reader, model_offset, end, model_time, event)) {
+            if (event.type == 'r') renderer.resize(event.rows, event.cols);
+            if (event.type != 'o') continue;
+            renderer.feed(event.data);
+            bytes_since_keyframe += event.data.size();
+            // 关键帧只能插在两个转义序列之间，否则重放时后半个序列会被当作文字
+            if ((bytes_since_keyframe >= interval_bytes || model_time - last_keyframe_us >= interval_us) &&
+                renderer.screen().between_sequences()) {
+                write_keyframe();
+            }
+        }
+        if (model_offset < std::min(end, batch_end)) break;  // 读回出错，不再生成关键帧
+    }
+    fclose(reader);
+}
+
+// 关键帧从空白终端重绘整个画面，再恢复当前的属性
+void SessionRecorder::write_keyframe() {
+    std::string frame;
+    renderer.render(frame, true);
+    append_sgr(frame, renderer.screen().current_pen());
+    bytes_since_keyframe = 0;
+    last_keyframe_us = model_time;
+
+    std::lock_guard<std::mutex> guard(lock);
+    size_t before = pending.size();
+    index.push_back({model_time, file_offset});
+    begin_record('k', now_us());
+    put_varint(record, renderer.screen().rows());
+    put_varint(record, renderer.screen().cols());
+    put_varint(record, model_time);
+    put_varint(record, model_offset);
+    put_varint(record, frame.size());
+    append(record);
+    append(frame);
+    notify_writer(before);
+}
+
+#ifdef __linux__
+
+// 把管道中的len字节记为一条输出：批连同记录头写入文件后用splice把数据从管道搬进文件，
+// 不经用户空间复制。文件不支持splice时读出再写
+void SessionRecorder::write_from_pipe(int pipe_fd, size_t len) {
+    static thread_local char buffer[64 * 1024];
+    std::lock_guard<std::mutex> order(file_lock);
+    uint64_t end = 0;
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        if (file) {
+            output_time_us = now_us();
+            begin_record('o', output_time_us);
+            put_varint(record, len);
+            append(record);
+            pending.swap(writing);
+            file_offset += len;
+            output_bytes += len;
+            end = file_offset;
+        }
+    }
+    if (end > 0) {
+        fwrite(writing.data(), 1, writing.size(), file);
+        writing.clear();
+    }
+    bool use_splice = end > 0;
+    while (len > 0) {
+        ssize_t n;
+        if (use_splice) {
+            n = splice(pipe_fd, nullptr, fileno(file), nullptr, len, SPLICE_F_MOVE);
+            if (n < 0 && errno == EINVAL) {
+                use_splice = false;
+                continue;
+            }
+        } else {
+            n = read(pipe_fd, buffer, std::min(len, sizeof(buffer)));
+            if (n > 0 && end > 0) fwrite(buffer, 1, n, file);
+        }
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) break;
+        len -= n;
+    }
+    if (end > 0) {
+        std::lock_guard<std::mutex> guard(lock);
+        flushed_offset = end;
+        if (model_waiting) wake.notify_one();
+    }
+}
+
+int SessionRecorder::tap_fd() {
+    if (tap[1] >= 0) return tap[1];
+    if (pipe2(tap, O_CLOEXEC) != 0) {
+        tap[0] = tap[1] = -1;
+        return -1;
+    }
+    fcntl(tap[1], F_SETPIPE_SZ, TAP_PIPE_SIZE);
+    // 管道中有多少就记多少，数据由write_from_pipe直接搬进文件
+    tap_thread = std::thread([this]() {
+        struct sched_param param = {};
+        pthread_setschedparam(pthread_self(), SCHED_IDLE, &param);
+        while (true) {
+            struct pollfd pfd = {tap[0], POLLIN, 0};
+            if (poll(&pfd, 1, -1) < 0) {
+                if (errno == EINTR) continue;
+                break;
+            }
+            int available = 0;
+            if (ioctl(tap[0], FIONREAD, &available) != 0 || available <= 0) {
+                if (pfd.revents & (POLLHUP | POLLERR)) break;  // 写端已关闭且读空
+                continue;
+            }
+            write_from_pipe(tap[0], available);
+        }
+    });
+    return tap[1];
+}
+
+#endif
+
+void SessionPlayer::close() {
+    if (file) fclose(file);
+    file = nullptr;
+    index.clear();
+}
+
+bool SessionPlayer::open(const std::string& path) {
+    close();
+    file = fopen(path.c_str(), "rb");
+    if (!file) return false;
+    setvbuf(file, nullptr, _IOFBF, FILE_BUFFER_SIZE);
+    char magic[5];
+    uint64_t rows, cols, seconds;
+    position = 5;
+    if (fread(magic, 1, 5, file) != 5 || memcmp(magic, MAGIC, 4) != 0 || (uint8_t)magic[4] != VERSION ||
+        !read_varint(file, position, rows) || !read_varint(file, position, cols) ||
+        !read_varint(file, position, seconds) || rows == 0 || cols == 0) {
+        close();
+        return false;
+    }
+    initial_rows = rows;
+    initial_cols = cols;
+    start_seconds = seconds;
+    data_offset = position;
+    if (!read_index()) scan();
+    rewind();
+    return true;
+}
+
+// 读文件末尾的索引，没有或不完整时返回false
+bool SessionPlayer::read_index() {
+    unsigned char footer[FOOTER_SIZE];
+    if (fseeko(file, -(off_t)FOOTER_SIZE, SEEK_END) != 0 || fread(footer, 1, FOOTER_SIZE, file) != FOOTER_SIZE ||
+        memcmp(footer + 8, INDEX_MAGIC, 4) != 0) {
+        return false;
+    }
+    uint64_t offset = 0;
+    for (int i = 0; i < 8; i++) offset |= (uint64_t)footer[i] << (i * 8);
+    uint64_t total, count;
+    if (offset < data_offset || fseeko(file, offset, SEEK_SET) != 0 || fgetc(file) != 'i' ||
+        !read_varint(file, position, total) || !read_varint(file, position, count)) {
+        return false;
+    }
+    IndexEntry entry = {0, 0};
+    for (uint64_t i = 0; i < count; i++) {
+        uint64_t time_delta, offset_delta;
+        if (!read_varint(file, position, time_delta) || !read_varint(file, position, offset_delta)) {
+            index.clear();
+            return false;
+        }
+        entry.time_us += time_delta;
+        entry.offset += offset_delta;
+        index.push_back(entry);
+    }
+    data_end = offset;
+    duration = total;
+    return true;
+}
+
+// 录制没有正常结束：顺序读一遍，重建关键帧的位置，截断的最后一条记录丢弃
+void SessionPlayer::scan() {
+    index.clear();
+    data_end = UINT64_MAX;
+    duration = 0;
+    move_to(data_offset, 0);
+    Event event;
+    uint64_t offset = position;
+    while (read_record(file, position, data_end, time, event)) {
+        if (event.type == 'k') index.push_back({event.frame_time_us, offset});
+        else duration = event.time_us;
+        offset = position;
+    }
+    data_end = offset;
+}
+
+void SessionPlayer::move_to(uint64_t offset, uint64_t time_us) {
+    fseeko(file, offset, SEEK_SET);
+    position = offset;
+    time = time_us;
+}
+
+void SessionPlayer::rewind() {
+    if (file) move_to(data_offset, 0);
+}
+
+bool SessionPlayer::next(Event& event) {
+    return file && read_record(file, position, data_end, time, event);
+}
+
+// 读出time_us之前最近的关键帧，移到它的续接位置；之前没有关键帧时回到开头，keyframe.type为0
+bool SessionPlayer::locate(uint64_t time_us, Event& keyframe) {
+    keyframe.type = 0;
+    auto it = std::upper_bound(index.begin(), index.end(), time_us,
+                               [](uint64_t t, const IndexEntry& entry) { return t < entry.time_us; });
+    if (it == index.begin()) {
+        rewind();
+        return true;
+    }
+    --it;
+    move_to(it->offset, 0);
+    if (!next(keyframe) || keyframe.type != 'k' || keyframe.resume_offset < data_offset ||
+        keyframe.resume_offset > data_end) {
+        return false;
+    }
+    keyframe.time_us = keyframe.frame_time_us;
+    move_to(keyframe.resume_offset, keyframe.frame_time_us);
+    return true;
+}
+
+// 读出下一条输出或大小变化，它晚于time_us时退回，返回false
+bool SessionPlayer::next_before(uint64_t time_us, Event& event) {
+    while (true) {
+        uint64_t saved_position = position;
+        uint64_t saved_time = time;
+        if (!next(event) || event.time_us > time_us) {
+            move_to(saved_position, saved_time);
+            return false;
+        }
+        if (event.type != 'k') return true;
+    }
+}
+
+bool SessionPlayer::seek(uint64_t time_us, Screen& screen) {
+    Event event;
+    if (!file || !locate(time_us, event)) return false;
+    screen.reset();
+    if (event.type == 'k') {
+        screen.resize(event.rows, event.cols);
+        screen.feed(event.data);
+    } else {
+        screen.resize(initial_rows, initial_cols);
+    }
+    while (next_before(time_us, event)) {
+        if (event.type == 'o') screen.feed(event.data);
+        else screen.resize(event.rows, event.cols);
+    }
+    return true;
+}
+
+bool SessionPlayer::seek(uint64_t time_us, std::string& out) {
+    Event event;
+    out.clear();
+    if (!file || !locate(time_us, event)) return false;
+    if (event.type == 'k') out = event.data;
+    while (next_before(time_us, event)) {
+        if (event.type == 'o') out += event.data;
+    }
+    return true;
+}
+
+// JSON字符串转义，控制字符写成\u00XX，其余字节原样输出
+static void append_json_string(std::string& out, const char* data, size_t len) {
+    out += '"';
+    for (size_t i = 0; i < len; i++) {
+        unsigned char c = data[i];
+        if (c == '"' || c == '\\') {
+            out += '\\';
+            out += c;
+        } else if (c < 0x20 || c == 0x7F) {
+            char escaped[8];
+            snprintf(escaped, sizeof(escaped), "\\u%04x", c);
+            out += escaped;
+        } else {
+            out += c;
+        }
+    }
+    out += '"';
+}
+
+// data末尾不完整的UTF-8字符的起点，没有时为data.size()
+static size_t utf8_complete_length(const std::string& data) {
+    size_t size = data.size();
+    for (size_t back = 1; back <= 4 && back <= size; back++) {
+        unsigned char c = data[size - back];
+        if ((c & 0xC0) == 0x80) continue;
+        size_t need = c >= 0xF0 ? 4 : c >= 0xE0 ? 3 : c >= 0xC0 ? 2 : 1;
+        return need > back ? size - back : size;
+    }
+    return size;
+}
+
+bool SessionPlayer::export_asciicast(const std::string& path) {
+    if (!file) return false;
+    FILE* out = fopen(path.c_str(), "w");
+    if (!out) return false;
+    fprintf(out, "{\"version\": 2, \"width\": %u, \"height\": %u, \"timestamp\": %llu}\n", initial_cols,
+            initial_rows, (unsigned long long)start_seconds);
+    // asciicast的输出是字符串，跨记录的UTF-8字符留到下一条一起输出
+    std::string pending;
+    std::string line;
+    Event event;
+    uint64_t last_time = 0;
+    rewind();
+    while (next(event)) {
+        if (event.type == 'r') {
+            fprintf(out, "[%.6f, \"r\", \"%ux%u\"]\n", event.time_us / 1e6, event.cols, event.rows);
+        }
+        if (event.type != 'o') continue;
+        last_time = event.time_us;
+        pending += event.data;
+        size_t length = utf8_complete_length(pending);
+        if (length == 0) continue;
+        line.clear();
+        append_json_string(line, pending.data(), length);
+        fprintf(out, "[%.6f, \"o\", %s]\n", event.time_us / 1e6, line.c_str());
+        pending.erase(0, length);
+    }
+    if (!pending.empty()) {
+        line.clear();
+        append_json_string(line, pending.data(), pending.size());
+        fprintf(out, "[%.6f, \"o\", %s]\n", last_time / 1e6, line.c_str());
+    }
+    rewind();
+    return fclose(out) == 0;
+}
@@ -0,0 +1,187 @@
+#ifndef _RECORDING_H_
+#define _RECORDING_H_
+
+#include <string>
+#include <vector>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <chrono>
+#include <cstdio>
+#include <cstdint>
+#include <cstddef>
+#include "screen.h"
+#include "fastscroll.h"
+
+// 会话输出录制
+// 记录会话写到终端的全部内容和时间，供审计回放。文件格式（整数都是LEB128变长整数，
+// 时间是距上一条记录的微秒数，按文件中的顺序递增）：
+//   文件头  "SHRC" 版本1 行数 列数 开始时间（Unix秒）
+//   'o' 时间 长度 字节                       输出
+//   'r' 时间 行数 列数                       终端大小变化
+//   'k' 时间 行数 列数 画面时刻 续接位置 长度 字节  关键帧
+//   'i' 总时长 个数 {画面时刻 关键帧位置}        关闭时写入的关键帧索引（都与前一项相减）
+//   8字节小端的索引偏移 "SHRI"
+// 关键帧是在空白终端上重现某一时刻画面的序列，画面时刻和续接位置是绝对值：画面包含到
+// 画面时刻为止的输出，从续接位置起的记录接着它重放。
+// 输出路径上只把记录编码进内存中的批，由写入线程攒批写文件；旁路的输出由录制线程用splice
+// 从管道直接搬进文件，不经用户空间复制。屏幕模型由后台的建模线程读回文件维护，每隔一段
+// 输出量或时间（且不在转义序列中间时）追加关键帧。Linux上这三个线程都只在CPU空闲时运行，
+// 输出洪水期间落后，之后再追上；CPU一直满载时，批超过上限后由调用者自己写文件，旁路管道
+// 写满后输出等待录制线程。
+// 回放定位时二分查找索引，从之前最近的关键帧开始重放，不必从头处理整个录制。
+// 没有正常关闭的录制没有索引，打开时顺序扫描一遍重建。
+class SessionRecorder {
+public:
+    SessionRecorder(unsigned rows = 24, unsigned cols = 80);
+    ~SessionRecorder();
+    SessionRecorder(const SessionRecorder&) = delete;
+    SessionRecorder& operator=(const SessionRecorder&) = delete;
+
+    bool open(const std::string& path);
+    // 等建模线程追上、写出索引后关闭，之后的输出不再记录
+    void close();
+    bool is_open() const { return file != nullptr; }
+
+    // 关键帧的间隔：距上一个关键帧的输出超过bytes字节，或有输出且超过ms毫秒
+    void set_keyframe_interval(size_t bytes, unsigned ms);
+
+    // 记录一段输出，可以从多个线程调用
+    void write(const char* data, size_t len);
+    // 记录终端大小变化（见Shell::set_window_listener），直接追加，旁路管道中此时尚未读出的输出排在它之后
+    void resize(unsigned rows, unsigned cols);
+    // 把批中的记录写入文件，交给建模线程
+    void flush();
+
+#ifdef __linux__
+    // 写入这个描述符的数据由录制线程读出记录（见Shell::set_output_tap），close时停止
+    int tap_fd();
+#endif
+
+    uint64_t bytes_recorded() const { return output_bytes; }
+    size_t keyframe_count() const { return index.size(); }
+
+private:
+    typedef std::chrono::steady_clock Clock;
+
+    struct IndexEntry {
+        uint64_t time_us;
+        uint64_t offset;
+    };
+
+    std::mutex file_lock;           // 持有它才能写文件，保证记录的顺序；先于lock获取
+    std::mutex lock;
+    std::condition_variable wake;   // 有新写入文件的记录或正在关闭，通知建模线程
+    bool model_waiting;             // 建模线程已追上，等待新记录；只有这时才需要通知，
+                                    // 在等输出停下时它定时醒来自己检查
+    std::condition_variable writer_wake;    // 批已攒够或正在关闭，通知写入线程
+    bool writer_waiting;
+    FILE* file;
+    std::string pending;            // 尚未写入文件的记录
+    std::string writing;            // 正在写入文件的批，与pending交换复用
+    uint64_t file_offset;           // 已追加的字节数（含pending）
+    uint64_t flushed_offset;        // 已写入文件的字节数
+    Clock::time_point start;
+    uint64_t last_time_us;          // 上一条记录的时间
+    uint64_t output_time_us;        // 最后一次输出或大小变化的时间
+    uint64_t output_bytes;
+    std::vector<IndexEntry> index;
+    uint64_t keyframe_bytes;        // 关键帧间隔
+    unsigned keyframe_ms;
+    bool closing;
+    std::string record;             // 编码用的缓冲，复用
+#ifdef __linux__
+    int tap[2];
+    std::thread tap_thread;
+#endif
+    std::thread writer;
+
+    // 以下只由建模线程使用
+    std::thread indexer;
+    unsigned initial_rows;
+    unsigned initial_cols;
+    FrameRenderer renderer;         // 屏幕模型，生成关键帧
+    uint64_t model_offset;          // 下一条要读回的记录
+    uint64_t model_time;            // 已读回的最后一条记录的时间
+    uint64_t bytes_since_keyframe;
+    uint64_t last_keyframe_us;
+
+    uint64_t now_us() const;
+    void append(const char* data, size_t len);
+    void append(const std::string& data) { append(data.data(), data.size()); }
+    void begin_record(char type, uint64_t time_us);
+    void notify_writer(size_t before);
+    void write_pending();
+    void write_loop();
+    void index_loop(FILE* reader);
+    void write_keyframe();
+#ifdef __linux__
+    void write_from_pipe(int pipe_fd, size_t len);
+#endif
+};
+
+// 录制的回放
+class SessionPlayer {
+public:
+    // 一条记录
+    struct Event {
+        char type;          // 'o'输出，'r'大小变化，'k'关键帧
+        uint64_t time_us;   // 距录制开始的时间
+        unsigned rows;      // 'r'和'k'的终端大小
+        unsigned cols;
+        std::string data;   // 'o'和'k'的字节
+        uint64_t frame_time_us;     // 'k'：画面时刻
+        uint64_t resume_offset;     // 'k'：续接位置
+    };
+
+    SessionPlayer() : file(nullptr) {}
+    ~SessionPlayer() { close(); }
+    SessionPlayer(const SessionPlayer&) = delete;
+    SessionPlayer& operator=(const SessionPlayer&) = delete;
+
+    bool open(const std::string& path);
+    void close();
+
+    unsigned rows() const { return initial_rows; }
+    unsigned cols() const { return initial_cols; }
+    uint64_t start_time() const { return start_seconds; }
+    uint64_t duration_us() const { return duration; }
+    size_t keyframe_count() const { return index.size(); }
+
+    // 把screen设为time_us时刻的画面（大小也随之改变），之后next从该时刻继续
+    bool seek(uint64_t time_us, Screen& screen);
+    // 同上，out为在空白终端上重现该时刻画面的输出
+    bool seek(uint64_t time_us, std::string& out);
+
+    // 顺序读取：rewind回到开头，next读出下一条记录，到结尾返回false
+    void rewind();
+    bool next(Event& event);
+
+    // 导出为asciinema v2格式（关键帧不导出）
+    bool export_asciicast(const std::string& path);
+
+private:
+    struct IndexEntry {
+        uint64_t time_us;
+        uint64_t offset;
+    };
+
+    FILE* file;
+    unsigned initial_rows;
+    unsigned initial_cols;
+    uint64_t start_seconds;
+    uint64_t data_offset;           // 第一条记录的位置
+    uint64_t data_end;              // 索引的位置（或文件末尾）
+    uint64_t duration;
+    std::vector<IndexEntry> index;
+    uint64_t position;              // 下一条记录的位置
+    uint64_t time;                  // 上一条记录的时间
+
+    bool read_index();
+    void scan();
+    void move_to(uint64_t offset, uint64_t time_us);
+    bool locate(uint64_t time_us, Event& keyframe);
+    bool next_before(uint64_t time_us, Event& event);
+};
+
+#endif
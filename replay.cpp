@@ -0,0 +1,101 @@
+#include "replay.h"
+#ifdef __linux__
+#include <atomic>
+#include <thread>
+#include <cerrno>
+#include <fcntl.h>
+#include <unistd.h>
+#include "fifo.h"
+#include "shell.h"
+
+// 读出shell的全部输出，计数并复制到sink_fd
+static void drain_output(int fd, int sink_fd, std::atomic<size_t>& bytes) {
+    char buffer[16384];
+    while (true) {
+        ssize_t n = read(fd, buffer, sizeof(buffer));
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) break;
+        bytes.fetch_add(n, std::memory_order_relaxed);
+        for (ssize_t done = 0; sink_fd >= 0 && done < n;) {
+            ssize_t w = write(sink_fd, buffer + done, n - done);
+            if (w < 0 && errno == EINTR) continue;
+            if (w <= 0) {
+                sink_fd = -1;
+                break;
+            }
+            done += w;
+        }
+    }
+}
+
+ReplayReport replay_input(const InputRecording& recording, const ReplayOptions& options) {
+    ReplayReport report = {};
+    report.keystrokes = recording.size();
+    report.input_bytes = recording.total_bytes();
+
+    // 输出管道的写端保持阻塞，shell每次写出都写完
+    int out[2];
+    if (pipe2(out, O_CLOEXEC) != 0) return report;
+    std::atomic<size_t> output_bytes(0);
+    std::thread sink(drain_output, out[0], options.sink_fd, std::ref(output_bytes));
+
+    static const uint32_t FIFO_SIZE = 1024;
+    uint8_t buffer[FIFO_SIZE];
+    struct fifo input;
+    fifo_init(&input, buffer, FIFO_SIZE);
+    {
+        Shell shell(&input, out[1]);
+        std::atomic<bool> fed(false);
+        auto start = std::chrono::steady_clock::now();
+
+        // 与终端输入线程一样写入fifo，fifo满时等shell读出
+        std::thread feeder([&]() {
+            auto due = start;
+            for (size_t i = 0; i < recording.size(); i++) {
+                const InputRecording::Event& event = recording.event(i);
+                if (options.speed > 0) {
+                    due += std::chrono::microseconds((uint64_t)(event.delay_us / options.speed));
+                    std::this_thread::sleep_until(due);
+                }
+                const uint8_t* data = (const uint8_t*)recording.bytes(event);
+                size_t left = event.length;
+                while (left > 0) {
+                    uint32_t n = fifo_write(&input, data, left);
+                    data += n;
+                    left -= n;
+                    if (left > 0) std::this_thread::yield();
+                }
+            }
+            fed.store(true, std::memory_order_release);
+        });
+
+        auto deadline = std::chrono::steady_clock::time_point::max();
+        while (true) {
+            if (shell.process_fifo()) continue;
+            bool done = fed.load(std::memory_order_acquire) && fifo_read_available(&input) == 0;
+            if (done && !shell.foreground_busy()) {
+                report.completed = true;
+                break;
+            }
+            if (done && deadline == std::chrono::steady_clock::time_point::max()) {
+                deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(options.timeout_ms);
+            }
+            if (std::chrono::steady_clock::now() >= deadline) break;
+            // 前台命令运行期间不必空转
+            if (shell.foreground_busy()) {
+                std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            } else {
+                std::this_thread::yield();
+            }
+        }
+        report.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        feeder.join();
+    }
+    close(out[1]);
+    sink.join();
+    close(out[0]);
+    report.output_bytes = output_bytes.load();
+    return report;
+}
+
+#endif
@@ -0,0 +1,37 @@
+#ifndef _REPLAY_H_
+#define _REPLAY_H_
+
+#include <cstddef>
+#include "inputrecord.h"
+
+#ifdef __linux__
+
+// 回放的参数
+struct ReplayOptions {
+    double speed = 1.0;     // 相对录制时的速度倍数，0为不等待、尽快送入
+    int sink_fd = -1;       // shell的输出另外复制到这里，-1为丢弃
+    int timeout_ms = 60000; // 回放结束后等待前台命令完成的上限
+};
+
+// 回放的结果
+struct ReplayReport {
+    size_t keystrokes;      // 事件数
+    size_t input_bytes;
+    size_t output_bytes;    // shell写到终端的字节数，包括命令的输出
+    double seconds;         // 第一个事件送入到shell处理完全部输入
+    bool completed;         // 前台命令在超时前全部结束
+
+    double keystrokes_per_second() const { return seconds > 0 ? keystrokes / seconds : 0; }
+    double output_bytes_per_keystroke() const {
+        return keystrokes > 0 ? (double)output_bytes / keystrokes : 0;
+    }
+};
+
+// 无终端回放：新建一个shell（会话模式，输出写入管道，由另一线程读出计数），
+// 输入线程按录制的间隔（或倍速、或不等待）把事件写入fifo，当前线程执行shell的
+// 输入循环，直到全部输入处理完且没有前台命令
+ReplayReport replay_input(const InputRecording& recording, const ReplayOptions& options = ReplayOptions());
+
+#endif
+
+#endif
@@ -0,0 +1,867 @@
+#include "screen.h"
+#include "scrollback.h"
+#include "utf8.h"
+#include <algorithm>
+#include <cstring>
+
+// DEC画线字符集，0x60-0x7E对应的Unicode字符
+static const uint32_t DEC_GRAPHICS[31] = {
+    0x25C6, 0x2592, 0x2409, 0x240C, 0x240D, 0x240A, 0x00B0, 0x00B1,  // ` a b c d e f g
+    0x2424, 0x240B, 0x2518, 0x2510, 0x250C, 0x2514, 0x253C, 0x23BA,  // h i j k l m n o
+    0x23BB, 0x2500, 0x23BC, 0x23BD, 0x251C, 0x2524, 0x2534, 0x252C,  // p q r s t u v w
+    0x2502, 0x2264, 0x2265, 0x03C0, 0x2260, 0x00A3, 0x00B7           // x y z { | } ~
+};
+
+Screen::Screen(unsigned rows, unsigned cols) :
+    row_count(std::max(rows, 1u)),
+    col_count(std::max(cols, 1u)),
+    scrollback(nullptr),
+    scrolled(0) {
+    reset();
+}
+
+void Screen::reset() {
+    pen = {' ', 0, 0, 0};
+    cells.assign((size_t)row_count * col_count, pen);
+    saved_cells = cells;
+    row_map.resize(row_count);
+    for (unsigned i = 0; i < row_count; i++) row_map[i] = i;
+    saved_map = row_map;
+    dirty.assign((row_count + 63) / 64, 0);
+    mark_dirty(0, row_count - 1);
+    tab_stops.assign(col_count, 0);
+    for (unsigned i = 8; i < col_count; i += 8) tab_stops[i] = 1;
+
+    cur_row = 0;
+    cur_col = 0;
+    wrap_pending = false;
+    scroll_top = 0;
+    scroll_bottom = row_count - 1;
+    origin_mode = false;
+    autowrap = true;
+    insert_mode = false;
+    cursor_shown = true;
+    alternate = false;
+    graphics[0] = graphics[1] = false;
+    charset = 0;
+    last_char = ' ';
+    saved = {0, 0, pen, false, {false, false}, 0};
+
+    state = GROUND;
+    param_count = 0;
+    private_marker = 0;
+    intermediate = 0;
+    string_escape = false;
+    utf8_code = 0;
+    utf8_left = 0;
+}
+
+void Screen::resize(unsigned rows, unsigned cols) {
+    rows = std::max(rows, 1u);
+    cols = std::max(cols, 1u);
+    if (rows == row_count && cols == col_count) return;
+
+    // 两块屏幕都按逻辑行复制左上角的内容
+    Cell empty = {' ', 0, 0, 0};
+    auto copy_screen = [&](const std::vector<Cell>& from, const std::vector<unsigned>& map) {
+        std::vector<Cell> to((size_t)rows * cols, empty);
+        unsigned keep_rows = std::min(rows, row_count);
+        unsigned keep_cols = std::min(cols, col_count);
+        for (unsigned r = 0; r < keep_rows; r++) {
+            const Cell* row = &from[(size_t)map[r] * col_count];
+            std::copy_n(row, keep_cols, &to[(size_t)r * cols]);
+            // 右边界切断的宽字符
+            if (keep_cols < col_count && row[keep_cols].ch == WIDE_TAIL) {
+                to[(size_t)r * cols + keep_cols - 1].ch = ' ';
+            }
+        }
+        return to;
+    };
+    cells = copy_screen(cells, row_map);
+    saved_cells = copy_screen(saved_cells, saved_map);
+
+    row_count = rows;
+    col_count = cols;
+    row_map.resize(rows);
+    for (unsigned i = 0; i < rows; i++) row_map[i] = i;
+    saved_map = row_map;
+    dirty.assign((rows + 63) / 64, 0);
+    mark_dirty(0, rows - 1);
+    size_t old_cols = tab_stops.size();
+    tab_stops.resize(cols, 0);
+    for (size_t i = old_cols; i < cols; i++) tab_stops[i] = i % 8 == 0;
+
+    scroll_top = 0;
+    scroll_bottom = rows - 1;
+    cur_row = std::min(cur_row, rows - 1);
+    cur_col = std::min(cur_col, cols - 1);
+    saved.row = std::min(saved.row, rows - 1);
+    saved.col = std::min(saved.col, cols - 1);
+    wrap_pending = false;
+}
+
+bool Screen::any_dirty() const {
+    for (uint64_t word : dirty) {
+        if (word) return true;
+    }
+    return false;
+}
+
+void Screen::clear_dirty() {
+    std::fill(dirty.begin(), dirty.end(), 0);
+}
+
+void Screen::mark_dirty(unsigned first, unsigned last) {
+    // 按64位字整段置位
+    for (unsigned word = first >> 6; word <= last >> 6; word++) {
+        uint64_t mask = ~(uint64_t)0;
+        if (word == first >> 6) mask &= ~(uint64_t)0 << (first & 63);
+        if (word == last >> 6 && (last & 63) != 63) mask &= ((uint64_t)1 << ((last & 63) + 1)) - 1;
+        dirty[word] |= mask;
+    }
+}
+
+// 擦除后的空白格保留当前背景色（与xterm一致）
+Screen::Cell Screen::blank() const {
+    return {' ', 0, pen.bg, (uint16_t)(pen.attrs & BG_COLOR)};
+}
+
+void Screen::clear_cells(unsigned row, unsigned from, unsigned to) {
+    if (from >= to) return;
+    break_wide(row_cells(row), from, to);
+    std::fill(row_cells(row) + from, row_cells(row) + to, blank());
+    mark_dirty(row);
+}
+
+// [from, to)将被覆盖或移动：跨在两端的宽字符整个换成空格
+void Screen::break_wide(Cell* cells_of_row, unsigned from, unsigned to) {
+    if (from > 0 && from < col_count && cells_of_row[from].ch == WIDE_TAIL) {
+        cells_of_row[from - 1].ch = cells_of_row[from].ch = ' ';
+    }
+    if (to > 0 && to < col_count && cells_of_row[to].ch == WIDE_TAIL) {
+        cells_of_row[to - 1].ch = cells_of_row[to].ch = ' ';
+    }
+}
+
+std::string Screen::row_text(unsigned row) const {
+    const Cell* cells_of_row = line(row);
+    unsigned end = col_count;
+    while (end > 0 && cells_of_row[end - 1].ch == ' ') end--;
+    std::string out;
+    out.reserve(end);
+    for (unsigned col = 0; col < end; col++) {
+        uint32_t ch = cells_of_row[col].ch;
+        if (ch == WIDE_TAIL) continue;
+        if (ch < 0x80) {
+            out += (char)ch;
+        } else if (ch < 0x800) {
+            out += (char)(0xC0 | (ch >> 6));
+            out += (char)(0x80 | (ch & 0x3F));
+        } else if (ch < 0x10000) {
+            out += (char)(0xE0 | (ch >> 12));
+            out += (char)(0x80 | ((ch >> 6) & 0x3F));
+            out += (char)(0x80 | (ch & 0x3F));
+        } else {
+            out += (char)(0xF0 | (ch >> 18));
+            out += (char)(0x80 | ((ch >> 12) & 0x3F));
+            out += (char)(0x80 | ((ch >> 6) & 0x3F));
+            out += (char)(0x80 | (ch & 0x3F));
+        }
+    }
+    return out;
+}
+
+std::string Screen::text() const {
+    std::string out;
+    for (unsigned row = 0; row < row_count; row++) {
+        out += row_text(row);
+        out += '\n';
+    }
+    return out;
+}
+
+void Screen::feed(const char* data, size_t len) {
+    const unsigned char* p = (const unsigned char*)data;
+    const unsigned char* end = p + len;
+    while (p < end) {
+        if (state == GROUND) {
+            // 连续的可打印ASCII整段写入
+            if (utf8_left == 0 && *p >= 0x20 && *p < 0x7F) {
+                p = print_ascii(p, end);
+                continue;
+            }
+            unsigned char c = *p++;
+            if (utf8_left > 0) {
+                if ((c & 0xC0) == 0x80) {
+                    utf8_code = (utf8_code << 6) | (c & 0x3F);
+                    if (--utf8_left == 0) print(utf8_code);
+                    continue;
+                }
+                // 不完整的UTF-8字符，重新处理当前字节
+                utf8_left = 0;
+                print(0xFFFD);
+                p--;
+                continue;
+            }
+            if (c == 0x1B && p < end && *p == '[') {
+                // 最常见的CSI直接进入参数解析
+                p++;
+                state = CSI_PARAM;
+                param_count = 0;
+                params[0] = 0;
+                private_marker = 0;
+                intermediate = 0;
+            } else if (c < 0x20 || c == 0x7F) {
+                execute(c);
+            } else if (c >= 0xE0 && c <= 0xEF && end - p >= 2 && (p[0] & 0xC0) == 0x80 &&
+                       (p[1] & 0xC0) == 0x80) {
+                // 完整的三字节字符（中日韩文字等）直接解码
+                print(((c & 0x0F) << 12) | ((p[0] & 0x3F) << 6) | (p[1] & 0x3F));
+                p += 2;
+            } else if (c >= 0xC2 && c <= 0xDF) {
+                utf8_code = c & 0x1F;
+                utf8_left = 1;
+            } else if (c >= 0xE0 && c <= 0xEF) {
+                utf8_code = c & 0x0F;
+                utf8_left = 2;
+            } else if (c >= 0xF0 && c <= 0xF4) {
+                utf8_code = c & 0x07;
+                utf8_left = 3;
+            } else {
+                print(0xFFFD);
+            }
+            continue;
+        }
+
+        if (state == STRING) {
+            // 字符串内容不显示，找到BEL或ESC \为止
+            unsigned char c = *p++;
+            if (c == 0x07 || (string_escape && c == '\\')) {
+                state = GROUND;
+            } else {
+                string_escape = c == 0x1B;
+            }
+            continue;
+        }
+
+        if (state == CSI_PARAM) {
+            // 参数中的数字和分隔符在这里直接累加，不逐字节经过下面的分派
+            while (p < end && ((*p >= '0' && *p <= '9') || *p == ';')) {
+                if (param_count == 0) param_count = 1;
+                if (*p == ';') {
+                    if (param_count < MAX_PARAMS) params[param_count++] = 0;
+                } else {
+                    int& value = params[param_count - 1];
+                    value = std::min(value * 10 + (*p - '0'), 65535);
+                }
+                p++;
+            }
+            if (p == end) break;
+        }
+
+        unsigned char c = *p++;
+        if (c == 0x1B) {
+            state = ESCAPE;
+            intermediate = 0;
+            continue;
+        }
+        if (c < 0x20) {
+            execute(c);  // 序列中间的控制字符照常执行
+            continue;
+        }
+        switch (state) {
+            case ESCAPE:
+                escape_dispatch(c);
+                break;
+            case ESCAPE_INTERMEDIATE:
+                if (c < 0x30) {
+                    intermediate = c;
+                    break;
+                }
+                if (intermediate == '(' || intermediate == ')') {
+                    graphics[intermediate == ')'] = c == '0';
+                } else if (intermediate == '#' && c == '8') {
+                    // DECALN：整屏填充'E'
+                    for (unsigned row = 0; row < row_count; row++) {
+                        Cell* cells_of_row = row_cells(row);
+                        for (unsigned col = 0; col < col_count; col++) cells_of_row[col] = {'E', 0, 0, 0};
+                    }
+                    mark_dirty(0, row_count - 1);
+                }
+                state = GROUND;
+                break;
+            case CSI_PARAM:
+                if (c >= '0' && c <= '9') {
+                    if (param_count == 0) param_count = 1;
+                    int& value = params[param_count - 1];
+                    value = std::min(value * 10 + (c - '0'), 65535);
+                } else if (c == ';' || c == ':') {
+                    if (param_count == 0) param_count = 1;
+                    if (param_count < MAX_PARAMS) params[param_count++] = 0;
+                } else if (c >= 0x3C && c <= 0x3F) {
+                    if (param_count == 0 && private_marker == 0) {
+                        private_marker = c;
+                    } else {
+                        state = CSI_IGNORE;
+                    }
+                } else if (c < 0x30) {
+                    intermediate = c;
+                } else if (c >= 0x40 && c <= 0x7E) {
+                    state = GROUND;
+                    csi_dispatch(c);
+                }
+                break;
+            case CSI_IGNORE:
+                if (c >= 0x40 && c <= 0x7E) state = GROUND;
+                break;
+            default:
+                state = GROUND;
+                break;
+        }
+    }
+}
+
+// 写入一段可打印ASCII，返回第一个不可打印字节的位置；扫描和写入在同一遍中完成
+const unsigned char* Screen::print_ascii(const unsigned char* p, const unsigned char* end) {
+    auto printable = [](unsigned char c) { return c >= 0x20 && c < 0x7F; };
+    if (graphics[charset] || insert_mode) {
+        while (p < end && printable(*p)) print(*p++);
+        return p;
+    }
+    Cell cell = {0, pen.fg, pen.bg, pen.attrs};
+    while (p < end && printable(*p)) {
+        if (wrap_pending) {
+            cur_col = 0;
+            line_feed();
+        }
+        Cell* cells_of_row = row_cells(cur_row);
+        Cell* dst = cells_of_row + cur_col;
+        size_t limit = std::min<size_t>(end - p, col_count - cur_col);
+        size_t n = 0;
+        break_wide(cells_of_row, cur_col, cur_col);
+        while (n < limit && printable(p[n])) {
+            cell.ch = p[n];
+            dst[n] = cell;
+            n++;
+        }
+        // 覆盖了宽字符的左半边
+        if (cur_col + n < col_count && dst[n].ch == WIDE_TAIL) dst[n].ch = ' ';
+        mark_dirty(cur_row);
+        last_char = p[n - 1];
+        p += n;
+        cur_col += n;
+        if (cur_col >= col_count) {
+            cur_col = col_count - 1;
+            if (autowrap) {
+                wrap_pending = true;
+            } else if (p < end && printable(*p)) {
+                // 不自动换行时多出的字符都落在最后一列
+                while (p < end && printable(*p)) p++;
+                cells_of_row[cur_col].ch = last_char = p[-1];
+            }
+        }
+    }
+    return p;
+}
+
+void Screen::print(uint32_t ch) {
+    if (graphics[charset] && ch >= 0x60 && ch <= 0x7E) ch = DEC_GRAPHICS[ch - 0x60];
+    unsigned width = codepoint_width(ch);
+    if (width == 0) return;
+    if (width > col_count) width = 1;
+    if (wrap_pending) {
+        cur_col = 0;
+        line_feed();
+    }
+    if (cur_col + width > col_count) {
+        // 最后一列放不下宽字符：自动换行时写到下一行，否则写在行尾两列
+        if (autowrap) {
+            cur_col = 0;
+            line_feed();
+        } else {
+            cur_col = col_count - width;
+        }
+    }
+    Cell* cells_of_row = row_cells(cur_row);
+    if (insert_mode && cur_col + width < col_count) {
+        break_wide(cells_of_row, cur_col, cur_col);
+        break_wide(cells_of_row, col_count - width, col_count);
+        std::memmove(cells_of_row + cur_col + width, cells_of_row + cur_col,
+                     (col_count - cur_col - width) * sizeof(Cell));
+    }
+    break_wide(cells_of_row, cur_col, cur_col + width);
+    cells_of_row[cur_col] = {ch, pen.fg, pen.bg, pen.attrs};
+    if (width == 2) cells_of_row[cur_col + 1] = {WIDE_TAIL, pen.fg, pen.bg, pen.attrs};
+    mark_dirty(cur_row);
+    last_char = ch;
+    if (cur_col + width < col_count) {
+        cur_col += width;
+    } else {
+        cur_col = col_count - 1;
+        if (autowrap) wrap_pending = true;
+    }
+}
+
+void Screen::execute(unsigned char c) {
+    switch (c) {
+        case 0x08:  // BS
+            if (cur_col > 0) cur_col--;
+            wrap_pending = false;
+            break;
+        case 0x09:  // HT
+            while (cur_col + 1 < col_count && !tab_stops[++cur_col]) {
+            }
+            wrap_pending = false;
+            break;
+        case 0x0A:  // LF
+        case 0x0B:  // VT
+        case 0x0C:  // FF
+            line_feed();
+            break;
+        case 0x0D:  // CR
+            cur_col = 0;
+            wrap_pending = false;
+            break;
+        case 0x0E:  // SO：使用G1
+            charset = 1;
+            break;
+        case 0x0F:  // SI：使用G0
+            charset = 0;
+            break;
+        case 0x18:  // CAN
+        case 0x1A:  // SUB
+            state = GROUND;
+            break;
+        case 0x1B:
+            state = ESCAPE;
+            intermediate = 0;
+            break;
+        default:
+            break;  // BEL等
+    }
+}
+
+void Screen::escape_dispatch(unsigned char c) {
+    state = GROUND;
+    switch (c) {
+        case '[':
+            state = CSI_PARAM;
+            param_count = 0;
+            params[0] = 0;  // 其余参数在遇到';'时清零
+            private_marker = 0;
+            intermediate = 0;
+            break;
+        case ']':   // OSC
+        case 'P':   // DCS
+        case 'X':   // SOS
+        case '^':   // PM
+        case '_':   // APC
+            state = STRING;
+            string_escape = false;
+            break;
+        case '7':
+            save_cursor();
+            break;
+        case '8':
+            restore_cursor();
+            break;
+        case 'D':   // IND
+            line_feed();
+            break;
+        case 'E':   // NEL
+            cur_col = 0;
+            line_feed();
+            break;
+        case 'M':   // RI
+            reverse_line_feed();
+            break;
+        case 'H':   // HTS
+            tab_stops[cur_col] = 1;
+            break;
+        case 'c':   // RIS
+            reset();
+            break;
+        default:
+            if (c >= 0x20 && c < 0x30) {
+                intermediate = c;
+                state = ESCAPE_INTERMEDIATE;
+            }
+            break;  // DECKPAM/DECKPNM等不影响屏幕
+    }
+}
+
+int Screen::param(size_t index, int fallback) const {
+    return index < param_count && params[index] != 0 ? params[index] : fallback;
+}
+
+void Screen::csi_dispatch(unsigned char c) {
+    if (intermediate != 0) return;  // DECSTR、DECSCUSR等不影响屏幕内容
+    if (private_marker != 0 && private_marker != '?') return;
+    if (private_marker == '?' && c != 'h' && c != 'l' && c != 'J' && c != 'K') return;
+    if (c != 'm') wrap_pending = false;
+
+    unsigned n = param(0, 1);
+    switch (c) {
+        case 'A': {  // CUU
+            unsigned top = cur_row >= scroll_top ? scroll_top : 0;
+            cur_row = cur_row >= top + n ? cur_row - n : top;
+            break;
+        }
+        case 'B':    // CUD
+        case 'e': {  // VPR
+            unsigned bottom = cur_row <= scroll_bottom ? scroll_bottom : row_count - 1;
+            cur_row = std::min(cur_row + n, bottom);
+            break;
+        }
+        case 'C':    // CUF
+        case 'a':    // HPR
+            cur_col = std::min(cur_col + n, col_count - 1);
+            break;
+        case 'D':    // CUB
+            cur_col = cur_col > n ? cur_col - n : 0;
+            break;
+        case 'E': {  // CNL
+            unsigned bottom = cur_row <= scroll_bottom ? scroll_bottom : row_count - 1;
+            cur_row = std::min(cur_row + n, bottom);
+            cur_col = 0;
+            break;
+        }
+        case 'F': {  // CPL
+            unsigned top = cur_row >= scroll_top ? scroll_top : 0;
+            cur_row = cur_row >= top + n ? cur_row - n : top;
+            cur_col = 0;
+            break;
+        }
+        case 'G':    // CHA
+        case '`':    // HPA
+            cur_col = std::min(n, col_count) - 1;
+            break;
+        case 'H':    // CUP
+        case 'f':    // HVP
+            move_to(param(0, 1) - 1, param(1, 1) - 1);
+            break;
+        case 'd':    // VPA
+            move_to(n - 1, cur_col);
+            break;
+        case 'J':
+            erase_display(param_count > 0 ? params[0] : 0);
+            break;
+        case 'K':
+            erase_line(param_count > 0 ? params[0] : 0);
+            break;
+        case '@':    // ICH
+            insert_chars(n);
+            break;
+        case 'P':    // DCH
+            delete_chars(n);
+            break;
+        case 'X':    // ECH
+            clear_cells(cur_row, cur_col, std::min(cur_col + n, col_count));
+            break;
+        case 'L':    // IL
+            if (cur_row >= scroll_top && cur_row <= scroll_bottom) {
+                scroll_down(cur_row, scroll_bottom, n);
+                cur_col = 0;
+            }
+            break;
+        case 'M':    // DL
+            if (cur_row >= scroll_top && cur_row <= scroll_bottom) {
+                scroll_up(cur_row, scroll_bottom, n);
+                cur_col = 0;
+            }
+            break;
+        case 'S':    // SU
+            scroll_up(scroll_top, scroll_bottom, n);
+            break;
+        case 'T':    // SD
+            scroll_down(scroll_top, scroll_bottom, n);
+            break;
+        case 'r': {  // DECSTBM
+            unsigned top = param(0, 1) - 1;
+            unsigned bottom = std::min<unsigned>(param(1, row_count), row_count) - 1;
+            if (top < bottom) {
+                scroll_top = top;
+                scroll_bottom = bottom;
+                move_to(0, 0);
+            }
+            break;
+        }
+        case 'm':
+            select_graphic_rendition();
+            break;
+        case 'h':
+            set_mode(true);
+            break;
+        case 'l':
+            set_mode(false);
+            break;
+        case 's':
+            save_cursor();
+            break;
+        case 'u':
+            restore_cursor();
+            break;
+        case 'g':    // TBC
+            if (param_count == 0 || params[0] == 0) {
+                tab_stops[cur_col] = 0;
+            } else if (params[0] == 3) {
+                std::fill(tab_stops.begin(), tab_stops.end(), 0);
+            }
+            break;
+        case 'I':    // CHT
+            for (unsigned i = 0; i < n; i++) execute(0x09);
+            break;
+        case 'Z':    // CBT
+            for (unsigned i = 0; i < n && cur_col > 0; i++) {
+                while (cur_col > 0 && !tab_stops[--cur_col]) {
+                }
+            }
+            break;
+        case 'b': {  // REP
+            unsigned count = std::min(n, row_count * col_count);
+            for (unsigned i = 0; i < count; i++) print(last_char);
+            break;
+        }
+        default:
+            break;
+    }
+}
+
+void Screen::set_mode(bool enable) {
+    for (size_t i = 0; i < param_count; i++) {
+        if (private_marker != '?') {
+            if (params[i] == 4) insert_mode = enable;  // IRM
+            continue;
+        }
+        switch (params[i]) {
+            case 6:     // DECOM
+                origin_mode = enable;
+                move_to(0, 0);
+                break;
+            case 7:     // DECAWM
+                autowrap = enable;
+                break;
+            case 25:    // DECTCEM
+                cursor_shown = enable;
+                break;
+            case 47:
+            case 1047:
+                switch_screen(enable);
+                break;
+            case 1048:
+                if (enable) save_cursor(); else restore_cursor();
+                break;
+            case 1049:  // 保存光标并切换到清空的备用屏幕
+                if (enable) {
+                    save_cursor();
+                    switch_screen(true);
+                } else {
+                    switch_screen(false);
+                    restore_cursor();
+                }
+                break;
+            default:
+                break;
+        }
+    }
+}
+
+// 256色立方体中最接近的颜色
+static uint8_t rgb_to_index(int r, int g, int b) {
+    auto level = [](int v) { return v < 48 ? 0 : v < 115 ? 1 : std::min((v - 35) / 40, 5); };
+    return (uint8_t)(16 + 36 * level(r) + 6 * level(g) + level(b));
+}
+
+void Screen::select_graphic_rendition() {
+    if (param_count == 0) {
+        pen.attrs = 0;
+        pen.fg = pen.bg = 0;
+        return;
+    }
+    for (size_t i = 0; i < param_count; i++) {
+        int p = params[i];
+        switch (p) {
+            case 0: pen.attrs = 0; pen.fg = pen.bg = 0; break;
+            case 1: pen.attrs |= BOLD; break;
+            case 2: pen.attrs |= DIM; break;
+            case 3: pen.attrs |= ITALIC; break;
+            case 4: pen.attrs |= UNDERLINE; break;
+            case 5:
+            case 6: pen.attrs |= BLINK; break;
+            case 7: pen.attrs |= REVERSE; break;
+            case 8: pen.attrs |= INVISIBLE; break;
+            case 9: pen.attrs |= STRIKE; break;
+            case 22: pen.attrs &= ~(BOLD | DIM); break;
+            case 23: pen.attrs &= ~ITALIC; break;
+            case 24: pen.attrs &= ~UNDERLINE; break;
+            case 25: pen.attrs &= ~BLINK; break;
+            case 27: pen.attrs &= ~REVERSE; break;
+            case 28: pen.attrs &= ~INVISIBLE; break;
+            case 29: pen.attrs &= ~STRIKE; break;
+            case 39: pen.attrs &= ~FG_COLOR; pen.fg = 0; break;
+            case 49: pen.attrs &= ~BG_COLOR; pen.bg = 0; break;
+            case 38:
+            case 48: {
+                // 256色（5;n）或真彩色（2;r;g;b，取最接近的256色）
+                uint8_t color;
+                if (i + 2 < param_count && params[i + 1] == 5) {
+                    color = (uint8_t)params[i + 2];
+                    i += 2;
+                } else if (i + 4 < param_count && params[i + 1] == 2) {
+                    color = rgb_to_index(params[i + 2], params[i + 3], params[i + 4]);
+                    i += 4;
+                } else {
+                    return;
+                }
+                if (p == 38) {
+                    pen.fg = color;
+                    pen.attrs |= FG_COLOR;
+                } else {
+                    pen.bg = color;
+                    pen.attrs |= BG_COLOR;
+                }
+                break;
+            }
+            default:
+                if (p >= 30 && p <= 37) {
+                    pen.fg = p - 30;
+                    pen.attrs |= FG_COLOR;
+                } else if (p >= 40 && p <= 47) {
+                    pen.bg = p - 40;
+                    pen.attrs |= BG_COLOR;
+                } else if (p >= 90 && p <= 97) {
+                    pen.fg = p - 90 + 8;
+                    pen.attrs |= FG_COLOR;
+                } else if (p >= 100 && p <= 107) {
+                    pen.bg = p - 100 + 8;
+                    pen.attrs |= BG_COLOR;
+                }
+                break;
+        }
+    }
+}
+
+void Screen::line_feed() {
+    wrap_pending = false;
+    if (cur_row == scroll_bottom) {
+        // 主屏幕上从顶行滚出的内容进入回滚缓冲区
+        if (scrollback && scroll_top == 0 && !alternate) scrollback->append(line(0), col_count);
+        scroll_up(scroll_top, scroll_bottom, 1);
+    } else if (cur_row + 1 < row_count) {
+        cur_row++;
+    }
+}
+
+void Screen::reverse_line_feed() {
+    wrap_pending = false;
+    if (cur_row == scroll_top) {
+        scroll_down(scroll_top, scroll_bottom, 1);
+    } else if (cur_row > 0) {
+        cur_row--;
+    }
+}
+
+// 滚动只轮换行映射表，移出的行清空后从另一端进入
+void Screen::scroll_up(unsigned top, unsigned bottom, unsigned n) {
+    n = std::min(n, bottom - top + 1);
+    if (top == 0 && bottom == row_count - 1) scrolled += n;
+    std::rotate(row_map.begin() + top, row_map.begin() + top + n, row_map.begin() + bottom + 1);
+    for (unsigned row = bottom + 1 - n; row <= bottom; row++) clear_cells(row, 0, col_count);
+    mark_dirty(top, bottom);
+}
+
+void Screen::scroll_down(unsigned top, unsigned bottom, unsigned n) {
+    n = std::min(n, bottom - top + 1);
+    std::rotate(row_map.begin() + top, row_map.begin() + bottom + 1 - n, row_map.begin() + bottom + 1);
+    for (unsigned row = top; row < top + n; row++) clear_cells(row, 0, col_count);
+    mark_dirty(top, bottom);
+}
+
+void Screen::move_to(int row, int col) {
+    int top = 0;
+    int bottom = row_count - 1;
+    if (origin_mode) {
+        top = scroll_top;
+        bottom = scroll_bottom;
+        row += top;
+    }
+    cur_row = std::max(top, std::min(row, bottom));
+    cur_col = std::max(0, std::min(col, (int)col_count - 1));
+    wrap_pending = false;
+}
+
+void Screen::erase_display(int mode) {
+    switch (mode) {
+        case 0:
+            clear_cells(cur_row, cur_col, col_count);
+            for (unsigned row = cur_row + 1; row < row_count; row++) clear_cells(row, 0, col_count);
+            break;
+        case 1:
+            for (unsigned row = 0; row < cur_row; row++) clear_cells(row, 0, col_count);
+            clear_cells(cur_row, 0, cur_col + 1);
+            break;
+        case 2:
+        case 3:
+            for (unsigned row = 0; row < row_count; row++) clear_cells(row, 0, col_count);
+            break;
+        default:
+            break;
+    }
+}
+
+void Screen::erase_line(int mode) {
+    switch (mode) {
+        case 0: clear_cells(cur_row, cur_col, col_count); break;
+        case 1: clear_cells(cur_row, 0, cur_col + 1); break;
+        case 2: clear_cells(cur_row, 0, col_count); break;
+        default: break;
+    }
+}
+
+void Screen::insert_chars(unsigned n) {
+    Cell* cells_of_row = row_cells(cur_row);
+    n = std::min(n, col_count - cur_col);
+    break_wide(cells_of_row, cur_col, cur_col);
+    break_wide(cells_of_row, col_count - n, col_count);
+    std::memmove(cells_of_row + cur_col + n, cells_of_row + cur_col,
+                 (col_count - cur_col - n) * sizeof(Cell));
+    clear_cells(cur_row, cur_col, cur_col + n);
+}
+
+void Screen::delete_chars(unsigned n) {
+    Cell* cells_of_row = row_cells(cur_row);
+    n = std::min(n, col_count - cur_col);
+    break_wide(cells_of_row, cur_col, cur_col + n);
+    std::memmove(cells_of_row + cur_col, cells_of_row + cur_col + n,
+                 (col_count - cur_col - n) * sizeof(Cell));
+    // 移入的空白，不经过clear_cells：那里的旧格子已移走
+    std::fill(cells_of_row + col_count - n, cells_of_row + col_count, blank());
+    mark_dirty(cur_row);
+}
+
+void Screen::save_cursor() {
+    saved = {cur_row, cur_col, pen, origin_mode, {graphics[0], graphics[1]}, charset};
+}
+
+void Screen::restore_cursor() {
+    cur_row = std::min(saved.row, row_count - 1);
+    cur_col = std::min(saved.col, col_count - 1);
+    pen = saved.pen;
+    origin_mode = saved.origin_mode;
+    graphics[0] = saved.graphics[0];
+    graphics[1] = saved.graphics[1];
+    charset = saved.charset;
+    wrap_pending = false;
+}
+
+void Screen::switch_screen(bool to_alternate) {
+    if (to_alternate == alternate) return;
+    cells.swap(saved_cells);
+    row_map.swap(saved_map);
+    alternate = to_alternate;
+    if (alternate) {
+        Cell empty = {' ', 0, 0, 0};
+        std::fill(cells.begin(), cells.end(), empty);
+    }
+    mark_dirty(0, row_count - 1);
+}
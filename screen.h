@@ -0,0 +1,190 @@
+#ifndef _SCREEN_H_
+#define _SCREEN_H_
+
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+
+class Scrollback;
+
+// VT100/xterm屏幕状态机
+// 消费命令或shell的输出字节流，维护屏幕内容：光标移动、擦除、滚动区域、插入删除、
+// SGR属性、DEC画线字符集、备用屏幕。用于会话录制、屏幕抓取和合并重绘。
+//
+// 宽字符（utf8.h的宽度表中占2列的字符）占两个格子，右边的格子ch为WIDE_TAIL；
+// 覆盖或擦除宽字符的一半时另一半变为空格。不占列的组合字符等不保存。
+// 格子紧凑存放（每格8字节），按物理行连续排列；逻辑行经行映射表找到物理行，
+// 滚动只轮换映射表并清空移出的行，不搬动格子。每行有一个脏位，修改格子时置位，
+// 由使用者在取走变化后清除。连续的可打印ASCII整段写入，不逐字节经过状态机。
+// 查询类序列（DSR、DA）没有回复通道，被忽略。
+class Screen {
+public:
+    // 一个格子
+    struct Cell {
+        uint32_t ch;        // Unicode码点，空白为' '，宽字符的右半边为WIDE_TAIL
+        uint8_t fg;         // 前景色（256色索引），attrs含FG_COLOR时有效，否则为默认色
+        uint8_t bg;         // 背景色，attrs含BG_COLOR时有效
+        uint16_t attrs;     // 属性位
+
+        bool operator==(const Cell& other) const {
+            return ch == other.ch && fg == other.fg && bg == other.bg && attrs == other.attrs;
+        }
+        bool operator!=(const Cell& other) const { return !(*this == other); }
+    };
+
+    // 宽字符右半边格子的ch
+    static constexpr uint32_t WIDE_TAIL = 0;
+
+    // 属性位
+    enum : uint16_t {
+        BOLD = 1 << 0,
+        DIM = 1 << 1,
+        ITALIC = 1 << 2,
+        UNDERLINE = 1 << 3,
+        BLINK = 1 << 4,
+        REVERSE = 1 << 5,
+        INVISIBLE = 1 << 6,
+        STRIKE = 1 << 7,
+        FG_COLOR = 1 << 8,  // fg有效
+        BG_COLOR = 1 << 9   // bg有效
+    };
+
+    Screen(unsigned rows = 24, unsigned cols = 80);
+
+    // 处理一段输出，转义序列和UTF-8字符可以跨调用
+    void feed(const char* data, size_t len);
+    void feed(const std::string& data) { feed(data.data(), data.size()); }
+
+    // 改变大小，保留左上角的内容，全部行置脏
+    void resize(unsigned rows, unsigned cols);
+
+    // 恢复初始状态（RIS）
+    void reset();
+
+    // 换行时从主屏幕顶部滚出的行追加到scrollback，nullptr表示不保留；reset不影响
+    void set_scrollback(Scrollback* scrollback) { this->scrollback = scrollback; }
+
+    unsigned rows() const { return row_count; }
+    unsigned cols() const { return col_count; }
+    unsigned cursor_row() const { return cur_row; }
+    unsigned cursor_col() const { return cur_col; }
+    bool cursor_visible() const { return cursor_shown; }
+    bool alternate_screen() const { return alternate; }
+    // 整屏向上滚动过的行数，只增不减，供合并重绘判断终端上可以同样滚动
+    uint64_t scroll_count() const { return scrolled; }
+    // 当前属性（ch不使用）
+    const Cell& current_pen() const { return pen; }
+    // 不在转义序列或UTF-8字符的中间，此时可以在输出流中插入其他序列
+    bool between_sequences() const { return state == GROUND && utf8_left == 0; }
+    // 光标定位和写入字符的效果与默认状态相同：没有原点模式、插入模式和画线字符集，也不在行尾待换行
+    bool plain_output() const {
+        return !origin_mode && !insert_mode && !wrap_pending && !graphics[charset];
+    }
+
+    const Cell& cell(unsigned row, unsigned col) const {
+        return cells[(size_t)row_map[row] * col_count + col];
+    }
+    // 一行的格子，连续的cols()个
+    const Cell* line(unsigned row) const { return &cells[(size_t)row_map[row] * col_count]; }
+
+    // 一行的文本（UTF-8），去掉行尾空白
+    std::string row_text(unsigned row) const;
+    // 整屏文本，各行以'\n'结尾
+    std::string text() const;
+
+    // 脏行
+    bool row_dirty(unsigned row) const { return (dirty[row >> 6] >> (row & 63)) & 1; }
+    bool any_dirty() const;
+    void clear_dirty();
+
+private:
+    // 解析状态
+    enum ParseState {
+        GROUND,
+        ESCAPE,             // 收到ESC
+        ESCAPE_INTERMEDIATE,  // ESC后的中间字符（字符集指定等）
+        CSI_PARAM,          // CSI参数
+        CSI_IGNORE,         // 无法识别的CSI，跳到结束字符
+        STRING              // OSC/DCS等字符串，跳到BEL或ST
+    };
+
+    // DECSC保存的状态
+    struct SavedCursor {
+        unsigned row;
+        unsigned col;
+        Cell pen;
+        bool origin_mode;
+        bool graphics[2];
+        unsigned charset;
+    };
+
+    static const size_t MAX_PARAMS = 16;
+
+    unsigned row_count;
+    unsigned col_count;
+    std::vector<Cell> cells;          // 物理行 × 列
+    std::vector<Cell> saved_cells;    // 另一块屏幕（主屏幕或备用屏幕）
+    std::vector<unsigned> row_map;    // 逻辑行到物理行
+    std::vector<unsigned> saved_map;
+    std::vector<uint64_t> dirty;      // 脏行位图
+    std::vector<uint8_t> tab_stops;   // 每列是否为制表位
+
+    unsigned cur_row;
+    unsigned cur_col;
+    bool wrap_pending;      // 在最后一列写入后，下一个字符先换行
+    Cell pen;               // 当前属性（ch不使用）
+    unsigned scroll_top;    // 滚动区域，包含两端
+    unsigned scroll_bottom;
+    bool origin_mode;       // DECOM：光标定位相对滚动区域
+    bool autowrap;          // DECAWM
+    bool insert_mode;       // IRM
+    bool cursor_shown;      // DECTCEM
+    bool alternate;         // 正在使用备用屏幕
+    bool graphics[2];       // G0/G1是否为DEC画线字符集
+    unsigned charset;       // 当前使用G0还是G1（SI/SO）
+    uint32_t last_char;     // 上一个显示的字符（REP）
+    SavedCursor saved;
+    Scrollback* scrollback;
+    uint64_t scrolled;
+
+    ParseState state;
+    int params[MAX_PARAMS];
+    size_t param_count;
+    char private_marker;    // CSI后的'?'、'>'等
+    char intermediate;      // 中间字符
+    bool string_escape;     // 字符串中收到ESC，等待'\'
+    uint32_t utf8_code;     // 未完成的UTF-8字符
+    unsigned utf8_left;     // 还需要的后续字节数
+
+    Cell blank() const;
+    Cell* row_cells(unsigned row) { return &cells[(size_t)row_map[row] * col_count]; }
+    void mark_dirty(unsigned row) { dirty[row >> 6] |= (uint64_t)1 << (row & 63); }
+    void mark_dirty(unsigned first, unsigned last);
+    void clear_cells(unsigned row, unsigned from, unsigned to);
+    void break_wide(Cell* cells_of_row, unsigned from, unsigned to);
+
+    const unsigned char* print_ascii(const unsigned char* p, const unsigned char* end);
+    void print(uint32_t ch);
+    void execute(unsigned char c);
+    void escape_dispatch(unsigned char c);
+    void csi_dispatch(unsigned char c);
+    void set_mode(bool enable);
+    void select_graphic_rendition();
+
+    void line_feed();
+    void reverse_line_feed();
+    void scroll_up(unsigned top, unsigned bottom, unsigned n);
+    void scroll_down(unsigned top, unsigned bottom, unsigned n);
+    void move_to(int row, int col);
+    void erase_display(int mode);
+    void erase_line(int mode);
+    void insert_chars(unsigned n);
+    void delete_chars(unsigned n);
+    void save_cursor();
+    void restore_cursor();
+    void switch_screen(bool to_alternate);
+    int param(size_t index, int fallback) const;
+};
+
+#endif
@@ -0,0 +1,323 @@
+#include "scrollback.h"
+#include <algorithm>
+#include <cstring>
+
+// 块压缩：LZ77，4字节哈希找匹配，序列为 字面量长度、字面量、匹配长度、匹配距离（变长整数），
+// 匹配长度0表示结束。终端输出重复多（提示符、路径、缩进、属性游程），压缩率高且解压很快。
+#define LZ_HASH_BITS 12
+#define LZ_MIN_MATCH 4
+#define LZ_MAX_OFFSET 65535
+
+static void put_varint(std::string& out, size_t value) {
+    while (value >= 0x80) {
+        out += (char)(value | 0x80);
+        value >>= 7;
+    }
+    out += (char)value;
+}
+
+static size_t get_varint(const unsigned char*& p, const unsigned char* end) {
+    size_t value = 0;
+    for (int shift = 0; p < end && shift < 64; shift += 7) {
+        unsigned char c = *p++;
+        value |= (size_t)(c & 0x7F) << shift;
+        if (!(c & 0x80)) break;
+    }
+    return value;
+}
+
+static uint32_t read32(const unsigned char* p) {
+    uint32_t value;
+    memcpy(&value, p, sizeof(value));
+    return value;
+}
+
+static void lz_compress(const std::string& src, std::string& out) {
+    const unsigned char* base = (const unsigned char*)src.data();
+    size_t n = src.size();
+    uint32_t table[1 << LZ_HASH_BITS] = {};  // 位置+1，0表示空
+    size_t anchor = 0;
+    size_t pos = 0;
+    out.clear();
+    while (pos + LZ_MIN_MATCH <= n) {
+        uint32_t value = read32(base + pos);
+        uint32_t hash = (value * 2654435761u) >> (32 - LZ_HASH_BITS);
+        size_t ref = table[hash];
+        table[hash] = (uint32_t)(pos + 1);
+        if (ref == 0 || pos - (ref - 1) > LZ_MAX_OFFSET || read32(base + ref - 1) != value) {
+            // 连续未命中时加大步长，不可压缩的数据很快跳过
+            pos += 1 + ((pos - anchor) >> 6);
+            continue;
+        }
+        size_t start = ref - 1;
+        size_t length = LZ_MIN_MATCH;
+        while (pos + length < n && base[start + length] == base[pos + length]) length++;
+        put_varint(out, pos - anchor);
+        out.append(src, anchor, pos - anchor);
+        put_varint(out, length);
+        put_varint(out, pos - start);
+        pos += length;
+        anchor = pos;
+    }
+    put_varint(out, n - anchor);
+    out.append(src, anchor, n - anchor);
+    put_varint(out, 0);
+}
+
+static bool lz_decompress(const std::string& in, size_t raw_size, std::string& out) {
+    out.resize(raw_size);
+    char* dst = &out[0];
+    size_t written = 0;
+    const unsigned char* p = (const unsigned char*)in.data();
+    const unsigned char* end = p + in.size();
+    while (true) {
+        size_t literals = get_varint(p, end);
+        if (literals > (size_t)(end - p) || literals > raw_size - written) return false;
+        memcpy(dst + written, p, literals);
+        p += literals;
+        written += literals;
+        size_t length = get_varint(p, end);
+        if (length == 0) break;
+        size_t offset = get_varint(p, end);
+        if (offset == 0 || offset > written || length > raw_size - written) return false;
+        const char* from = dst + written - offset;
+        if (offset >= length) {
+            memcpy(dst + written, from, length);
+        } else {
+            // 重叠的匹配（重复的短模式）逐字节复制
+            for (size_t i = 0; i < length; i++) dst[written + i] = from[i];
+        }
+        written += length;
+    }
+    return written == raw_size;
+}
+
+Scrollback::Scrollback(size_t max_bytes, size_t block_size) :
+    max_bytes(std::max(max_bytes, 4 * block_size)),
+    block_size(block_size),
+    open_first(0),
+    open_lines(0),
+    sealed_bytes(0),
+    raw_total(0),
+    cached_first(UINT64_MAX) {
+}
+
+void Scrollback::append(std::string_view text, const std::vector<ScrollbackRun>& runs) {
+    size_t start = open_text.size();
+    open_text.append(text.data(), text.size());
+    std::replace(open_text.begin() + start, open_text.end(), '\n', ' ');
+    open_text += '\n';
+
+    put_varint(open_attrs, runs.size());
+    for (const auto& run : runs) {
+        put_varint(open_attrs, run.length);
+        open_attrs += (char)run.fg;
+        open_attrs += (char)run.bg;
+        open_attrs += (char)(run.attrs & 0xFF);
+        open_attrs += (char)(run.attrs >> 8);
+    }
+    open_lines++;
+    raw_total += text.size() + 1;
+
+    if (open_text.size() + open_attrs.size() >= block_size) seal();
+    evict();
+}
+
+static void append_utf8(std::string& out, uint32_t ch) {
+    if (ch < 0x80) {
+        out += (char)ch;
+    } else if (ch < 0x800) {
+        out += (char)(0xC0 | (ch >> 6));
+        out += (char)(0x80 | (ch & 0x3F));
+    } else if (ch < 0x10000) {
+        out += (char)(0xE0 | (ch >> 12));
+        out += (char)(0x80 | ((ch >> 6) & 0x3F));
+        out += (char)(0x80 | (ch & 0x3F));
+    } else {
+        out += (char)(0xF0 | (ch >> 18));
+        out += (char)(0x80 | ((ch >> 12) & 0x3F));
+        out += (char)(0x80 | ((ch >> 6) & 0x3F));
+        out += (char)(0x80 | (ch & 0x3F));
+    }
+}
+
+void Scrollback::append(const Screen::Cell* cells, unsigned count) {
+    while (count > 0 && cells[count - 1].ch == ' ' && cells[count - 1].attrs == 0) count--;
+
+    std::string text;
+    std::vector<ScrollbackRun> runs;
+    text.reserve(count);
+    bool styled = false;
+    for (unsigned i = 0; i < count; i++) {
+        const Screen::Cell& cell = cells[i];
+        if (cell.ch == Screen::WIDE_TAIL) continue;
+        append_utf8(text, cell.ch);
+        styled |= cell.attrs != 0;
+        if (!runs.empty() && runs.back().fg == cell.fg && runs.back().bg == cell.bg &&
+            runs.back().attrs == cell.attrs) {
+            runs.back().length++;
+        } else {
+            runs.push_back({1, cell.fg, cell.bg, cell.attrs});
+        }
+    }
+    // 全部为默认属性时不记录游程，末尾的默认属性游程也可以省略
+    if (!styled) {
+        runs.clear();
+    } else if (runs.back().attrs == 0) {
+        runs.pop_back();
+    }
+    append(text, runs);
+}
+
+void Scrollback::seal() {
+    if (open_lines == 0) return;
+    Block block;
+    block.first_line = open_first;
+    block.lines = open_lines;
+    block.text_size = (uint32_t)open_text.size();
+    std::string raw = open_text + open_attrs;
+    block.raw_size = (uint32_t)raw.size();
+    lz_compress(raw, block.data);
+    block.data.shrink_to_fit();
+    sealed_bytes += block.data.size();
+    blocks.push_back(std::move(block));
+
+    open_first += open_lines;
+    open_lines = 0;
+    open_text.clear();
+    open_attrs.clear();
+}
+
+size_t Scrollback::memory_usage() const {
+    return sealed_bytes + blocks.size() * sizeof(Block) + open_text.capacity() +
+           open_attrs.capacity() + cached_raw.capacity();
+}
+
+void Scrollback::evict() {
+    while (memory_usage() > max_bytes && !blocks.empty()) {
+        if (cached_first == blocks.front().first_line) {
+            cached_first = UINT64_MAX;
+            std::string().swap(cached_raw);
+        }
+        sealed_bytes -= blocks.front().data.size();
+        blocks.pop_front();
+    }
+}
+
+bool Scrollback::block_for(uint64_t index, const std::string*& raw, size_t& text_size,
+                           uint64_t& first_line) const {
+    auto it = std::upper_bound(blocks.begin(), blocks.end(), index,
+                               [](uint64_t value, const Block& block) { return value < block.first_line; });
+    if (it == blocks.begin()) return false;
+    --it;
+    if (cached_first != it->first_line) {
+        if (!lz_decompress(it->data, it->raw_size, cached_raw)) {
+            cached_first = UINT64_MAX;
+            return false;
+        }
+        cached_first = it->first_line;
+    }
+    raw = &cached_raw;
+    text_size = it->text_size;
+    first_line = it->first_line;
+    return true;
+}
+
+void Scrollback::decode_line(const char* text, size_t text_size, const char* attrs, size_t attrs_size,
+                             uint64_t skip, ScrollbackLine& out) {
+    // 文本区：跳过前面skip行
+    const char* p = text;
+    const char* text_end = text + text_size;
+    for (uint64_t i = 0; i < skip && p < text_end; i++) {
+        const char* newline = (const char*)memchr(p, '\n', text_end - p);
+        p = newline ? newline + 1 : text_end;
+    }
+    const char* newline = (const char*)memchr(p, '\n', text_end - p);
+    out.text.assign(p, newline ? newline : text_end);
+
+    // 属性区：逐行跳过游程
+    const unsigned char* a = (const unsigned char*)attrs;
+    const unsigned char* attrs_end = a + attrs_size;
+    for (uint64_t i = 0; i < skip && a < attrs_end; i++) {
+        size_t runs = get_varint(a, attrs_end);
+        for (size_t r = 0; r < runs && a < attrs_end; r++) {
+            get_varint(a, attrs_end);
+            a += 4;
+        }
+    }
+    out.runs.clear();
+    size_t runs = a < attrs_end ? get_varint(a, attrs_end) : 0;
+    for (size_t r = 0; r < runs && a < attrs_end; r++) {
+        ScrollbackRun run;
+        run.length = (uint32_t)get_varint(a, attrs_end);
+        if (attrs_end - a < 4) break;
+        run.fg = a[0];
+        run.bg = a[1];
+        run.attrs = (uint16_t)(a[2] | (a[3] << 8));
+        a += 4;
+        out.runs.push_back(run);
+    }
+}
+
+bool Scrollback::line(uint64_t index, ScrollbackLine& out) const {
+    if (index < begin() || index >= end()) return false;
+    if (index >= open_first) {
+        decode_line(open_text.data(), open_text.size(), open_attrs.data(), open_attrs.size(),
+                    index - open_first, out);
+        return true;
+    }
+    const std::string* raw;
+    size_t text_size;
+    uint64_t first_line;
+    if (!block_for(index, raw, text_size, first_line)) return false;
+    decode_line(raw->data(), text_size, raw->data() + text_size, raw->size() - text_size,
+                index - first_line, out);
+    return true;
+}
+
+std::string Scrollback::text(uint64_t index) const {
+    ScrollbackLine out;
+    return line(index, out) ? out.text : std::string();
+}
+
+// 在一块的文本区中查找，匹配按从后向前的顺序追加到result
+static void search_text(std::string_view text, uint64_t first_line, std::string_view needle,
+                        size_t limit, std::vector<Scrollback::Match>& result) {
+    std::vector<Scrollback::Match> found;
+    uint64_t line = first_line;
+    size_t line_start = 0;
+    size_t pos = text.find(needle);
+    while (pos != std::string_view::npos) {
+        // 数出匹配之前的换行
+        while (true) {
+            const char* newline = (const char*)memchr(text.data() + line_start, '\n', pos - line_start);
+            if (!newline) break;
+            line++;
+            line_start = newline - text.data() + 1;
+        }
+        found.push_back({line, pos - line_start});
+        pos = text.find(needle, pos + 1);
+    }
+    for (auto it = found.rbegin(); it != found.rend() && result.size() < limit; ++it) {
+        result.push_back(*it);
+    }
+}
+
+std::vector<Scrollback::Match> Scrollback::search(std::string_view needle, size_t limit) const {
+    std::vector<Match> result;
+    if (needle.empty() || needle.find('\n') != std::string_view::npos) return result;
+
+    search_text(open_text, open_first, needle, limit, result);
+    std::string raw;
+    for (auto it = blocks.rbegin(); it != blocks.rend() && result.size() < limit; ++it) {
+        std::string_view text;
+        if (cached_first == it->first_line) {
+            text = std::string_view(cached_raw.data(), it->text_size);
+        } else {
+            if (!lz_decompress(it->data, it->raw_size, raw)) continue;
+            text = std::string_view(raw.data(), it->text_size);
+        }
+        search_text(text, it->first_line, needle, limit, result);
+    }
+    return result;
+}
@@ -0,0 +1,95 @@
+#ifndef _SCROLLBACK_H_
+#define _SCROLLBACK_H_
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <deque>
+#include <cstdint>
+#include <cstddef>
+#include "screen.h"
+
+// 一段属性相同的字符
+struct ScrollbackRun {
+    uint32_t length;    // 字符数
+    uint8_t fg;
+    uint8_t bg;
+    uint16_t attrs;     // Screen的属性位，0表示默认属性
+};
+
+// 一行回滚内容
+struct ScrollbackLine {
+    std::string text;                   // UTF-8文本，不含换行
+    std::vector<ScrollbackRun> runs;    // 属性游程，覆盖的字符数可以少于文本（其余为默认属性）
+};
+
+// 压缩的回滚缓冲区
+// 行按追加顺序编号，写满一块（默认32KB原始数据）后整块压缩封存。块内文本和属性分开存放：
+// 文本区是各行文本加'\n'，属性区是各行的属性游程，默认属性的行只占一个字节。
+// 总内存超过上限时从最早的块整块淘汰，begin()随之前移。
+// 按行号访问只解压该行所在的一块（最近解压的块被缓存）；搜索逐块解压后在文本区中查找。
+// 不加锁，只能由一个线程使用。
+class Scrollback {
+public:
+    struct Match {
+        uint64_t line;      // 行号
+        size_t offset;      // 在该行文本中的字节偏移
+    };
+
+    // max_bytes为内存上限（压缩后的块、未封存的块和解压缓存），至少为四块
+    explicit Scrollback(size_t max_bytes = 1 << 20, size_t block_size = 32768);
+
+    // 追加一行，文本中的'\n'被替换为空格
+    void append(std::string_view text, const std::vector<ScrollbackRun>& runs = {});
+    // 追加屏幕上的一行，去掉行尾的默认空白
+    void append(const Screen::Cell* cells, unsigned count);
+
+    uint64_t begin() const { return blocks.empty() ? open_first : blocks.front().first_line; }
+    uint64_t end() const { return open_first + open_lines; }
+    size_t size() const { return end() - begin(); }
+
+    // 读取一行，已淘汰或不存在时返回false
+    bool line(uint64_t index, ScrollbackLine& out) const;
+    std::string text(uint64_t index) const;
+
+    // 查找包含needle的行，从最新的行向前，最多limit个；同一行的多处匹配都返回
+    std::vector<Match> search(std::string_view needle, size_t limit = SIZE_MAX) const;
+
+    // 占用的内存（块数据和块描述）与追加过的原始数据量
+    size_t memory_usage() const;
+    uint64_t raw_bytes() const { return raw_total; }
+
+private:
+    struct Block {
+        uint64_t first_line;
+        uint32_t lines;
+        uint32_t text_size;     // 原始数据中文本区的长度
+        uint32_t raw_size;      // 原始数据总长度
+        std::string data;       // 压缩后的数据
+    };
+
+    size_t max_bytes;
+    size_t block_size;
+    std::deque<Block> blocks;
+    std::string open_text;      // 未封存块的文本区
+    std::string open_attrs;     // 未封存块的属性区
+    uint64_t open_first;        // 未封存块的第一行行号
+    uint32_t open_lines;
+    size_t sealed_bytes;        // 已封存块的压缩数据总长度
+    uint64_t raw_total;
+
+    // 最近解压的块
+    mutable uint64_t cached_first;
+    mutable std::string cached_raw;
+
+    void seal();
+    void evict();
+    // 取得某行所在块的原始数据（文本区在前、属性区在后），text_size为文本区长度
+    bool block_for(uint64_t index, const std::string*& raw, size_t& text_size,
+                   uint64_t& first_line) const;
+    // 从文本区和属性区中取出第skip行
+    static void decode_line(const char* text, size_t text_size, const char* attrs, size_t attrs_size,
+                            uint64_t skip, ScrollbackLine& out);
+};
+
+#endif
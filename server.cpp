@@ -0,0 +1,316 @@
+#include "server.h"
+
+#ifdef __linux__
+
+#include "shell.h"
+#include "pseudoterm.h"
+#include "tracer.h"
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstdlib>
+#include <memory_resource>
+#include <mutex>
+#include <thread>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+// 一个会话：连接描述符和它的Shell，只由所属工作线程访问
+struct ShellServer::Session {
+    int fd;
+    uint32_t index;     // 在工作线程会话表中的下标
+    bool writing;       // 已关注EPOLLOUT
+    bool busy;          // 已登记在有后台工作的会话列表中
+    Shell shell;
+
+    Session(int fd, std::pmr::memory_resource* resource, PathCache* path_cache, Completer* completer) :
+        fd(fd), index(0), writing(false), busy(false), shell(nullptr, fd, resource) {
+        shell.share_lookup_caches(path_cache, completer);
+    }
+};
+
+struct ShellServer::Worker {
+    int epoll_fd;
+    int wake_fd;                        // eventfd，交来新会话或停止时唤醒
+    std::thread thread;
+    std::mutex lock;
+    std::vector<int> incoming;          // 其他线程交来的连接，受lock保护
+    std::vector<Session*> sessions;     // 本线程的全部会话
+    std::vector<Session*> busy;         // 有作业或搜索索引未建完的会话
+    std::chrono::steady_clock::time_point last_poll;
+    // 本线程全部会话的对象、编辑状态和内存历史都从这里分配：会话只由本线程访问，
+    // 不需要同步；同样大小的块集中存放，大量会话反复建立、断开时不会使堆碎片化
+    std::pmr::unsynchronized_pool_resource pool;
+    // 本线程全部会话共用的命令路径缓存和补全索引，每个工作线程只占两个inotify实例
+    PathCache path_cache;
+    Completer completer;
+};
+
+const int ShellServer::JOB_POLL_MS;
+const size_t ShellServer::READ_BUDGET;
+
+ShellServer::ShellServer(size_t count) :
+    sessions(0),
+    next_worker(0),
+    stopping(false),
+    listen_fd(-1),
+    running(false) {
+    if (count == 0) {
+        unsigned cpus = std::thread::hardware_concurrency();
+        count = cpus ? cpus : 1;
+    }
+    for (size_t i = 0; i < count; i++) {
+        std::unique_ptr<Worker> worker(new Worker());
+        worker->epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+        worker->wake_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        // data.ptr：nullptr为监听套接字，Worker自身为唤醒事件，其余为会话
+        struct epoll_event ev = {};
+        ev.events = EPOLLIN;
+        ev.data.ptr = worker.get();
+        epoll_ctl(worker->epoll_fd, EPOLL_CTL_ADD, worker->wake_fd, &ev);
+        workers.push_back(std::move(worker));
+    }
+}
+
+ShellServer::~ShellServer() {
+    stop();
+    for (auto& worker : workers) {
+        for (int fd : worker->incoming) close(fd);
+        close(worker->wake_fd);
+        close(worker->epoll_fd);
+    }
+    if (listen_fd >= 0) {
+        close(listen_fd);
+        unlink(listen_path.c_str());
+    }
+}
+
+bool ShellServer::listen(const std::string& path) {
+    struct sockaddr_un addr = {};
+    if (listen_fd >= 0 || path.length() >= sizeof(addr.sun_path)) return false;
+    addr.sun_family = AF_UNIX;
+    path.copy(addr.sun_path, path.length());
+
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (fd < 0) return false;
+    unlink(path.c_str());
+    if (bind(fd, (struct sockaddr*)&addr, sizeof(addr)) != 0 || ::listen(fd, SOMAXCONN) != 0) {
+        close(fd);
+        return false;
+    }
+    listen_fd = fd;
+    listen_path = path;
+
+    // 每个连接只唤醒一个工作线程，避免惊群
+    for (auto& worker : workers) {
+        struct epoll_event ev = {};
+        ev.events = EPOLLIN | EPOLLEXCLUSIVE;
+        ev.data.ptr = nullptr;
+        epoll_ctl(worker->epoll_fd, EPOLL_CTL_ADD, listen_fd, &ev);
+    }
+    return true;
+}
+
+bool ShellServer::add_session(int fd) {
+    if (fd < 0) return false;
+    Worker& worker = *workers[next_worker.fetch_add(1, std::memory_order_relaxed) % workers.size()];
+    {
+        std::lock_guard<std::mutex> guard(worker.lock);
+        worker.incoming.push_back(fd);
+    }
+    uint64_t one = 1;
+    return write(worker.wake_fd, &one, sizeof(one)) == sizeof(one);
+}
+
+int ShellServer::open_pty(std::string* name) {
+    // 按键和回显都由shell处理，从端的行规程不能再回显或按行缓冲
+    int master, slave;
+    if (!open_pseudo_terminal(master, slave, true, name)) return -1;
+    if (!add_session(master)) {
+        close(slave);
+        return -1;
+    }
+    return slave;
+}
+
+void ShellServer::start() {
+    if (running) return;
+    running = true;
+    stopping = false;
+    for (auto& worker : workers) {
+        Worker* w = worker.get();
+        w->last_poll = std::chrono::steady_clock::now();
+        w->thread = std::thread([this, w]() { run(*w); });
+    }
+}
+
+void ShellServer::stop() {
+    if (!running) return;
+    stopping = true;
+    for (auto& worker : workers) {
+        uint64_t one = 1;
+        if (write(worker->wake_fd, &one, sizeof(one)) < 0) {
+            // eventfd计数不会溢出，忽略
+        }
+    }
+    for (auto& worker : workers) {
+        worker->thread.join();
+        while (!worker->sessions.empty()) {
+            destroy_session(*worker, worker->sessions.back());
+        }
+    }
+    running = false;
+}
+
+void ShellServer::run(Worker& worker) {
+    struct epoll_event events[64];
+    TRACE_THREAD("worker");
+    while (!stopping.load(std::memory_order_relaxed)) {
+        int timeout = worker.busy.empty() ? -1 : JOB_POLL_MS;
+        int n = epoll_wait(worker.epoll_fd, events, 64, timeout);
+        if (n < 0 && errno != EINTR) break;
+
+        for (int i = 0; i < n; i++) {
+            void* ptr = events[i].data.ptr;
+            if (ptr == nullptr) {
+                accept_sessions(worker);
+            } else if (ptr == &worker) {
+                uint64_t count;
+                if (read(worker.wake_fd, &count, sizeof(count)) < 0) {
+                    // 已被读空
+                }
+                std::vector<int> fds;
+                {
+                    std::lock_guard<std::mutex> guard(worker.lock);
+                    fds.swap(worker.incoming);
+                }
+                for (int fd : fds) create_session(worker, fd);
+            } else {
+                handle_session(worker, (Session*)ptr, events[i].events);
+            }
+        }
+
+        if (!worker.busy.empty()) {
+            auto now = std::chrono::steady_clock::now();
+            if (now - worker.last_poll >= std::chrono::milliseconds(JOB_POLL_MS)) {
+                worker.last_poll = now;
+                poll_busy(worker);
+            }
+        }
+    }
+}
+
+void ShellServer::accept_sessions(Worker& worker) {
+    while (true) {
+        int fd = accept4(listen_fd, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (fd < 0) {
+            if (errno == EINTR || errno == ECONNABORTED) continue;
+            break;  // EAGAIN，或描述符耗尽时等下一次事件
+        }
+        create_session(worker, fd);
+    }
+}
+
+void ShellServer::create_session(Worker& worker, int fd) {
+    int flags = fcntl(fd, F_GETFL);
+    if (flags >= 0) fcntl(fd, F_SETFL, flags | O_NONBLOCK);
+
+    // Shell的构造函数会写出提示符
+    std::pmr::polymorphic_allocator<Session> allocator(&worker.pool);
+    Session* session = allocator.allocate(1);
+    new (session) Session(fd, &worker.pool, &worker.path_cache, &worker.completer);
+    session->index = worker.sessions.size();
+    worker.sessions.push_back(session);
+    sessions.fetch_add(1, std::memory_order_relaxed);
+
+    struct epoll_event ev = {};
+    ev.events = EPOLLIN;
+    ev.data.ptr = session;
+    epoll_ctl(worker.epoll_fd, EPOLL_CTL_ADD, fd, &ev);
+    update_interest(worker, session);
+}
+
+void ShellServer::destroy_session(Worker& worker, Session* session) {
+    epoll_ctl(worker.epoll_fd, EPOLL_CTL_DEL, session->fd, nullptr);
+
+    // 从会话表中交换删除
+    Session* last = worker.sessions.back();
+    worker.sessions[session->index] = last;
+    last->index = session->index;
+    worker.sessions.pop_back();
+    if (session->busy) {
+        worker.busy.erase(std::find(worker.busy.begin(), worker.busy.end(), session));
+    }
+
+    // 先断开连接，正在向连接转发命令输出的线程随即退出；Shell析构时挂断剩余作业
+    shutdown(session->fd, SHUT_RDWR);
+    int fd = session->fd;
+    session->~Session();
+    std::pmr::polymorphic_allocator<Session>(&worker.pool).deallocate(session, 1);
+    close(fd);
+    sessions.fetch_sub(1, std::memory_order_relaxed);
+}
+
+void ShellServer::handle_session(Worker& worker, Session* session, uint32_t events) {
+    if (events & (EPOLLIN | EPOLLHUP | EPOLLERR)) {
+        char buffer[4096];
+        size_t total = 0;
+        while (total < READ_BUDGET) {
+            ssize_t n = read(session->fd, buffer, sizeof(buffer));
+            if (n < 0 && errno == EINTR) continue;
+            if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) break;
+            if (n <= 0) {
+                // 对端关闭（PTY主端在从端全部关闭后读到EIO）
+                destroy_session(worker, session);
+                return;
+            }
+            session->shell.feed_input(buffer, n);
+            total += n;
+            if ((size_t)n < sizeof(buffer)) break;
+        }
+    }
+    if (events & EPOLLOUT) {
+        session->shell.flush_output();
+    }
+    update_interest(worker, session);
+}
+
+// 有待写输出时关注可写事件，有作业或搜索索引未建完时登记到定时检查的列表
+void ShellServer::update_interest(Worker& worker, Session* session) {
+    bool writing = session->shell.output_pending();
+    if (writing != session->writing) {
+        struct epoll_event ev = {};
+        ev.events = EPOLLIN;
+        if (writing) ev.events |= EPOLLOUT;
+        ev.data.ptr = session;
+        epoll_ctl(worker.epoll_fd, EPOLL_CTL_MOD, session->fd, &ev);
+        session->writing = writing;
+    }
+    if (!session->busy && session->shell.has_background_work()) {
+        session->busy = true;
+        worker.busy.push_back(session);
+    }
+}
+
+void ShellServer::poll_busy(Worker& worker) {
+    for (size_t i = 0; i < worker.busy.size();) {
+        Session* session = worker.busy[i];
+        session->shell.poll_jobs();
+        session->shell.continue_search();
+        if (!session->shell.has_background_work()) {
+            session->busy = false;
+            worker.busy[i] = worker.busy.back();
+            worker.busy.pop_back();
+        } else {
+            i++;
+        }
+        // 作业结束后处理的预输入可能又启动了作业，由update_interest重新登记
+        update_interest(worker, session);
+    }
+}
+
+#endif
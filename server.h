@@ -0,0 +1,70 @@
+#ifndef _SERVER_H_
+#define _SERVER_H_
+
+#ifdef __linux__
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <atomic>
+#include <cstddef>
+
+// 多会话shell服务
+// 一个进程内承载大量Shell会话：客户端经Unix域套接字连接，或从服务创建的PTY对的从端
+// 接入，每个连接对应一个会话模式的Shell（见Shell的构造函数）。
+// 固定数量的工作线程各有一个epoll实例，监听套接字以EPOLLEXCLUSIVE加入全部实例，
+// 被唤醒的线程接受连接，会话在生命期内固定在该线程上，状态只由一个线程访问，不需要加锁。
+// 读到的输入整批交给Shell处理，回显在处理完后一次写出；写不完的部分等可写时继续。
+// 有作业的会话单独登记，只对它们定时检查作业状态（增量搜索中的会话同样登记，定时补入历史索引），
+// 空闲会话不占用任何处理时间。
+// 每个工作线程有一个不加锁的内存池，其会话的状态都从中分配。
+class ShellServer {
+public:
+    // workers为0时按CPU数
+    explicit ShellServer(size_t workers = 0);
+    ~ShellServer();
+
+    // 在path上监听Unix域套接字，已存在的文件被替换
+    bool listen(const std::string& path);
+
+    // 以已连接的描述符（套接字、PTY主端等）建立会话，fd由服务接管
+    bool add_session(int fd);
+
+    // 创建PTY对并以主端建立会话，返回设为原始模式的从端（调用者持有，全部关闭后会话结束），
+    // 失败返回-1；name非空时填入从端路径
+    int open_pty(std::string* name = nullptr);
+
+    // 启动工作线程；停止时等待工作线程退出并关闭全部会话
+    void start();
+    void stop();
+
+    size_t session_count() const { return sessions.load(std::memory_order_relaxed); }
+    size_t worker_count() const { return workers.size(); }
+
+private:
+    struct Session;
+    struct Worker;
+
+    std::vector<std::unique_ptr<Worker>> workers;
+    std::atomic<size_t> sessions;
+    std::atomic<size_t> next_worker;     // 外部交来的会话按轮转分配
+    std::atomic<bool> stopping;
+    int listen_fd;
+    std::string listen_path;
+    bool running;
+
+    void run(Worker& worker);
+    void accept_sessions(Worker& worker);
+    void create_session(Worker& worker, int fd);
+    void destroy_session(Worker& worker, Session* session);
+    void handle_session(Worker& worker, Session* session, uint32_t events);
+    void update_interest(Worker& worker, Session* session);
+    void poll_busy(Worker& worker);
+
+    static const int JOB_POLL_MS = 20;          // 有作业的会话检查作业状态的间隔
+    static const size_t READ_BUDGET = 65536;    // 每次事件最多从一个会话读取的字节数
+};
+
+#endif
+
+#endif
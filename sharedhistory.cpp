@@ -0,0 +1,134 @@
+#include "sharedhistory.h"
+
+#ifdef __linux__
+
+#include <atomic>
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#define SHAREDHISTORY_MAGIC 0x5348484953523031ull   // "SHHISR01"
+
+// 槽位：seq为0表示空，2*ticket+1表示正在写入编号ticket，2*ticket+2表示已写完
+struct SharedHistoryRing::Slot {
+    std::atomic<uint64_t> seq;
+    uint32_t length;
+    uint32_t checksum;
+    uint64_t reserved;
+    char text[MAX_LENGTH];
+};
+
+struct SharedHistoryRing::Header {
+    std::atomic<uint64_t> magic;
+    std::atomic<uint64_t> head;     // 下一个编号
+    char padding[48];               // head独占一个缓存行
+    Slot slots[SLOT_COUNT];
+};
+
+static_assert(sizeof(std::atomic<uint64_t>) == sizeof(uint64_t) &&
+              std::atomic<uint64_t>::is_always_lock_free, "共享内存中的原子变量必须无锁");
+
+const size_t SharedHistoryRing::SLOT_COUNT;
+const size_t SharedHistoryRing::MAX_LENGTH;
+const uint64_t SharedHistoryRing::NO_TICKET;
+
+static uint32_t text_checksum(const char* data, size_t length) {
+    // FNV-1a
+    uint32_t hash = 2166136261u;
+    for (size_t i = 0; i < length; i++) {
+        hash = (hash ^ (unsigned char)data[i]) * 16777619u;
+    }
+    return hash;
+}
+
+SharedHistoryRing::SharedHistoryRing() :
+    header(nullptr) {
+}
+
+SharedHistoryRing::~SharedHistoryRing() {
+    close();
+}
+
+bool SharedHistoryRing::open(const std::string& name) {
+    close();
+    int fd = shm_open(name.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0600);
+    if (fd < 0) return false;
+
+    // 新建的共享内存全部为0，即全部槽位为空；多个进程同时创建时ftruncate到同样大小
+    struct stat st;
+    bool ok = fstat(fd, &st) == 0 &&
+              ((size_t)st.st_size >= sizeof(Header) || ftruncate(fd, sizeof(Header)) == 0);
+    void* addr = ok ? mmap(nullptr, sizeof(Header), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0)
+                    : MAP_FAILED;
+    ::close(fd);
+    if (addr == MAP_FAILED) return false;
+
+    header = (Header*)addr;
+    uint64_t magic = 0;
+    if (!header->magic.compare_exchange_strong(magic, SHAREDHISTORY_MAGIC) &&
+        magic != SHAREDHISTORY_MAGIC) {
+        // 同名的共享内存不是本格式
+        close();
+        return false;
+    }
+    return true;
+}
+
+void SharedHistoryRing::close() {
+    if (header) {
+        munmap(header, sizeof(Header));
+        header = nullptr;
+    }
+}
+
+bool SharedHistoryRing::append(std::string_view line) {
+    if (!header || line.length() > MAX_LENGTH) return false;
+
+    uint64_t ticket = header->head.fetch_add(1, std::memory_order_relaxed);
+    Slot& slot = header->slots[ticket % SLOT_COUNT];
+
+    // 占用槽位，已被更新的编号占用时放弃（写入者被整整一圈超过）
+    uint64_t current = slot.seq.load(std::memory_order_relaxed);
+    do {
+        if (current >= 2 * ticket + 1) return false;
+    } while (!slot.seq.compare_exchange_weak(current, 2 * ticket + 1, std::memory_order_acquire));
+    std::atomic_thread_fence(std::memory_order_release);
+
+    slot.length = line.length();
+    slot.checksum = text_checksum(line.data(), line.length());
+    memcpy(slot.text, line.data(), line.length());
+
+    // 写完后发布，期间槽位被更新的编号占用则不覆盖
+    uint64_t writing = 2 * ticket + 1;
+    return slot.seq.compare_exchange_strong(writing, 2 * ticket + 2, std::memory_order_release);
+}
+
+uint64_t SharedHistoryRing::head() const {
+    return header ? header->head.load(std::memory_order_acquire) : 0;
+}
+
+uint64_t SharedHistoryRing::oldest() const {
+    uint64_t next = head();
+    return next > SLOT_COUNT ? next - SLOT_COUNT : 0;
+}
+
+bool SharedHistoryRing::read(uint64_t ticket, std::string& out) const {
+    if (!header) return false;
+    const Slot& slot = header->slots[ticket % SLOT_COUNT];
+    uint64_t before = slot.seq.load(std::memory_order_acquire);
+    if (before != 2 * ticket + 2) return false;
+
+    uint32_t length = slot.length;
+    uint32_t checksum = slot.checksum;
+    if (length > MAX_LENGTH) return false;
+    out.assign(slot.text, length);
+
+    // seqlock：复制期间序号未变才有效；校验和防止被套圈的写入者留下的残缺内容
+    std::atomic_thread_fence(std::memory_order_acquire);
+    if (slot.seq.load(std::memory_order_relaxed) != before) return false;
+    return text_checksum(out.data(), out.length()) == checksum;
+}
+
+#endif
@@ -0,0 +1,49 @@
+#ifndef _SHAREDHISTORY_H_
+#define _SHAREDHISTORY_H_
+
+#ifdef __linux__
+
+#include <string>
+#include <string_view>
+#include <cstdint>
+#include <cstddef>
+
+// 跨会话共享的最近历史（共享内存环）
+// 同一主机上的多个shell映射同一块POSIX共享内存，按全局编号依次写入固定大小的槽位。
+// 写入无锁：fetch_add取得编号后占用槽位（每个槽位是一个seqlock），写完再标记完成；
+// 读取不加锁，复制内容后核对槽位序号和校验和，被覆盖或正在写入的槽位读取失败。
+// 每个会话自己保存读取位置，环中只保留最近SLOT_COUNT条。
+class SharedHistoryRing {
+public:
+    static const size_t SLOT_COUNT = 4096;
+    static const size_t MAX_LENGTH = 488;     // 超过此长度的命令不进入共享环
+    static const uint64_t NO_TICKET = UINT64_MAX;
+
+    SharedHistoryRing();
+    ~SharedHistoryRing();
+
+    // 映射（不存在时创建）名为name的共享内存，如"/shell-history-1000"
+    bool open(const std::string& name);
+    void close();
+    bool is_open() const { return header != nullptr; }
+
+    // 追加一条命令，过长或未打开时返回false
+    bool append(std::string_view line);
+
+    // 下一条将要写入的编号
+    uint64_t head() const;
+    // 环中仍可能读到的最早编号
+    uint64_t oldest() const;
+
+    // 读取编号为ticket的记录，已被覆盖、尚未写完或内容不完整时返回false
+    bool read(uint64_t ticket, std::string& out) const;
+
+private:
+    struct Header;
+    struct Slot;
+    Header* header;
+};
+
+#endif
+
+#endif
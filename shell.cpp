@@ -1,143 +1,700 @@
 #include "shell.h"
+#include "tracer.h"
 #include <cstdio>
+#include <cstdlib>
 #include <cstring>
 #include <chrono>
+#include <cstdarg>
+#include <algorithm>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+#ifdef __linux__
+#include <cerrno>
+#include <csignal>
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/wait.h>
+#include "pseudoterm.h"
+#include "fastscroll.h"
+#endif
 
-void Shell::move_cursor(int n) {
-    if (n > 0) {
-        printf("\033[%dC", n);  // 右移
-    } else if (n < 0) {
-        printf("\033[%dD", -n); // 左移
+#ifdef __linux__
+// 写出全部数据，非阻塞的描述符写满时等待可写；对端关闭返回false
+static bool write_fully(int fd, const char* data, size_t len) {
+    while (len > 0) {
+        ssize_t n = write(fd, data, len);
+        if (n < 0 && errno == EINTR) continue;
+        if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            struct pollfd pfd = {fd, POLLOUT, 0};
+            poll(&pfd, 1, -1);
+            continue;
+        }
+        if (n <= 0) return false;
+        data += n;
+        len -= n;
+    }
+    return true;
+}
+#endif
+
+// data开头连续的文本字节（0x20以上，DEL除外，包括UTF-8的多字节字符）数。粘贴和管道
+// 输入大多是这样的字节，整段一次插入和回显，只有遇到控制字节才回到逐字节的状态机
+static size_t printable_run(const char* data, size_t len) {
+    size_t i = 0;
+#ifdef __SSE2__
+    // 每次比较16字节：按有符号比较，0x80以上的字节是负数，控制字节不大于0x1F
+    const __m128i space = _mm_set1_epi8(0x1F);
+    const __m128i del = _mm_set1_epi8(0x7F);
+    const __m128i zero = _mm_setzero_si128();
+    for (; i + 16 <= len; i += 16) {
+        __m128i bytes = _mm_loadu_si128((const __m128i*)(data + i));
+        __m128i text = _mm_or_si128(_mm_cmpgt_epi8(bytes, space), _mm_cmplt_epi8(bytes, zero));
+        unsigned mask = _mm_movemask_epi8(_mm_andnot_si128(_mm_cmpeq_epi8(bytes, del), text));
+        if (mask != 0xFFFF) return i + __builtin_ctz(~mask);
+    }
+#endif
+    while (i < len && (unsigned char)data[i] >= 0x20 && data[i] != 0x7F) i++;
+    return i;
+}
+
+// data是一个UTF-8字符的开头部分，其余字节还没有收到
+static bool utf8_incomplete(const char* data, size_t len) {
+    if (len == 0 || utf8_sequence_length((unsigned char)data[0]) <= len) return false;
+    for (size_t i = 1; i < len; i++) {
+        if (((unsigned char)data[i] & 0xC0) != 0x80) return false;
+    }
+    return true;
+}
+
+// 输出先写入缓存，flush_output时一次写出，一次按键的回显只产生一次写操作
+void Shell::emit(const char* data, size_t len) {
+    out_buffer.append(data, len);
+}
+
+void Shell::emitf(const char* format, ...) {
+    char buffer[256];
+    va_list args;
+    va_start(args, format);
+    int n = vsnprintf(buffer, sizeof(buffer), format, args);
+    va_end(args);
+    if (n < 0) return;
+    if ((size_t)n < sizeof(buffer)) {
+        out_buffer.append(buffer, n);
+        return;
+    }
+    // 超长的内容直接格式化到缓存末尾
+    size_t old_size = out_buffer.size();
+    out_buffer.resize(old_size + n + 1);
+    va_start(args, format);
+    vsnprintf(&out_buffer[old_size], n + 1, format, args);
+    va_end(args);
+    out_buffer.resize(old_size + n);
+}
+
+bool Shell::flush_output() {
+    if (out_buffer.empty()) return true;
+    TRACE_SCOPE("flush");
+    LatencyStage stage = stage_timer.switch_to(LatencyStage::FLUSH);
+    bool done = write_output();
+    stage_timer.switch_to(stage);
+    return done;
+}
+
+bool Shell::write_output() {
+    if (terminal_fd < 0) {
+        fwrite(out_buffer.data(), 1, out_buffer.size(), stdout);
+        fflush(stdout);
+        if (tap_echo) tap_output(out_buffer.data(), out_buffer.size());
+        out_buffer.clear();
+        return true;
+    }
+#ifdef __linux__
+    // 会话模式：终端描述符非阻塞，写不完的部分留在缓存中，由服务在可写时再次调用
+    size_t done = 0;
+    while (done < out_buffer.size()) {
+        ssize_t n = write(terminal_fd, out_buffer.data() + done, out_buffer.size() - done);
+        if (n < 0 && errno == EINTR) continue;
+        if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) break;
+        if (n <= 0) {
+            done = out_buffer.size();  // 连接已断开，丢弃
+            break;
+        }
+        done += n;
     }
+    if (tap_echo) tap_output(out_buffer.data(), done);
+    out_buffer.erase(0, done);
+#endif
+    return out_buffer.empty();
+}
+
+// 复制到旁路，旁路出错时不再复制
+void Shell::tap_output(const char* data, size_t len) {
+#ifdef __linux__
+    if (!write_fully(output_tap_fd, data, len)) tap_echo = false;
+#else
+    (void)data;
+    (void)len;
+#endif
+}
+
+// 命令行中字节偏移处的列号
+size_t Shell::column(size_t offset) {
+    widths.update(command_line);
+    return widths.column(offset);
+}
+
+// 光标在命令行内从from列移到to列，由编码器选最短的写法
+void Shell::move_cursor(size_t from, size_t to) {
+    encoder.move(out_buffer, edit_line(), PROMPT.size() + from, PROMPT.size() + to);
 }
 
 void Shell::clear_line() {
-    printf("\r\033[K");  // 回到行首并清除整行
+    emit("\r\033[K");  // 回到行首并清除整行
 }
 
 void Shell::append_char(char c) {
-    putchar(c);
-    fflush(stdout);
+    emit(c);
+    flush_output();
 }
 
-void Shell::refresh_from_cursor() {
-    // 从光标位置刷新到行尾
-    printf("\033[K");  // 先清除从光标到行尾的内容
-    if (cursor_pos < command_line.length()) {
-        // 打印从光标位置到行尾的内容
-        const char* remaining = command_line.c_str() + cursor_pos;
-        printf("%s", remaining);
-        // 将光标移回正确位置，只有当光标不在字符串末尾时才需要移动
-        size_t remaining_len = strlen(remaining);
-        if (remaining_len > 0) {
-            move_cursor(-remaining_len);
-        }
+// 在光标处插入一段文本，输出由调用者写出
+void Shell::insert_text(std::string_view text) {
+    size_t at = cursor_pos;
+    size_t from = column(at);
+    command_line.insert(at, text.data(), text.length());
+    widths.invalidate(at);
+    cursor_pos += text.length();
+    EditLine line = edit_line();
+    if (!widths.boundary(at) || !widths.boundary(cursor_pos)) {
+        // 插入的内容与前后的字符组成了字形簇（如单独输入的组合字符），整行重绘
+        refresh_line();
+        return;
     }
-    fflush(stdout);
+    encoder.insert(out_buffer, line, PROMPT.size() + from, widths.column(cursor_pos) - from);
 }
 
 void Shell::refresh_line() {
+    TRACE_SCOPE("refresh_line");
+    widths.invalidate(0);  // 命令行可能整个换过
     clear_line();
-    printf("$ %s", command_line.c_str());
-    move_cursor(cursor_pos - command_line.length());
-    fflush(stdout);
+    suggestion.clear();  // 整行重绘，提示随之清除
+    emit(PROMPT);
+    emit(command_line);
+    move_cursor(column(command_line.length()), column(cursor_pos));
+    flush_output();
 }
 
-void Shell::handle_cursor_movement(char direction, int count) {
+void Shell::handle_cursor_movement(char direction, size_t count) {
     switch (direction) {
         case 'A':  // UP
-            handle_history_navigation(-1);
+            handle_history_navigation(-1, count);
             break;
         case 'B':  // DOWN
-            handle_history_navigation(1);
+            handle_history_navigation(1, count);
             break;
         case 'C':  // RIGHT
-            if (cursor_pos < command_line.length()) {
-                cursor_pos++;
-                move_cursor(1);
+        case 'D': {  // LEFT
+            // 按字形簇移动，宽字符一次移过两列
+            size_t from = column(cursor_pos);
+            size_t pos = cursor_pos;
+            if (direction == 'C') {
+                while (count-- > 0 && pos < command_line.length()) pos = widths.next_boundary(pos);
+            } else {
+                while (count-- > 0 && pos > 0) pos = widths.prev_boundary(pos);
             }
-            break;
-        case 'D':  // LEFT
-            if (cursor_pos > 0) {
-                cursor_pos--;
-                move_cursor(-1);
+            if (pos != cursor_pos) {
+                cursor_pos = pos;
+                move_cursor(from, widths.column(pos));
             }
             break;
+        }
     }
 }
 
-void Shell::handle_history_navigation(int direction) {
-    if (direction < 0 && history_pos > 0) {
-        history_pos--;
-        command_line = history[history_pos];
-        cursor_pos = command_line.length();
-        refresh_line();
-    } else if (direction > 0 && history_pos < history.size()) {
-        history_pos++;
-        if (history_pos == history.size()) {
+// 把命令行换成历史中的一条记录，直接从日志复制，命令行的容量足够时不分配
+void Shell::load_history(size_t pos) {
+    size_t length;
+    const char* text = history.text(pos, length);
+    command_line.assign(text, length);
+    widths.invalidate(0);
+}
+
+// 连续移动count条记录，只在最后重绘一次
+void Shell::handle_history_navigation(int direction, size_t count) {
+    bool moved = false;
+    while (count-- > 0 && history_step(direction)) {
+        moved = true;
+    }
+    if (!moved) return;
+    cursor_pos = command_line.length();
+    refresh_line();
+}
+
+// 移到上一条或下一条记录并载入命令行，已到头时返回false
+bool Shell::history_step(int direction) {
+#ifdef __linux__
+    if (shared_history.is_open()) {
+        return shared_history_step(direction);
+    }
+#endif
+    // 直接在历史日志上前后移动，不需要按下标索引
+    if (direction < 0) {
+        size_t pos = history.prev(history_pos);
+        if (pos == HistoryStore::npos) return false;
+        history_pos = pos;
+        load_history(history_pos);
+    } else {
+        if (history_pos == history.end()) return false;
+        history_pos = history.next(history_pos);
+        if (history_pos == history.end()) {
             command_line.clear();
         } else {
-            command_line = history[history_pos];
+            load_history(history_pos);
+        }
+    }
+    return true;
+}
+
+#ifdef __linux__
+// 接入共享环后的浏览顺序：日志中接入前的记录，然后是环中接入后全部会话的命令
+// 浏览环只读共享内存，不做文件I/O也不加锁
+bool Shell::shared_history_step(int direction) {
+    // 日志整理后接入位置失效，此后日志中的记录都视为接入前的
+    if (history.compaction_count() != mark_compactions) {
+        mark_compactions = history.compaction_count();
+        store_mark = history.end();
+        history_pos = history.end();
+    }
+
+    bool in_store = history_pos != history.end();
+    uint64_t first = std::max(ring_start, shared_history.oldest());
+    if (direction < 0) {
+        if (!in_store) {
+            uint64_t from = ring_pos == SharedHistoryRing::NO_TICKET ? shared_history.head() : ring_pos;
+            for (uint64_t ticket = from; ticket > first; ticket--) {
+                if (shared_history.read(ticket - 1, ring_line)) {
+                    ring_pos = ticket - 1;
+                    command_line = ring_line;
+                    return true;
+                }
+            }
+        }
+        // 环中没有更早的记录，转入日志
+        size_t pos = history.prev(in_store ? history_pos : store_mark);
+        if (pos == HistoryStore::npos) return false;
+        history_pos = pos;
+        ring_pos = SharedHistoryRing::NO_TICKET;
+        load_history(pos);
+    } else {
+        uint64_t from;
+        if (in_store) {
+            size_t pos = history.next(history_pos);
+            if (pos < store_mark) {
+                history_pos = pos;
+                load_history(pos);
+                return true;
+            }
+            history_pos = history.end();
+            from = first;
+        } else if (ring_pos != SharedHistoryRing::NO_TICKET) {
+            from = ring_pos + 1;
+        } else {
+            return false;  // 已在新输入行
+        }
+        ring_pos = SharedHistoryRing::NO_TICKET;
+        command_line.clear();
+        for (uint64_t ticket = from; ticket < shared_history.head(); ticket++) {
+            if (shared_history.read(ticket, ring_line)) {
+                ring_pos = ticket;
+                command_line = ring_line;
+                break;
+            }
+        }
+    }
+    return true;
+}
+
+bool Shell::attach_shared_history(const std::string& name) {
+    bool ok = shared_history.open(name);
+    ring_start = shared_history.head();
+    ring_pos = SharedHistoryRing::NO_TICKET;
+    store_mark = history.end();
+    mark_compactions = history.compaction_count();
+    history_pos = history.end();
+    ring_line.reserve(SharedHistoryRing::MAX_LENGTH);
+    return ok;
+}
+#endif
+
+// 在行尾查找以当前命令行开头的最近一条历史，以暗色显示剩余部分
+void Shell::show_suggestion() {
+    bool shown = !suggestion.empty();
+    suggestion.clear();
+    if (cursor_pos == command_line.length() && !command_line.empty()) {
+        suggest_index.sync(history);
+        size_t pos = suggest_index.lookup(history, command_line);
+        if (pos != HistoryStore::npos) {
+            size_t length;
+            const char* text = history.text(pos, length);
+            if (length > command_line.length()) {
+                suggestion.assign(text + command_line.length(), length - command_line.length());
+            }
+        }
+    }
+    if (shown) {
+        emit("\033[K");
+    }
+    if (!suggestion.empty()) {
+        emitf("\033[2m%s\033[0m", suggestion.c_str());
+        size_t end = column(command_line.length());
+        move_cursor(end + text_width(suggestion), end);
+    }
+    flush_output();
+}
+
+void Shell::hide_suggestion() {
+    if (!suggestion.empty()) {
+        emit("\033[K");
+        flush_output();
+        suggestion.clear();
+    }
+}
+
+// 右方向键在行尾接受提示
+void Shell::accept_suggestion() {
+    emit(suggestion);
+    flush_output();
+    widths.invalidate(command_line.length());
+    command_line += suggestion;
+    cursor_pos = command_line.length();
+    suggestion.clear();
+}
+
+// 进入增量搜索
+void Shell::start_search(bool reverse) {
+    searching = true;
+    search_reverse = reverse;
+    search_failed = false;
+    search_pending = false;
+    search_query.clear();
+    search_match = HistoryStore::npos;
+    search_saved_line = command_line;
+    history_index.sync(history);
+    render_search();
+}
+
+// 从limit开始按方向查找，找不到时保留原来的匹配并标记失败；
+// 索引尚未建完时不算失败，留待continue_search补入后再找
+void Shell::find_search_match(size_t limit, bool reverse) {
+    search_reverse = reverse;
+    search_limit = limit;
+    size_t match = reverse ? history_index.search_backward(history, search_query, limit)
+                           : history_index.search_forward(history, search_query, limit);
+    search_pending = match == HistoryStore::npos && !history_index.complete(history);
+    search_failed = match == HistoryStore::npos && !search_pending;
+    if (match != HistoryStore::npos) {
+        search_match = match;
+    }
+}
+
+void Shell::continue_search() {
+    if (!searching || history_index.complete(history)) return;
+    history_index.extend(history);
+    if (search_pending) {
+        find_search_match(search_limit, search_reverse);
+        if (!search_pending) render_search();
+    }
+}
+
+void Shell::render_search() {
+    const char* label = search_reverse ? "reverse-i-search" : "i-search";
+    clear_line();
+    emitf("(%s%s)`%s': ", search_failed ? "failed " : "", label, search_query.c_str());
+    if (search_match != HistoryStore::npos) {
+        size_t length;
+        const char* text = history.text(search_match, length);
+        emit(text, length);
+    }
+    flush_output();
+}
+
+// 搜索中的按键，返回false表示搜索已结束，按键需按普通输入继续处理
+bool Shell::handle_search_key(char c) {
+    size_t begin = history.begin();
+    size_t end = history.end();
+    if (c == 0x12 || c == 0x13) {  // Ctrl-R/Ctrl-S：同一查询的下一个匹配
+        bool reverse = c == 0x12;
+        if (search_query.empty()) {
+            search_query = last_search;
+        }
+        if (search_match == HistoryStore::npos) {
+            find_search_match(reverse ? end : begin, reverse);
+        } else {
+            find_search_match(reverse ? search_match : history.next(search_match), reverse);
+        }
+    } else if (c == '\b' || c == 127) {
+        // 删除一个字符后从头重新搜索
+        if (!search_query.empty()) {
+            search_query.pop_back();
+        }
+        search_match = HistoryStore::npos;
+        search_failed = false;
+        search_pending = false;
+        if (!search_query.empty()) {
+            find_search_match(search_reverse ? end : begin, search_reverse);
+        }
+    } else if (c == 0x07) {  // Ctrl-G：取消搜索，恢复原来的命令行
+        searching = false;
+        command_line = search_saved_line;
+        cursor_pos = command_line.length();
+        refresh_line();
+        return true;
+    } else if ((unsigned char)c >= 32) {
+        // 查询变长后当前匹配仍可能满足，从当前匹配（含）开始找
+        search_query += c;
+        size_t limit = search_reverse ? end : begin;
+        if (search_match != HistoryStore::npos) {
+            limit = search_reverse ? history.next(search_match) : search_match;
+        }
+        find_search_match(limit, search_reverse);
+    } else {
+        // 其他按键接受当前匹配并退出搜索
+        searching = false;
+        if (!search_query.empty()) {
+            last_search = search_query;
+        }
+        if (search_match != HistoryStore::npos) {
+            load_history(search_match);
+            history_pos = search_match;
         }
         cursor_pos = command_line.length();
         refresh_line();
+        return false;
     }
+    render_search();
+    return true;
 }
 
-void Shell::handle_delete_key() {
-    if (cursor_pos < command_line.length()) {
-        command_line.erase(cursor_pos, 1);
-        refresh_line();
+// 删除光标后的count个字形簇
+void Shell::handle_delete_key(size_t count) {
+    size_t from = column(cursor_pos);
+    size_t end = cursor_pos;
+    while (count-- > 0 && end < command_line.length()) end = widths.next_boundary(end);
+    if (end == cursor_pos) return;
+    size_t erased = widths.column(end) - from;
+    command_line.erase(cursor_pos, end - cursor_pos);
+    widths.invalidate(cursor_pos);
+    EditLine line = edit_line();
+    if (!widths.boundary(cursor_pos)) {
+        refresh_line();  // 前后的字符连成了一个簇
+        return;
+    }
+    encoder.erase(out_buffer, line, PROMPT.size() + from, erased);
+    flush_output();
+}
+
+// Tab补全：第一次补全公共部分，有多个候选时再次按Tab分页列出
+// 补全插入命令行时需要转义的字符：空白和shell元字符，'~'和'#'只在单词开头有特殊含义
+static bool needs_escape(char c, bool word_start) {
+    return (c != '\0' && strchr(" \t\n\\'\"$`&;|<>()*?[]{}!", c) != nullptr) ||
+           (word_start && (c == '~' || c == '#'));
+}
+
+// 给补全的文本加反斜杠转义，at_start表示text从单词开头开始
+static std::string escape_completion(const std::string& text, bool at_start) {
+    std::string escaped;
+    for (size_t i = 0; i < text.length(); i++) {
+        if (needs_escape(text[i], at_start && i == 0)) escaped += '\\';
+        escaped += text[i];
     }
+    return escaped;
 }
 
-void Shell::parse_csi_sequence() {
+void Shell::handle_tab() {
+#ifdef __linux__
+    completion_tabs++;
+
+    // 光标前的当前单词（未转义的空格或'|'之后），去掉转义后补全；
+    // 位于行首或'|'之后的单词补全命令名，其他补全文件名
+    size_t start = 0;
+    std::string word;
+    for (size_t i = 0; i < cursor_pos; i++) {
+        char c = command_line[i];
+        if (c == '\\' && i + 1 < cursor_pos) {
+            word += command_line[++i];
+        } else if (c == ' ' || c == '|') {
+            start = i + 1;
+            word.clear();
+        } else {
+            word += c;
+        }
+    }
+    size_t prev = start;
+    while (prev > 0 && command_line[prev - 1] == ' ') {
+        prev--;
+    }
+    bool command_position = (prev == 0 || command_line[prev - 1] == '|') &&
+                            word.find('/') == std::string::npos;
+
+    size_t offset = completion_tabs > 2 ? (completion_tabs - 2) * COMPLETION_PAGE_SIZE : 0;
+    size_t limit = completion_tabs >= 2 ? COMPLETION_PAGE_SIZE : 0;
+    CompletionResult result = command_position
+        ? completer->complete_command(word, offset, limit)
+        : completer->complete_file(word, offset, limit);
+    if (result.total > 0 && offset >= result.total) {
+        // 已列出最后一页，从头开始
+        completion_tabs = 2;
+        offset = 0;
+        result = command_position ? completer->complete_command(word, 0, limit)
+                                  : completer->complete_file(word, 0, limit);
+    }
+
+    if (result.total == 0) {
+        emit('\a');
+        flush_output();
+        return;
+    }
+    if (result.total == 1) {
+        // 唯一候选：补全剩余部分，不是目录时加空格
+        std::string text = escape_completion(result.common.substr(word.length()), word.empty());
+        if (result.common.back() != '/') text += ' ';
+        insert_text(text);
+        completion_tabs = 0;
+        return;
+    }
+    if (result.common.length() > word.length()) {
+        insert_text(escape_completion(result.common.substr(word.length()), word.empty()));
+        completion_tabs = 1;  // 下一次Tab直接列出候选
+        return;
+    }
+    if (completion_tabs == 1) {
+        emit('\a');
+        flush_output();
+        return;
+    }
+    size_t slash = word.rfind('/');
+    list_candidates(result, offset, slash == std::string::npos ? 0 : slash + 1);
+#endif
+}
+
+// 分列显示一页候选，strip为不显示的目录部分长度
+void Shell::list_candidates(const CompletionResult& result, size_t offset, size_t strip) {
+    size_t width = 0;
+    for (const auto& candidate : result.candidates) {
+        if (candidate.length() - strip > width) width = candidate.length() - strip;
+    }
+    width += 2;
+    size_t columns = width < 80 ? 80 / width : 1;
+
+    emit("\n");
+    for (size_t i = 0; i < result.candidates.size(); i++) {
+        const char* name = result.candidates[i].c_str() + strip;
+        bool last_column = (i % columns == columns - 1) || i == result.candidates.size() - 1;
+        if (last_column) {
+            emitf("%s\n", name);
+        } else {
+            emitf("%-*s", (int)width, name);
+        }
+    }
+    size_t shown = offset + result.candidates.size();
+    if (shown < result.total) {
+        emitf("--More-- (%zu/%zu)\n", shown, result.total);
+    }
+    refresh_line();
+}
+
+void Shell::parse_csi_sequence(size_t repeats) {
+    TRACE_SCOPE("parse_csi");
     CSISequence seq;
-    std::string current_param;
-    
+    seq.count = 0;
+    seq.final = 0;
+    int current_param = 0;
+    bool has_digits = false;
+
     for (size_t i = 2; i < escape_pos; i++) {
         char c = escape_buffer[i];
         if (c >= '0' && c <= '9') {
-            current_param += c;
+            current_param = std::min(current_param * 10 + (c - '0'), 99999);  // 过大的参数截断
+            has_digits = true;
         } else if (c == ';') {
-            if (!current_param.empty()) {
-                seq.parameters.push_back(std::stoi(current_param));
-                current_param.clear();
-            } else {
-                seq.parameters.push_back(0);
+            if (seq.count < CSISequence::MAX_PARAMETERS) {
+                seq.parameters[seq.count++] = current_param;
             }
+            current_param = 0;
+            has_digits = false;
         } else {  // 最终字符
-            if (!current_param.empty()) {
-                seq.parameters.push_back(std::stoi(current_param));
+            if (has_digits && seq.count < CSISequence::MAX_PARAMETERS) {
+                seq.parameters[seq.count++] = current_param;
             }
             seq.final = c;
             break;
         }
     }
-    handle_csi_sequence(seq);
+    stage_timer.switch_to(LatencyStage::RENDER);
+    handle_csi_sequence(seq, repeats);
 }
 
-void Shell::handle_csi_sequence(const CSISequence& seq) {
-    int count = seq.parameters.empty() ? 1 : seq.parameters[0];
+// repeats为连续收到的相同序列个数，合并为一次编辑
+void Shell::handle_csi_sequence(const CSISequence& seq, size_t repeats) {
+    // 方向键的参数是移动次数，省略或为0时按1（带修饰键的写法如1;5D也是1）
+    size_t count = (seq.count == 0 || seq.parameters[0] == 0 ? 1 : seq.parameters[0]) * repeats;
+
+    if (!suggestion.empty()) {
+        if (seq.final == 'C') {
+            // 第一次右移接受提示，合并的其余右移照常移动光标
+            accept_suggestion();
+            if (count > 1) {
+                handle_cursor_movement('C', count - 1);
+            }
+            return;
+        }
+        hide_suggestion();
+    }
     
     switch (seq.final) {
         case 'A': case 'B': case 'C': case 'D':
             handle_cursor_movement(seq.final, count);
             break;
         case '~':
-            if (!seq.parameters.empty() && seq.parameters[0] == 3) {
-                handle_delete_key();
+            if (seq.count > 0 && seq.parameters[0] == 3) {
+                handle_delete_key(repeats);
             }
             break;
     }
 }
 
 void Shell::handle_input(const char* seq, size_t len) {
+    if (utf8_pending_length > 0 && len > 0) {
+        // 上次输入末尾不完整的UTF-8字符，与这次开头的字节一起先处理
+        char joined[8];
+        size_t pending = utf8_pending_length;
+        size_t take = std::min(len, utf8_sequence_length(utf8_pending[0]) - pending);
+        memcpy(joined, utf8_pending, pending);
+        memcpy(joined + pending, seq, take);
+        utf8_pending_length = 0;
+        handle_input(joined, pending + take);
+        seq += take;
+        len -= take;
+    }
     auto now = std::chrono::steady_clock::now();
+    bool timing = stage_timer.start(LatencyStage::PARSE);
+    TRACE_SCOPE("handle_input");
 
     for (size_t i = 0; i < len; i++) {
         char c = seq[i];
 
+        // 回车启动了前台作业，剩余输入缓存起来等作业结束后再处理
+        if (foreground_busy()) {
+            buffer_typeahead(seq + i, len - i);
+            break;
+        }
+
+        if (c != '\t') {
+            completion_tabs = 0;
+        }
+
         if (check_sequence_timeout()) {
             i--;
             continue;
@@ -145,46 +702,101 @@ void Shell::handle_input(const char* seq, size_t len) {
 
         switch (input_state) {
             case NORMAL:
+                if (c != '\033') {
+                    stage_timer.switch_to(LatencyStage::RENDER);
+                }
+                if (searching && handle_search_key(c)) {
+                    break;
+                }
                 if (c == '\033') {
                     input_state = ESC_RECEIVED;
                     escape_buffer[0] = c;
                     escape_pos = 1;
                 } else if (c == '\r' || c == '\n') {
-                    printf("\n");
+                    hide_suggestion();
+                    emit("\n");
                     if (!command_line.empty()) {
-                        history.push_back(command_line);
-                        history_pos = history.size();
-                        execute_command(command_line);
+                        history.append(command_line);
+                        history_pos = history.end();
+#ifdef __linux__
+                        shared_history.append(command_line);
+                        ring_pos = SharedHistoryRing::NO_TICKET;
+#endif
+                        execute_command(std::string(command_line));
                         command_line.clear();
                         cursor_pos = 0;
                     }
-                    printf("$ ");
-                    fflush(stdout);
-                } else if (c == '\b' || c == 8) {
-                    if (cursor_pos > 0) {
-                        command_line.erase(cursor_pos - 1, 1);
-                        cursor_pos--;
-                        // 回退光标并清除当前位置到行尾
-                        move_cursor(-1);
-                        printf("\033[K");  // 清除从光标到行尾的内容
-                        // 如果不是在行尾删除，需要重新显示后面的内容
-                        if (cursor_pos < command_line.length()) {
-                            printf("%s", command_line.c_str() + cursor_pos);
-                            // 将光标移回正确位置
-                            move_cursor(-(command_line.length() - cursor_pos));
+                    if (!foreground_busy()) {
+                        print_prompt();
+                    }
+                } else if (c == '\b' || c == 0x7F) {
+                    // 连续的退格（按住不放，BS和DEL都算）合并为一次删除，每次删除一个字形簇
+                    size_t run = 1;
+                    while (i + run < len && (seq[i + run] == '\b' || seq[i + run] == 0x7F)) run++;
+                    i += run - 1;
+                    hide_suggestion();
+                    size_t from = column(cursor_pos);
+                    size_t start = cursor_pos;
+                    while (run-- > 0 && start > 0) start = widths.prev_boundary(start);
+                    if (start < cursor_pos) {
+                        size_t to = widths.column(start);
+                        command_line.erase(start, cursor_pos - start);
+                        widths.invalidate(start);
+                        cursor_pos = start;
+                        if (!widths.boundary(start)) {
+                            refresh_line();
+                        } else {
+                            // 回退光标，删除这些字符，行尾左移
+                            EditLine line = edit_line();
+                            encoder.move(out_buffer, line, PROMPT.size() + from, PROMPT.size() + to);
+                            encoder.erase(out_buffer, line, PROMPT.size() + to, from - to);
                         }
-                        fflush(stdout);
+                        show_suggestion();
+                    }
+                } else if (c == '\t') {
+                    hide_suggestion();
+                    handle_tab();
+                } else if (c == 0x12 || c == 0x13) {  // Ctrl-R/Ctrl-S
+                    hide_suggestion();
+                    start_search(c == 0x12);
+                } else if (size_t run = printable_run(seq + i, len - i); run > 1 || (unsigned char)c >= 0x80) {
+                    // 连续的文本（粘贴、多字节字符）整段插入，在行尾时只查找一次提示；
+                    // 不合法的UTF-8字节丢弃，输入末尾不完整的字符留到下次补全
+                    size_t valid = utf8_valid_length(seq + i, run);
+                    if (valid > 0) {
+                        insert_text(std::string_view(seq + i, valid));
+                        if (cursor_pos == command_line.length()) {
+                            show_suggestion();
+                        }
+                        i += valid - 1;
+                    } else if (i + run == len && utf8_incomplete(seq + i, run)) {
+                        memcpy(utf8_pending, seq + i, run);
+                        utf8_pending_length = run;
+                        i = len - 1;
                     }
                 } else if (c >= 32) {  // 可打印字符
                     command_line.insert(cursor_pos, 1, c);
+                    widths.invalidate(cursor_pos);
                     cursor_pos++;  // 先增加光标位置
                     if (cursor_pos == command_line.length()) {
-                        // 如果在行尾追加，直接输出字符
-                        append_char(c);
+                        if (!suggestion.empty() && suggestion[0] == c) {
+                            // 与提示一致：提示仍来自同一条记录，覆盖掉暗色的字符即可
+                            suggestion.erase(0, 1);
+                            append_char(c);
+                        } else {
+                            emit(c);
+                            show_suggestion();
+                        }
                     } else {
-                        // 如果在行中插入，刷新从当前位置到行尾的内容
-                        putchar(c);
-                        refresh_from_cursor();  // 刷新后续内容
+                        // 在行中插入，由编码器选择ICH或重印行尾
+                        size_t from = column(cursor_pos - 1);
+                        EditLine line = edit_line();
+                        if (!widths.boundary(cursor_pos)) {
+                            refresh_line();  // 后面的组合字符接到了新字符上
+                        } else {
+                            encoder.insert(out_buffer, line, PROMPT.size() + from, 1);
+                        }
+                        flush_output();
                     }
                 }
                 break;
@@ -200,17 +812,37 @@ void Shell::handle_input(const char* seq, size_t len) {
 
             case CSI_RECEIVED:
             case CSI_PARAMETER:
-                escape_buffer[escape_pos++] = c;
                 if ((c >= '0' && c <= '9') || c == ';') {
-                    input_state = CSI_PARAMETER;
+                    // 留一个字节给最终字符，过长的序列不会是按键（可能来自不可信的连接）
+                    if (escape_pos + 1 >= sizeof(escape_buffer)) {
+                        input_state = CSI_DISCARD;
+                    } else {
+                        escape_buffer[escape_pos++] = c;
+                        input_state = CSI_PARAMETER;
+                    }
                 } else {
-                    parse_csi_sequence();
+                    escape_buffer[escape_pos++] = c;
+                    // 已收到的输入中紧接着的相同序列（按住方向键或Delete）一并处理，只输出一次
+                    size_t repeats = 1;
+                    while (len - i - 1 >= escape_pos * repeats &&
+                           memcmp(seq + i + 1 + escape_pos * (repeats - 1), escape_buffer, escape_pos) == 0) {
+                        repeats++;
+                    }
+                    i += escape_pos * (repeats - 1);
+                    parse_csi_sequence(repeats);
                     reset_sequence_state();
                 }
                 break;
+
+            case CSI_DISCARD:
+                if (!((c >= '0' && c <= '9') || c == ';')) reset_sequence_state();
+                break;
         }
+        stage_timer.switch_to(LatencyStage::PARSE);
         last_input_time = now;
     }
+    flush_output();
+    if (timing) stage_timer.finish();
 }
 
 bool Shell::check_sequence_timeout() {
@@ -221,7 +853,8 @@ bool Shell::check_sequence_timeout() {
         now - last_input_time).count();
     
     if (elapsed > ESCAPE_TIMEOUT_MS) {
-        handle_incomplete_sequence();
+        TRACE_INSTANT("escape_timeout", (int32_t)escape_pos);
+        if (input_state != CSI_DISCARD) handle_incomplete_sequence();
         reset_sequence_state();
         return true;
     }
@@ -241,28 +874,541 @@ void Shell::reset_sequence_state() {
     escape_pos = 0;
 }
 
-Shell::Shell(struct fifo* fifo) : 
+Shell::Shell(struct fifo* fifo, int terminal_fd, std::pmr::memory_resource* resource) : 
+    command_line(resource),
     cursor_pos(0), 
-    history_pos(0), 
+    widths(resource),
+    history(HistoryOptions(), resource),
+    history_pos(history.end()), 
+    suggestion(resource),
+    searching(false),
+    search_reverse(true),
+    search_failed(false),
+    search_pending(false),
+    search_limit(HistoryStore::npos),
+    search_query(resource),
+    last_search(resource),
+    search_match(HistoryStore::npos),
+    search_saved_line(resource),
     input_fifo(fifo),
+    output_tap_fd(-1),
+    tap_echo(false),
+    terminal_fd(terminal_fd),
+    out_buffer(resource),
+    typeahead(resource),
+    completion_tabs(0),
     input_state(NORMAL),
     escape_pos(0),
+    utf8_pending_length(0),
     last_input_time(std::chrono::steady_clock::now()) {
-    printf("$ ");
-    fflush(stdout);
+#ifdef __linux__
+    // 内建命令向管道写数据时读端可能提前退出，用EPIPE代替信号
+    signal(SIGPIPE, SIG_IGN);
+    // 作业结束后shell在后台进程组中调用tcsetpgrp取回终端
+    signal(SIGTTOU, SIG_IGN);
+    shell_pgid = getpgrp();
+    // 会话模式下多个shell共用一个进程，都不控制终端
+    job_control = terminal_fd < 0 && isatty(STDIN_FILENO) && tcgetpgrp(STDIN_FILENO) == shell_pgid;
+    ring_start = 0;
+    ring_pos = SharedHistoryRing::NO_TICKET;
+    store_mark = history.end();
+    mark_compactions = 0;
+    pty_mode = false;
+    fast_scroll_fps = 0;
+    window_changes_seen = 0;
+    tracking_window = false;
+    if (!get_terminal_size(terminal_fd >= 0 ? terminal_fd : STDOUT_FILENO, window_rows, window_cols)) {
+        window_rows = 24;
+        window_cols = 80;
+    }
+    path_cache = &own_path_cache;
+    completer = &own_completer;
+    completer->set_builtins(BUILTINS);
+#endif
+    print_prompt();
+}
+
+#ifdef __linux__
+void Shell::share_lookup_caches(PathCache* cache, Completer* shared_completer) {
+    path_cache = cache;
+    completer = shared_completer;
+    completer->set_builtins(BUILTINS);
+}
+#endif
+
+void Shell::print_prompt() {
+    emit(PROMPT);
+    flush_output();
 }
 
 void Shell::process_input() {
-    uint8_t buffer[256];
+    TRACE_THREAD("shell");
     while (true) {
-        uint32_t len = fifo_read(input_fifo, buffer, sizeof(buffer));
-        if (len > 0) {
-            handle_input((const char*)buffer, len);
+        // 命令异步执行，循环持续读取FIFO，避免按键在命令运行期间溢出丢失
+        process_fifo();
+    }
+}
+
+bool Shell::process_fifo() {
+    // 一次取出fifo中全部的输入，连续的相同按键才能合并
+    uint8_t buffer[1024];
+    poll_jobs();
+    uint32_t len = fifo_read(input_fifo, buffer, sizeof(buffer));
+    if (len == 0) {
+        continue_search();
+        return false;
+    }
+    TRACE_INSTANT("fifo_read", (int32_t)len);
+    // 延迟跟踪：取回这些按键写入fifo时的时间戳，回显写出后得到端到端延迟
+    bool traced = LatencyTrace::enabled();
+    if (traced) LatencyTrace::instance().dequeued(input_fifo->out);
+    handle_input((const char*)buffer, len);
+    if (traced) LatencyTrace::instance().echoed();
+    return true;
+}
+
+bool Shell::foreground_busy() const {
+#ifdef __linux__
+    return jobs.has_foreground();
+#else
+    return false;
+#endif
+}
+
+// 缓存前台作业运行期间的输入，中断类控制键转换为发给作业的信号
+// 前台作业运行在伪终端上时按键直接写入主端，由从端的行规程回显和编辑
+void Shell::buffer_typeahead(const char* seq, size_t len) {
+#ifdef __linux__
+    Job* job = jobs.foreground();
+    bool to_terminal = job && job->terminal >= 0;
+    size_t start = 0;  // 尚未写入伪终端的按键
+    for (size_t i = 0; i < len; i++) {
+        int sig = 0;
+        switch (seq[i]) {
+            case 0x03: sig = SIGINT; break;   // Ctrl+C
+            case 0x1A: sig = SIGTSTP; break;  // Ctrl+Z
+            case 0x1C: sig = SIGQUIT; break;  // Ctrl+\ (退出)
+        }
+        if (sig == 0) {
+            if (!to_terminal) typeahead += seq[i];
+            continue;
+        }
+        if (to_terminal) forward_to_terminal(*job, seq + start, i - start);
+        start = i + 1;
+        if (job) {
+            jobs.signal(*job, sig);
+            if (sig != SIGTSTP) {
+                typeahead.clear();  // 与终端驱动一样，中断时丢弃之前的预输入
+            }
+        }
+    }
+    if (to_terminal) forward_to_terminal(*job, seq + start, len - start);
+#else
+    typeahead.append(seq, len);
+#endif
+}
+
+#ifdef __linux__
+// 主端非阻塞，作业不读输入而输入队列已满时丢弃，与终端的行为一致
+void Shell::forward_to_terminal(Job& job, const char* data, size_t len) {
+    while (len > 0) {
+        ssize_t n = write(job.terminal, data, len);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) break;
+        data += n;
+        len -= n;
+    }
+}
+
+static volatile sig_atomic_t window_changes = 0;
+
+static void count_window_change(int) {
+    window_changes = window_changes + 1;
+}
+
+// shell自身终端的大小变化只记录次数，在poll_jobs中同步到作业和监听者
+void Shell::track_window_size() {
+    if (terminal_fd >= 0 || tracking_window) return;
+    tracking_window = true;
+    window_changes_seen = window_changes;
+    struct sigaction action = {};
+    action.sa_handler = count_window_change;
+    action.sa_flags = SA_RESTART;
+    sigaction(SIGWINCH, &action, nullptr);
+}
+
+void Shell::set_pty_mode(bool enabled) {
+    pty_mode = enabled;
+    if (enabled) track_window_size();
+}
+
+void Shell::set_window_size(unsigned short rows, unsigned short cols) {
+    window_rows = rows;
+    window_cols = cols;
+    // 命令没有控制终端，内核不会代为发送SIGWINCH
+    for (const Job& job : jobs.list()) {
+        if (job.terminal >= 0 && set_terminal_size(job.terminal, rows, cols)) {
+            kill(-job.pgid, SIGWINCH);
         }
     }
+    if (window_listener) window_listener(rows, cols);
 }
 
+void Shell::set_window_listener(std::function<void(unsigned short, unsigned short)> listener) {
+    window_listener = std::move(listener);
+    if (window_listener) track_window_size();
+}
+#endif
+
+void Shell::poll_jobs() {
+#ifdef __linux__
+    if (tracking_window && window_changes != (sig_atomic_t)window_changes_seen) {
+        window_changes_seen = window_changes;
+        unsigned short rows, cols;
+        if (get_terminal_size(STDOUT_FILENO, rows, cols)) set_window_size(rows, cols);
+    }
+
+    std::vector<JobEvent> events = jobs.poll();
+    if (events.empty()) return;
+
+    bool foreground_finished = false;
+    bool line_dirty = false;
+    for (const auto& event : events) {
+        TRACE_INSTANT(event.state == JobState::STOPPED ? "job_stopped" :
+                      event.state == JobState::RUNNING ? "job_continued" : "job_exited", event.id);
+        if (event.foreground) {
+            foreground_finished = true;
+            give_terminal(shell_pgid);
+            if (event.state == JobState::STOPPED) {
+                emitf("\n[%d]+  Stopped                 %s\n", event.id, event.command.c_str());
+            } else if (WIFSIGNALED(event.status) && WTERMSIG(event.status) != SIGINT &&
+                       WTERMSIG(event.status) != SIGPIPE) {
+                emitf("%s\n", strsignal(WTERMSIG(event.status)));
+            }
+        } else if (event.state != JobState::RUNNING) {
+            // 后台作业状态变化，在新行上通知后重绘当前编辑行
+            emitf("\r\033[K[%d]+  %-24s%s\n", event.id,
+                   event.state == JobState::DONE ? "Done" : "Stopped", event.command.c_str());
+            line_dirty = true;
+        }
+    }
+
+    if (foreground_finished && !jobs.has_foreground()) {
+        print_prompt();
+        // 处理作业运行期间缓存的预输入（其中的回车可能再次启动前台作业）
+        std::pmr::string pending(typeahead.get_allocator());
+        pending.swap(typeahead);
+        handle_input(pending.data(), pending.size());
+    } else if (line_dirty && !jobs.has_foreground()) {
+        refresh_line();
+    }
+    flush_output();
+#endif
+}
+
+bool Shell::open_history(const std::string& path) {
+    bool ok = history.open(path);
+    history_pos = history.end();
+    history_index.build(history);
+    suggest_index.clear();
+#ifdef __linux__
+    store_mark = history.end();
+    mark_compactions = history.compaction_count();
+#endif
+    return ok;
+}
+
+void Shell::set_output_tap(int fd, bool with_echo) {
+    output_tap_fd = fd;
+    tap_echo = fd >= 0 && with_echo;
+}
+
+// 内建命令，输出写入output，不是内建命令返回false
+bool Shell::run_builtin(const Command& cmd, std::string& output) {
+    const std::string& name = cmd.argv[0];
+    if (name == "history") {
+        char number[16];
+        size_t index = 1;
+        for (size_t pos = history.begin(); pos != history.end(); pos = history.next(pos)) {
+            size_t length;
+            const char* text = history.text(pos, length);
+            snprintf(number, sizeof(number), "%5zu  ", index++);
+            output += number;
+            output.append(text, length);
+            output += '\n';
+        }
+        return true;
+    }
+    if (name == "stats") {
+        // stats [on|off|reset]：按键延迟各阶段的统计
+        LatencyTrace& trace = LatencyTrace::instance();
+        const std::string arg = cmd.argv.size() > 1 ? cmd.argv[1] : "";
+        if (arg == "on" || arg == "off") {
+            trace.enable(arg == "on");
+        } else if (arg == "reset") {
+            trace.reset();
+        } else if (!arg.empty()) {
+            output += "stats: usage: stats [on|off|reset]\n";
+        } else {
+            output += trace.report();
+        }
+        return true;
+    }
+#ifdef SHELL_TRACE
+    if (name == "trace") {
+        // trace on|off|clear|dump <文件>：事件跟踪，导出为Chrome跟踪JSON
+        const std::string arg = cmd.argv.size() > 1 ? cmd.argv[1] : "";
+        if (arg == "on" || arg == "off") {
+            Tracer::enable(arg == "on");
+        } else if (arg == "clear") {
+            Tracer::clear();
+        } else if (arg == "dump" && cmd.argv.size() > 2) {
+            if (!Tracer::write_chrome_trace(cmd.argv[2])) output += "trace: cannot write " + cmd.argv[2] + "\n";
+        } else {
+            output += "trace: usage: trace on|off|clear|dump <file>\n";
+        }
+        return true;
+    }
+#endif
+#ifdef __linux__
+    if (name == "jobs") {
+        char line[64];
+        const Job* current = jobs.find(0);
+        for (const auto& job : jobs.list()) {
+            snprintf(line, sizeof(line), "[%d]%c  %-24s", job.id, &job == current ? '+' : ' ',
+                     job.state == JobState::STOPPED ? "Stopped" : "Running");
+            output += line;
+            output += job.command;
+            output += '\n';
+        }
+        return true;
+    }
+    if (name == "fg" || name == "bg") {
+        // 参数形如%n或n，缺省为当前作业
+        int id = 0;
+        if (cmd.argv.size() > 1) {
+            const std::string& arg = cmd.argv[1];
+            id = atoi(arg.c_str() + (arg[0] == '%' ? 1 : 0));
+            if (id <= 0) id = -1;
+        }
+        Job* job = id < 0 ? nullptr : jobs.find(id);
+        if (!job) {
+            output += name + ": no such job\n";
+            return true;
+        }
+        if (name == "fg") {
+            output += job->command + "\n";
+            jobs.set_foreground(job->id);
+            if (job->terminal < 0) give_terminal(job->pgid);
+        } else {
+            output += "[" + std::to_string(job->id) + "]+ " + job->command + "\n";
+        }
+        jobs.signal(*job, SIGCONT);
+        return true;
+    }
+    if (name == "hash") {
+        if (cmd.argv.size() == 1) {
+            // 列出缓存内容
+            if (path_cache->entries().empty()) {
+                output += "hash: hash table empty\n";
+                return true;
+            }
+            char hits[16];
+            output += "hits\tcommand\n";
+            for (const auto& entry : path_cache->entries()) {
+                snprintf(hits, sizeof(hits), "%4u\t", entry.second.hits);
+                output += hits;
+                output += entry.second.path;
+                output += '\n';
+            }
+        } else if (cmd.argv[1] == "-r") {
+            path_cache->clear();
+        } else {
+            // hash name... 解析并记住；hash -d name... 删除
+            bool remove = (cmd.argv[1] == "-d");
+            for (size_t i = remove ? 2 : 1; i < cmd.argv.size(); i++) {
+                bool found = remove ? path_cache->forget(cmd.argv[i])
+                                    : !path_cache->lookup(cmd.argv[i]).empty();
+                if (!found) {
+                    output += "hash: " + cmd.argv[i] + ": not found\n";
+                }
+            }
+        }
+        return true;
+    }
+#endif
+    return false;
+}
+
+#ifdef __linux__
+// 会话模式下把命令输出从管道转发到会话的终端（和旁路），直到命令关闭管道或stop_fd通知停止
+// 终端断开后继续读空管道，命令不会因管道写满而挂起
+static void forward_output(int in_pipe, int out_fd, int tap_fd, int stop_fd) {
+    char buffer[16384];
+    InputWait input(stop_fd);
+    while (input.wait(in_pipe)) {
+        ssize_t n = read(in_pipe, buffer, sizeof(buffer));
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) break;
+        if (out_fd >= 0 && !write_fully(out_fd, buffer, n)) out_fd = -1;
+        if (tap_fd >= 0 && !write_fully(tap_fd, buffer, n)) tap_fd = -1;
+    }
+}
+
+// 把终端交给指定进程组，只有shell控制着终端时才有效
+void Shell::give_terminal(pid_t pgid) {
+    if (job_control) {
+        tcsetpgrp(STDIN_FILENO, pgid);
+    }
+}
+
+void Shell::run_pipeline(const Pipeline& pipeline, const std::string& cmd) {
+    // 内建命令位于管道头部时，由shell把它的输出写入第一级外部命令的标准输入
+    std::string builtin_output;
+    bool builtin_head = run_builtin(pipeline.commands[0], builtin_output);
+    Pipeline external;
+    external.commands.assign(pipeline.commands.begin() + (builtin_head ? 1 : 0),
+                             pipeline.commands.end());
+
+    // 用路径缓存解析各级命令，避免每次都沿PATH逐个目录查找
+    for (auto& command : external.commands) {
+        command.path = path_cache->lookup(command.argv[0]);
+        if (command.path.empty()) {
+            emitf("%s: command not found\n", command.argv[0].c_str());
+            return;
+        }
+    }
+
+    // 伪终端模式下命令的标准输入、输出和错误都是新建伪终端的从端，shell只持有主端
+    int master = -1;
+    int slave = -1;
+    if (pty_mode) {
+        if (!open_pseudo_terminal(master, slave, false)) {
+            emitf("%s: cannot execute\n", cmd.c_str());
+            return;
+        }
+        set_terminal_size(master, window_rows, window_cols);
+    }
+
+    int feed[2] = {-1, -1};
+    int tap[2] = {-1, -1};
+    if (builtin_head && pipe2(feed, O_CLOEXEC) != 0) feed[0] = feed[1] = -1;
+    // 需要旁路输出时最后一级写入管道，由shell用tee/splice分发；
+    // 会话模式下终端描述符是非阻塞的，命令的输出也经管道由shell转发
+    if (!pty_mode && (output_tap_fd >= 0 || terminal_fd >= 0) && pipe2(tap, O_CLOEXEC) != 0) {
+        tap[0] = tap[1] = -1;
+    }
+    if ((builtin_head && feed[0] < 0) || (!pty_mode && terminal_fd >= 0 && tap[1] < 0)) {
+        for (int fd : {feed[0], feed[1], master, slave}) {
+            if (fd >= 0) close(fd);
+        }
+        emitf("%s: cannot execute\n", cmd.c_str());
+        return;
+    }
+    // 会话模式下按键由shell读取，命令的标准输入为/dev/null
+    int stdin_fd = feed[0] >= 0 ? feed[0] : slave;
+    if (terminal_fd >= 0 && stdin_fd < 0) {
+        stdin_fd = open("/dev/null", O_RDONLY | O_CLOEXEC);
+    }
+    int out_fd = pty_mode ? slave : tap[1];
+    int err_fd = pty_mode ? slave : (terminal_fd >= 0 ? tap[1] : -1);
+
+    flush_output();  // 保证已缓冲的输出先于子进程输出
+    std::vector<pid_t> pids = spawn_pipeline(external, stdin_fd, out_fd, true, err_fd);
+    if (stdin_fd >= 0 && stdin_fd != slave) close(stdin_fd);
+    // 从端只留在子进程中，全部退出后主端读到EIO
+    if (slave >= 0) close(slave);
+    if (tap[1] >= 0) close(tap[1]);
+
+    if (pids.empty()) {
+        emitf("%s: cannot execute\n", cmd.c_str());
+        for (int fd : {feed[1], tap[0], master}) {
+            if (fd >= 0) close(fd);
+        }
+        return;
+    }
+
+    // shell位于数据通路上时由搬运线程完成，输入循环不被阻塞
+    std::thread pump;
+    std::shared_ptr<PumpControl> control;
+    if (feed[1] >= 0 || tap[0] >= 0 || master >= 0) {
+        // 会话断开后作业由作业表在后台回收，搬运线程可能比会话活得久，
+        // 用复制的描述符写出，会话的描述符关闭后编号被新连接复用也不会写错地方
+        int pump_out = terminal_fd;
+        if (terminal_fd >= 0) {
+            int copy = fcntl(terminal_fd, F_DUPFD_CLOEXEC, 0);
+            if (copy >= 0) pump_out = copy;
+        }
+        // 进程全部退出后由作业表通知停止，孙进程占着输出时不等EOF
+        control = std::make_shared<PumpControl>();
+        pump = std::thread([feed_fd = feed[1], tap_in = tap[0], master, tap_fd = output_tap_fd,
+                            out_fd = pump_out, own_out = pump_out != terminal_fd,
+                            fps = fast_scroll_fps, data = std::move(builtin_output), control]() {
+            int stop_fd = control->stop_fd();
+            // 输入和输出同时搬运，避免管道写满互相等待
+            std::thread feeder;
+            if (feed_fd >= 0) {
+                feeder = std::thread([feed_fd, &data]() {
+                    write_to_pipe(feed_fd, data.data(), data.size());
+                    close(feed_fd);
+                });
+            }
+            if (master >= 0) {
+                // 主端由作业表在本线程结束后关闭
+                if (fps > 0) {
+                    forward_terminal_frames(master, out_fd >= 0 ? out_fd : STDOUT_FILENO, tap_fd, fps,
+                                            nullptr, stop_fd);
+                } else {
+                    forward_terminal(master, out_fd >= 0 ? out_fd : STDOUT_FILENO, tap_fd, stop_fd);
+                }
+            } else if (tap_in >= 0 && out_fd >= 0) {
+                forward_output(tap_in, out_fd, tap_fd, stop_fd);
+                close(tap_in);
+            } else if (tap_in >= 0) {
+                tee_splice_all(tap_in, STDOUT_FILENO, tap_fd, stop_fd);
+                close(tap_in);
+            }
+            if (feeder.joinable()) feeder.join();
+            if (own_out) close(out_fd);
+            control->finish();
+        });
+    }
+
+    Job& job = jobs.add(pids, cmd, !pipeline.background, std::move(pump), master, control);
+    TRACE_INSTANT("spawn", (int32_t)job.pgid);
+    if (pipeline.background) {
+        emitf("[%d] %d\n", job.id, (int)job.pgid);
+    } else if (master < 0) {
+        give_terminal(job.pgid);
+    }
+}
+#endif
+
 void Shell::execute_command(const std::string& cmd) {
     // printf("Executing command: %s\n", cmd.c_str());
+    Pipeline pipeline;
+    if (parse_pipeline(cmd, pipeline)) {
+        std::string output;
+        if (pipeline.commands.size() == 1 && run_builtin(pipeline.commands[0], output)) {
+            emit(output.data(), output.size());
+            flush_output();
+            return;
+        }
+#ifdef __linux__
+        // 简单管道由shell直接用pipe2/posix_spawn异步执行
+        run_pipeline(pipeline, cmd);
+        return;
+#endif
+    }
+#ifdef __linux__
+    // 其他语法（重定向、;、&&、通配符等）交给sh -c，同样作为作业异步执行：输入循环不阻塞，
+    // 预输入、作业控制、伪终端模式和会话录制都照常生效
+    pipeline.commands.assign(1, Command());
+    pipeline.commands[0].argv = {"sh", "-c", cmd};
+    pipeline.background = false;
+    run_pipeline(pipeline, cmd);
+#else
+    // 没有作业控制的平台交给/bin/sh同步执行
     system(cmd.c_str());
+#endif
 }
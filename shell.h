@@ -2,14 +2,91 @@
 #define _SHELL_H_
 
 #include <string>
+#include <string_view>
 #include <vector>
+#include <memory_resource>
 #include <chrono>
+#include <functional>
 #include "fifo.h"
+#include "pipeline.h"
+#include "jobs.h"
+#include "pathcache.h"
+#include "completion.h"
+#include "history.h"
+#include "sharedhistory.h"
+#include "lineencoder.h"
+#include "utf8.h"
+#include "latency.h"
 
 class Shell {
 public:
-    Shell(struct fifo* fifo);
+    // terminal_fd为-1时输出到标准输出；否则为会话模式（见ShellServer）：
+    // terminal_fd是会话的连接（非阻塞的套接字或PTY主端），输出写入该描述符，
+    // 命令的标准输出和标准错误经管道转发过去，标准输入为/dev/null，fifo可以为nullptr
+    // 编辑状态和内存中的历史从resource分配，多会话服务中同一工作线程的会话共用一个内存池
+    Shell(struct fifo* fifo, int terminal_fd = -1,
+          std::pmr::memory_resource* resource = std::pmr::get_default_resource());
     void process_input();
+    // 输入循环的一次：检查作业，处理fifo中已有的输入，读到输入返回true。
+    // 无终端回放（见replay.h）用它代替process_input驱动shell
+    bool process_fifo();
+
+    // 处理一段输入，会话模式下由服务的工作线程直接调用，不经过fifo
+    void feed_input(const char* seq, size_t len) {
+        handle_input(seq, len);
+    }
+
+    // 写出缓存的输出，会话模式下写不完的部分留在缓存中，全部写出返回true
+    bool flush_output();
+    bool output_pending() const { return !out_buffer.empty(); }
+    // 前台作业正在运行，按键作为预输入缓存
+    bool foreground_busy() const;
+
+#ifdef __linux__
+    // 是否有未结束的作业
+    bool has_jobs() const { return jobs.size() > 0; }
+    // 是否有作业或搜索中尚未建完的历史索引，服务只对这些会话定时调用poll_jobs和continue_search
+    bool has_background_work() const {
+        return has_jobs() || (searching && !history_index.complete(history));
+    }
+
+    // 伪终端执行模式：每条命令运行在新建的伪终端上，标准输入、输出和错误都是它的从端
+    // （命令没有控制终端，中断类控制键仍由shell转换为信号）。shell把主端的输出转发到
+    // 自己的输出，前台作业运行期间的按键写入主端。标准输出模式下同时跟踪终端的窗口大小
+    void set_pty_mode(bool enabled);
+
+    // 改用外部的命令路径缓存和补全引擎，多会话服务中同一工作线程的会话共用一份，
+    // 不必每个会话各占inotify实例；两者须比shell活得久，且只由shell所在线程使用
+    void share_lookup_caches(PathCache* cache, Completer* completer);
+
+    // 窗口大小变化，同步到各作业的伪终端并向作业发送SIGWINCH，再通知监听者
+    void set_window_size(unsigned short rows, unsigned short cols);
+    // 窗口大小变化的监听者（如会话录制）。标准输出模式下同时开始跟踪自身终端的SIGWINCH
+    void set_window_listener(std::function<void(unsigned short, unsigned short)> listener);
+
+    // 伪终端模式下命令输出的合并重绘帧率，0为原样转发（见forward_terminal_frames）
+    void set_fast_scroll(unsigned fps) { fast_scroll_fps = fps; }
+#endif
+
+    // 检查作业状态变化，前台作业结束后恢复提示符并处理缓存的预输入
+    void poll_jobs();
+    // 增量搜索中没有输入时调用：补入一批历史索引，之前因索引未建完而未找到的匹配此时再找
+    void continue_search();
+
+    // 打开历史文件，之后的命令追加到文件中，失败时历史只保存在内存中
+    bool open_history(const std::string& path);
+
+#ifdef __linux__
+    // 接入跨会话共享的历史环，之后上下键可以立即看到其他会话输入的命令
+    bool attach_shared_history(const std::string& name);
+#endif
+
+    // 设置命令输出旁路：命令输出除送往终端外，同时复制一份写入fd（-1关闭）；
+    // with_echo时提示符和行编辑的输出也按顺序写入，旁路得到终端上的全部内容
+    void set_output_tap(int fd, bool with_echo = false);
+
+    // 终端支持的编辑序列，行编辑的输出按它选最短的写法，默认按xterm
+    void set_terminal_caps(const TerminalCaps& caps) { encoder.set_caps(caps); }
 
     // 测试用公共方法
     #ifdef TESTING
@@ -17,11 +94,22 @@ public:
         handle_input(seq, len);
     }
     std::string get_command_line() const {
-        return command_line;
+        return std::string(command_line);
     }
     size_t get_cursor_position() const {
         return cursor_pos;
     }
+    bool has_foreground_job() const {
+        return foreground_busy();
+    }
+    void test_wait_history_index() {
+        history_index.wait_build();
+    }
+    #ifdef __linux__
+    size_t get_job_count() const {
+        return jobs.size();
+    }
+    #endif
     #endif
 
 private:
@@ -30,47 +118,131 @@ private:
         NORMAL,         // 普通输入状态
         ESC_RECEIVED,   // 收到ESC
         CSI_RECEIVED,   // 收到 CSI (Control Sequence Introducer)
-        CSI_PARAMETER   // 参数处理状态
+        CSI_PARAMETER,  // 参数处理状态
+        CSI_DISCARD     // 序列超出escape_buffer，丢弃到最终字符为止
     };
 
-    // CSI序列解析结构
+    // CSI序列解析结构，参数存放在定长数组中，解析时不分配内存
     struct CSISequence {
-        std::vector<int> parameters;  // 参数列表
-        char final;                   // 最终字符
+        static const size_t MAX_PARAMETERS = 8;  // 超出的参数被忽略
+        int parameters[MAX_PARAMETERS];          // 参数列表
+        size_t count;                            // 参数个数
+        char final;                              // 最终字符
     };
 
     // 成员变量
-    std::string command_line;  // 当前命令行
-    size_t cursor_pos;         // 光标位置
-    std::vector<std::string> history;  // 命令历史
-    size_t history_pos;        // 历史命令位置
+    std::pmr::string command_line;  // 当前命令行
+    size_t cursor_pos;         // 光标位置（字节偏移，总在字形簇的边界上）
+    LineWidths widths;         // 命令行各位置的列号
+    HistoryStore history;      // 命令历史
+    size_t history_pos;        // 浏览中的历史记录位置，history.end()表示当前输入行
+    HistoryIndex history_index;  // 历史搜索索引，搜索时和搜索中空闲时逐批建立
+    HistoryPrefixIndex suggest_index;  // 自动提示用的前缀索引
+    std::pmr::string suggestion;  // 光标后以暗色显示的提示，非空时光标一定在行尾
+    bool searching;            // 处于Ctrl-R/Ctrl-S增量搜索中
+    bool search_reverse;       // 搜索方向，true为向更早的记录
+    bool search_failed;        // 当前查询没有（更多）匹配
+    bool search_pending;       // 索引尚未建完，未找到匹配，空闲时补入索引后重新查找
+    size_t search_limit;       // 待重新查找的起点
+    std::pmr::string search_query;  // 搜索串
+    std::pmr::string last_search;   // 上一次的搜索串，空查询时按Ctrl-R复用
+    size_t search_match;       // 当前匹配的记录位置，npos表示尚无匹配
+    std::pmr::string search_saved_line;  // 开始搜索前的命令行，Ctrl-G时恢复
     struct fifo* input_fifo;   // 输入FIFO
+    int output_tap_fd;         // 命令输出旁路，-1表示不复制
+    bool tap_echo;             // 旁路也复制shell自己的输出
+    int terminal_fd;           // 会话的终端连接，-1表示标准输出
+    std::pmr::string out_buffer;  // 尚未写出的输出
+    std::pmr::string typeahead;  // 前台作业运行期间缓存的预输入
+    unsigned completion_tabs;  // 连续按Tab的次数，其他按键清零
+    LineEncoder encoder;       // 行编辑的输出编码
+    StageTimer stage_timer;    // 延迟跟踪打开时，一次输入处理中解码、渲染、写出的计时
+#ifdef __linux__
+    JobTable jobs;             // 作业表
+    PathCache own_path_cache;  // 未共用时使用的命令路径缓存和补全引擎
+    Completer own_completer;
+    PathCache* path_cache;     // 命令路径缓存
+    Completer* completer;      // Tab补全引擎
+    SharedHistoryRing shared_history;  // 跨会话共享的最近历史
+    uint64_t ring_start;       // 接入共享环时的编号，之前的命令已在历史日志中
+    uint64_t ring_pos;         // 浏览中的环编号，NO_TICKET表示不在环中
+    size_t store_mark;         // 接入共享环时历史日志的末尾，浏览日志只到此为止
+    unsigned long mark_compactions;  // 记录store_mark时日志的整理次数
+    std::string ring_line;     // 从共享环读出的记录，复用以免浏览时分配
+    pid_t shell_pgid;          // shell自身的进程组
+    bool job_control;          // 标准输入是shell所在前台进程组的终端，可以移交终端
+    bool pty_mode;             // 命令运行在新建的伪终端上
+    unsigned short window_rows;  // 新建伪终端的窗口大小
+    unsigned short window_cols;
+    unsigned window_changes_seen;  // 已处理的SIGWINCH次数
+    bool tracking_window;      // 跟踪自身终端的大小变化（伪终端模式或有监听者）
+    std::function<void(unsigned short, unsigned short)> window_listener;
+    unsigned fast_scroll_fps;  // 合并重绘的帧率，0表示不合并
+#endif
     
     InputState input_state;    // 当前输入状态
     char escape_buffer[32];    // 存储转义序列
     size_t escape_pos;         // 转义序列当前位置
+    char utf8_pending[4];      // 输入末尾不完整的UTF-8字符
+    size_t utf8_pending_length;
     std::chrono::steady_clock::time_point last_input_time;  // 最后输入时间
 
     static const int ESCAPE_TIMEOUT_MS = 50;  // 转义序列超时时间（毫秒）
+    static const size_t COMPLETION_PAGE_SIZE = 100;  // 每次Tab列出的候选数量
+    static constexpr std::string_view PROMPT = "$ ";
+#ifdef __linux__
+    static inline const std::vector<std::string> BUILTINS = {"history", "jobs", "fg", "bg", "hash", "stats"};
+#endif
 
     // 私有成员函数
-    void move_cursor(int n);
+    void emit(const char* data, size_t len);
+    void emit(std::string_view text) { emit(text.data(), text.size()); }
+    void emit(char c) { out_buffer += c; }
+    void emitf(const char* format, ...) __attribute__((format(printf, 2, 3)));
+    bool write_output();
+    void tap_output(const char* data, size_t len);
+    void move_cursor(size_t from, size_t to);
     void clear_line();
+    EditLine edit_line() { return {PROMPT, command_line, widths.update(command_line)}; }
+    size_t column(size_t offset);
     void refresh_line();
     void append_char(char c);
-    void refresh_from_cursor();
+    void insert_text(std::string_view text);
+    void load_history(size_t pos);
     void handle_input(const char* seq, size_t len);
     void execute_command(const std::string& cmd);
+    bool run_builtin(const Command& cmd, std::string& output);
+    void print_prompt();
+    void buffer_typeahead(const char* seq, size_t len);
+#ifdef __linux__
+    void run_pipeline(const Pipeline& pipeline, const std::string& cmd);
+    void give_terminal(pid_t pgid);
+    void forward_to_terminal(Job& job, const char* data, size_t len);
+    bool shared_history_step(int direction);
+#endif
 
     // CSI序列处理
-    void parse_csi_sequence();
-    void handle_csi_sequence(const CSISequence& seq);
-    void handle_cursor_movement(char direction, int count);
-    void handle_delete_key();
-    void handle_history_navigation(int direction);
+    void parse_csi_sequence(size_t repeats);
+    void handle_csi_sequence(const CSISequence& seq, size_t repeats);
+    void handle_cursor_movement(char direction, size_t count);
+    void handle_delete_key(size_t count = 1);
+    void handle_tab();
+    void list_candidates(const CompletionResult& result, size_t offset, size_t strip);
+    void handle_history_navigation(int direction, size_t count = 1);
+    bool history_step(int direction);
+    void show_suggestion();
+    void hide_suggestion();
+    void accept_suggestion();
+    void start_search(bool reverse);
+    bool handle_search_key(char c);
+    void find_search_match(size_t limit, bool reverse);
+    void render_search();
     bool check_sequence_timeout();
     void handle_incomplete_sequence();
     void reset_sequence_state();
+#ifdef __linux__
+    void track_window_size();
+#endif
 };
 
 #endif
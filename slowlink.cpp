@@ -0,0 +1,244 @@
+#include "slowlink.h"
+
+#ifdef __linux__
+
+#include "pseudoterm.h"
+#include <algorithm>
+#include <cerrno>
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+
+static const int JOB_POLL_MS = 10;     // 有作业或输出未写完时的检查间隔
+static const int SETTLE_MS = 20;       // 判断空闲前从端须保持安静的时间
+
+SlowLinkSession::SlowLinkSession(const LinkProfile& profile, unsigned short rows, unsigned short cols,
+                                 PredictiveEcho* echo) :
+    profile(profile),
+    master(-1),
+    slave(-1),
+    shell(nullptr),
+    terminal(rows, cols),
+    echo(echo),
+    next_send(0),
+    written(0),
+    consumed(0),
+    read_pos(0),
+    current_key(NO_KEY) {
+    last_scheduled = Clock::now();
+    up.line_free = last_scheduled;
+    down.line_free = last_scheduled;
+    if (!open_pseudo_terminal(master, slave, true)) {
+        master = slave = -1;
+        return;
+    }
+    fcntl(slave, F_SETFL, fcntl(slave, F_GETFL) | O_NONBLOCK);
+    set_terminal_size(master, rows, cols);
+    shell = new Shell(nullptr, master);
+    wait_idle();    // 第一个提示符不计入任何按键
+}
+
+SlowLinkSession::~SlowLinkSession() {
+    delete shell;
+    if (master >= 0) close(master);
+    if (slave >= 0) close(slave);
+}
+
+void SlowLinkSession::send(const std::string& keys, unsigned delay_ms) {
+    Clock::time_point now = Clock::now();
+    if (last_scheduled < now) last_scheduled = now;
+    last_scheduled += std::chrono::milliseconds(delay_ms);
+    strokes.push_back({keys, last_scheduled, {}, {}, strokes.size(), 0, {}, false});
+}
+
+void SlowLinkSession::type(const std::string& text, unsigned interval_ms) {
+    for (size_t i = 0; i < text.size(); i++) {
+        send(text.substr(i, 1), i ? interval_ms : 0);
+    }
+}
+
+KeystrokeStats SlowLinkSession::press(const std::string& keys) {
+    send(keys);
+    wait_idle();
+    return keystroke(strokes.size() - 1);
+}
+
+void SlowLinkSession::transmit(Direction& direction, const char* data, size_t len, size_t key) {
+    Clock::time_point start = std::max(Clock::now(), direction.line_free);
+    if (profile.bytes_per_second > 0) {
+        direction.line_free = start + std::chrono::duration_cast<Clock::duration>(
+            std::chrono::duration<double>(len / profile.bytes_per_second));
+    } else {
+        direction.line_free = start;
+    }
+    Clock::time_point arrival = direction.line_free + std::chrono::milliseconds(profile.latency_ms);
+    direction.queue.push_back({arrival, std::string(data, len), key});
+}
+
+void SlowLinkSession::deliver_up(const Segment& segment) {
+    size_t done = 0;
+    while (done < segment.data.size()) {
+        ssize_t n = write(slave, segment.data.data() + done, segment.data.size() - done);
+        if (n > 0) {
+            done += n;
+        } else if (n < 0 && errno == EAGAIN) {
+            // 伪终端写满，先让shell读走
+            pump_shell();
+            struct pollfd pfd = {master, POLLIN, 0};
+            poll(&pfd, 1, JOB_POLL_MS);
+        } else if (n < 0 && errno != EINTR) {
+            break;
+        }
+    }
+    written += segment.data.size();
+    key_ends.push_back(written);
+}
+
+// 客户端显示：按键的预测或shell的输出经过预测回显，返回是否改变了画面
+bool SlowLinkSession::show(const std::string& data, bool from_shell) {
+    if (!echo) {
+        if (from_shell) terminal.feed(data);
+        return from_shell;
+    }
+    std::string out;
+    if (from_shell) {
+        echo->server_output(data.data(), data.size(), out);
+    } else {
+        echo->keystroke(data.data(), data.size(), out);
+    }
+    terminal.feed(out);
+    return !out.empty();
+}
+
+void SlowLinkSession::deliver_down(const Segment& segment) {
+    show(segment.data, true);
+    if (segment.key == NO_KEY) return;
+    Key& key = strokes[segment.key];
+    key.done = Clock::now();
+    key.bytes += segment.data.size();
+    key.output += segment.data;
+}
+
+void SlowLinkSession::pump_shell() {
+    char buffer[4096];
+    ssize_t n;
+    while ((n = read(master, buffer, sizeof(buffer))) > 0) {
+        // 这次读到的按键，回应都归于其中最后一个
+        size_t before = consumed;
+        consumed += n;
+        while (read_pos < key_ends.size() && key_ends[read_pos] <= before) read_pos++;
+        size_t last = read_pos;
+        while (last + 1 < key_ends.size() && key_ends[last] < consumed) last++;
+        for (size_t i = read_pos; i <= last && i < strokes.size(); i++) {
+            strokes[i].answer = last;
+        }
+        current_key = last;
+        shell->feed_input(buffer, n);
+    }
+    shell->poll_jobs();
+    shell->flush_output();
+    while ((n = read(slave, buffer, sizeof(buffer))) > 0) {
+        // 同终端的ONLCR，换行前补回车
+        std::string data;
+        for (ssize_t i = 0; i < n; i++) {
+            if (buffer[i] == '\n') data += '\r';
+            data += buffer[i];
+        }
+        transmit(down, data.data(), data.size(), current_key);
+    }
+}
+
+bool SlowLinkSession::idle() const {
+    return next_send == strokes.size() && up.queue.empty() && down.queue.empty() && consumed == written &&
+           !shell->output_pending() && !shell->has_jobs() && !(echo && echo->pending());
+}
+
+void SlowLinkSession::step(Clock::time_point deadline) {
+    // 等到下一个事件：按键发出、数据到达，或伪终端上有数据
+    Clock::time_point now = Clock::now();
+    Clock::time_point wake = deadline;
+    if (next_send < strokes.size()) wake = std::min(wake, strokes[next_send].scheduled);
+    if (!up.queue.empty()) wake = std::min(wake, up.queue.front().arrival);
+    if (!down.queue.empty()) wake = std::min(wake, down.queue.front().arrival);
+    if (shell->has_jobs() || shell->output_pending() || (echo && echo->pending())) {
+        wake = std::min(wake, now + std::chrono::milliseconds(JOB_POLL_MS));
+    }
+    auto wait = std::chrono::duration_cast<std::chrono::microseconds>(wake - now).count();
+    int timeout = wait > 0 ? (int)((wait + 999) / 1000) : 0;
+    struct pollfd fds[2] = {{master, POLLIN, 0}, {slave, POLLIN, 0}};
+    poll(fds, 2, timeout);
+
+    now = Clock::now();
+    while (next_send < strokes.size() && strokes[next_send].scheduled <= now) {
+        Key& key = strokes[next_send];
+        key.sent = now;
+        key.predicted = show(key.keys, false) && echo->showing();
+        transmit(up, key.keys.data(), key.keys.size(), next_send);
+        next_send++;
+    }
+    while (!up.queue.empty() && up.queue.front().arrival <= now) {
+        deliver_up(up.queue.front());
+        up.queue.pop_front();
+    }
+    pump_shell();
+    now = Clock::now();
+    while (!down.queue.empty() && down.queue.front().arrival <= now) {
+        deliver_down(down.queue.front());
+        down.queue.pop_front();
+    }
+    if (echo && echo->pending()) {
+        std::string out;
+        echo->tick(out);
+        terminal.feed(out);
+    }
+}
+
+bool SlowLinkSession::wait_idle(unsigned timeout_ms) {
+    if (!shell) return false;
+    Clock::time_point deadline = Clock::now() + std::chrono::milliseconds(timeout_ms);
+    while (true) {
+        if (idle()) {
+            // 输出可能还在伪终端中，确认从端安静一段时间
+            struct pollfd pfd = {slave, POLLIN, 0};
+            if (poll(&pfd, 1, SETTLE_MS) == 0) return true;
+        }
+        if (Clock::now() >= deadline) return false;
+        step(deadline);
+    }
+}
+
+double SlowLinkSession::echo_ms(size_t index) const {
+    const Key& answer = strokes[strokes[index].answer];
+    if (answer.bytes == 0) return 0;
+    return std::chrono::duration<double, std::milli>(answer.done - strokes[index].sent).count();
+}
+
+KeystrokeStats SlowLinkSession::keystroke(size_t index) const {
+    const Key& key = strokes[index];
+    return {key.keys, echo_ms(index), key.bytes, key.output.find("\r\033[K") != std::string::npos,
+            key.predicted, key.output};
+}
+
+LinkReport SlowLinkSession::report(size_t first, size_t last) const {
+    LinkReport report = {};
+    last = std::min(last, strokes.size());
+    size_t answered = 0;
+    double total_echo = 0;
+    for (size_t i = first; i < last; i++) {
+        KeystrokeStats stats = keystroke(i);
+        report.keystrokes++;
+        report.bytes_up += stats.keys.size();
+        report.bytes_down += stats.bytes;
+        if (stats.redraw) report.redraws++;
+        if (stats.predicted) report.predicted++;
+        if (strokes[strokes[i].answer].bytes > 0) {
+            answered++;
+            total_echo += stats.echo_ms;
+            report.max_echo_ms = std::max(report.max_echo_ms, stats.echo_ms);
+        }
+    }
+    if (answered) report.mean_echo_ms = total_echo / answered;
+    return report;
+}
+
+#endif
@@ -0,0 +1,138 @@
+#ifndef _SLOWLINK_H_
+#define _SLOWLINK_H_
+
+#ifdef __linux__
+
+#include <string>
+#include <vector>
+#include <deque>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include "shell.h"
+#include "screen.h"
+#include "predict.h"
+
+// 链路参数，两个方向相同
+struct LinkProfile {
+    double bytes_per_second;    // 带宽，0为不限
+    unsigned latency_ms;        // 单向传播延迟
+
+    // 8N1串口，每字节10位，无传播延迟
+    static LinkProfile serial(unsigned baud) { return {baud / 10.0, 0}; }
+};
+
+// 一次按键（转义序列或整段粘贴算一次）的测量结果
+struct KeystrokeStats {
+    std::string keys;
+    double echo_ms;         // 从客户端发出到收完shell对它的回应
+    size_t bytes;           // 回应的字节数
+    bool redraw;            // 回应整行重绘（回车后EL）
+    bool predicted;         // 发出时即由预测回显显示在客户端
+    std::string output;     // 回应的内容
+};
+
+// 一段按键的汇总
+struct LinkReport {
+    size_t keystrokes;
+    size_t bytes_up;        // 客户端发出的字节数
+    size_t bytes_down;      // 回应的字节数
+    unsigned redraws;
+    unsigned predicted;
+    double mean_echo_ms;
+    double max_echo_ms;
+
+    double bytes_per_keystroke() const { return keystrokes ? (double)bytes_down / keystrokes : 0; }
+};
+
+// 慢速链路上的交互会话
+// shell以会话模式运行在伪终端的主端上（同ShellServer的PTY会话），从端为原始模式，
+// 脚本化的客户端经一条按带宽逐字节串行、再加传播延迟的模拟链路与从端相连，
+// 链路上的输出同串口终端一样按ONLCR在换行前补回车，
+// 客户端一侧的屏幕模型即用户看到的画面。全部在调用线程中按真实时间推进。
+// 从端读到的输出归于shell最后读到的那次按键：shell一次读到几次按键时，回应归于最后一次，
+// 前面的按键回显时间按同一回应计算；命令运行期间的输出归于回车。
+// 给出echo时客户端经预测回显显示（见PredictiveEcho），echo由调用者持有。
+class SlowLinkSession {
+public:
+    SlowLinkSession(const LinkProfile& profile, unsigned short rows = 24, unsigned short cols = 80,
+                    PredictiveEcho* echo = nullptr);
+    ~SlowLinkSession();
+
+    bool ok() const { return shell != nullptr; }
+    Shell& target() { return *shell; }
+    const Screen& screen() const { return terminal; }
+
+    // 排入一次按键，在上一次排入的按键之后delay_ms发出
+    void send(const std::string& keys, unsigned delay_ms = 0);
+    // 按打字间隔逐字节排入
+    void type(const std::string& text, unsigned interval_ms);
+    // 推进直到排入的按键都已发出、回应都已到达客户端且shell空闲，超时返回false
+    bool wait_idle(unsigned timeout_ms = 10000);
+    // 发出一次按键并等待回应
+    KeystrokeStats press(const std::string& keys);
+
+    size_t keystroke_count() const { return strokes.size(); }
+    KeystrokeStats keystroke(size_t index) const;
+    // 汇总[first, last)的按键
+    LinkReport report(size_t first = 0, size_t last = SIZE_MAX) const;
+
+private:
+    typedef std::chrono::steady_clock Clock;
+
+    static const size_t NO_KEY = SIZE_MAX;
+
+    // 链路上传输中的一段数据
+    struct Segment {
+        Clock::time_point arrival;
+        std::string data;
+        size_t key;
+    };
+
+    // 一个方向的链路：数据按带宽排队串行发送，发完再经过传播延迟到达
+    struct Direction {
+        Clock::time_point line_free;
+        std::deque<Segment> queue;
+    };
+
+    struct Key {
+        std::string keys;
+        Clock::time_point scheduled;
+        Clock::time_point sent;
+        Clock::time_point done;     // 最后一个回应字节到达的时间
+        size_t answer;              // 回应归于哪次按键
+        size_t bytes;
+        std::string output;
+        bool predicted;
+    };
+
+    LinkProfile profile;
+    int master;
+    int slave;
+    Shell* shell;
+    Screen terminal;
+    PredictiveEcho* echo;
+    std::vector<Key> strokes;
+    size_t next_send;               // 下一个待发出的按键
+    Clock::time_point last_scheduled;
+    Direction up;                   // 客户端到shell
+    Direction down;                 // shell到客户端
+    std::vector<size_t> key_ends;   // 各按键写入从端后的累计字节数，按发出顺序
+    size_t written;                 // 写入从端的字节数
+    size_t consumed;                // shell从主端读到的字节数
+    size_t read_pos;                // shell正在读的按键
+    size_t current_key;             // shell最后读到的按键，回应归于它
+
+    void transmit(Direction& direction, const char* data, size_t len, size_t key);
+    bool idle() const;
+    void step(Clock::time_point deadline);
+    void deliver_up(const Segment& segment);
+    void deliver_down(const Segment& segment);
+    void pump_shell();
+    bool show(const std::string& data, bool from_shell);
+    double echo_ms(size_t index) const;
+};
+
+#endif
+
+#endif
@@ -4,11 +4,15 @@
 #include <cstring>
 #include "fifo.h"
 #include "term.h"
+#include "latency.h"
+#include "tracer.h"
+#include "inputrecord.h"
 #include <map>
 
 #define FIFO_SIZE 1024  // 确保是2的幂
 static uint8_t fifo_buffer[FIFO_SIZE];
 static struct fifo kbd_fifo;
+static InputRecorder* input_recorder = nullptr;
 
 // 默认按键映射定义
 static const std::vector<KeyDef> default_windows_mappings = {
@@ -83,30 +87,44 @@ void KeyMap::init_default_mappings() {
 // 捕捉键盘输入转化为VT100控制字符
 void term_capture_input(struct fifo* kbd_fifo) {
     KeyMap& key_map = KeyMap::instance();
+    TRACE_THREAD("term");
 
     while (true) {
         // 1. 获取键盘输入
         unsigned char c = _getch();
-        std::string vt100_seq;
+        uint64_t captured = LatencyTrace::enabled() ? LatencyTrace::now() : 0;  // 延迟跟踪：取得按键的时间
+        std::string_view vt100_seq;
 
         // 2. 判断输入类型
         if (c == 0xE0 || c == 0) {  // Windows扩展键
             // 2.1 Windows扩展键处理
             char key = _getch();  // 获取扩展键的实际键值
-            vt100_seq = key_map.get_vt100_sequence(key, KeyType::EXTENDED);
+            vt100_seq = key_map.find_sequence(key, KeyType::EXTENDED);
         } else {
             // 2.2 普通键处理
             KeyType type = (c < 32) ? KeyType::CONTROL : KeyType::NORMAL;
-            vt100_seq = key_map.get_vt100_sequence(c, type);
+            vt100_seq = key_map.find_sequence(c, type);
         }
 
         // 3. 写入FIFO
         if (!vt100_seq.empty()) {
-            fifo_write(kbd_fifo, (uint8_t*)vt100_seq.c_str(), vt100_seq.length());
+            uint32_t len = (uint32_t)vt100_seq.length();
+            if (captured != 0) {
+                // 时间戳先于按键入队，读出端取到按键时一定能取回它的时间戳
+                uint32_t end = kbd_fifo->in + fifo_min(len, fifo_write_available(kbd_fifo));
+                LatencyTrace::instance().enqueued(end, captured, LatencyTrace::now());
+            }
+            fifo_write(kbd_fifo, (const uint8_t*)vt100_seq.data(), len);
+            TRACE_INSTANT("fifo_write", (int32_t)len);
+            if (input_recorder) input_recorder->record(vt100_seq.data(), vt100_seq.length());
         }
     }
 }
 
+void term_record_input(InputRecorder* recorder) {
+    input_recorder = recorder;
+}
+
 // KeyMap实现
 KeyMap& KeyMap::instance() {
     static KeyMap instance;
@@ -118,6 +136,18 @@ KeyMap::KeyMap() {
 }
 
 std::string KeyMap::get_vt100_sequence(int platform_code, KeyType type) {
+    return std::string(find_sequence(platform_code, type));
+}
+
+// 单字节字符的序列就是它本身，指向这张表
+static const struct ByteTable {
+    char bytes[256];
+    ByteTable() {
+        for (int i = 0; i < 256; i++) bytes[i] = (char)i;
+    }
+} byte_table;
+
+std::string_view KeyMap::find_sequence(int platform_code, KeyType type) const {
     for (const auto& mapping : key_mappings) {
         if (mapping.platform_code == platform_code && mapping.type == type) {
             return mapping.vt100_seq;
@@ -125,9 +155,9 @@ std::string KeyMap::get_vt100_sequence(int platform_code, KeyType type) {
     }
     // 如果是普通可打印字符，直接返回对应的字符
     if (type == KeyType::NORMAL && platform_code >= 32) {
-        return std::string(1, (char)platform_code);
+        return std::string_view(&byte_table.bytes[(unsigned char)platform_code], 1);
     }
-    return "";
+    return std::string_view();
 }
 
 void KeyMap::add_mapping(const KeyDef& key_def) {
@@ -2,6 +2,7 @@
 #define _TERM_H_
 
 #include <string>
+#include <string_view>
 #include <vector>
 #include "fifo.h"
 
@@ -30,6 +31,8 @@ public:
     
     // 根据平台键码获取对应的VT100序列
     std::string get_vt100_sequence(int platform_code, KeyType type = KeyType::NORMAL);
+    // 同上，返回映射表（或静态表）中的序列，不分配内存，输入线程每个按键调用
+    std::string_view find_sequence(int platform_code, KeyType type = KeyType::NORMAL) const;
     
     // 添加或更新按键映射
     void add_mapping(const KeyDef& key_def);
@@ -40,6 +43,10 @@ private:
     void init_default_mappings();
 };
 
+class InputRecorder;
+
 void term_capture_input(struct fifo* kbd_fifo);
+// 录制之后写入fifo的输入（见inputrecord.h），nullptr停止录制；在输入线程启动前设置
+void term_record_input(InputRecorder* recorder);
 
 #endif
@@ -0,0 +1,208 @@
+#include <gtest/gtest.h>
+#include "completion.h"
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <chrono>
+
+TEST(PrefixTrieTest, CompleteTest) {
+    PrefixTrie trie;
+    trie.insert("git");
+    trie.insert("gitk");
+    trie.insert("gcc");
+    trie.insert("grep");
+    trie.insert("ls");
+
+    CompletionResult result = trie.complete("g", 0, 10);
+    EXPECT_EQ(result.total, 4);
+    EXPECT_EQ(result.common, "g");
+    ASSERT_EQ(result.candidates.size(), 4);
+    EXPECT_EQ(result.candidates[0], "gcc");
+    EXPECT_EQ(result.candidates[3], "grep");
+
+    result = trie.complete("gi", 0, 10);
+    EXPECT_EQ(result.total, 2);
+    EXPECT_EQ(result.common, "git");
+
+    result = trie.complete("x", 0, 10);
+    EXPECT_EQ(result.total, 0);
+    EXPECT_TRUE(result.candidates.empty());
+}
+
+TEST(PrefixTrieTest, PagingTest) {
+    PrefixTrie trie;
+    char name[16];
+    for (int i = 0; i < 1000; i++) {
+        snprintf(name, sizeof(name), "cmd%04d", i);
+        trie.insert(name);
+    }
+
+    CompletionResult result = trie.complete("cmd", 990, 20);
+    EXPECT_EQ(result.total, 1000);
+    ASSERT_EQ(result.candidates.size(), 10);
+    EXPECT_EQ(result.candidates[0], "cmd0990");
+    EXPECT_EQ(result.candidates[9], "cmd0999");
+
+    // limit为0时只计算数量和公共前缀
+    result = trie.complete("cmd05", 0, 0);
+    EXPECT_EQ(result.total, 100);
+    EXPECT_EQ(result.common, "cmd05");
+    EXPECT_TRUE(result.candidates.empty());
+}
+
+TEST(PrefixTrieTest, RefcountTest) {
+    PrefixTrie trie;
+    // 同名命令出现在两个PATH目录中
+    trie.insert("make");
+    trie.insert("make");
+    EXPECT_EQ(trie.size(), 1);
+
+    trie.remove("make");
+    EXPECT_TRUE(trie.contains("make"));
+    trie.remove("make");
+    EXPECT_FALSE(trie.contains("make"));
+    EXPECT_EQ(trie.size(), 0);
+    EXPECT_EQ(trie.complete("m", 0, 10).total, 0);
+}
+
+#ifdef __linux__
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/resource.h>
+
+class CompleterTest : public ::testing::Test {
+protected:
+    std::string old_path;
+    std::string dir;
+
+    void SetUp() override {
+        const char* path = getenv("PATH");
+        old_path = path ? path : "";
+        char tmpl[] = "/tmp/test_completionXXXXXX";
+        dir = mkdtemp(tmpl);
+    }
+
+    void TearDown() override {
+        setenv("PATH", old_path.c_str(), 1);
+        system(("rm -rf " + dir).c_str());
+    }
+
+    void make_file(const std::string& name, mode_t mode = 0644) {
+        int fd = open((dir + "/" + name).c_str(), O_WRONLY | O_CREAT | O_TRUNC, mode);
+        close(fd);
+    }
+};
+
+TEST_F(CompleterTest, FileCompletionTest) {
+    make_file("alpha.txt");
+    make_file("alpine.txt");
+    make_file(".hidden");
+    mkdir((dir + "/beta").c_str(), 0755);
+    Completer completer;
+
+    CompletionResult result = completer.complete_file(dir + "/al", 0, 10);
+    EXPECT_EQ(result.total, 2);
+    EXPECT_EQ(result.common, dir + "/alp");
+
+    // 唯一匹配的目录以'/'结尾
+    result = completer.complete_file(dir + "/b", 0, 10);
+    EXPECT_EQ(result.total, 1);
+    EXPECT_EQ(result.common, dir + "/beta/");
+
+    // 隐藏文件只在以'.'开头时补全
+    result = completer.complete_file(dir + "/", 0, 10);
+    EXPECT_EQ(result.total, 3);
+    result = completer.complete_file(dir + "/.", 0, 10);
+    EXPECT_EQ(result.total, 1);
+    EXPECT_EQ(result.common, dir + "/.hidden");
+}
+
+TEST_F(CompleterTest, IncrementalUpdateTest) {
+    make_file("one");
+    Completer completer;
+
+    EXPECT_EQ(completer.complete_file(dir + "/", 0, 10).total, 1);
+    unsigned long loads = completer.load_count();
+
+    // 目录变化由inotify事件增量更新，不重新读取目录
+    make_file("two");
+    EXPECT_EQ(completer.complete_file(dir + "/", 0, 10).total, 2);
+    unlink((dir + "/one").c_str());
+    CompletionResult result = completer.complete_file(dir + "/", 0, 10);
+    ASSERT_EQ(result.total, 1);
+    EXPECT_EQ(result.candidates[0], dir + "/two");
+    EXPECT_EQ(completer.load_count(), loads);
+}
+
+TEST_F(CompleterTest, NoInotifyTest) {
+    make_file("one");
+    make_file("zzcmd_first", 0755);
+    setenv("PATH", dir.c_str(), 1);
+    Completer completer;
+
+    // 只留一个描述符给opendir，建立不了inotify实例
+    struct rlimit saved;
+    getrlimit(RLIMIT_NOFILE, &saved);
+    struct rlimit low = saved;
+    low.rlim_cur = 64;
+    setrlimit(RLIMIT_NOFILE, &low);
+    std::vector<int> fds;
+    for (int fd; (fd = open("/dev/null", O_RDONLY)) >= 0;) fds.push_back(fd);
+    close(fds.back());
+    fds.pop_back();
+
+    // 没有监视的目录每次重新读取，变化仍然可见
+    EXPECT_EQ(completer.complete_file(dir + "/", 0, 10).total, 2);
+    EXPECT_EQ(completer.complete_command("zzcmd", 0, 10).total, 1);
+    make_file("two");
+    make_file("zzcmd_second", 0755);
+    EXPECT_EQ(completer.complete_file(dir + "/", 0, 10).total, 4);
+    EXPECT_EQ(completer.complete_command("zzcmd", 0, 10).total, 2);
+
+    for (int fd : fds) close(fd);
+    setrlimit(RLIMIT_NOFILE, &saved);
+}
+
+TEST_F(CompleterTest, CommandCompletionTest) {
+    make_file("zzcmd_first", 0755);
+    setenv("PATH", dir.c_str(), 1);
+    Completer completer;
+    completer.set_builtins({"history"});
+
+    EXPECT_EQ(completer.complete_command("zzcmd", 0, 10).common, "zzcmd_first");
+    EXPECT_EQ(completer.complete_command("hist", 0, 10).common, "history");
+
+    // PATH目录中新增和删除的命令立即反映到前缀树
+    make_file("zzcmd_second", 0755);
+    EXPECT_EQ(completer.complete_command("zzcmd", 0, 10).total, 2);
+    unlink((dir + "/zzcmd_first").c_str());
+    CompletionResult result = completer.complete_command("zzcmd", 0, 10);
+    EXPECT_EQ(result.total, 1);
+    EXPECT_EQ(result.common, "zzcmd_second");
+}
+
+TEST_F(CompleterTest, LargeDirectoryTest) {
+    char name[32];
+    for (int i = 0; i < 50000; i++) {
+        snprintf(name, sizeof(name), "file%06d", i);
+        make_file(name);
+    }
+    Completer completer;
+    completer.complete_file(dir + "/", 0, 0);
+    unsigned long loads = completer.load_count();
+
+    // 目录已缓存后，每次Tab只做二分查找和一页候选的处理
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < 100; i++) {
+        CompletionResult result = completer.complete_file(dir + "/file04", 5000, 100);
+        ASSERT_EQ(result.total, 10000);
+        ASSERT_EQ(result.candidates.size(), 100);
+        EXPECT_EQ(result.candidates[0], dir + "/file045000");
+    }
+    auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::steady_clock::now() - start).count();
+    EXPECT_LT(elapsed, 1000);
+    EXPECT_EQ(completer.load_count(), loads);
+}
+#endif
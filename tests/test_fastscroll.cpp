@@ -0,0 +1,243 @@
+#include <gtest/gtest.h>
+#include "fastscroll.h"
+#include "screen.h"
+#include <string>
+
+// 终端（用另一个Screen模拟）收到差异后应与模型完全一致
+static void expect_same(const Screen& terminal, const Screen& model) {
+    ASSERT_EQ(terminal.rows(), model.rows());
+    ASSERT_EQ(terminal.cols(), model.cols());
+    for (unsigned row = 0; row < model.rows(); row++) {
+        for (unsigned col = 0; col < model.cols(); col++) {
+            ASSERT_TRUE(terminal.cell(row, col) == model.cell(row, col))
+                << "row " << row << " col " << col << "\n" << terminal.text() << "---\n" << model.text();
+        }
+    }
+    EXPECT_EQ(terminal.cursor_row(), model.cursor_row());
+    EXPECT_EQ(terminal.cursor_col(), model.cursor_col());
+    EXPECT_EQ(terminal.cursor_visible(), model.cursor_visible());
+}
+
+TEST(FrameRendererTest, DiffTest) {
+    FrameRenderer renderer(5, 20);
+    Screen terminal(5, 20);
+    terminal.feed("stale content");
+    renderer.feed("hello\r\nworld");
+
+    // 第一帧清屏整屏绘制
+    std::string out;
+    renderer.render(out);
+    terminal.feed(out);
+    expect_same(terminal, renderer.screen());
+    EXPECT_FALSE(renderer.changed());
+
+    // 没有变化时不发送任何内容
+    out.clear();
+    renderer.render(out);
+    EXPECT_EQ(out, "");
+
+    // 只改一个字符，只发送定位和该字符，光标正好停在模型的位置上
+    renderer.feed("\033[1;2Ha");
+    out.clear();
+    renderer.render(out);
+    EXPECT_EQ(out, "\033[1;2Ha");
+    terminal.feed(out);
+    expect_same(terminal, renderer.screen());
+
+    // 行尾变为空白用EL清除
+    renderer.feed("\033[2;3H\033[K");
+    out.clear();
+    renderer.render(out);
+    EXPECT_NE(out.find("\033[K"), std::string::npos);
+    terminal.feed(out);
+    expect_same(terminal, renderer.screen());
+}
+
+TEST(FrameRendererTest, AttributeTest) {
+    FrameRenderer renderer(4, 30);
+    Screen terminal(4, 30);
+    renderer.feed("\033[1;31mred\033[0m plain \033[4;38;5;200;48;5;17mrich\033[7;92;103mx\033[m");
+    renderer.feed("\033[?25l\033(0lqk\033(B");
+    std::string out;
+    renderer.render(out);
+    terminal.feed(out);
+    expect_same(terminal, renderer.screen());
+    EXPECT_FALSE(terminal.cursor_visible());
+
+    renderer.feed("\033[?25h\033[3;5H\033[44m  \033[m");
+    out.clear();
+    renderer.render(out);
+    terminal.feed(out);
+    expect_same(terminal, renderer.screen());
+}
+
+// 整屏滚动在终端上也用换行滚动，只补画新出现的行
+TEST(FrameRendererTest, ScrollTest) {
+    FrameRenderer renderer(24, 80);
+    Screen terminal(24, 80);
+    for (int i = 0; i < 24; i++) renderer.feed("line " + std::to_string(i) + " of the output\r\n");
+    std::string out;
+    renderer.render(out);
+    terminal.feed(out);
+    size_t full = out.size();
+
+    renderer.feed("line 24 of the output\r\nline 25 of the output\r\n");
+    out.clear();
+    renderer.render(out);
+    terminal.feed(out);
+    expect_same(terminal, renderer.screen());
+    EXPECT_NE(out.find("\n\n"), std::string::npos);
+    EXPECT_LT(out.size() * 10, full);
+}
+
+// 各种输出分块送入、每块后绘制，终端始终与模型一致
+TEST(FrameRendererTest, RandomizedTest) {
+    static const char* pieces[] = {
+        "text ", "\r\n", "\033[1;32m", "\033[m", "\033[5;10H", "\033[K", "\033[2J", "\033[3;20r",
+        "\033[r", "\033[L", "\033[2M", "\033[4@", "\033[3P", "\033[5X", "\033M", "\033D", "中文",
+        "\033[?1049h", "\033[?1049l", "\033[7m", "\t", "\b\b", "\033[99C", "\033[S", "\033[2T",
+        "\033[1K", "\033[0J", "\033[?25l", "\033[?25h", "ab\033[4hcd\033[4l", "\033[48;5;33m",
+    };
+    FrameRenderer renderer(10, 30);
+    Screen terminal(10, 30);
+    unsigned seed = 12345;
+    for (int frame = 0; frame < 300; frame++) {
+        for (int i = 0; i < 20; i++) {
+            seed = seed * 1103515245 + 12345;
+            renderer.feed(pieces[(seed >> 16) % (sizeof(pieces) / sizeof(pieces[0]))]);
+        }
+        std::string out;
+        renderer.render(out);
+        terminal.feed(out);
+        expect_same(terminal, renderer.screen());
+        if (HasFatalFailure()) return;
+    }
+}
+
+TEST(FrameRendererTest, ResizeTest) {
+    FrameRenderer renderer(5, 20);
+    Screen terminal(8, 40);
+    renderer.feed("before");
+    renderer.resize(8, 40);
+    renderer.feed("\r\nafter");
+    std::string out;
+    renderer.render(out);
+    EXPECT_EQ(out[0], '\030');
+    terminal.feed(out);
+    expect_same(terminal, renderer.screen());
+}
+
+#ifdef __linux__
+#include "pseudoterm.h"
+#include <chrono>
+#include <thread>
+#include <future>
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/socket.h>
+
+class FastScrollForwardTest : public ::testing::Test {
+protected:
+    int master, slave;
+    int fds[2];
+
+    void SetUp() override {
+        ASSERT_TRUE(open_pseudo_terminal(master, slave, false));
+        set_terminal_size(master, 24, 80);
+        ASSERT_EQ(socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, fds), 0);
+        fcntl(fds[1], F_SETFL, O_NONBLOCK);
+    }
+
+    void TearDown() override {
+        close(master);
+        close(fds[0]);
+        if (fds[1] >= 0) close(fds[1]);
+    }
+
+    // 转发线程结束后关闭终端连接，读到结束为止
+    std::string receive_all(FastScrollStats& stats) {
+        std::thread forwarder([this, &stats]() {
+            forward_terminal_frames(master, fds[1], -1, 30, &stats);
+            close(fds[1]);
+        });
+        std::string received;
+        char buffer[65536];
+        ssize_t n;
+        while ((n = read(fds[0], buffer, sizeof(buffer))) > 0) received.append(buffer, n);
+        forwarder.join();
+        fds[1] = -1;
+        return received;
+    }
+};
+
+// 少量输出原样转发
+TEST_F(FastScrollForwardTest, PassThroughTest) {
+    ASSERT_EQ(write(slave, "hello\n", 6), 6);
+    close(slave);
+    FastScrollStats stats;
+    std::string received = receive_all(stats);
+    EXPECT_EQ(received, "hello\r\n");
+    EXPECT_FALSE(stats.coalesced);
+    EXPECT_EQ(stats.bytes_in, 7);
+    EXPECT_EQ(stats.bytes_out, 7);
+}
+
+// 输出洪水合并为少量的帧，终端上的最终画面与原样转发相同
+TEST_F(FastScrollForwardTest, FloodTest) {
+    std::string flood;
+    for (int i = 0; i < 100000; i++) flood += "output line " + std::to_string(i) + "\n";
+    std::thread writer([this, &flood]() {
+        size_t done = 0;
+        while (done < flood.size()) {
+            ssize_t n = write(slave, flood.data() + done, flood.size() - done);
+            if (n <= 0) break;
+            done += n;
+        }
+        close(slave);
+    });
+    FastScrollStats stats;
+    std::string received = receive_all(stats);
+    writer.join();
+
+    EXPECT_TRUE(stats.coalesced);
+    EXPECT_GT(stats.bytes_in, (long long)flood.size());
+    EXPECT_EQ(stats.bytes_out, (long long)received.size());
+    EXPECT_LT(stats.bytes_out * 10, stats.bytes_in);
+
+    Screen terminal(24, 80);
+    terminal.feed(received);
+    EXPECT_EQ(terminal.row_text(22), "output line 99999");
+    EXPECT_EQ(terminal.row_text(0), "output line 99977");
+    EXPECT_EQ(terminal.cursor_row(), 23u);
+}
+
+// 终端没有读走积压的帧时，主端关闭后照样画出最后一帧并结束
+TEST_F(FastScrollForwardTest, UnreadLinkTest) {
+    std::string flood;
+    for (int i = 0; i < 20000; i++) flood += "output line " + std::to_string(i) + "\n";
+    auto forwarder = std::async(std::launch::async, [this]() {
+        return forward_terminal_frames(master, fds[1], -1, 30);
+    });
+    size_t done = 0;
+    while (done < flood.size()) {
+        ssize_t n = write(slave, flood.data() + done, flood.size() - done);
+        if (n <= 0) break;
+        done += n;
+    }
+    close(slave);
+    bool finished = forwarder.wait_for(std::chrono::seconds(2)) == std::future_status::ready;
+    close(fds[1]);
+    fds[1] = -1;
+    EXPECT_TRUE(finished);
+
+    std::string received;
+    char buffer[65536];
+    ssize_t n;
+    while ((n = read(fds[0], buffer, sizeof(buffer))) > 0) received.append(buffer, n);
+    forwarder.wait();
+    Screen terminal(24, 80);
+    terminal.feed(received);
+    EXPECT_EQ(terminal.row_text(22), "output line 19999");
+}
+#endif
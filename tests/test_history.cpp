@@ -0,0 +1,476 @@
+#include <gtest/gtest.h>
+#include "history.h"
+#include <cstdio>
+#include <string>
+#include <vector>
+
+// 从前向后收集全部记录
+static std::vector<std::string> entries(const HistoryStore& store) {
+    std::vector<std::string> out;
+    for (size_t pos = store.begin(); pos != store.end(); pos = store.next(pos)) {
+        out.push_back(store.at(pos));
+    }
+    return out;
+}
+
+TEST(HistoryStoreTest, NavigationTest) {
+    HistoryStore store;
+    EXPECT_TRUE(store.empty());
+    EXPECT_EQ(store.prev(store.end()), HistoryStore::npos);
+
+    store.append("first");
+    store.append("");
+    store.append("third command");
+    EXPECT_EQ(store.size(), 3);
+
+    size_t pos = store.prev(store.end());
+    EXPECT_EQ(store.at(pos), "third command");
+    pos = store.prev(pos);
+    EXPECT_EQ(store.at(pos), "");
+    pos = store.prev(pos);
+    EXPECT_EQ(store.at(pos), "first");
+    EXPECT_EQ(store.prev(pos), HistoryStore::npos);
+    EXPECT_EQ(store.next(store.next(store.next(pos))), store.end());
+}
+
+TEST(HistoryStoreTest, DedupTest) {
+    HistoryStore consecutive;
+    EXPECT_TRUE(consecutive.append("ls"));
+    EXPECT_FALSE(consecutive.append("ls"));
+    EXPECT_TRUE(consecutive.append("pwd"));
+    EXPECT_TRUE(consecutive.append("ls"));
+    EXPECT_EQ(consecutive.size(), 3);
+
+    HistoryOptions options;
+    options.dedup = HistoryOptions::KEEP_ALL;
+    HistoryStore keep(options);
+    keep.append("ls");
+    keep.append("ls");
+    EXPECT_EQ(keep.size(), 2);
+
+    // 整理时只保留每条命令最近的一次
+    options.dedup = HistoryOptions::ERASE_ALL;
+    HistoryStore erase(options);
+    for (int i = 0; i < 300; i++) {
+        erase.append(i % 2 ? "make" : "git status");
+    }
+    erase.wait_compaction();
+    EXPECT_GE(erase.compaction_count(), 1);
+    std::vector<std::string> expected = {"git status", "make"};
+    std::vector<std::string> actual = entries(erase);
+    ASSERT_GE(actual.size(), 2);
+    EXPECT_EQ(std::vector<std::string>(actual.begin(), actual.begin() + 2), expected);
+}
+
+TEST(HistoryStoreTest, MemoryCapTest) {
+    HistoryOptions options;
+    options.max_entries = 100;
+    HistoryStore store(options);
+    for (int i = 0; i < 1000; i++) {
+        store.append("cmd " + std::to_string(i));
+    }
+    EXPECT_LE(store.size(), 125);
+    EXPECT_GE(store.size(), 100);
+    EXPECT_EQ(store.at(store.prev(store.end())), "cmd 999");
+}
+
+TEST(HistoryIndexTest, SearchTest) {
+    HistoryStore store;
+    store.append("git status");
+    store.append("make -j8");
+    store.append("git commit -m fix");
+    store.append("ls -la");
+    HistoryIndex index;
+    index.sync(store);
+    EXPECT_EQ(index.size(), 0);     // 已有的记录查询时才补入
+
+    // 向更早的记录查找
+    size_t pos = index.search_backward(store, "git", store.end());
+    EXPECT_EQ(store.at(pos), "git commit -m fix");
+    pos = index.search_backward(store, "git", pos);
+    EXPECT_EQ(store.at(pos), "git status");
+    EXPECT_EQ(index.search_backward(store, "git", pos), HistoryStore::npos);
+
+    // 向更新的记录查找
+    pos = index.search_forward(store, "git", store.begin());
+    EXPECT_EQ(store.at(pos), "git status");
+    pos = index.search_forward(store, "git", store.next(pos));
+    EXPECT_EQ(store.at(pos), "git commit -m fix");
+
+    // 一到两个字符的查询，包括行尾字符
+    EXPECT_EQ(store.at(index.search_backward(store, "8", store.end())), "make -j8");
+    EXPECT_EQ(store.at(index.search_backward(store, "-j", store.end())), "make -j8");
+    EXPECT_EQ(store.at(index.search_backward(store, "x", store.end())), "git commit -m fix");
+
+    // 三元组都出现但不相邻
+    EXPECT_EQ(index.search_backward(store, "git fix", store.end()), HistoryStore::npos);
+    EXPECT_EQ(index.search_backward(store, "nope", store.end()), HistoryStore::npos);
+}
+
+TEST(HistoryIndexTest, IncrementalTest) {
+    HistoryOptions options;
+    options.max_entries = 100;
+    HistoryStore store(options);
+    HistoryIndex index;
+    store.append("first entry");
+    index.sync(store);
+    store.append("second entry");
+    index.sync(store);
+    EXPECT_EQ(index.size(), 1);
+    EXPECT_EQ(store.at(index.search_backward(store, "second", store.end())), "second entry");
+    EXPECT_EQ(store.at(index.search_backward(store, "first", store.end())), "first entry");
+    EXPECT_TRUE(index.complete(store));
+
+    // 整理后重建
+    for (int i = 0; i < 200; i++) {
+        store.append("cmd " + std::to_string(i));
+    }
+    index.sync(store);
+    EXPECT_EQ(index.search_backward(store, "second", store.end()), HistoryStore::npos);
+    EXPECT_EQ(index.size(), store.size());
+    EXPECT_EQ(store.at(index.search_backward(store, "cmd 19", store.end())), "cmd 199");
+}
+
+// 测试每次查询补入的记录数有上限，较早的匹配经过多次查询或空闲时的补入后找到
+TEST(HistoryIndexTest, BudgetTest) {
+    HistoryOptions options;
+    options.max_entries = 0;
+    HistoryStore store(options);
+    store.append("very old entry");
+    for (int i = 0; i < 100000; i++) {
+        store.append("cmd " + std::to_string(i));
+    }
+    HistoryIndex index;
+    index.sync(store);
+    store.append("new entry");
+    index.sync(store);
+
+    // 最近的匹配立即找到，只补入了一批
+    EXPECT_EQ(store.at(index.search_backward(store, "cmd", store.end())), "cmd 99999");
+    EXPECT_EQ(store.at(index.search_backward(store, "entry", store.end())), "new entry");
+    size_t pos = index.search_backward(store, "entry", index.search_backward(store, "new", store.end()));
+    EXPECT_EQ(pos, HistoryStore::npos);
+    EXPECT_FALSE(index.complete(store));
+    EXPECT_LT(index.size(), 20000u);
+
+    // 向前查找的起点尚未索引时也只补入一批
+    EXPECT_EQ(index.search_forward(store, "old", store.begin()), HistoryStore::npos);
+
+    int calls = 1;
+    while (pos == HistoryStore::npos && calls < 1000) {
+        pos = index.search_backward(store, "old", store.end());
+        calls++;
+    }
+    ASSERT_NE(pos, HistoryStore::npos);
+    EXPECT_EQ(store.at(pos), "very old entry");
+    EXPECT_GT(calls, 10);
+    EXPECT_TRUE(index.complete(store));
+    EXPECT_EQ(index.size(), store.size());
+
+    // 全部索引后两段的匹配都能找到
+    EXPECT_EQ(store.at(index.search_forward(store, "entry", store.begin())), "very old entry");
+    EXPECT_EQ(store.at(index.search_forward(store, "entry", store.next(store.begin()))), "new entry");
+    EXPECT_EQ(store.at(index.search_backward(store, "cmd 5", store.end())), "cmd 59999");
+    EXPECT_EQ(index.search_backward(store, "entry", store.begin()), HistoryStore::npos);
+
+    // 空闲时补入
+    HistoryIndex idle;
+    idle.sync(store);
+    for (int i = 0; i < 1000 && !idle.complete(store); i++) {
+        idle.extend(store);
+    }
+    EXPECT_TRUE(idle.complete(store));
+    EXPECT_EQ(store.at(idle.search_forward(store, "old", store.begin())), "very old entry");
+}
+
+// 后台建立的索引换入后，只有最早的记录匹配的查询不经补入就能找到
+TEST(HistoryIndexTest, BackgroundBuildTest) {
+    HistoryOptions options;
+    options.max_entries = 0;
+    HistoryStore store(options);
+    store.append("very old entry");
+    for (int i = 0; i < 100000; i++) {
+        store.append("cmd " + std::to_string(i));
+    }
+    HistoryIndex index;
+    index.build(store);
+    store.append("new entry");
+    index.sync(store);
+    index.wait_build();
+    EXPECT_TRUE(index.complete(store));
+    EXPECT_EQ(index.size(), store.size());
+    EXPECT_EQ(store.at(index.search_backward(store, "old", store.end())), "very old entry");
+    EXPECT_EQ(store.at(index.search_backward(store, "entry", store.end())), "new entry");
+    EXPECT_EQ(store.at(index.search_forward(store, "entry", store.begin())), "very old entry");
+    EXPECT_EQ(store.at(index.search_backward(store, "cmd 5", store.end())), "cmd 59999");
+
+    // 建立中清空或重新建立时停止之前的线程
+    index.build(store);
+    index.clear();
+    index.build(store);
+    index.build(store);
+    index.wait_build();
+    EXPECT_TRUE(index.complete(store));
+    EXPECT_EQ(store.at(index.search_backward(store, "old", store.end())), "very old entry");
+}
+
+TEST(HistoryPrefixIndexTest, LookupTest) {
+    HistoryStore store;
+    HistoryPrefixIndex index;
+    index.sync(store);
+    store.append("git status");
+    store.append("git stash pop");
+    store.append("grep -rn foo");
+    store.append("git");
+    index.sync(store);
+
+    EXPECT_EQ(store.at(index.lookup(store, "g")), "git");
+    EXPECT_EQ(store.at(index.lookup(store, "gr")), "grep -rn foo");
+    EXPECT_EQ(store.at(index.lookup(store, "git st")), "git stash pop");
+    EXPECT_EQ(store.at(index.lookup(store, "git stat")), "git status");
+    EXPECT_EQ(index.lookup(store, "git statusx"), HistoryStore::npos);
+    EXPECT_EQ(index.lookup(store, "make"), HistoryStore::npos);
+
+    // 较早的记录被更新的同前缀记录取代
+    store.append("git status --short");
+    index.sync(store);
+    EXPECT_EQ(store.at(index.lookup(store, "git stat")), "git status --short");
+}
+
+TEST(HistoryPrefixIndexTest, LazyBackfillTest) {
+    HistoryOptions options;
+    options.max_entries = 0;
+    options.dedup = HistoryOptions::KEEP_ALL;
+    HistoryStore store(options);
+    store.append("ancient command");
+    for (int i = 0; i < 50000; i++) {
+        store.append("cmd " + std::to_string(i));
+    }
+    // 已有的记录不预先索引
+    HistoryPrefixIndex index;
+    index.sync(store);
+    EXPECT_EQ(index.node_count(), 1);
+    EXPECT_FALSE(index.complete(store));
+
+    // 最近的匹配只需索引最新的一批
+    EXPECT_EQ(store.at(index.lookup(store, "cmd 4999")), "cmd 49999");
+    EXPECT_FALSE(index.complete(store));
+
+    // 很早的记录分几次查询补齐索引后找到
+    size_t pos = HistoryStore::npos;
+    for (int i = 0; i < 10 && pos == HistoryStore::npos; i++) {
+        pos = index.lookup(store, "anc");
+    }
+    ASSERT_NE(pos, HistoryStore::npos);
+    EXPECT_EQ(store.at(pos), "ancient command");
+    EXPECT_TRUE(index.complete(store));
+}
+
+#ifdef __linux__
+#include <fcntl.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <chrono>
+
+// 目录中的文件名（不含.和..）
+static std::vector<std::string> list_dir(const std::string& dir) {
+    std::vector<std::string> names;
+    DIR* d = opendir(dir.c_str());
+    while (struct dirent* entry = d ? readdir(d) : nullptr) {
+        std::string name = entry->d_name;
+        if (name != "." && name != "..") names.push_back(name);
+    }
+    if (d) closedir(d);
+    return names;
+}
+
+class HistoryFileTest : public ::testing::Test {
+protected:
+    std::string dir;
+    std::string path;
+
+    void SetUp() override {
+        char tmpl[] = "/tmp/test_historyXXXXXX";
+        dir = mkdtemp(tmpl);
+        path = dir + "/history";
+    }
+
+    void TearDown() override {
+        for (const std::string& name : list_dir(dir)) {
+            unlink((dir + "/" + name).c_str());
+        }
+        rmdir(dir.c_str());
+    }
+};
+
+TEST_F(HistoryFileTest, PersistTest) {
+    {
+        HistoryStore store;
+        ASSERT_TRUE(store.open(path));
+        store.append("echo one");
+        store.append("echo two");
+    }
+    HistoryStore store;
+    ASSERT_TRUE(store.open(path));
+    EXPECT_EQ(store.size(), 2);
+    EXPECT_EQ(entries(store), std::vector<std::string>({"echo one", "echo two"}));
+
+    // 继续追加
+    store.append("echo three");
+    HistoryStore reader;
+    ASSERT_TRUE(reader.open(path));
+    EXPECT_EQ(reader.size(), 3);
+}
+
+TEST_F(HistoryFileTest, TornAppendTest) {
+    {
+        HistoryStore store;
+        ASSERT_TRUE(store.open(path));
+        store.append("committed");
+    }
+    // 模拟追加到一半崩溃：记录已部分写入，文件头未提交
+    int fd = open(path.c_str(), O_RDWR);
+    uint64_t end;
+    ASSERT_EQ(pread(fd, &end, sizeof(end), 8), (ssize_t)sizeof(end));
+    const char garbage[] = "\x20\x00\x00\x00partial";
+    pwrite(fd, garbage, sizeof(garbage), end);
+    close(fd);
+
+    HistoryStore store;
+    ASSERT_TRUE(store.open(path));
+    EXPECT_EQ(entries(store), std::vector<std::string>({"committed"}));
+    store.append("after crash");
+    EXPECT_EQ(store.size(), 2);
+}
+
+TEST_F(HistoryFileTest, CorruptHeaderTest) {
+    {
+        HistoryStore store;
+        ASSERT_TRUE(store.open(path));
+        store.append("alpha");
+        store.append("beta");
+    }
+    // 提交位置损坏时逐条校验恢复
+    int fd = open(path.c_str(), O_RDWR);
+    uint64_t end = 1u << 30;
+    pwrite(fd, &end, sizeof(end), 8);
+    close(fd);
+
+    HistoryStore store;
+    ASSERT_TRUE(store.open(path));
+    EXPECT_EQ(entries(store), std::vector<std::string>({"alpha", "beta"}));
+}
+
+TEST_F(HistoryFileTest, BackgroundCompactionTest) {
+    HistoryOptions options;
+    options.max_entries = 1000;
+    {
+        HistoryStore store(options);
+        ASSERT_TRUE(store.open(path));
+        for (int i = 0; i < 3000; i++) {
+            store.append("cmd " + std::to_string(i));
+        }
+        store.wait_compaction();
+        EXPECT_GE(store.compaction_count(), 1);
+        // 整理期间追加的记录全部接在保留的记录之后
+        EXPECT_LT(store.size(), 3000);
+        EXPECT_GE(store.size(), 1000);
+        EXPECT_EQ(store.at(store.prev(store.end())), "cmd 2999");
+    }
+    // 整理后的文件替换了原文件，记录连续
+    HistoryStore store(options);
+    ASSERT_TRUE(store.open(path));
+    std::vector<std::string> all = entries(store);
+    ASSERT_EQ(all.size(), store.size());
+    EXPECT_EQ(all.back(), "cmd 2999");
+    for (size_t i = 1; i < all.size(); i++) {
+        EXPECT_EQ(std::stoi(all[i].substr(4)), std::stoi(all[i - 1].substr(4)) + 1);
+    }
+    // 没有留下整理用的临时文件
+    EXPECT_EQ(list_dir(dir), std::vector<std::string>({"history"}));
+}
+
+TEST_F(HistoryFileTest, ConcurrentCompactionTest) {
+    // 两个shell共用历史文件、同时超过上限各自整理，换入的文件不互相破坏
+    HistoryOptions options;
+    options.max_entries = 500;
+    {
+        HistoryStore a(options), b(options);
+        ASSERT_TRUE(a.open(path));
+        ASSERT_TRUE(b.open(path));
+        for (int i = 0; i < 2000; i++) {
+            a.append("a " + std::to_string(i));
+            b.append("b " + std::to_string(i));
+        }
+        a.wait_compaction();
+        b.wait_compaction();
+        b.append("last");
+        a.append("after last");
+        EXPECT_EQ(entries(a).back(), "after last");
+        EXPECT_EQ(entries(b).back(), "last");
+    }
+    HistoryStore store(options);
+    ASSERT_TRUE(store.open(path));
+    std::vector<std::string> all = entries(store);
+    ASSERT_EQ(all.size(), store.size());
+    ASSERT_GE(all.size(), 2u);
+    EXPECT_EQ(all[all.size() - 2], "last");
+    EXPECT_EQ(all.back(), "after last");
+    EXPECT_EQ(list_dir(dir), std::vector<std::string>({"history"}));
+}
+
+TEST_F(HistoryFileTest, ReopenInvalidatesTest) {
+    // 其他shell换入新文件后，改用新文件时整理次数增加，索引据此重建
+    HistoryOptions options;
+    options.max_entries = 100;
+    HistoryStore a(options), b(options);
+    ASSERT_TRUE(a.open(path));
+    ASSERT_TRUE(b.open(path));
+    b.append("first");
+    unsigned long before = b.compaction_count();
+    for (int i = 0; i < 200; i++) {
+        a.append("a " + std::to_string(i));
+    }
+    a.wait_compaction();
+    b.append("from b");
+    EXPECT_GT(b.compaction_count(), before);
+    HistoryIndex index;
+    index.sync(b);
+    EXPECT_EQ(b.at(index.search_backward(b, "from", b.end())), "from b");
+}
+
+TEST_F(HistoryFileTest, SharedFileTest) {
+    // 两个shell共用一个历史文件，追加互不覆盖
+    HistoryStore a, b;
+    ASSERT_TRUE(a.open(path));
+    ASSERT_TRUE(b.open(path));
+    a.append("from a");
+    b.append("from b");
+    a.append("from a again");
+
+    HistoryStore reader;
+    ASSERT_TRUE(reader.open(path));
+    EXPECT_EQ(entries(reader), std::vector<std::string>({"from a", "from b", "from a again"}));
+}
+
+TEST_F(HistoryFileTest, StartupTest) {
+    HistoryOptions options;
+    options.max_entries = 0;
+    {
+        HistoryStore store(options);
+        ASSERT_TRUE(store.open(path));
+        for (int i = 0; i < 200000; i++) {
+            store.append("some fairly typical command line " + std::to_string(i));
+        }
+    }
+    // 打开只映射文件并校验最后一条，与条数无关
+    auto start = std::chrono::steady_clock::now();
+    HistoryStore store(options);
+    ASSERT_TRUE(store.open(path));
+    EXPECT_EQ(store.size(), 200000);
+    EXPECT_EQ(store.at(store.prev(store.end())), "some fairly typical command line 199999");
+    auto elapsed = std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::steady_clock::now() - start).count();
+    EXPECT_LT(elapsed, 10000);
+}
+#endif
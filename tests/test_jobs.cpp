@@ -0,0 +1,126 @@
+#include <gtest/gtest.h>
+#include "jobs.h"
+#include "pipeline.h"
+#include <csignal>
+#include <thread>
+#include <chrono>
+
+#ifdef __linux__
+class JobTableTest : public ::testing::Test {
+protected:
+    JobTable jobs;
+
+    // 启动一个独立进程组的命令并登记为作业
+    Job& start(const std::string& cmd, bool foreground) {
+        Pipeline p;
+        EXPECT_TRUE(parse_pipeline(cmd, p));
+        std::vector<pid_t> pids = spawn_pipeline(p, -1, -1, true);
+        EXPECT_FALSE(pids.empty());
+        return jobs.add(pids, cmd, foreground);
+    }
+
+    // 轮询直到出现状态变化或超时
+    std::vector<JobEvent> wait_events(int timeout_ms = 2000) {
+        auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeout_ms);
+        while (std::chrono::steady_clock::now() < deadline) {
+            std::vector<JobEvent> events = jobs.poll();
+            if (!events.empty()) return events;
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+        return {};
+    }
+};
+
+TEST_F(JobTableTest, AddAndFindTest) {
+    Job& a = start("sleep 5", false);
+    Job& b = start("sleep 5", false);
+    EXPECT_EQ(a.id, 1);
+    EXPECT_EQ(b.id, 2);
+    EXPECT_EQ(a.pgid, a.processes[0].pid);
+    EXPECT_EQ(jobs.size(), 2);
+
+    // 缺省查找当前（最近）作业
+    EXPECT_EQ(jobs.find(0), &b);
+    EXPECT_EQ(jobs.find(1), &a);
+    EXPECT_EQ(jobs.find(7), nullptr);
+    EXPECT_FALSE(jobs.has_foreground());
+}
+
+TEST_F(JobTableTest, ForegroundDoneTest) {
+    Job& job = start("true | sh -c 'exit 3'", true);
+    int id = job.id;
+    EXPECT_TRUE(jobs.has_foreground());
+    EXPECT_EQ(jobs.foreground()->processes.size(), 2);
+
+    std::vector<JobEvent> events = wait_events();
+    ASSERT_EQ(events.size(), 1);
+    EXPECT_EQ(events[0].id, id);
+    EXPECT_EQ(events[0].state, JobState::DONE);
+    EXPECT_TRUE(events[0].foreground);
+    EXPECT_EQ(WEXITSTATUS(events[0].status), 3);  // 最后一级的退出状态
+
+    // 结束的作业从表中移除，前台清空
+    EXPECT_FALSE(jobs.has_foreground());
+    EXPECT_EQ(jobs.size(), 0);
+}
+
+TEST_F(JobTableTest, StopAndContinueTest) {
+    Job& job = start("sleep 5", true);
+    jobs.signal(job, SIGTSTP);
+
+    std::vector<JobEvent> events = wait_events();
+    ASSERT_EQ(events.size(), 1);
+    EXPECT_EQ(events[0].state, JobState::STOPPED);
+    EXPECT_TRUE(events[0].foreground);
+    EXPECT_FALSE(jobs.has_foreground());  // 暂停后shell取回前台
+    ASSERT_EQ(jobs.size(), 1);
+
+    jobs.signal(*jobs.find(0), SIGCONT);
+    EXPECT_EQ(jobs.find(0)->state, JobState::RUNNING);
+
+    jobs.signal(*jobs.find(0), SIGINT);
+    events = wait_events();
+    ASSERT_EQ(events.size(), 1);
+    EXPECT_EQ(events[0].state, JobState::DONE);
+    EXPECT_TRUE(WIFSIGNALED(events[0].status));
+    EXPECT_EQ(jobs.size(), 0);
+}
+
+TEST_F(JobTableTest, PumpJoinTest) {
+    // 搬运线程在作业结束时被回收
+    bool pumped = false;
+    Pipeline p;
+    ASSERT_TRUE(parse_pipeline("true", p));
+    std::vector<pid_t> pids = spawn_pipeline(p, -1, -1, true);
+    jobs.add(pids, "true", false, std::thread([&pumped]() { pumped = true; }));
+
+    std::vector<JobEvent> events = wait_events();
+    ASSERT_EQ(events.size(), 1);
+    EXPECT_TRUE(pumped);
+}
+
+TEST(JobTableTeardownTest, IgnoredHangupTest) {
+    // 忽略SIGHUP的作业不阻塞析构，宽限期后被SIGKILL并回收
+    Pipeline p;
+    p.commands.assign(1, Command());
+    p.commands[0].argv = {"sh", "-c", "trap '' HUP; sleep 10"};
+    std::vector<pid_t> pids = spawn_pipeline(p, -1, -1, true);
+    ASSERT_EQ(pids.size(), 1u);
+
+    auto start = std::chrono::steady_clock::now();
+    {
+        JobTable jobs;
+        jobs.add(pids, "sleep", true);
+        std::this_thread::sleep_for(std::chrono::milliseconds(50));  // 等sh设置好忽略SIGHUP
+        start = std::chrono::steady_clock::now();
+    }
+    EXPECT_LT(std::chrono::steady_clock::now() - start, std::chrono::milliseconds(200));
+
+    // 整个进程组最终被杀死
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(5);
+    while (kill(-pids[0], 0) == 0 && std::chrono::steady_clock::now() < deadline) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    EXPECT_NE(kill(-pids[0], 0), 0);
+}
+#endif
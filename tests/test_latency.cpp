@@ -0,0 +1,148 @@
+#include <gtest/gtest.h>
+#include "latency.h"
+#include "fifo.h"
+#include <string>
+#include <cstring>
+#include <thread>
+#include <vector>
+
+#ifdef __linux__
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include "shell.h"
+#endif
+
+// 百分位数的相对误差不超过1/16
+TEST(LatencyHistogramTest, PercentileTest) {
+    LatencyHistogram histogram;
+    EXPECT_EQ(histogram.percentile(50), 0u);
+    for (uint64_t ns = 1; ns <= 10000; ns++) histogram.record(ns);
+    EXPECT_EQ(histogram.count(), 10000u);
+    EXPECT_EQ(histogram.max(), 10000u);
+    EXPECT_NEAR(histogram.mean(), 5000.5, 0.01);
+    for (double p : {50.0, 90.0, 99.0}) {
+        double exact = p * 100;
+        EXPECT_GE((double)histogram.percentile(p), exact);
+        EXPECT_LE((double)histogram.percentile(p), exact * (1 + 1.0 / 16));
+    }
+    EXPECT_EQ(histogram.percentile(100), 10000u);
+
+    // 很大的值也有自己的桶
+    histogram.reset();
+    histogram.record(UINT64_MAX);
+    histogram.record(3);
+    EXPECT_EQ(histogram.percentile(50), 3u);
+    EXPECT_EQ(histogram.percentile(100), UINT64_MAX);
+}
+
+// 多个线程同时记录不丢计数
+TEST(LatencyHistogramTest, ConcurrentTest) {
+    LatencyHistogram histogram;
+    std::vector<std::thread> threads;
+    for (int t = 0; t < 4; t++) {
+        threads.emplace_back([&histogram, t] {
+            for (uint64_t i = 0; i < 50000; i++) histogram.record(i * (t + 1));
+        });
+    }
+    for (auto& thread : threads) thread.join();
+    EXPECT_EQ(histogram.count(), 200000u);
+    EXPECT_EQ(histogram.max(), 49999u * 4);
+}
+
+// 时间戳随fifo中的按键传递：读到的位置之前写入的按键计入排队时间，回显后计入端到端延迟
+TEST(LatencyTraceTest, FifoTest) {
+    LatencyTrace& trace = LatencyTrace::instance();
+    trace.enable(true);
+    trace.reset();
+
+    uint8_t buffer[16];
+    struct fifo fifo;
+    fifo_init(&fifo, buffer, sizeof(buffer));
+    // 写入位置回绕
+    fifo.in = fifo.out = UINT32_MAX - 4;
+
+    // 时间戳先于按键入队，此时读出端还读不到它们，不取回时间戳
+    for (const char* keys : {"a", "\033[A", "b"}) {
+        uint64_t captured = LatencyTrace::now();
+        trace.enqueued(fifo.in + strlen(keys), captured, LatencyTrace::now());
+        trace.dequeued(fifo.out);
+        fifo_write(&fifo, (const uint8_t*)keys, strlen(keys));
+    }
+    EXPECT_EQ(trace.histogram(LatencyStage::CAPTURE).count(), 3u);
+    EXPECT_EQ(trace.histogram(LatencyStage::QUEUE).count(), 0u);
+
+    // 读到方向键的中间：只有第一个按键完整读出
+    uint8_t out[16];
+    fifo_read(&fifo, out, 3);
+    trace.dequeued(fifo.out);
+    EXPECT_EQ(trace.histogram(LatencyStage::QUEUE).count(), 1u);
+    trace.echoed();
+    EXPECT_EQ(trace.histogram(LatencyStage::END_TO_END).count(), 1u);
+
+    fifo_read(&fifo, out, sizeof(out));
+    trace.dequeued(fifo.out);
+    trace.echoed();
+    EXPECT_EQ(trace.histogram(LatencyStage::QUEUE).count(), 3u);
+    EXPECT_EQ(trace.histogram(LatencyStage::END_TO_END).count(), 3u);
+    EXPECT_GE(trace.histogram(LatencyStage::END_TO_END).max(), trace.histogram(LatencyStage::QUEUE).max());
+
+    trace.enable(false);
+    trace.reset();
+}
+
+// 关闭时不计时
+TEST(LatencyTraceTest, DisabledTest) {
+    LatencyTrace::instance().enable(false);
+    StageTimer timer;
+    EXPECT_FALSE(timer.start(LatencyStage::PARSE));
+    EXPECT_EQ(timer.switch_to(LatencyStage::RENDER), LatencyStage::COUNT);
+    timer.finish();
+    EXPECT_EQ(LatencyTrace::instance().histogram(LatencyStage::RENDER).count(), 0u);
+}
+
+#ifdef __linux__
+
+static void type(Shell& shell, const char* keys) {
+    shell.test_handle_input(keys, strlen(keys));
+}
+
+// 会话模式的shell：每次输入处理计入解码、渲染、写出三个阶段，stats命令显示统计
+TEST(LatencyTraceTest, ShellStatsTest) {
+    int fds[2];
+    ASSERT_EQ(socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, fds), 0);
+    fcntl(fds[0], F_SETFL, O_NONBLOCK);
+    fcntl(fds[1], F_SETFL, O_NONBLOCK);
+    LatencyTrace& trace = LatencyTrace::instance();
+    trace.reset();
+    {
+        Shell shell(nullptr, fds[1]);
+        type(shell, "ab\b\b");
+        EXPECT_EQ(trace.histogram(LatencyStage::PARSE).count(), 0u);
+
+        type(shell, "stats on\r");
+        for (const char* key : {"x", "\b", "\033[D"}) type(shell, key);
+        EXPECT_EQ(trace.histogram(LatencyStage::PARSE).count(), 3u);
+        EXPECT_EQ(trace.histogram(LatencyStage::RENDER).count(), 3u);
+        EXPECT_EQ(trace.histogram(LatencyStage::FLUSH).count(), 3u);
+        EXPECT_GT(trace.histogram(LatencyStage::FLUSH).max(), 0u);
+
+        type(shell, "\033[C\rstats\r");
+        std::string received;
+        char buffer[4096];
+        ssize_t n;
+        while ((n = read(fds[0], buffer, sizeof(buffer))) > 0) received.append(buffer, n);
+        EXPECT_NE(received.find("latency tracing: on"), std::string::npos);
+        EXPECT_NE(received.find("render"), std::string::npos);
+        EXPECT_NE(received.find("key->echo"), std::string::npos);
+
+        type(shell, "stats off\r");
+        EXPECT_FALSE(LatencyTrace::enabled());
+    }
+    trace.reset();
+    close(fds[0]);
+    close(fds[1]);
+}
+
+#endif
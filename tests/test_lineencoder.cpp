@@ -0,0 +1,212 @@
+#include <gtest/gtest.h>
+#include "lineencoder.h"
+#include "screen.h"
+#include "utf8.h"
+#include <string>
+
+// 在模拟终端上显示"$ "加before、光标在cursor列，送入编码器的输出后检查画面
+class LineEncoderTest : public ::testing::Test {
+protected:
+    Screen terminal{1, 80};
+
+    void show(const std::string& before, size_t cursor) {
+        terminal.reset();
+        terminal.feed("$ " + before);
+        terminal.feed("\r\033[" + std::to_string(cursor + 1) + "G");
+        ASSERT_EQ(terminal.cursor_col(), cursor);
+    }
+
+    void expect_screen(const std::pmr::string& out, const std::string& after, size_t cursor) {
+        terminal.feed(out.data(), out.size());
+        EXPECT_EQ(terminal.row_text(0), "$ " + after);
+        EXPECT_EQ(terminal.cursor_col(), cursor);
+    }
+};
+
+TEST_F(LineEncoderTest, MoveTest) {
+    LineEncoder encoder;
+    std::string text = "git commit -m 'fix the parser for long lines'";
+    EditLine line = {"$ ", text};
+    std::pmr::string out;
+
+    // 左移一列用退格
+    show(text, 20);
+    encoder.move(out, line, 20, 19);
+    EXPECT_EQ(out, "\b");
+    expect_screen(out, text, 19);
+
+    // 右移一列重印经过的字符
+    out.clear();
+    encoder.move(out, line, 19, 20);
+    EXPECT_EQ(out, "x");
+    expect_screen(out, text, 20);
+
+    // 远距离左移用CUB
+    show(text, 46);
+    out.clear();
+    encoder.move(out, line, 46, 16);
+    EXPECT_EQ(out, "\033[30D");
+    expect_screen(out, text, 16);
+
+    // 靠近行首时回车后重印更短
+    out.clear();
+    encoder.move(out, line, 16, 2);
+    EXPECT_EQ(out, "\r$ ");
+    expect_screen(out, text, 2);
+
+    // 没有CUB/CHA的终端只能用退格或回车重印
+    LineEncoder dumb(TerminalCaps::dumb());
+    show(text, 46);
+    out.clear();
+    dumb.move(out, line, 46, 30);
+    EXPECT_EQ(out.size(), 16u);
+    expect_screen(out, text, 30);
+}
+
+TEST_F(LineEncoderTest, InsertTest) {
+    std::string after = "echo hello world";
+    EditLine line = {"$ ", after};
+    std::pmr::string out;
+
+    // xterm：行中插入一个字符用ICH，4字节
+    LineEncoder xterm;
+    show("echo hell world", 11);
+    xterm.insert(out, line, 11, 1);
+    EXPECT_EQ(out, "\033[@o");
+    EXPECT_EQ(xterm.insert_cost(line, 11, 1), 4u);
+    expect_screen(out, after, 12);
+
+    // 靠近行尾时重印行尾更短
+    show("echo hello word", 16);
+    out.clear();
+    xterm.insert(out, line, 16, 1);
+    EXPECT_EQ(out, "ld\b");
+    expect_screen(out, after, 17);
+
+    // 在行尾只输出该字符
+    show("echo hello worl", 17);
+    out.clear();
+    xterm.insert(out, line, 17, 1);
+    EXPECT_EQ(out, "d");
+    expect_screen(out, after, 18);
+
+    // VT100没有ICH：重印行尾再退回
+    LineEncoder vt100(TerminalCaps::vt100());
+    show("echo hell world", 11);
+    out.clear();
+    vt100.insert(out, line, 11, 1);
+    EXPECT_EQ(out, "o world\033[6D");
+    expect_screen(out, after, 12);
+}
+
+TEST_F(LineEncoderTest, EraseTest) {
+    std::string after = "ls -l /tmp";
+    EditLine line = {"$ ", after};
+    std::pmr::string out;
+
+    // 行中删除一个字符用DCH，3字节
+    LineEncoder xterm;
+    show("ls -la /tmp", 7);
+    xterm.erase(out, line, 7, 1);
+    EXPECT_EQ(out, "\033[P");
+    expect_screen(out, after, 7);
+
+    // 行尾删除：空格覆盖再退格，2字节
+    show("ls -l /tmpx", 12);
+    out.clear();
+    xterm.erase(out, line, 12, 1);
+    EXPECT_EQ(out, " \b");
+    expect_screen(out, after, 12);
+
+    // VT100没有DCH：重印行尾，多出的一列用空格覆盖（比EL短），退回
+    LineEncoder vt100(TerminalCaps::vt100());
+    show("ls -la /tmp", 7);
+    out.clear();
+    vt100.erase(out, line, 7, 1);
+    EXPECT_EQ(out, " /tmp \033[6D");
+    EXPECT_EQ(vt100.erase_cost(line, 7, 1), out.size());
+    expect_screen(out, after, 7);
+
+    // 一次删除多个字符
+    show("ls -l --color /tmp", 7);
+    out.clear();
+    xterm.erase(out, line, 7, 8);
+    EXPECT_EQ(out, "\033[8P");
+    expect_screen(out, after, 7);
+}
+
+// 命令行含宽字符时按列计算：每个汉字占2列，重印的代价按字节数
+TEST(LineEncoderWideTest, WideTextTest) {
+    LineEncoder xterm;
+    std::string text = "ls 中文 -l";
+    LineWidths widths;
+    EditLine line = {"$ ", text, widths.update(text)};
+    EXPECT_EQ(line.size(), 12u);
+    std::pmr::string out;
+
+    // 右移经过"中"：重印3字节比CUF短
+    xterm.move(out, line, 5, 7);
+    EXPECT_EQ(out, "中");
+    // 左移2列用两个退格
+    out.clear();
+    xterm.move(out, line, 7, 5);
+    EXPECT_EQ(out, "\b\b");
+    // 回车后重印要输出提示符和"ls 中"
+    EXPECT_EQ(line.bytes(0, 7), 8u);
+
+    // 删除"中"后行内删除2列
+    std::string after = "ls 文 -l";
+    widths.invalidate(3);
+    EditLine erased = {"$ ", after, widths.update(after)};
+    out.clear();
+    xterm.erase(out, erased, 5, 2);
+    EXPECT_EQ(out, "\033[2P");
+
+    // 在行尾插入一个宽字符只输出该字符
+    std::string appended = after + "中";
+    widths.invalidate(after.size());
+    EditLine inserted = {"$ ", appended, widths.update(appended)};
+    out.clear();
+    xterm.insert(out, inserted, 10, 2);
+    EXPECT_EQ(out, "中");
+}
+
+// 各种终端、各种位置的编辑都得到正确的画面，且不比原来的写法（EL加重印行尾加CUB）长
+TEST_F(LineEncoderTest, ExhaustiveTest) {
+    std::string text = "make -j8 all && ./run_tests --gtest_filter=Line*";
+    for (TerminalCaps caps : {TerminalCaps::xterm(), TerminalCaps::vt220(), TerminalCaps::vt102(),
+                              TerminalCaps::vt100(), TerminalCaps::dumb()}) {
+        LineEncoder encoder(caps);
+        for (size_t pos = 0; pos < text.size(); pos++) {
+            std::string before = text.substr(0, pos) + text.substr(pos + 1);
+            EditLine line = {"$ ", text};
+            std::pmr::string out;
+            show(before, pos + 2);
+            encoder.insert(out, line, pos + 2, 1);
+            expect_screen(out, text, pos + 3);
+            size_t tail = text.size() - pos - 1;
+            size_t old_cost = 1 + 3 + tail + (tail ? 3 + std::to_string(tail).size() : 0);
+            if (caps.cursor_moves && caps.erase_line) {
+                EXPECT_LE(out.size(), old_cost) << pos;
+            }
+
+            line.text = before;
+            out.clear();
+            show(text, pos + 2);
+            encoder.erase(out, line, pos + 2, 1);
+            expect_screen(out, before, pos + 2);
+            if (HasFailure()) return;
+        }
+    }
+}
+
+TEST(TerminalCapsTest, FromTermTest) {
+    EXPECT_TRUE(TerminalCaps::from_term("xterm-256color").insert_chars);
+    EXPECT_TRUE(TerminalCaps::from_term(nullptr).column_address);
+    EXPECT_FALSE(TerminalCaps::from_term("vt100").delete_chars);
+    EXPECT_TRUE(TerminalCaps::from_term("vt102").delete_chars);
+    EXPECT_FALSE(TerminalCaps::from_term("vt102").insert_chars);
+    EXPECT_TRUE(TerminalCaps::from_term("vt220").erase_chars);
+    EXPECT_FALSE(TerminalCaps::from_term("vt220").column_address);
+    EXPECT_FALSE(TerminalCaps::from_term("dumb").cursor_moves);
+}
@@ -0,0 +1,169 @@
+#include <gtest/gtest.h>
+#include "pathcache.h"
+#include <cstdlib>
+#include <string>
+
+#ifdef __linux__
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/resource.h>
+#include <vector>
+
+class PathCacheTest : public ::testing::Test {
+protected:
+    std::string old_path;
+    std::string dir1, dir2;
+
+    void SetUp() override {
+        const char* path = getenv("PATH");
+        old_path = path ? path : "";
+        char tmpl1[] = "/tmp/test_pathcache1XXXXXX";
+        char tmpl2[] = "/tmp/test_pathcache2XXXXXX";
+        dir1 = mkdtemp(tmpl1);
+        dir2 = mkdtemp(tmpl2);
+        setenv("PATH", (dir1 + ":" + dir2).c_str(), 1);
+    }
+
+    void TearDown() override {
+        setenv("PATH", old_path.c_str(), 1);
+        system(("rm -rf " + dir1 + " " + dir2).c_str());
+    }
+
+    // 在目录中创建可执行文件
+    std::string make_exec(const std::string& dir, const std::string& name) {
+        std::string path = dir + "/" + name;
+        int fd = open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0755);
+        close(fd);
+        return path;
+    }
+};
+
+TEST_F(PathCacheTest, LookupAndHitTest) {
+    std::string tool = make_exec(dir2, "tool");
+    PathCache cache;
+
+    EXPECT_EQ(cache.lookup("tool"), tool);
+    EXPECT_EQ(cache.probe_count(), 1);
+
+    // 第二次命中缓存，不再探测文件系统
+    EXPECT_EQ(cache.lookup("tool"), tool);
+    EXPECT_EQ(cache.probe_count(), 1);
+    EXPECT_EQ(cache.entries().at("tool").hits, 2);
+
+    // 找不到的命令和含'/'的名字
+    EXPECT_EQ(cache.lookup("missing"), "");
+    EXPECT_EQ(cache.lookup("./local"), "./local");
+    EXPECT_EQ(cache.entries().size(), 1);
+}
+
+TEST_F(PathCacheTest, NonExecutableTest) {
+    std::string path = dir1 + "/data";
+    int fd = open(path.c_str(), O_WRONLY | O_CREAT, 0644);
+    close(fd);
+    PathCache cache;
+    EXPECT_EQ(cache.lookup("data"), "");
+
+    // 加上执行权限后（IN_ATTRIB）可以找到
+    chmod(path.c_str(), 0755);
+    EXPECT_EQ(cache.lookup("data"), path);
+}
+
+TEST_F(PathCacheTest, ShadowInvalidationTest) {
+    std::string later = make_exec(dir2, "tool");
+    PathCache cache;
+    EXPECT_EQ(cache.lookup("tool"), later);
+
+    // 在更靠前的目录中新建同名命令，记录失效
+    std::string earlier = make_exec(dir1, "tool");
+    EXPECT_EQ(cache.lookup("tool"), earlier);
+    EXPECT_EQ(cache.probe_count(), 2);
+}
+
+TEST_F(PathCacheTest, DeleteInvalidationTest) {
+    std::string earlier = make_exec(dir1, "tool");
+    std::string later = make_exec(dir2, "tool");
+    std::string other = make_exec(dir2, "other");
+    PathCache cache;
+    EXPECT_EQ(cache.lookup("tool"), earlier);
+    EXPECT_EQ(cache.lookup("other"), other);
+
+    unlink(earlier.c_str());
+    EXPECT_EQ(cache.lookup("tool"), later);
+    // 无关的记录不受影响
+    EXPECT_EQ(cache.lookup("other"), other);
+    EXPECT_EQ(cache.probe_count(), 3);
+
+    rename(later.c_str(), (dir2 + "/renamed").c_str());
+    EXPECT_EQ(cache.lookup("tool"), "");
+}
+
+TEST_F(PathCacheTest, PathChangeTest) {
+    std::string tool1 = make_exec(dir1, "tool");
+    std::string tool2 = make_exec(dir2, "tool");
+    PathCache cache;
+    EXPECT_EQ(cache.lookup("tool"), tool1);
+
+    setenv("PATH", dir2.c_str(), 1);
+    EXPECT_EQ(cache.lookup("tool"), tool2);
+
+    // 新PATH下的目录同样被监视
+    unlink(tool2.c_str());
+    EXPECT_EQ(cache.lookup("tool"), "");
+}
+
+TEST_F(PathCacheTest, ClearAndForgetTest) {
+    make_exec(dir1, "a");
+    make_exec(dir1, "b");
+    PathCache cache;
+    cache.lookup("a");
+    cache.lookup("b");
+    EXPECT_EQ(cache.entries().size(), 2);
+
+    EXPECT_TRUE(cache.forget("a"));
+    EXPECT_FALSE(cache.forget("a"));
+    EXPECT_EQ(cache.entries().size(), 1);
+
+    cache.clear();
+    EXPECT_TRUE(cache.entries().empty());
+}
+
+TEST_F(PathCacheTest, NoInotifyTest) {
+    std::string tool = make_exec(dir2, "tool");
+    PathCache cache;
+
+    // 描述符用尽，建立不了inotify实例时不缓存，否则记录永远不会失效
+    struct rlimit saved;
+    getrlimit(RLIMIT_NOFILE, &saved);
+    struct rlimit low = saved;
+    low.rlim_cur = 64;
+    setrlimit(RLIMIT_NOFILE, &low);
+    std::vector<int> fds;
+    for (int fd; (fd = open("/dev/null", O_RDONLY)) >= 0;) fds.push_back(fd);
+    EXPECT_EQ(cache.lookup("tool"), tool);
+    EXPECT_EQ(cache.lookup("tool"), tool);
+    for (int fd : fds) close(fd);
+    setrlimit(RLIMIT_NOFILE, &saved);
+    EXPECT_EQ(cache.probe_count(), 2);
+
+    // 能够监视后恢复缓存
+    EXPECT_EQ(cache.lookup("tool"), tool);
+    EXPECT_EQ(cache.lookup("tool"), tool);
+    EXPECT_EQ(cache.probe_count(), 3);
+}
+
+TEST_F(PathCacheTest, RemovedDirectoryTest) {
+    std::string tool = make_exec(dir1, "tool");
+    PathCache cache;
+    EXPECT_EQ(cache.lookup("tool"), tool);
+
+    // 目录被删除后重新建立，监视随之恢复
+    unlink(tool.c_str());
+    rmdir(dir1.c_str());
+    EXPECT_EQ(cache.lookup("tool"), "");
+    mkdir(dir1.c_str(), 0755);
+    EXPECT_EQ(cache.lookup("tool"), "");
+    tool = make_exec(dir1, "tool");
+    EXPECT_EQ(cache.lookup("tool"), tool);
+}
+#endif
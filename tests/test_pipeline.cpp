@@ -0,0 +1,208 @@
+#include <gtest/gtest.h>
+#include "pipeline.h"
+#include <cstring>
+#include <chrono>
+#include <future>
+#ifdef __linux__
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/wait.h>
+#endif
+
+TEST(PipelineParseTest, SimpleCommandTest) {
+    Pipeline p;
+    ASSERT_TRUE(parse_pipeline("ls -l  /tmp", p));
+    ASSERT_EQ(p.commands.size(), 1);
+    EXPECT_EQ(p.commands[0].argv, (std::vector<std::string>{"ls", "-l", "/tmp"}));
+}
+
+TEST(PipelineParseTest, PipeTest) {
+    Pipeline p;
+    ASSERT_TRUE(parse_pipeline("cat file|grep a | wc -l", p));
+    ASSERT_EQ(p.commands.size(), 3);
+    EXPECT_EQ(p.commands[0].argv, (std::vector<std::string>{"cat", "file"}));
+    EXPECT_EQ(p.commands[1].argv, (std::vector<std::string>{"grep", "a"}));
+    EXPECT_EQ(p.commands[2].argv, (std::vector<std::string>{"wc", "-l"}));
+}
+
+TEST(PipelineParseTest, QuoteTest) {
+    Pipeline p;
+    ASSERT_TRUE(parse_pipeline("echo 'a | b' \"c \\\"d\\\"\" e\\ f ''", p));
+    ASSERT_EQ(p.commands.size(), 1);
+    EXPECT_EQ(p.commands[0].argv,
+              (std::vector<std::string>{"echo", "a | b", "c \"d\"", "e f", ""}));
+
+    // 引号与普通字符相连组成同一个单词
+    ASSERT_TRUE(parse_pipeline("echo ab'cd'\"ef\"", p));
+    EXPECT_EQ(p.commands[0].argv, (std::vector<std::string>{"echo", "abcdef"}));
+}
+
+TEST(PipelineParseTest, RejectTest) {
+    Pipeline p;
+    // 语法错误
+    EXPECT_FALSE(parse_pipeline("", p));
+    EXPECT_FALSE(parse_pipeline("   ", p));
+    EXPECT_FALSE(parse_pipeline("| a", p));
+    EXPECT_FALSE(parse_pipeline("a |", p));
+    EXPECT_FALSE(parse_pipeline("a || b", p));
+    EXPECT_FALSE(parse_pipeline("echo 'abc", p));
+    EXPECT_FALSE(parse_pipeline("echo \"abc", p));
+    // 需要/bin/sh处理的语法
+    EXPECT_FALSE(parse_pipeline("echo a > file", p));
+    EXPECT_FALSE(parse_pipeline("a; b", p));
+    EXPECT_FALSE(parse_pipeline("a && b", p));
+    EXPECT_FALSE(parse_pipeline("echo $HOME", p));
+    EXPECT_FALSE(parse_pipeline("echo \"$HOME\"", p));
+    EXPECT_FALSE(parse_pipeline("ls *.cpp", p));
+    EXPECT_FALSE(parse_pipeline("FOO=1 env", p));
+    // 引号内的特殊字符按字面处理
+    EXPECT_TRUE(parse_pipeline("echo '$HOME > *'", p));
+}
+
+#ifdef __linux__
+// 读出fd中的全部数据
+static std::string read_all(int fd) {
+    std::string result;
+    char buffer[4096];
+    ssize_t n;
+    while ((n = read(fd, buffer, sizeof(buffer))) > 0) {
+        result.append(buffer, n);
+    }
+    return result;
+}
+
+TEST(PipelineExecTest, SpawnPipelineTest) {
+    Pipeline p;
+    ASSERT_TRUE(parse_pipeline("printf 'b\\na\\nc\\n' | sort | tr a-z A-Z", p));
+
+    int out[2];
+    ASSERT_EQ(pipe2(out, O_CLOEXEC), 0);
+    std::vector<pid_t> pids = spawn_pipeline(p, -1, out[1]);
+    close(out[1]);
+    ASSERT_EQ(pids.size(), 3);
+
+    EXPECT_EQ(read_all(out[0]), "A\nB\nC\n");
+    int status = wait_pipeline(pids);
+    EXPECT_TRUE(WIFEXITED(status));
+    EXPECT_EQ(WEXITSTATUS(status), 0);
+    close(out[0]);
+}
+
+TEST(PipelineExecTest, SpawnFailureTest) {
+    Pipeline p;
+    ASSERT_TRUE(parse_pipeline("echo a | no_such_command_for_test", p));
+    EXPECT_TRUE(spawn_pipeline(p).empty());
+}
+
+TEST(PipelineExecTest, SpawnFailureBehindReaderTest) {
+    // 第一级在等待永远不会关闭的输入，第二级启动失败时不能卡在回收上
+    Pipeline p;
+    ASSERT_TRUE(parse_pipeline("cat | ./no-such-file-for-test", p));
+
+    int in[2];
+    ASSERT_EQ(pipe2(in, O_CLOEXEC), 0);
+    auto result = std::async(std::launch::async, [&] { return spawn_pipeline(p, in[0], -1, true); });
+    bool finished = result.wait_for(std::chrono::seconds(2)) == std::future_status::ready;
+    close(in[1]);
+    EXPECT_TRUE(finished);
+    EXPECT_TRUE(result.get().empty());
+    close(in[0]);
+}
+
+TEST(PipelineExecTest, WriteToPipeTest) {
+    // 模拟内建命令位于管道头部
+    Pipeline p;
+    ASSERT_TRUE(parse_pipeline("wc -c", p));
+
+    int in[2], out[2];
+    ASSERT_EQ(pipe2(in, O_CLOEXEC), 0);
+    ASSERT_EQ(pipe2(out, O_CLOEXEC), 0);
+    std::vector<pid_t> pids = spawn_pipeline(p, in[0], out[1]);
+    close(in[0]);
+    close(out[1]);
+
+    std::string data(200000, 'x');  // 大于管道默认容量
+    EXPECT_TRUE(write_to_pipe(in[1], data.data(), data.size()));
+    close(in[1]);
+
+    std::string result = read_all(out[0]);
+    wait_pipeline(pids);
+    close(out[0]);
+    EXPECT_EQ(std::stoul(result), data.size());
+}
+
+TEST(PipelineExecTest, SpliceAllTest) {
+    int src[2], dst[2];
+    ASSERT_EQ(pipe2(src, O_CLOEXEC), 0);
+    ASSERT_EQ(pipe2(dst, O_CLOEXEC), 0);
+
+    const char data[] = "splice data";
+    ASSERT_EQ(write(src[1], data, strlen(data)), (ssize_t)strlen(data));
+    close(src[1]);
+
+    EXPECT_EQ(splice_all(src[0], dst[1]), (long long)strlen(data));
+    close(dst[1]);
+    EXPECT_EQ(read_all(dst[0]), data);
+    close(src[0]);
+    close(dst[0]);
+}
+
+TEST(PipelineExecTest, SpliceFallbackTest) {
+    // 两端都是普通文件时splice不可用，回退到read/write
+    char src_path[] = "/tmp/test_pipeline_srcXXXXXX";
+    char dst_path[] = "/tmp/test_pipeline_dstXXXXXX";
+    int src = mkstemp(src_path);
+    int dst = mkstemp(dst_path);
+    ASSERT_GE(src, 0);
+    ASSERT_GE(dst, 0);
+    ASSERT_EQ(write(src, "file data", 9), 9);
+    lseek(src, 0, SEEK_SET);
+
+    EXPECT_EQ(splice_all(src, dst), 9);
+    lseek(dst, 0, SEEK_SET);
+    EXPECT_EQ(read_all(dst), "file data");
+
+    close(src);
+    close(dst);
+    unlink(src_path);
+    unlink(dst_path);
+}
+
+TEST(PipelineExecTest, TeeSpliceTest) {
+    Pipeline p;
+    ASSERT_TRUE(parse_pipeline("seq 1 20000", p));
+
+    int out[2], main_out[2];
+    ASSERT_EQ(pipe2(out, O_CLOEXEC), 0);
+    ASSERT_EQ(pipe2(main_out, O_CLOEXEC), 0);
+    char tap_path[] = "/tmp/test_pipeline_tapXXXXXX";
+    int tap = mkstemp(tap_path);
+    ASSERT_GE(tap, 0);
+
+    std::vector<pid_t> pids = spawn_pipeline(p, -1, out[1]);
+    close(out[1]);
+
+    // 主输出由另一个进程读取，避免管道写满阻塞
+    Pipeline reader;
+    ASSERT_TRUE(parse_pipeline("wc -l", reader));
+    int count[2];
+    ASSERT_EQ(pipe2(count, O_CLOEXEC), 0);
+    std::vector<pid_t> reader_pids = spawn_pipeline(reader, main_out[0], count[1]);
+    close(main_out[0]);
+    close(count[1]);
+
+    long long moved = tee_splice_all(out[0], main_out[1], tap);
+    close(main_out[1]);
+    close(out[0]);
+    wait_pipeline(pids);
+
+    EXPECT_EQ(std::stoi(read_all(count[0])), 20000);
+    wait_pipeline(reader_pids);
+    close(count[0]);
+
+    EXPECT_EQ(lseek(tap, 0, SEEK_END), moved);
+    EXPECT_GT(moved, 0);
+    close(tap);
+    unlink(tap_path);
+}
+#endif
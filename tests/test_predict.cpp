@@ -0,0 +1,243 @@
+#include <gtest/gtest.h>
+#include "predict.h"
+#include "screen.h"
+#include <string>
+#include <thread>
+#include <chrono>
+
+#ifdef __linux__
+#include "slowlink.h"
+#include "pseudoterm.h"
+#include <csignal>
+#include <poll.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#endif
+
+// 用户终端：预测回显的输出送入屏幕模型
+class PredictiveEchoTest : public ::testing::Test {
+protected:
+    PredictiveEcho echo{24, 80, PredictMode::ALWAYS};
+    Screen terminal{24, 80};
+
+    std::string type(const std::string& keys) {
+        std::string out;
+        echo.keystroke(keys.data(), keys.size(), out);
+        terminal.feed(out);
+        return out;
+    }
+
+    void receive(const std::string& data) {
+        std::string out;
+        echo.server_output(data.data(), data.size(), out);
+        terminal.feed(out);
+    }
+
+    bool underlined(unsigned col) const {
+        return terminal.cell(terminal.cursor_row(), col).attrs & Screen::UNDERLINE;
+    }
+};
+
+// 按键立即以下划线显示，shell的回显到达后逐个确认
+TEST_F(PredictiveEchoTest, ConfirmTest) {
+    receive("$ ");
+    type("ls");
+    EXPECT_EQ(terminal.row_text(0), "$ ls");
+    EXPECT_EQ(terminal.cursor_col(), 4u);
+    EXPECT_TRUE(underlined(2));
+    EXPECT_TRUE(echo.pending());
+
+    receive("l");
+    EXPECT_EQ(terminal.row_text(0), "$ ls");
+    EXPECT_FALSE(underlined(2));
+    EXPECT_TRUE(underlined(3));
+    EXPECT_EQ(echo.confirmed(), 1u);
+
+    receive("s");
+    EXPECT_EQ(terminal.row_text(0), "$ ls");
+    EXPECT_FALSE(underlined(3));
+    EXPECT_EQ(terminal.cursor_col(), 4u);
+    EXPECT_FALSE(echo.pending());
+    EXPECT_EQ(echo.confirmed(), 2u);
+    EXPECT_GE(echo.rtt_ms(), 0);
+}
+
+// 行中插入时行尾右移，shell用ICH回显后确认
+TEST_F(PredictiveEchoTest, InsertTest) {
+    receive("$ ac\b");
+    type("b");
+    EXPECT_EQ(terminal.row_text(0), "$ abc");
+    EXPECT_EQ(terminal.cursor_col(), 4u);
+    EXPECT_TRUE(underlined(3));
+
+    receive("\033[@b");
+    EXPECT_EQ(terminal.row_text(0), "$ abc");
+    EXPECT_FALSE(underlined(3));
+    EXPECT_FALSE(echo.pending());
+}
+
+// 退格和左移不越过本行第一次按键时光标所在的列（提示符）
+TEST_F(PredictiveEchoTest, BackspaceTest) {
+    receive("$ ");
+    type("abc");
+    receive("abc");
+    type("\b");
+    EXPECT_EQ(terminal.row_text(0), "$ ab");
+    EXPECT_EQ(terminal.cursor_col(), 4u);
+    type("\033[D");
+    EXPECT_EQ(terminal.cursor_col(), 3u);
+    type("\b\b\b");
+    EXPECT_EQ(terminal.row_text(0), "$ b");
+    EXPECT_EQ(terminal.cursor_col(), 2u);
+
+    // shell的回显与预测一致
+    receive("\b \b\b\b\033[P");
+    EXPECT_FALSE(echo.pending());
+    EXPECT_EQ(terminal.row_text(0), "$ b");
+}
+
+// 宽字符占两列：右移整个跳过，插入时整个右移，退格整个删除
+TEST_F(PredictiveEchoTest, WideCharTest) {
+    receive("$ 中文\r\033[3G");
+    type("\033[C");
+    EXPECT_EQ(terminal.cursor_col(), 4u);
+    type("a");
+    EXPECT_EQ(terminal.row_text(0), "$ 中a文");
+    EXPECT_EQ(terminal.cursor_col(), 5u);
+    type("\b\b");
+    EXPECT_EQ(terminal.row_text(0), "$ 文");
+    EXPECT_EQ(terminal.cursor_col(), 2u);
+
+    // shell的回显与预测一致
+    receive("\033[2C\033[@a\b\033[P\b\b\033[2P");
+    EXPECT_FALSE(echo.pending());
+    EXPECT_EQ(terminal.row_text(0), "$ 文");
+    EXPECT_EQ(terminal.cursor_col(), 2u);
+}
+
+// shell没有回显（如输入密码），超时后撤下预测
+TEST_F(PredictiveEchoTest, RollbackTest) {
+    receive("$ ");
+    type("a");
+    receive("a");
+    ASSERT_FALSE(echo.pending());
+
+    receive("\r\nPassword: ");
+    type("secret");
+    EXPECT_EQ(terminal.row_text(1), "Password: secret");
+    std::this_thread::sleep_for(std::chrono::milliseconds(600));
+    std::string out;
+    echo.tick(out);
+    terminal.feed(out);
+    EXPECT_EQ(terminal.row_text(1), "Password:");
+    EXPECT_EQ(terminal.cursor_col(), 10u);
+    EXPECT_EQ(echo.mispredicted(), 1u);
+    EXPECT_FALSE(echo.pending());
+}
+
+// shell的输出停在转义序列中间时不插入预测；回车之后暂停预测
+TEST_F(PredictiveEchoTest, UnpredictableTest) {
+    receive("$ \033[1");
+    EXPECT_TRUE(type("x").empty());
+    receive("mx");
+
+    PredictiveEcho other(24, 80, PredictMode::ALWAYS);
+    std::string out;
+    other.server_output("$ ", 2, out);
+    out.clear();
+    other.keystroke("ls\rpwd", 6, out);
+    Screen screen;
+    screen.feed("$ ");
+    screen.feed(out);
+    EXPECT_EQ(screen.row_text(0), "$ ls");
+    EXPECT_EQ(screen.row_text(1), "");
+}
+
+// 自适应模式：往返时间很短时不显示
+TEST(PredictModeTest, AdaptiveTest) {
+    PredictiveEcho echo(24, 80, PredictMode::ADAPTIVE);
+    std::string out;
+    echo.server_output("$ ", 2, out);
+    for (char c : std::string("abc")) {
+        out.clear();
+        echo.keystroke(&c, 1, out);
+        EXPECT_TRUE(out.empty());
+        echo.server_output(&c, 1, out);
+    }
+    EXPECT_EQ(echo.confirmed(), 3u);
+    EXPECT_LT(echo.rtt_ms(), 30);
+    EXPECT_FALSE(echo.showing());
+}
+
+#ifdef __linux__
+
+// 经注入延迟的链路连接shell：按键发出时即显示，最终画面与不预测时相同
+TEST(PredictiveRelayTest, LatencyTest) {
+    PredictiveEcho echo(24, 80, PredictMode::ALWAYS);
+    SlowLinkSession session({0, 100}, 24, 80, &echo);
+    SlowLinkSession plain({0, 100});
+    ASSERT_TRUE(session.ok());
+    ASSERT_TRUE(plain.ok());
+
+    for (SlowLinkSession* s : {&session, &plain}) {
+        s->send("echo hllo");
+        for (const char* key : {"\033[D", "\033[D", "\033[D", "e"}) s->send(key, 10);
+        ASSERT_TRUE(s->wait_idle());
+    }
+    LinkReport report = session.report();
+    EXPECT_EQ(report.predicted, report.keystrokes);
+    EXPECT_EQ(session.screen().text(), plain.screen().text());
+    EXPECT_EQ(session.screen().row_text(0), "$ echo hello");
+    EXPECT_EQ(session.screen().cursor_col(), plain.screen().cursor_col());
+    EXPECT_EQ(echo.mispredicted(), 0u);
+    EXPECT_GE(echo.rtt_ms(), 200);
+
+    // 回车不预测，命令输出之后画面仍一致
+    for (SlowLinkSession* s : {&session, &plain}) {
+        s->press("\r");
+        s->type("echo h", 10);
+        ASSERT_TRUE(s->wait_idle());
+    }
+    EXPECT_EQ(session.screen().text(), plain.screen().text());
+    EXPECT_FALSE(session.keystroke(report.keystrokes).predicted);
+}
+
+// 读取直到收到的内容包含expected，超时返回已收到的内容
+static std::string read_until(int fd, const std::string& expected) {
+    std::string received;
+    while (received.find(expected) == std::string::npos) {
+        struct pollfd pfd = {fd, POLLIN, 0};
+        if (poll(&pfd, 1, 3000) <= 0) break;
+        char buffer[4096];
+        ssize_t n = read(fd, buffer, sizeof(buffer));
+        if (n <= 0) break;
+        received.append(buffer, n);
+    }
+    return received;
+}
+
+// 客户端开始时清屏，终端大小变化后屏幕模型随之改变
+TEST(PredictiveClientTest, ClearAndResizeTest) {
+    int master, slave, input[2], link[2];
+    ASSERT_TRUE(open_pseudo_terminal(master, slave, true));
+    ASSERT_EQ(pipe(input), 0);
+    ASSERT_EQ(socketpair(AF_UNIX, SOCK_STREAM, 0, link), 0);
+    PredictiveEcho echo(24, 80, PredictMode::NEVER);
+    std::thread client([&] { run_predictive_client(input[0], slave, link[0], echo); });
+
+    EXPECT_EQ(read_until(master, "\033[2J").compare(0, 7, "\033[H\033[2J"), 0);
+    ASSERT_TRUE(set_terminal_size(slave, 30, 100));
+    pthread_kill(client.native_handle(), SIGWINCH);
+    ASSERT_EQ(write(link[1], "$ ls", 4), 4);
+    EXPECT_NE(read_until(master, "$ ls").find("$ ls"), std::string::npos);
+
+    close(link[1]);
+    client.join();
+    EXPECT_EQ(echo.screen().rows(), 30u);
+    EXPECT_EQ(echo.screen().cols(), 100u);
+    EXPECT_EQ(echo.screen().row_text(0), "$ ls");
+    for (int fd : {master, slave, input[0], input[1], link[0]}) close(fd);
+}
+
+#endif
@@ -0,0 +1,123 @@
+#include <gtest/gtest.h>
+#include "pseudoterm.h"
+#include <string>
+#include <thread>
+#ifdef __linux__
+#include <fcntl.h>
+#include <unistd.h>
+#include <termios.h>
+
+// 读出管道中的全部数据，直到写端关闭
+static std::string read_all(int fd) {
+    std::string data;
+    char buffer[4096];
+    ssize_t n;
+    while ((n = read(fd, buffer, sizeof(buffer))) > 0) {
+        data.append(buffer, n);
+    }
+    return data;
+}
+
+TEST(PseudoTerminalTest, OpenTest) {
+    int master, slave;
+    std::string name;
+    ASSERT_TRUE(open_pseudo_terminal(master, slave, false, &name));
+    EXPECT_EQ(name.compare(0, 9, "/dev/pts/"), 0);
+    EXPECT_TRUE(isatty(slave));
+    EXPECT_TRUE(fcntl(master, F_GETFL) & O_NONBLOCK);
+
+    // 供命令使用的从端保持规范模式
+    struct termios tio;
+    ASSERT_EQ(tcgetattr(slave, &tio), 0);
+    EXPECT_TRUE(tio.c_lflag & ICANON);
+    EXPECT_TRUE(tio.c_lflag & ECHO);
+    close(slave);
+    close(master);
+
+    ASSERT_TRUE(open_pseudo_terminal(master, slave, true));
+    ASSERT_EQ(tcgetattr(slave, &tio), 0);
+    EXPECT_FALSE(tio.c_lflag & ICANON);
+    EXPECT_FALSE(tio.c_lflag & ECHO);
+    close(slave);
+    close(master);
+}
+
+TEST(PseudoTerminalTest, WindowSizeTest) {
+    int master, slave;
+    ASSERT_TRUE(open_pseudo_terminal(master, slave, false));
+    unsigned short rows, cols;
+    ASSERT_TRUE(set_terminal_size(master, 40, 132));
+    ASSERT_TRUE(get_terminal_size(slave, rows, cols));
+    EXPECT_EQ(rows, 40);
+    EXPECT_EQ(cols, 132);
+
+    // 不是终端
+    int fds[2];
+    ASSERT_EQ(pipe(fds), 0);
+    EXPECT_FALSE(get_terminal_size(fds[0], rows, cols));
+    close(fds[0]);
+    close(fds[1]);
+    close(slave);
+    close(master);
+}
+
+TEST(PseudoTerminalTest, ForwardTest) {
+    int master, slave;
+    ASSERT_TRUE(open_pseudo_terminal(master, slave, true));
+    int out[2], tap[2];
+    ASSERT_EQ(pipe(out), 0);
+    ASSERT_EQ(pipe(tap), 0);
+
+    // 超过中间管道容量的输出分多批送出，两端都收到完整的数据
+    std::string data;
+    for (int i = 0; i < 200000; i++) data += "line " + std::to_string(i) + "\n";
+    std::thread writer([slave, &data]() {
+        const char* p = data.data();
+        size_t left = data.size();
+        while (left > 0) {
+            ssize_t n = write(slave, p, left);
+            if (n <= 0) break;
+            p += n;
+            left -= n;
+        }
+        close(slave);
+    });
+    std::string out_data, tap_data;
+    std::thread out_reader([&]() { out_data = read_all(out[0]); });
+    std::thread tap_reader([&]() { tap_data = read_all(tap[0]); });
+
+    EXPECT_EQ(forward_terminal(master, out[1], tap[1]), (long long)data.size());
+    close(out[1]);
+    close(tap[1]);
+    writer.join();
+    out_reader.join();
+    tap_reader.join();
+    EXPECT_TRUE(out_data == data);
+    EXPECT_TRUE(tap_data == data);
+    close(out[0]);
+    close(tap[0]);
+    close(master);
+}
+
+TEST(PseudoTerminalTest, ClosedOutputTest) {
+    int master, slave;
+    ASSERT_TRUE(open_pseudo_terminal(master, slave, false));
+    int out[2];
+    ASSERT_EQ(pipe(out), 0);
+    close(out[0]);
+
+    // 输出端已关闭时继续读空主端，写入从端的一方不会挂起
+    signal(SIGPIPE, SIG_IGN);
+    std::thread writer([slave]() {
+        std::string chunk(65536, 'x');
+        for (int i = 0; i < 32; i++) {
+            if (write(slave, chunk.data(), chunk.size()) <= 0) break;
+        }
+        close(slave);
+    });
+    EXPECT_GT(forward_terminal(master, out[1]), 0);
+    writer.join();
+    close(out[1]);
+    close(master);
+}
+#endif
@@ -0,0 +1,256 @@
+#include <gtest/gtest.h>
+#include "recording.h"
+#include <string>
+#include <vector>
+#include <thread>
+#include <chrono>
+#include <cstdio>
+#include <unistd.h>
+
+class RecordingTest : public ::testing::Test {
+protected:
+    std::string path;
+
+    void SetUp() override {
+        path = "/tmp/test_recording_" + std::to_string(getpid()) + ".rec";
+    }
+    void TearDown() override {
+        unlink(path.c_str());
+        unlink((path + ".cast").c_str());
+    }
+
+    static std::string read_file(const std::string& name) {
+        std::string content;
+        FILE* file = fopen(name.c_str(), "rb");
+        if (!file) return content;
+        char buffer[4096];
+        size_t n;
+        while ((n = fread(buffer, 1, sizeof(buffer), file)) > 0) content.append(buffer, n);
+        fclose(file);
+        return content;
+    }
+
+    // 带颜色、光标移动和清屏的输出，每块之间稍作停顿，使各块的时间不同
+    void record_session(SessionRecorder& recorder) {
+        for (int i = 0; i < 200; i++) {
+            std::string chunk = "\033[3" + std::to_string(i % 8) + "mline " + std::to_string(i) + "\033[0m\r\n";
+            if (i % 50 == 49) chunk += "\033[2J\033[H";
+            if (i % 7 == 0) chunk += "\033[5;10Hx";
+            recorder.write(chunk.data(), chunk.size());
+            if (i == 120) recorder.resize(10, 40);
+            if (i % 10 == 0) std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+    }
+
+    // 从头逐条重放到time_us，作为定位结果的参照
+    static void replay_to(SessionPlayer& player, uint64_t time_us, Screen& screen) {
+        screen.reset();
+        screen.resize(player.rows(), player.cols());
+        player.rewind();
+        SessionPlayer::Event event;
+        while (player.next(event) && event.time_us <= time_us) {
+            if (event.type == 'o') screen.feed(event.data);
+            else if (event.type == 'r') screen.resize(event.rows, event.cols);
+        }
+    }
+
+    static void expect_same(const Screen& expected, const Screen& actual, uint64_t time_us) {
+        ASSERT_EQ(expected.rows(), actual.rows()) << time_us;
+        ASSERT_EQ(expected.cols(), actual.cols()) << time_us;
+        for (unsigned row = 0; row < expected.rows(); row++) {
+            for (unsigned col = 0; col < expected.cols(); col++) {
+                ASSERT_TRUE(expected.cell(row, col) == actual.cell(row, col)) << time_us << " " << row << "," << col;
+            }
+        }
+        EXPECT_EQ(expected.cursor_row(), actual.cursor_row()) << time_us;
+        EXPECT_EQ(expected.cursor_col(), actual.cursor_col()) << time_us;
+        EXPECT_TRUE(expected.current_pen() == actual.current_pen()) << time_us;
+    }
+};
+
+// 顺序读出的输出与写入的完全相同，关键帧和大小变化单独成为记录
+TEST_F(RecordingTest, RoundTripTest) {
+    SessionRecorder recorder(24, 80);
+    recorder.set_keyframe_interval(500, 60000);
+    ASSERT_TRUE(recorder.open(path));
+    std::string written;
+    for (int i = 0; i < 100; i++) {
+        std::string chunk = "\033[1mrow\033[0m " + std::to_string(i) + "\r\n";
+        recorder.write(chunk.data(), chunk.size());
+        written += chunk;
+    }
+    recorder.resize(30, 100);
+    recorder.close();
+    EXPECT_EQ(recorder.bytes_recorded(), written.size());
+    EXPECT_GE(recorder.keyframe_count(), 2u);
+
+    SessionPlayer player;
+    ASSERT_TRUE(player.open(path));
+    EXPECT_EQ(player.rows(), 24u);
+    EXPECT_EQ(player.cols(), 80u);
+    EXPECT_EQ(player.keyframe_count(), recorder.keyframe_count());
+    EXPECT_GT(player.start_time(), 0u);
+    std::string output;
+    size_t keyframes = 0;
+    SessionPlayer::Event event;
+    uint64_t last_time = 0;
+    uint64_t resize_time = 0;
+    while (player.next(event)) {
+        EXPECT_GE(event.time_us, last_time);
+        last_time = event.time_us;
+        if (event.type == 'o') output += event.data;
+        if (event.type == 'r' && event.rows == 30 && event.cols == 100) resize_time = event.time_us;
+        if (event.type == 'k') {
+            keyframes++;
+            EXPECT_LE(event.frame_time_us, event.time_us);
+            EXPECT_LT(event.resume_offset, 1000000u);
+        }
+    }
+    EXPECT_EQ(output, written);
+    EXPECT_EQ(keyframes, player.keyframe_count());
+    // 时长到最后一次输出或大小变化为止，不含之后追加的关键帧
+    EXPECT_GT(resize_time, 0u);
+    EXPECT_EQ(player.duration_us(), resize_time);
+
+    // 不是录制文件
+    FILE* file = fopen(path.c_str(), "wb");
+    fputs("hello", file);
+    fclose(file);
+    EXPECT_FALSE(player.open(path));
+}
+
+// 定位到任意时刻的画面与从头重放到该时刻的相同，之后next从该时刻继续
+TEST_F(RecordingTest, SeekTest) {
+    SessionRecorder recorder(24, 80);
+    recorder.set_keyframe_interval(300, 60000);
+    ASSERT_TRUE(recorder.open(path));
+    record_session(recorder);
+    recorder.close();
+
+    SessionPlayer player;
+    ASSERT_TRUE(player.open(path));
+    ASSERT_GE(player.keyframe_count(), 10u);
+    std::vector<uint64_t> times = {0, player.duration_us() / 3, player.duration_us() / 2,
+                                   player.duration_us() * 9 / 10, player.duration_us(), player.duration_us() + 1000};
+    for (uint64_t t : times) {
+        Screen expected, actual;
+        replay_to(player, t, expected);
+        ASSERT_TRUE(player.seek(t, actual));
+        expect_same(expected, actual, t);
+        SessionPlayer::Event event;
+        if (player.next(event)) {
+            EXPECT_GT(event.time_us, t);
+        }
+    }
+
+    // 字节形式的结果送入空白屏幕得到同样的画面
+    uint64_t t = player.duration_us() / 2;
+    Screen expected, actual(24, 80);
+    ASSERT_TRUE(player.seek(t, expected));
+    std::string out;
+    ASSERT_TRUE(player.seek(t, out));
+    actual.feed(out);
+    expect_same(expected, actual, t);
+}
+
+// 没有正常关闭的录制没有索引，打开时扫描重建，截断的最后一条记录被丢弃
+TEST_F(RecordingTest, UnindexedTest) {
+    SessionRecorder recorder(24, 80);
+    recorder.set_keyframe_interval(300, 60000);
+    ASSERT_TRUE(recorder.open(path));
+    record_session(recorder);
+    recorder.close();
+
+    SessionPlayer player;
+    ASSERT_TRUE(player.open(path));
+    size_t keyframes = player.keyframe_count();
+    uint64_t t = player.duration_us() * 2 / 3;
+    Screen expected;
+    ASSERT_TRUE(player.seek(t, expected));
+    player.close();
+
+    // 去掉索引和最后一条记录的一部分
+    std::string content = read_file(path);
+    ASSERT_GT(content.size(), 12u);
+    uint64_t index_offset = 0;
+    for (int i = 0; i < 8; i++) index_offset |= (uint64_t)(uint8_t)content[content.size() - 12 + i] << (i * 8);
+    ASSERT_EQ(content[index_offset], 'i');
+    ASSERT_EQ(truncate(path.c_str(), index_offset - 3), 0);
+    ASSERT_TRUE(player.open(path));
+    // 最后一条记录可能是关闭时追加的关键帧
+    EXPECT_GE(player.keyframe_count() + 1, keyframes);
+    EXPECT_GT(player.keyframe_count(), 0u);
+    EXPECT_LT(player.duration_us(), 60000000u);
+    Screen actual;
+    ASSERT_TRUE(player.seek(t, actual));
+    expect_same(expected, actual, t);
+}
+
+// asciicast：控制字符转义，跨记录的UTF-8字符合并输出，关键帧不导出
+TEST_F(RecordingTest, AsciicastTest) {
+    SessionRecorder recorder(24, 80);
+    recorder.set_keyframe_interval(1, 60000);
+    ASSERT_TRUE(recorder.open(path));
+    recorder.write("\033[1m\"hi\"\\", 9);
+    recorder.write("\xe4\xb8", 2);
+    recorder.write("\xad\r\n", 3);
+    recorder.resize(30, 100);
+    recorder.close();
+
+    SessionPlayer player;
+    ASSERT_TRUE(player.open(path));
+    ASSERT_TRUE(player.export_asciicast(path + ".cast"));
+    std::string cast = read_file(path + ".cast");
+    std::vector<std::string> lines;
+    for (size_t pos = 0, end; (end = cast.find('\n', pos)) != std::string::npos; pos = end + 1) {
+        lines.push_back(cast.substr(pos, end - pos));
+    }
+    ASSERT_EQ(lines.size(), 4u) << cast;
+    EXPECT_EQ(lines[0].find("{\"version\": 2, \"width\": 80, \"height\": 24, \"timestamp\": "), 0u);
+    EXPECT_NE(lines[1].find(", \"o\", \"\\u001b[1m\\\"hi\\\"\\\\\"]"), std::string::npos) << lines[1];
+    EXPECT_NE(lines[2].find(", \"o\", \"\xe4\xb8\xad\\u000d\\u000a\"]"), std::string::npos) << lines[2];
+    EXPECT_NE(lines[3].find(", \"r\", \"100x30\"]"), std::string::npos) << lines[3];
+}
+
+// 记录由写入线程写入文件，不调用flush也很快可以读到
+TEST_F(RecordingTest, WriterTest) {
+    SessionRecorder recorder(24, 80);
+    ASSERT_TRUE(recorder.open(path));
+    size_t header = read_file(path).size();
+    recorder.write("hello", 5);
+    for (int i = 0; i < 100 && read_file(path).size() == header; i++) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    std::string content = read_file(path);
+    EXPECT_GT(content.size(), header + 5);
+    EXPECT_NE(content.find("hello"), std::string::npos);
+    recorder.close();
+}
+
+#ifdef __linux__
+// 写入旁路的输出由录制线程记录
+TEST_F(RecordingTest, TapTest) {
+    SessionRecorder recorder(24, 80);
+    ASSERT_TRUE(recorder.open(path));
+    int fd = recorder.tap_fd();
+    ASSERT_GE(fd, 0);
+    EXPECT_EQ(recorder.tap_fd(), fd);
+    std::string written;
+    for (int i = 0; i < 1000; i++) {
+        std::string line = "output line " + std::to_string(i) + "\r\n";
+        ASSERT_EQ(write(fd, line.data(), line.size()), (ssize_t)line.size());
+        written += line;
+    }
+    recorder.close();
+    EXPECT_EQ(recorder.bytes_recorded(), written.size());
+
+    SessionPlayer player;
+    ASSERT_TRUE(player.open(path));
+    std::string output;
+    SessionPlayer::Event event;
+    while (player.next(event)) {
+        if (event.type == 'o') output += event.data;
+    }
+    EXPECT_EQ(output, written);
+}
+#endif
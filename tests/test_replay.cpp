@@ -0,0 +1,123 @@
+#include <gtest/gtest.h>
+#include "replay.h"
+#include <string>
+#include <thread>
+#include <chrono>
+#include <cstdio>
+#include <unistd.h>
+
+class ReplayTest : public ::testing::Test {
+protected:
+    std::string path;
+
+    void SetUp() override {
+        path = "/tmp/test_replay_" + std::to_string(getpid()) + ".rec";
+    }
+    void TearDown() override {
+        unlink(path.c_str());
+    }
+
+    static std::string read_file(const std::string& name) {
+        std::string content;
+        FILE* file = fopen(name.c_str(), "rb");
+        if (!file) return content;
+        char buffer[4096];
+        size_t n;
+        while ((n = fread(buffer, 1, sizeof(buffer), file)) > 0) content.append(buffer, n);
+        fclose(file);
+        return content;
+    }
+};
+
+// 录制器写出的文件可以读回，间隔按微秒记录
+TEST_F(ReplayTest, RecorderTest) {
+    InputRecorder recorder;
+    ASSERT_TRUE(recorder.open(path));
+    recorder.record("l", 1);
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    recorder.record("\033[A", 3);
+    recorder.close();
+
+    InputRecording recording;
+    ASSERT_TRUE(recording.load(path));
+    ASSERT_EQ(recording.size(), 2u);
+    EXPECT_EQ(std::string(recording.bytes(recording.event(0)), recording.event(0).length), "l");
+    EXPECT_EQ(std::string(recording.bytes(recording.event(1)), recording.event(1).length), "\033[A");
+    EXPECT_GE(recording.event(1).delay_us, 20000u);
+    EXPECT_LT(recording.event(1).delay_us, 1000000u);
+    EXPECT_EQ(recording.total_bytes(), 4u);
+}
+
+// 按键事件很紧凑；截断的最后一个事件被丢弃
+TEST_F(ReplayTest, FormatTest) {
+    InputRecording recording;
+    recording.append(100, "l");
+    recording.append(10000, "\033[A");
+    ASSERT_TRUE(recording.save(path));
+    // 文件头5字节，"l"事件1+1+1字节，方向键事件2+1+3字节
+    EXPECT_EQ(read_file(path).size(), 5u + 3 + 6);
+
+    InputRecording copy;
+    ASSERT_TRUE(copy.load(path));
+    ASSERT_EQ(copy.size(), 2u);
+    EXPECT_EQ(copy.duration_us(), 10100u);
+    ASSERT_EQ(truncate(path.c_str(), 5 + 3 + 4), 0);
+    ASSERT_TRUE(copy.load(path));
+    EXPECT_EQ(copy.size(), 1u);
+
+    // 不是录制文件
+    FILE* file = fopen(path.c_str(), "wb");
+    fputs("hello", file);
+    fclose(file);
+    EXPECT_FALSE(copy.load(path));
+}
+
+// 最快回放：shell处理全部按键，命令执行完成，输出复制到sink
+TEST_F(ReplayTest, MaxSpeedTest) {
+    InputRecording recording;
+    for (char c : std::string("echo hello")) recording.append(1000, &c, 1);
+    for (int i = 0; i < 5; i++) recording.append(1000, "\033[D");
+    recording.append(1000, "\b");
+    recording.append(1000, "\r");
+
+    FILE* sink = tmpfile();
+    ReplayOptions options;
+    options.speed = 0;
+    options.sink_fd = fileno(sink);
+    ReplayReport report = replay_input(recording, options);
+    EXPECT_TRUE(report.completed);
+    EXPECT_EQ(report.keystrokes, 17u);
+    EXPECT_EQ(report.input_bytes, 27u);
+    EXPECT_LT(report.seconds, recording.duration_us() / 1e6);
+    EXPECT_GT(report.keystrokes_per_second(), 0);
+
+    fflush(sink);
+    std::string output;
+    char buffer[4096];
+    rewind(sink);
+    size_t n;
+    while ((n = fread(buffer, 1, sizeof(buffer), sink)) > 0) output.append(buffer, n);
+    fclose(sink);
+    EXPECT_NE(output.find("echohello"), std::string::npos);
+    EXPECT_NE(output.find("\nechohello"), std::string::npos);
+    EXPECT_EQ(report.output_bytes, output.size());
+    EXPECT_GT(report.output_bytes_per_keystroke(), 1.0);
+}
+
+// 按录制的间隔回放，倍速按比例缩短
+TEST_F(ReplayTest, SpeedTest) {
+    InputRecording recording;
+    recording.append(0, "a");
+    recording.append(200000, "b");
+    recording.append(100000, "\b\b");
+
+    ReplayReport report = replay_input(recording);
+    EXPECT_TRUE(report.completed);
+    EXPECT_GE(report.seconds, 0.3);
+
+    ReplayOptions fast;
+    fast.speed = 10;
+    report = replay_input(recording, fast);
+    EXPECT_GE(report.seconds, 0.03);
+    EXPECT_LT(report.seconds, 0.3);
+}
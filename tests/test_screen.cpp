@@ -0,0 +1,240 @@
+#include <gtest/gtest.h>
+#include "screen.h"
+#include <string>
+
+TEST(ScreenTest, PrintAndWrapTest) {
+    Screen screen(3, 10);
+    screen.feed("hello");
+    EXPECT_EQ(screen.row_text(0), "hello");
+    EXPECT_EQ(screen.cursor_col(), 5u);
+
+    // 写满最后一列后光标停在该列，下一个字符才换行
+    screen.feed("world");
+    EXPECT_EQ(screen.row_text(0), "helloworld");
+    EXPECT_EQ(screen.cursor_row(), 0u);
+    EXPECT_EQ(screen.cursor_col(), 9u);
+    screen.feed("!");
+    EXPECT_EQ(screen.row_text(1), "!");
+    EXPECT_EQ(screen.cursor_row(), 1u);
+
+    // 关闭自动换行后多出的字符覆盖最后一列
+    screen.feed("\r\n\033[?7labcdefghijklm");
+    EXPECT_EQ(screen.row_text(2), "abcdefghim");
+}
+
+TEST(ScreenTest, ScrollTest) {
+    Screen screen(3, 10);
+    screen.feed("1\r\n2\r\n3\r\n4");
+    EXPECT_EQ(screen.text(), "2\n3\n4\n");
+
+    // 滚动区域内的换行只滚动区域
+    screen.reset();
+    screen.feed("top\r\nmid\r\nbot\033[1;2r\033[2;1H\nnew");
+    EXPECT_EQ(screen.text(), "mid\nnew\nbot\n");
+
+    // 反向换行在区域顶部向下滚动
+    screen.feed("\033[1;1H\033Mins");
+    EXPECT_EQ(screen.text(), "ins\nmid\nbot\n");
+
+    // SU/SD
+    screen.feed("\033[r\033[S");
+    EXPECT_EQ(screen.text(), "mid\nbot\n\n");
+    screen.feed("\033[2T");
+    EXPECT_EQ(screen.text(), "\n\nmid\n");
+}
+
+TEST(ScreenTest, CursorMovementTest) {
+    Screen screen(5, 20);
+    screen.feed("\033[3;4H");
+    EXPECT_EQ(screen.cursor_row(), 2u);
+    EXPECT_EQ(screen.cursor_col(), 3u);
+    screen.feed("\033[A\033[2C");
+    EXPECT_EQ(screen.cursor_row(), 1u);
+    EXPECT_EQ(screen.cursor_col(), 5u);
+    // 越界时停在边上
+    screen.feed("\033[99A\033[99D");
+    EXPECT_EQ(screen.cursor_row(), 0u);
+    EXPECT_EQ(screen.cursor_col(), 0u);
+    screen.feed("\033[99;99H");
+    EXPECT_EQ(screen.cursor_row(), 4u);
+    EXPECT_EQ(screen.cursor_col(), 19u);
+    screen.feed("\033[2G\033[3d");
+    EXPECT_EQ(screen.cursor_row(), 2u);
+    EXPECT_EQ(screen.cursor_col(), 1u);
+
+    // 制表位、退格、保存和恢复光标
+    screen.feed("\r\tx\b\b");
+    EXPECT_EQ(screen.cursor_col(), 7u);
+    screen.feed("\0337\033[5;5H\0338");
+    EXPECT_EQ(screen.cursor_row(), 2u);
+    EXPECT_EQ(screen.cursor_col(), 7u);
+
+    // 原点模式下定位相对滚动区域
+    screen.feed("\033[2;4r\033[?6h\033[1;1H");
+    EXPECT_EQ(screen.cursor_row(), 1u);
+    screen.feed("\033[9;1H");
+    EXPECT_EQ(screen.cursor_row(), 3u);
+}
+
+TEST(ScreenTest, EraseTest) {
+    Screen screen(3, 10);
+    screen.feed("aaaaaaaaaa\r\nbbbbbbbbbb\r\ncccccccccc");
+    screen.feed("\033[2;5H\033[K");
+    EXPECT_EQ(screen.row_text(1), "bbbb");
+    screen.feed("\033[1K");
+    EXPECT_EQ(screen.row_text(1), "");
+    screen.feed("\033[1;3H\033[0J");
+    EXPECT_EQ(screen.text(), "aa\n\n\n");
+
+    screen.feed("\033[1;1Hxyz\033[1;2H\033[X");
+    EXPECT_EQ(screen.row_text(0), "x z");
+    screen.feed("\033[2J");
+    EXPECT_EQ(screen.text(), "\n\n\n");
+}
+
+TEST(ScreenTest, InsertDeleteTest) {
+    Screen screen(4, 10);
+    screen.feed("abcdef\033[1;3H\033[2@");
+    EXPECT_EQ(screen.row_text(0), "ab  cdef");
+    screen.feed("\033[3P");
+    EXPECT_EQ(screen.row_text(0), "abdef");
+
+    // 插入模式
+    screen.feed("\033[4hXY\033[4l");
+    EXPECT_EQ(screen.row_text(0), "abXYdef");
+
+    // 插入和删除行
+    screen.reset();
+    screen.feed("1\r\n2\r\n3\r\n4\033[2;1H\033[L");
+    EXPECT_EQ(screen.text(), "1\n\n2\n3\n");
+    screen.feed("\033[2M");
+    EXPECT_EQ(screen.text(), "1\n3\n\n\n");
+}
+
+TEST(ScreenTest, AttributeTest) {
+    Screen screen(2, 10);
+    screen.feed("\033[1;31mR\033[0m\033[4;48;5;200mU\033[38;2;255;0;0mT\033[mN");
+    EXPECT_EQ(screen.cell(0, 0).attrs, Screen::BOLD | Screen::FG_COLOR);
+    EXPECT_EQ(screen.cell(0, 0).fg, 1);
+    EXPECT_EQ(screen.cell(0, 1).attrs, Screen::UNDERLINE | Screen::BG_COLOR);
+    EXPECT_EQ(screen.cell(0, 1).bg, 200);
+    EXPECT_EQ(screen.cell(0, 2).fg, 196);
+    EXPECT_EQ(screen.cell(0, 3).attrs, 0);
+
+    // 擦除后的空白保留背景色
+    screen.feed("\033[44m\033[2;1H\033[K");
+    EXPECT_EQ(screen.cell(1, 5).bg, 4);
+    EXPECT_EQ(screen.cell(1, 5).attrs, Screen::BG_COLOR);
+}
+
+TEST(ScreenTest, CharsetTest) {
+    Screen screen(2, 10);
+    // DEC画线字符集
+    screen.feed("\033(0lqqk\033(Bq");
+    EXPECT_EQ(screen.row_text(0), "┌──┐q");
+    // SO切换到G1
+    screen.feed("\033)0\x0ex\x0fx");
+    EXPECT_EQ(screen.row_text(0), "┌──┐q│x");
+
+    // UTF-8，可以跨调用
+    screen.feed("\r\n\xe4\xb8");
+    screen.feed("\xad\xc3\xa9");
+    EXPECT_EQ(screen.row_text(1), "中é");
+    EXPECT_EQ(screen.cell(1, 0).ch, 0x4e2du);
+}
+
+TEST(ScreenTest, WideCharTest) {
+    Screen screen(2, 6);
+    // 宽字符占两格，右边的格子为WIDE_TAIL
+    screen.feed("a\xe4\xb8\xad" "b");
+    EXPECT_EQ(screen.cell(0, 1).ch, 0x4e2du);
+    EXPECT_EQ(screen.cell(0, 2).ch, Screen::WIDE_TAIL);
+    EXPECT_EQ(screen.cursor_col(), 4u);
+    EXPECT_EQ(screen.row_text(0), "a中b");
+
+    // 覆盖右半边时左半边变为空格
+    screen.feed("\033[3Gx");
+    EXPECT_EQ(screen.row_text(0), "a xb");
+
+    // 最后一列放不下时写到下一行
+    screen.feed("\033[1;6H\xe6\x96\x87");
+    EXPECT_EQ(screen.row_text(1), "文");
+    EXPECT_EQ(screen.cursor_row(), 1u);
+    EXPECT_EQ(screen.cursor_col(), 2u);
+
+    // 组合字符不占格子
+    screen.feed("e\xcc\x81");
+    EXPECT_EQ(screen.row_text(1), "文e");
+    EXPECT_EQ(screen.cursor_col(), 3u);
+
+    // 插入模式整个右移，删除一半时整个字符变为空格
+    screen.feed("\r\033[4hz\033[4l");
+    EXPECT_EQ(screen.row_text(1), "z文e");
+    screen.feed("\033[P");
+    EXPECT_EQ(screen.row_text(1), "z e");
+}
+
+TEST(ScreenTest, SequenceSplitTest) {
+    // 转义序列在任意位置断开，结果相同
+    std::string stream = "ab\033[1;32mcd\033]0;title\007ef\033[2;3Hgh\033[?25l";
+    Screen whole(3, 10);
+    whole.feed(stream);
+    for (size_t split = 1; split < stream.size(); split++) {
+        Screen parts(3, 10);
+        parts.feed(stream.substr(0, split));
+        parts.feed(stream.substr(split));
+        ASSERT_EQ(parts.text(), whole.text()) << split;
+        ASSERT_EQ(parts.cell(0, 2).attrs, whole.cell(0, 2).attrs) << split;
+    }
+    EXPECT_EQ(whole.text(), "abcdef\n  gh\n\n");
+    EXPECT_FALSE(whole.cursor_visible());
+}
+
+TEST(ScreenTest, AlternateScreenTest) {
+    Screen screen(2, 10);
+    screen.feed("shell$ ");
+    screen.feed("\033[?1049h");
+    EXPECT_TRUE(screen.alternate_screen());
+    EXPECT_EQ(screen.text(), "\n\n");
+    screen.feed("\033[1;1Hvi");
+    screen.feed("\033[?1049l");
+    EXPECT_FALSE(screen.alternate_screen());
+    EXPECT_EQ(screen.text(), "shell$\n\n");
+    EXPECT_EQ(screen.cursor_col(), 7u);
+}
+
+TEST(ScreenTest, DirtyRowsTest) {
+    Screen screen(4, 10);
+    EXPECT_TRUE(screen.any_dirty());
+    screen.clear_dirty();
+    EXPECT_FALSE(screen.any_dirty());
+
+    screen.feed("\033[3;1Hx");
+    EXPECT_FALSE(screen.row_dirty(0));
+    EXPECT_TRUE(screen.row_dirty(2));
+    screen.clear_dirty();
+
+    // 只移动光标不置脏
+    screen.feed("\033[1;1H\033[5C");
+    EXPECT_FALSE(screen.any_dirty());
+
+    // 滚动使区域内全部行变脏
+    screen.feed("\033[2;3r\033[3;1H\n");
+    EXPECT_FALSE(screen.row_dirty(0));
+    EXPECT_TRUE(screen.row_dirty(1));
+    EXPECT_TRUE(screen.row_dirty(2));
+    EXPECT_FALSE(screen.row_dirty(3));
+}
+
+TEST(ScreenTest, ResizeTest) {
+    Screen screen(3, 10);
+    screen.feed("0123456789\r\nabc\r\nxyz");
+    screen.resize(2, 5);
+    EXPECT_EQ(screen.text(), "01234\nabc\n");
+    EXPECT_EQ(screen.cursor_row(), 1u);
+    EXPECT_EQ(screen.cursor_col(), 3u);
+    screen.resize(4, 12);
+    EXPECT_EQ(screen.text(), "01234\nabc\n\n\n");
+    screen.feed("\033[4;1Hend");
+    EXPECT_EQ(screen.row_text(3), "end");
+}
@@ -0,0 +1,139 @@
+#include <gtest/gtest.h>
+#include "scrollback.h"
+#include "screen.h"
+#include <string>
+
+TEST(ScrollbackTest, AppendTest) {
+    Scrollback scrollback;
+    scrollback.append("plain");
+    scrollback.append("two\nlines", {{3, 1, 0, Screen::FG_COLOR | Screen::BOLD}});
+    EXPECT_EQ(scrollback.begin(), 0u);
+    EXPECT_EQ(scrollback.end(), 2u);
+
+    ScrollbackLine line;
+    ASSERT_TRUE(scrollback.line(0, line));
+    EXPECT_EQ(line.text, "plain");
+    EXPECT_TRUE(line.runs.empty());
+
+    // 文本中的换行被替换为空格
+    ASSERT_TRUE(scrollback.line(1, line));
+    EXPECT_EQ(line.text, "two lines");
+    ASSERT_EQ(line.runs.size(), 1u);
+    EXPECT_EQ(line.runs[0].length, 3u);
+    EXPECT_EQ(line.runs[0].fg, 1);
+    EXPECT_EQ(line.runs[0].attrs, Screen::FG_COLOR | Screen::BOLD);
+
+    EXPECT_FALSE(scrollback.line(2, line));
+    EXPECT_EQ(scrollback.text(2), "");
+}
+
+TEST(ScrollbackTest, RandomAccessTest) {
+    Scrollback scrollback(1 << 24, 4096);
+    for (int i = 0; i < 10000; i++) {
+        std::vector<ScrollbackRun> runs;
+        if (i % 3 == 0) runs.push_back({(uint32_t)(i % 7 + 1), (uint8_t)(i % 256), 0, Screen::FG_COLOR});
+        scrollback.append("line " + std::to_string(i), runs);
+    }
+    EXPECT_EQ(scrollback.size(), 10000u);
+
+    // 跨块的随机访问，文本和属性都对应到正确的行
+    for (int i : {0, 1, 4999, 123, 9999, 5000, 77}) {
+        ScrollbackLine line;
+        ASSERT_TRUE(scrollback.line(i, line)) << i;
+        EXPECT_EQ(line.text, "line " + std::to_string(i));
+        if (i % 3 == 0) {
+            ASSERT_EQ(line.runs.size(), 1u) << i;
+            EXPECT_EQ(line.runs[0].length, (uint32_t)(i % 7 + 1));
+            EXPECT_EQ(line.runs[0].fg, i % 256);
+        } else {
+            EXPECT_TRUE(line.runs.empty()) << i;
+        }
+    }
+}
+
+TEST(ScrollbackTest, EvictionTest) {
+    const size_t cap = 64 * 1024;
+    Scrollback scrollback(cap, 4096);
+    std::string noise;
+    unsigned seed = 1;
+    for (int i = 0; i < 20000; i++) {
+        // 伪随机内容，压缩不了多少
+        noise.clear();
+        for (int j = 0; j < 60; j++) {
+            seed = seed * 1103515245 + 12345;
+            noise += (char)('!' + (seed >> 16) % 90);
+        }
+        scrollback.append(noise);
+        ASSERT_LE(scrollback.memory_usage(), cap);
+    }
+    EXPECT_GT(scrollback.begin(), 0u);
+    EXPECT_EQ(scrollback.end(), 20000u);
+    EXPECT_LT(scrollback.size(), 20000u);
+
+    // 淘汰的行不能访问，最新的行还在
+    ScrollbackLine line;
+    EXPECT_FALSE(scrollback.line(0, line));
+    EXPECT_EQ(scrollback.text(19999), noise);
+    EXPECT_EQ(scrollback.text(scrollback.begin()).size(), 60u);
+}
+
+TEST(ScrollbackTest, SearchTest) {
+    Scrollback scrollback(1 << 24, 4096);
+    for (int i = 0; i < 5000; i++) {
+        scrollback.append(i % 1000 == 7 ? "error: x error" : "ok " + std::to_string(i));
+    }
+    // 从新到旧，同一行内也从后向前
+    auto matches = scrollback.search("error");
+    ASSERT_EQ(matches.size(), 10u);
+    EXPECT_EQ(matches[0].line, 4007u);
+    EXPECT_EQ(matches[0].offset, 9u);
+    EXPECT_EQ(matches[1].line, 4007u);
+    EXPECT_EQ(matches[1].offset, 0u);
+    EXPECT_EQ(matches[9].line, 7u);
+
+    matches = scrollback.search("error", 3);
+    ASSERT_EQ(matches.size(), 3u);
+    EXPECT_EQ(matches[2].line, 3007u);
+
+    matches = scrollback.search("ok 4999");
+    ASSERT_EQ(matches.size(), 1u);
+    EXPECT_EQ(matches[0].line, 4999u);
+
+    // 不跨行匹配
+    EXPECT_TRUE(scrollback.search("1\nok").empty());
+    EXPECT_TRUE(scrollback.search("").empty());
+    EXPECT_TRUE(scrollback.search("missing").empty());
+}
+
+TEST(ScrollbackTest, CompressionTest) {
+    Scrollback scrollback(1 << 24);
+    for (int i = 0; i < 20000; i++) {
+        scrollback.append("[ " + std::to_string(i % 100) + "%] Building CXX object src/module_" +
+                          std::to_string(i) + ".cpp.o");
+    }
+    // 典型的构建输出压缩到原始大小的三分之一以下
+    EXPECT_LT(scrollback.memory_usage() * 3, scrollback.raw_bytes());
+    EXPECT_EQ(scrollback.text(12345), "[ 45%] Building CXX object src/module_12345.cpp.o");
+}
+
+TEST(ScrollbackTest, ScreenTest) {
+    Scrollback scrollback;
+    Screen screen(3, 20);
+    screen.set_scrollback(&scrollback);
+    screen.feed("one\r\n\033[1;31mtwo\033[m red\r\nthree\r\nfour\r\nfive");
+    ASSERT_EQ(scrollback.size(), 2u);
+    EXPECT_EQ(scrollback.text(0), "one");
+
+    ScrollbackLine line;
+    ASSERT_TRUE(scrollback.line(1, line));
+    EXPECT_EQ(line.text, "two red");
+    ASSERT_EQ(line.runs.size(), 1u);
+    EXPECT_EQ(line.runs[0].length, 3u);
+    EXPECT_EQ(line.runs[0].fg, 1);
+    EXPECT_EQ(line.runs[0].attrs, Screen::BOLD | Screen::FG_COLOR);
+
+    // 备用屏幕和滚动区域内的滚动不进入回滚缓冲区
+    screen.feed("\033[?1049h\r\na\r\nb\r\nc\r\nd\033[?1049l");
+    screen.feed("\033[2;3r\033[3;1H\r\nx\r\ny\033[r");
+    EXPECT_EQ(scrollback.size(), 2u);
+}
@@ -0,0 +1,262 @@
+#include <gtest/gtest.h>
+#include "server.h"
+#include <string>
+#include <vector>
+#include <chrono>
+#include <thread>
+
+#ifdef __linux__
+#include <poll.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+class ServerTest : public ::testing::Test {
+protected:
+    std::string path;
+
+    void SetUp() override {
+        path = "/tmp/test_server_" + std::to_string(getpid()) + ".sock";
+    }
+
+    int connect_client() {
+        int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        struct sockaddr_un addr = {};
+        addr.sun_family = AF_UNIX;
+        path.copy(addr.sun_path, path.length());
+        if (connect(fd, (struct sockaddr*)&addr, sizeof(addr)) != 0) {
+            close(fd);
+            return -1;
+        }
+        return fd;
+    }
+
+    // 读取直到收到的内容包含expected，超时返回已收到的内容
+    static std::string read_until(int fd, const std::string& expected, int timeout_ms = 3000) {
+        std::string received;
+        auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeout_ms);
+        while (received.find(expected) == std::string::npos) {
+            int left = std::chrono::duration_cast<std::chrono::milliseconds>(
+                deadline - std::chrono::steady_clock::now()).count();
+            struct pollfd pfd = {fd, POLLIN, 0};
+            if (left <= 0 || poll(&pfd, 1, left) <= 0) break;
+            char buffer[4096];
+            ssize_t n = read(fd, buffer, sizeof(buffer));
+            if (n <= 0) break;
+            received.append(buffer, n);
+        }
+        return received;
+    }
+
+    static void send_text(int fd, const std::string& text) {
+        ASSERT_EQ(write(fd, text.data(), text.size()), (ssize_t)text.size());
+    }
+
+    static bool wait_sessions(const ShellServer& server, size_t count) {
+        for (int i = 0; i < 300 && server.session_count() != count; i++) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        }
+        return server.session_count() == count;
+    }
+};
+
+TEST_F(ServerTest, EchoTest) {
+    ShellServer server(2);
+    ASSERT_TRUE(server.listen(path));
+    server.start();
+
+    int fd = connect_client();
+    ASSERT_GE(fd, 0);
+    EXPECT_EQ(read_until(fd, "$ "), "$ ");
+    send_text(fd, "ab");
+    EXPECT_EQ(read_until(fd, "ab"), "ab");
+    ASSERT_TRUE(wait_sessions(server, 1));
+
+    // 断开连接后会话被回收
+    close(fd);
+    EXPECT_TRUE(wait_sessions(server, 0));
+    server.stop();
+}
+
+TEST_F(ServerTest, ManySessionsTest) {
+    ShellServer server(4);
+    ASSERT_TRUE(server.listen(path));
+    server.start();
+
+    const size_t count = 200;
+    std::vector<int> fds;
+    for (size_t i = 0; i < count; i++) {
+        int fd = connect_client();
+        ASSERT_GE(fd, 0);
+        fds.push_back(fd);
+    }
+    ASSERT_TRUE(wait_sessions(server, count));
+
+    // 每个会话只收到自己的回显
+    for (size_t i = 0; i < count; i++) {
+        read_until(fds[i], "$ ");
+        send_text(fds[i], "s" + std::to_string(i) + ";");
+    }
+    for (size_t i = 0; i < count; i++) {
+        std::string expected = "s" + std::to_string(i) + ";";
+        EXPECT_EQ(read_until(fds[i], expected), expected);
+    }
+
+    // 停止服务时关闭全部会话，客户端读到EOF
+    server.stop();
+    EXPECT_EQ(server.session_count(), 0u);
+    char c;
+    EXPECT_EQ(read(fds[0], &c, 1), 0);
+    for (int fd : fds) close(fd);
+}
+
+TEST_F(ServerTest, CommandOutputTest) {
+    ShellServer server(1);
+    ASSERT_TRUE(server.listen(path));
+    server.start();
+
+    int fd = connect_client();
+    ASSERT_GE(fd, 0);
+    read_until(fd, "$ ");
+
+    // 外部命令的标准输出和标准错误都送到会话，结束后出现新的提示符
+    send_text(fd, "echo hello\r");
+    std::string out = read_until(fd, "hello\n$ ");
+    EXPECT_NE(out.find("hello\n$ "), std::string::npos) << out;
+
+    send_text(fd, "ls /nonexistent-dir-for-test\r");
+    out = read_until(fd, "$ ");
+    EXPECT_NE(out.find("nonexistent-dir-for-test"), std::string::npos) << out;
+
+    // 需要/bin/sh的语法也在会话中异步执行
+    send_text(fd, "echo one > /dev/null; echo two\r");
+    out = read_until(fd, "two\n$ ");
+    EXPECT_NE(out.find("two\n$ "), std::string::npos) << out;
+
+    // 内建命令
+    send_text(fd, "history\r");
+    out = read_until(fd, "4  history");
+    EXPECT_NE(out.find("1  echo hello"), std::string::npos) << out;
+
+    close(fd);
+    EXPECT_TRUE(wait_sessions(server, 0));
+}
+
+// 本进程打开的inotify实例数
+static size_t inotify_count() {
+    size_t count = 0;
+    for (int fd = 0; fd < 1024; fd++) {
+        char link[64], target[64];
+        snprintf(link, sizeof(link), "/proc/self/fd/%d", fd);
+        ssize_t n = readlink(link, target, sizeof(target) - 1);
+        if (n > 0 && std::string(target, n) == "anon_inode:inotify") count++;
+    }
+    return count;
+}
+
+TEST_F(ServerTest, SharedLookupCacheTest) {
+    // 同一工作线程的会话共用命令路径缓存和补全索引，inotify实例数与会话数无关
+    size_t before = inotify_count();
+    ShellServer server(1);
+    ASSERT_TRUE(server.listen(path));
+    server.start();
+
+    std::vector<int> fds;
+    for (int i = 0; i < 8; i++) {
+        int fd = connect_client();
+        ASSERT_GE(fd, 0);
+        read_until(fd, "$ ");
+        send_text(fd, "true\r");
+        read_until(fd, "$ ");
+        send_text(fd, "ec\t");
+        read_until(fd, "echo");
+        fds.push_back(fd);
+    }
+    EXPECT_LE(inotify_count(), before + 2);
+
+    for (int fd : fds) close(fd);
+    EXPECT_TRUE(wait_sessions(server, 0));
+    server.stop();
+}
+
+TEST_F(ServerTest, HungJobTeardownTest) {
+    // 断开的会话还有忽略SIGHUP的作业时，同一工作线程上的其他会话不受影响
+    ShellServer server(1);
+    ASSERT_TRUE(server.listen(path));
+    server.start();
+
+    int hung = connect_client();
+    int other = connect_client();
+    ASSERT_GE(hung, 0);
+    ASSERT_GE(other, 0);
+    read_until(hung, "$ ");
+    read_until(other, "$ ");
+    send_text(hung, "trap '' HUP; sleep 10\r");
+    read_until(hung, "sleep 10");
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+
+    auto start = std::chrono::steady_clock::now();
+    close(hung);
+    ASSERT_TRUE(wait_sessions(server, 1));
+    send_text(other, "ab");
+    EXPECT_EQ(read_until(other, "ab"), "ab");
+    EXPECT_LT(std::chrono::steady_clock::now() - start, std::chrono::milliseconds(500));
+
+    close(other);
+    EXPECT_TRUE(wait_sessions(server, 0));
+    server.stop();
+}
+
+TEST_F(ServerTest, OrphanedOutputTest) {
+    // 作业留下占着输出的后台孙进程时，同一工作线程上的其他会话照常回显
+    ShellServer server(1);
+    ASSERT_TRUE(server.listen(path));
+    server.start();
+
+    int busy = connect_client();
+    int other = connect_client();
+    ASSERT_GE(busy, 0);
+    ASSERT_GE(other, 0);
+    read_until(busy, "$ ");
+    read_until(other, "$ ");
+    send_text(busy, "sh -c 'sleep 2 &'\r");
+
+    auto longest = std::chrono::steady_clock::duration::zero();
+    for (int i = 0; i < 20; i++) {
+        auto start = std::chrono::steady_clock::now();
+        send_text(other, "x");
+        EXPECT_EQ(read_until(other, "x"), "x");
+        longest = std::max(longest, std::chrono::steady_clock::now() - start);
+        std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    }
+    EXPECT_LT(longest, std::chrono::milliseconds(20));
+    std::string out = read_until(busy, "\n$ ");
+    EXPECT_NE(out.find("\n$ "), std::string::npos) << out;
+
+    close(busy);
+    close(other);
+    EXPECT_TRUE(wait_sessions(server, 0));
+    server.stop();
+}
+
+TEST_F(ServerTest, PtySessionTest) {
+    ShellServer server(1);
+    server.start();
+
+    std::string name;
+    int slave = server.open_pty(&name);
+    ASSERT_GE(slave, 0);
+    EXPECT_EQ(name.compare(0, 9, "/dev/pts/"), 0);
+    EXPECT_TRUE(isatty(slave));
+
+    EXPECT_EQ(read_until(slave, "$ "), "$ ");
+    send_text(slave, "xy");
+    EXPECT_EQ(read_until(slave, "xy"), "xy");
+    ASSERT_TRUE(wait_sessions(server, 1));
+
+    // 从端全部关闭后会话结束
+    close(slave);
+    EXPECT_TRUE(wait_sessions(server, 0));
+}
+
+#endif
@@ -0,0 +1,102 @@
+#include <gtest/gtest.h>
+#include "sharedhistory.h"
+#include <string>
+#include <thread>
+#include <vector>
+
+#ifdef __linux__
+#include <unistd.h>
+#include <sys/mman.h>
+
+class SharedHistoryTest : public ::testing::Test {
+protected:
+    std::string name;
+
+    void SetUp() override {
+        name = "/test-shell-history-" + std::to_string(getpid());
+        shm_unlink(name.c_str());
+    }
+
+    void TearDown() override {
+        shm_unlink(name.c_str());
+    }
+};
+
+TEST_F(SharedHistoryTest, CrossSessionTest) {
+    SharedHistoryRing a, b;
+    ASSERT_TRUE(a.open(name));
+    ASSERT_TRUE(b.open(name));
+    EXPECT_EQ(b.head(), 0);
+
+    EXPECT_TRUE(a.append("make test"));
+    EXPECT_TRUE(b.append("git push"));
+
+    // 两个会话看到同样的全局顺序
+    std::string text;
+    EXPECT_EQ(a.head(), 2);
+    ASSERT_TRUE(b.read(0, text));
+    EXPECT_EQ(text, "make test");
+    ASSERT_TRUE(a.read(1, text));
+    EXPECT_EQ(text, "git push");
+    EXPECT_FALSE(a.read(2, text));
+
+    // 过长的命令不进入共享环
+    EXPECT_FALSE(a.append(std::string(SharedHistoryRing::MAX_LENGTH + 1, 'x')));
+}
+
+TEST_F(SharedHistoryTest, WrapAroundTest) {
+    SharedHistoryRing ring;
+    ASSERT_TRUE(ring.open(name));
+    for (size_t i = 0; i < SharedHistoryRing::SLOT_COUNT + 10; i++) {
+        ring.append("cmd " + std::to_string(i));
+    }
+    std::string text;
+    // 被覆盖的编号读取失败
+    EXPECT_FALSE(ring.read(5, text));
+    EXPECT_EQ(ring.oldest(), 10);
+    ASSERT_TRUE(ring.read(10, text));
+    EXPECT_EQ(text, "cmd 10");
+    ASSERT_TRUE(ring.read(ring.head() - 1, text));
+    EXPECT_EQ(text, "cmd " + std::to_string(SharedHistoryRing::SLOT_COUNT + 9));
+}
+
+TEST_F(SharedHistoryTest, ConcurrentWritersTest) {
+    const int writers = 4;
+    const int per_writer = 20000;
+    std::vector<std::thread> threads;
+    for (int w = 0; w < writers; w++) {
+        threads.emplace_back([this, w]() {
+            SharedHistoryRing ring;
+            ASSERT_TRUE(ring.open(name));
+            for (int i = 0; i < per_writer; i++) {
+                ring.append("writer " + std::to_string(w) + " entry " + std::to_string(i));
+            }
+        });
+    }
+
+    // 写入的同时读取，读到的内容必须完整
+    SharedHistoryRing reader;
+    ASSERT_TRUE(reader.open(name));
+    std::string text;
+    long valid = 0;
+    while (reader.head() < (uint64_t)writers * per_writer) {
+        uint64_t head = reader.head();
+        for (uint64_t t = head > 64 ? head - 64 : 0; t < head; t++) {
+            if (reader.read(t, text)) {
+                ASSERT_EQ(text.compare(0, 7, "writer "), 0);
+                valid++;
+            }
+        }
+    }
+    for (auto& thread : threads) {
+        thread.join();
+    }
+    EXPECT_EQ(reader.head(), (uint64_t)writers * per_writer);
+    EXPECT_GT(valid, 0);
+
+    // 全部写完后，环中保留的都能读到
+    for (uint64_t t = reader.oldest(); t < reader.head(); t++) {
+        EXPECT_TRUE(reader.read(t, text));
+    }
+}
+#endif
@@ -3,6 +3,8 @@
 #include <cstring>
 #include <thread>
 #include <chrono>
+#include <memory_resource>
+#include "alloccount.h"
 
 class ShellTest : public ::testing::Test {
 protected:
@@ -49,6 +51,11 @@ TEST_F(ShellTest, BackspaceTest) {
     // 空字符串上退格不应有效果
     shell->test_handle_input(&backspace, 1);
     EXPECT_EQ(shell->get_command_line(), "");
+
+    // 终端的退格键发送DEL（0x7F），同样删除字符
+    const char del_input[] = "ab\x7f";
+    shell->test_handle_input(del_input, strlen(del_input));
+    EXPECT_EQ(shell->get_command_line(), "a");
 }
 
 TEST_F(ShellTest, CursorMovementTest) {
@@ -253,4 +260,778 @@ TEST_F(ShellTest, CursorPositionBoundaryTest) {
     shell->test_handle_input(delete_key, strlen(delete_key));
     EXPECT_EQ(shell->get_command_line(), "");
     EXPECT_EQ(shell->get_cursor_position(), 0);
-} 
\ No newline at end of file
+}
+
+// 测试内建history命令
+TEST_F(ShellTest, HistoryBuiltinTest) {
+    shell->test_handle_input("jobs\r", 5);
+
+    testing::internal::CaptureStdout();
+    shell->test_handle_input("history\r", 8);
+    shell->test_handle_input("history\r", 8);
+    std::string output = testing::internal::GetCapturedStdout();
+
+    EXPECT_NE(output.find("    1  jobs\n"), std::string::npos);
+    EXPECT_NE(output.find("    2  history\n"), std::string::npos);
+    // 连续重复的命令只记录一次
+    EXPECT_EQ(output.find("    3  history\n"), std::string::npos);
+}
+
+// 测试上下键浏览历史
+TEST_F(ShellTest, HistoryNavigationTest) {
+    shell->test_handle_input("jobs\r", 5);
+    shell->test_handle_input("hash -r\r", 8);
+
+    shell->test_handle_input("\033[A", 3);
+    EXPECT_EQ(shell->get_command_line(), "hash -r");
+    shell->test_handle_input("\033[A", 3);
+    EXPECT_EQ(shell->get_command_line(), "jobs");
+    shell->test_handle_input("\033[A", 3);
+    EXPECT_EQ(shell->get_command_line(), "jobs");
+    shell->test_handle_input("\033[B", 3);
+    shell->test_handle_input("\033[B", 3);
+    EXPECT_EQ(shell->get_command_line(), "");
+}
+
+#ifdef __linux__
+// 等待前台作业结束
+static bool wait_foreground(Shell* shell, int timeout_ms = 3000) {
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeout_ms);
+    while (shell->has_foreground_job()) {
+        if (std::chrono::steady_clock::now() > deadline) return false;
+        shell->poll_jobs();
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    return true;
+}
+
+// 测试前台命令运行期间的预输入
+TEST_F(ShellTest, TypeaheadTest) {
+    shell->test_handle_input("sleep 0.2\r", 10);
+    EXPECT_TRUE(shell->has_foreground_job());
+
+    // 命令运行期间的输入（包括第二条命令）被缓存而不是丢弃
+    shell->test_handle_input("sleep 0.1\rab", 12);
+    EXPECT_EQ(shell->get_command_line(), "");
+
+    // 第一条结束后执行缓存中的第二条，其后的输入继续缓存
+    ASSERT_TRUE(wait_foreground(shell));
+    EXPECT_EQ(shell->get_command_line(), "ab");
+    EXPECT_EQ(shell->get_job_count(), 0);
+}
+
+// 测试交给sh -c的复合命令同样作为作业异步执行，期间的输入作为预输入
+TEST_F(ShellTest, CompoundCommandTest) {
+    shell->test_handle_input("sleep 0.2; true\r", 16);
+    EXPECT_TRUE(shell->has_foreground_job());
+    shell->test_handle_input("ab", 2);
+    ASSERT_TRUE(wait_foreground(shell));
+    EXPECT_EQ(shell->get_command_line(), "ab");
+    EXPECT_EQ(shell->get_job_count(), 0);
+
+    // Ctrl+C同样能中断
+    shell->test_handle_input("\x03sleep 5 && true\r", 17);
+    ASSERT_TRUE(shell->has_foreground_job());
+    shell->test_handle_input("\x03", 1);
+    ASSERT_TRUE(wait_foreground(shell));
+}
+
+// 测试前台命令运行期间Ctrl+C中断作业并丢弃预输入
+TEST_F(ShellTest, InterruptForegroundTest) {
+    shell->test_handle_input("sleep 5\r", 8);
+    ASSERT_TRUE(shell->has_foreground_job());
+
+    auto start = std::chrono::steady_clock::now();
+    shell->test_handle_input("xyz\x03", 4);
+    ASSERT_TRUE(wait_foreground(shell));
+    EXPECT_LT(std::chrono::steady_clock::now() - start, std::chrono::seconds(2));
+    EXPECT_EQ(shell->get_command_line(), "");
+}
+
+// 测试后台作业与jobs/fg/bg内建命令
+TEST_F(ShellTest, BackgroundJobTest) {
+    shell->test_handle_input("sleep 5 &\r", 10);
+    EXPECT_FALSE(shell->has_foreground_job());
+    EXPECT_EQ(shell->get_job_count(), 1);
+
+    testing::internal::CaptureStdout();
+    shell->test_handle_input("jobs\r", 5);
+    std::string output = testing::internal::GetCapturedStdout();
+    EXPECT_NE(output.find("[1]+  Running"), std::string::npos);
+    EXPECT_NE(output.find("sleep 5 &"), std::string::npos);
+
+    // Ctrl+Z暂停前台作业后用bg继续在后台运行
+    shell->test_handle_input("fg %1\r", 6);
+    EXPECT_TRUE(shell->has_foreground_job());
+    shell->test_handle_input("\x1A", 1);
+    ASSERT_TRUE(wait_foreground(shell));
+
+    testing::internal::CaptureStdout();
+    shell->test_handle_input("jobs\r", 5);
+    output = testing::internal::GetCapturedStdout();
+    EXPECT_NE(output.find("Stopped"), std::string::npos);
+
+    testing::internal::CaptureStdout();
+    shell->test_handle_input("bg\r", 3);
+    shell->test_handle_input("jobs\r", 5);
+    shell->test_handle_input("fg 9\r", 5);
+    output = testing::internal::GetCapturedStdout();
+    EXPECT_NE(output.find("Running"), std::string::npos);
+    EXPECT_NE(output.find("fg: no such job"), std::string::npos);
+    EXPECT_FALSE(shell->has_foreground_job());
+}
+#endif
+
+#ifdef __linux__
+// 测试hash内建命令
+TEST_F(ShellTest, HashBuiltinTest) {
+    testing::internal::CaptureStdout();
+    shell->test_handle_input("hash -r\r", 8);
+    shell->test_handle_input("hash\r", 5);
+    shell->test_handle_input("hash sh no_such_command_for_test\r", 33);
+    shell->test_handle_input("hash\r", 5);
+    shell->test_handle_input("hash -d sh\r", 11);
+    shell->test_handle_input("hash\r", 5);
+    std::string output = testing::internal::GetCapturedStdout();
+
+    EXPECT_NE(output.find("hash: hash table empty"), std::string::npos);
+    EXPECT_NE(output.find("hash: no_such_command_for_test: not found"), std::string::npos);
+    EXPECT_NE(output.find("hits\tcommand"), std::string::npos);
+    EXPECT_NE(output.find("/sh\n"), std::string::npos);
+    // hash -d之后缓存再次为空
+    EXPECT_GT(output.rfind("hash: hash table empty"), output.rfind("/sh\n"));
+}
+#endif
+
+#ifdef __linux__
+// 测试Tab补全
+TEST_F(ShellTest, TabCompletionTest) {
+    testing::internal::CaptureStdout();
+    // 内建命令唯一匹配，补全后加空格
+    shell->test_handle_input("hist\t", 5);
+    EXPECT_EQ(shell->get_command_line(), "history ");
+
+    // 目录补全以'/'结尾
+    shell->test_handle_input("\r", 1);
+    shell->test_handle_input("ls /tm\t", 7);
+    testing::internal::GetCapturedStdout();
+    EXPECT_EQ(shell->get_command_line(), "ls /tmp/");
+}
+
+// 补全的文件名中的空格和shell元字符加反斜杠转义，已转义的单词也能继续补全
+TEST_F(ShellTest, TabCompletionEscapeTest) {
+    std::string dir = "/tmp/test_shell_complete_" + std::to_string(getpid());
+    ASSERT_EQ(mkdir(dir.c_str(), 0700), 0);
+    fclose(fopen((dir + "/a b").c_str(), "w"));
+    fclose(fopen((dir + "/x;y$f").c_str(), "w"));
+
+    testing::internal::CaptureStdout();
+    std::string line = "ls " + dir + "/a\t";
+    shell->test_handle_input(line.c_str(), line.length());
+    EXPECT_EQ(shell->get_command_line(), "ls " + dir + "/a\\ b ");
+
+    // 删掉整行后补全已转义的单词
+    std::string erase(shell->get_command_line().length(), '\x7F');
+    shell->test_handle_input(erase.c_str(), erase.length());
+    line = "ls " + dir + "/x\\;\t";
+    shell->test_handle_input(line.c_str(), line.length());
+    testing::internal::GetCapturedStdout();
+    EXPECT_EQ(shell->get_command_line(), "ls " + dir + "/x\\;y\\$f ");
+
+    unlink((dir + "/a b").c_str());
+    unlink((dir + "/x;y$f").c_str());
+    rmdir(dir.c_str());
+}
+#endif
+
+#ifdef __linux__
+// 窗口大小变化通知监听者，如会话录制
+TEST_F(ShellTest, WindowListenerTest) {
+    std::vector<std::pair<unsigned short, unsigned short>> sizes;
+    shell->set_window_listener([&](unsigned short rows, unsigned short cols) { sizes.push_back({rows, cols}); });
+    shell->set_window_size(30, 100);
+    shell->set_window_size(40, 120);
+    shell->set_window_listener(nullptr);
+    shell->set_window_size(24, 80);
+    EXPECT_EQ(sizes, (std::vector<std::pair<unsigned short, unsigned short>>{{30, 100}, {40, 120}}));
+}
+#endif
+
+// 测试Ctrl-R/Ctrl-S增量搜索
+TEST_F(ShellTest, HistorySearchTest) {
+    testing::internal::CaptureStdout();
+    shell->test_handle_input("jobs\r", 5);
+    shell->test_handle_input("hash -r\r", 8);
+    shell->test_handle_input("history\r", 8);
+
+    // Ctrl-R逐字输入，再按一次找更早的匹配
+    shell->test_handle_input("\x12h", 2);
+    shell->test_handle_input("\x12", 1);
+    shell->test_handle_input("\033[C", 3);
+    EXPECT_EQ(shell->get_command_line(), "hash -r");
+
+    // Ctrl-G取消，命令行恢复
+    shell->test_handle_input(" x\x12jo\x07", 6);
+    EXPECT_EQ(shell->get_command_line(), "hash -r x");
+
+    // 没有匹配时保留原命令行
+    shell->test_handle_input("\x12zzz\033[C", 7);
+    std::string output = testing::internal::GetCapturedStdout();
+    EXPECT_EQ(shell->get_command_line(), "hash -r x");
+    EXPECT_NE(output.find("(failed reverse-i-search)`zzz': "), std::string::npos);
+}
+
+#ifdef __linux__
+// 历史很多时，索引在后台建完之前搜索只补入一批，较早的匹配在建完或空闲时补入后显示
+TEST_F(ShellTest, LargeHistorySearchTest) {
+    std::string path = "/tmp/test_shell_history_" + std::to_string(getpid());
+    {
+        HistoryStore store;
+        ASSERT_TRUE(store.open(path));
+        store.append("echo very old");
+        for (int i = 0; i < 50000; i++) {
+            store.append("cmd " + std::to_string(i));
+        }
+    }
+    ASSERT_TRUE(shell->open_history(path));
+
+    // 尚未找到时不显示失败
+    testing::internal::CaptureStdout();
+    shell->test_handle_input("\x12very", 5);
+    for (int i = 0; i < 1000 && shell->has_background_work(); i++) {
+        shell->process_fifo();
+    }
+    std::string output = testing::internal::GetCapturedStdout();
+    EXPECT_EQ(output.find("failed"), std::string::npos) << output;
+    EXPECT_NE(output.find("(reverse-i-search)`very': echo very old"), std::string::npos) << output;
+    shell->test_handle_input("\033[C", 3);
+    EXPECT_EQ(shell->get_command_line(), "echo very old");
+
+    // 全部索引后没有的查询才显示失败
+    testing::internal::CaptureStdout();
+    shell->test_handle_input("\x12zzz", 4);
+    output = testing::internal::GetCapturedStdout();
+    EXPECT_NE(output.find("(failed reverse-i-search)`zzz': "), std::string::npos) << output;
+    unlink(path.c_str());
+}
+
+// 打开历史文件后索引在后台建立，建完后只有最早的记录匹配的查询也在按键时立即找到
+TEST_F(ShellTest, BackgroundHistoryIndexTest) {
+    std::string path = "/tmp/test_shell_history_" + std::to_string(getpid());
+    {
+        HistoryStore store;
+        ASSERT_TRUE(store.open(path));
+        store.append("echo very old");
+        for (int i = 0; i < 50000; i++) {
+            store.append("cmd " + std::to_string(i));
+        }
+    }
+    ASSERT_TRUE(shell->open_history(path));
+    shell->test_wait_history_index();
+
+    testing::internal::CaptureStdout();
+    shell->test_handle_input("\x12very", 5);
+    std::string output = testing::internal::GetCapturedStdout();
+    EXPECT_NE(output.find("(reverse-i-search)`very': echo very old"), std::string::npos) << output;
+    EXPECT_FALSE(shell->has_background_work());
+    unlink(path.c_str());
+}
+#endif
+
+// 测试历史自动提示
+TEST_F(ShellTest, AutosuggestionTest) {
+    shell->test_handle_input("hash -r\r", 8);
+    shell->test_handle_input("history\r", 8);
+
+    testing::internal::CaptureStdout();
+    shell->test_handle_input("ha", 2);
+    std::string output = testing::internal::GetCapturedStdout();
+    EXPECT_NE(output.find("\033[2msh -r\033[0m"), std::string::npos);
+
+    // 与提示一致的输入只输出该字符，不重绘提示
+    testing::internal::CaptureStdout();
+    shell->test_handle_input("s", 1);
+    output = testing::internal::GetCapturedStdout();
+    EXPECT_EQ(output, "s");
+
+    // 右方向键接受提示
+    testing::internal::CaptureStdout();
+    shell->test_handle_input("\033[C", 3);
+    output = testing::internal::GetCapturedStdout();
+    EXPECT_EQ(shell->get_command_line(), "hash -r");
+    EXPECT_EQ(shell->get_cursor_position(), 7);
+    EXPECT_EQ(output, "h -r");
+}
+
+// 提示显示时合并的一串右方向键：接受提示后其余的右移照常处理，与逐个收到时结果相同
+TEST_F(ShellTest, AutosuggestionRepeatTest) {
+    shell->test_handle_input("hash -r\r", 8);
+
+    testing::internal::CaptureStdout();
+    shell->test_handle_input("ha\033[C\033[C\033[C", 11);
+    std::string output = testing::internal::GetCapturedStdout();
+    EXPECT_EQ(shell->get_command_line(), "hash -r");
+    EXPECT_EQ(shell->get_cursor_position(), 7);
+    EXPECT_NE(output.find("sh -r"), std::string::npos);
+
+    // 带次数参数的右移同样只接受一次
+    shell->test_handle_input("\r", 1);
+    testing::internal::CaptureStdout();
+    shell->test_handle_input("ha\033[3C", 6);
+    testing::internal::GetCapturedStdout();
+    EXPECT_EQ(shell->get_command_line(), "hash -r");
+    EXPECT_EQ(shell->get_cursor_position(), 7);
+}
+
+// 统计分配的内存资源
+class CountingResource : public std::pmr::memory_resource {
+public:
+    size_t allocations = 0;
+    size_t outstanding = 0;
+
+private:
+    void* do_allocate(size_t bytes, size_t alignment) override {
+        allocations++;
+        outstanding += bytes;
+        return std::pmr::new_delete_resource()->allocate(bytes, alignment);
+    }
+    void do_deallocate(void* p, size_t bytes, size_t alignment) override {
+        outstanding -= bytes;
+        std::pmr::new_delete_resource()->deallocate(p, bytes, alignment);
+    }
+    bool do_is_equal(const std::pmr::memory_resource& other) const noexcept override {
+        return this == &other;
+    }
+};
+
+// 测试编辑状态和内存历史从指定的内存资源分配
+TEST_F(ShellTest, MemoryResourceTest) {
+    CountingResource resource;
+    {
+        testing::internal::CaptureStdout();
+        Shell session(&input_fifo, -1, &resource);
+        size_t constructed = resource.allocations;
+        EXPECT_GT(constructed, 0u);  // 内存历史
+
+        std::string line = "history --a-line-longer-than-the-small-string-buffer";
+        session.test_handle_input(line.data(), line.size());
+        EXPECT_GT(resource.allocations, constructed);
+        EXPECT_EQ(session.get_command_line(), line);
+
+        session.test_handle_input("\rjobs\r", 6);
+        session.test_handle_input("\033[A\033[A", 6);
+        EXPECT_EQ(session.get_command_line(), line);
+        testing::internal::GetCapturedStdout();
+    }
+    // 析构后全部归还
+    EXPECT_EQ(resource.outstanding, 0u);
+}
+
+// 测试CSI参数解析：多个参数、空参数和过大的参数
+TEST_F(ShellTest, CSIParameterTest) {
+    testing::internal::CaptureStdout();
+    shell->test_handle_input("abcdef", 6);
+    shell->test_handle_input("\033[1;5D", 6);   // 带修饰键的左移
+    EXPECT_EQ(shell->get_cursor_position(), 5);
+    shell->test_handle_input("\033[;D", 4);
+    EXPECT_EQ(shell->get_cursor_position(), 4);
+    shell->test_handle_input("\033[99999999999999999999D", 23);  // 超出int的参数截断，移到行首为止
+    EXPECT_EQ(shell->get_cursor_position(), 0);
+    shell->test_handle_input("\033[3C", 4);  // 参数为移动次数
+    EXPECT_EQ(shell->get_cursor_position(), 3);
+    shell->test_handle_input("\033[3;2~", 6);  // 第一个参数为3即为Delete
+    EXPECT_EQ(shell->get_command_line(), "abcef");
+    testing::internal::GetCapturedStdout();
+}
+
+// 测试超出转义缓冲区的CSI序列被整个丢弃，之后的输入照常处理
+TEST_F(ShellTest, LongCSISequenceTest) {
+    testing::internal::CaptureStdout();
+    shell->test_handle_input("abc", 3);
+    std::string input = "\033[" + std::string(4000, '1') + "D";
+    shell->test_handle_input(input.data(), input.size());
+    EXPECT_EQ(shell->get_command_line(), "abc");
+    EXPECT_EQ(shell->get_cursor_position(), 3);
+
+    // 分几次到达也一样
+    input = "\033[" + std::string(100, ';');
+    shell->test_handle_input(input.data(), input.size());
+    shell->test_handle_input(input.data() + 2, input.size() - 2);
+    shell->test_handle_input("Dx\033[D", 5);
+    EXPECT_EQ(shell->get_command_line(), "abcx");
+    EXPECT_EQ(shell->get_cursor_position(), 3);
+    testing::internal::GetCapturedStdout();
+}
+
+// 测试按字形簇编辑UTF-8命令行：光标移动和删除以整个字符为单位，按列输出
+TEST_F(ShellTest, Utf8EditTest) {
+    testing::internal::CaptureStdout();
+    shell->test_handle_input("ls 中文", 9);
+    EXPECT_EQ(shell->get_cursor_position(), 9);
+    testing::internal::GetCapturedStdout();
+
+    // 左移越过一个宽字符，退回2列
+    testing::internal::CaptureStdout();
+    shell->test_handle_input("\033[D", 3);
+    EXPECT_EQ(testing::internal::GetCapturedStdout(), "\b\b");
+    EXPECT_EQ(shell->get_cursor_position(), 6);
+
+    // 退格删除整个"中"，行内删除2列
+    testing::internal::CaptureStdout();
+    shell->test_handle_input("\b", 1);
+    EXPECT_EQ(testing::internal::GetCapturedStdout(), "\b\b\033[2P");
+    EXPECT_EQ(shell->get_command_line(), "ls 文");
+    EXPECT_EQ(shell->get_cursor_position(), 3);
+
+    // Delete删除光标后的"文"
+    testing::internal::CaptureStdout();
+    shell->test_handle_input("\033[3~", 4);
+    EXPECT_EQ(shell->get_command_line(), "ls ");
+
+    // 组合字符和前一个字母是一个簇，退格一起删除
+    shell->test_handle_input("e\xCC\x81", 3);
+    EXPECT_EQ(shell->get_command_line(), "ls e\xCC\x81");
+    shell->test_handle_input("\033[D", 3);
+    EXPECT_EQ(shell->get_cursor_position(), 3);
+    shell->test_handle_input("\033[C", 3);
+    shell->test_handle_input("\b", 1);
+    EXPECT_EQ(shell->get_command_line(), "ls ");
+
+    // 分几次到达的字符拼接完整后插入，不合法的字节被丢弃
+    shell->test_handle_input("\xE4", 1);
+    EXPECT_EQ(shell->get_command_line(), "ls ");
+    shell->test_handle_input("\xB8", 1);
+    shell->test_handle_input("\xAD\xFF", 2);
+    EXPECT_EQ(shell->get_command_line(), "ls 中");
+    shell->test_handle_input("\xFF" "a", 2);
+    EXPECT_EQ(shell->get_command_line(), "ls 中a");
+    testing::internal::GetCapturedStdout();
+}
+
+// 按一遍编辑按键：输入（经过自动提示）、左右移动、Delete、退格、上下浏览历史
+static void edit_keys(Shell* shell) {
+    const char* keys[] = {"hash -r more text", "\033[D", "\033[D", "\033[D", "\033[C", "\033[3~",
+                          "x", "\b", "\033[A", "\033[A", "\033[B", "\033[B"};
+    for (const char* key : keys) {
+        shell->test_handle_input(key, strlen(key));
+    }
+    // 回到空行，下一遍从同样的状态开始
+    while (!shell->get_command_line().empty()) shell->test_handle_input("\b", 1);
+}
+
+// 测试稳定状态下的按键处理不分配内存
+TEST_F(ShellTest, KeystrokeAllocationTest) {
+    testing::internal::CaptureStdout();
+    shell->test_handle_input("jobs\r", 5);
+    shell->test_handle_input("no-such-command-for-allocation-test\r", 36);  // 超出短字符串的容量
+    // 第一遍让各个缓存达到需要的容量
+    edit_keys(shell);
+    AllocationCounter counter;
+    edit_keys(shell);
+    size_t allocations = counter.count();
+    testing::internal::GetCapturedStdout();
+    EXPECT_EQ(allocations, 0u);
+    EXPECT_GT(thread_allocation_count(), 0u);  // 计数确实接入
+}
+
+#ifdef __linux__
+#include <unistd.h>
+#include <sys/mman.h>
+
+// 测试跨会话共享历史
+TEST_F(ShellTest, SharedHistoryTest) {
+    std::string name = "/test-shell-shared-" + std::to_string(getpid());
+    struct fifo other_fifo;
+    uint8_t other_buffer[64];
+    fifo_init(&other_fifo, other_buffer, sizeof(other_buffer));
+    Shell other(&other_fifo);
+    ASSERT_TRUE(shell->attach_shared_history(name));
+    ASSERT_TRUE(other.attach_shared_history(name));
+
+    testing::internal::CaptureStdout();
+    shell->test_handle_input("jobs\r", 5);
+    other.test_handle_input("hash -r\r", 8);
+
+    // 另一个会话的命令立即可见，按全局顺序排列
+    shell->test_handle_input("\033[A", 3);
+    EXPECT_EQ(shell->get_command_line(), "hash -r");
+    shell->test_handle_input("\033[A", 3);
+    EXPECT_EQ(shell->get_command_line(), "jobs");
+    shell->test_handle_input("\033[B", 3);
+    EXPECT_EQ(shell->get_command_line(), "hash -r");
+    shell->test_handle_input("\033[B", 3);
+    EXPECT_EQ(shell->get_command_line(), "");
+    testing::internal::GetCapturedStdout();
+    shm_unlink(name.c_str());
+}
+
+// 测试浏览共享环时不分配内存
+TEST_F(ShellTest, SharedHistoryAllocationTest) {
+    std::string name = "/test-shell-shared-alloc-" + std::to_string(getpid());
+    ASSERT_TRUE(shell->attach_shared_history(name));
+    testing::internal::CaptureStdout();
+    shell->test_handle_input("jobs\r", 5);
+    shell->test_handle_input("no-such-command-for-allocation-test\r", 36);
+    edit_keys(shell);
+    AllocationCounter counter;
+    edit_keys(shell);
+    size_t allocations = counter.count();
+    testing::internal::GetCapturedStdout();
+    EXPECT_EQ(allocations, 0u);
+    shm_unlink(name.c_str());
+}
+#endif
+
+#ifdef __linux__
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include "screen.h"
+
+// 伪终端模式的会话：shell输出到套接字对的一端，测试从另一端读取
+class ShellPtyTest : public ::testing::Test {
+protected:
+    int fds[2];
+    Shell* shell;
+
+    void SetUp() override {
+        ASSERT_EQ(socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, fds), 0);
+        fcntl(fds[1], F_SETFL, O_NONBLOCK);
+        shell = new Shell(nullptr, fds[1]);
+        shell->set_pty_mode(true);
+        read_until("$ ");
+    }
+
+    void TearDown() override {
+        delete shell;
+        close(fds[0]);
+        close(fds[1]);
+    }
+
+    void type(const std::string& text) {
+        shell->test_handle_input(text.data(), text.size());
+    }
+
+    // 读取直到收到的内容包含expected，期间检查作业状态
+    std::string read_until(const std::string& expected, int timeout_ms = 3000) {
+        std::string received;
+        auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeout_ms);
+        while (received.find(expected) == std::string::npos &&
+               std::chrono::steady_clock::now() < deadline) {
+            shell->poll_jobs();
+            struct pollfd pfd = {fds[0], POLLIN, 0};
+            if (poll(&pfd, 1, 5) <= 0) continue;
+            char buffer[4096];
+            ssize_t n = read(fds[0], buffer, sizeof(buffer));
+            if (n <= 0) break;
+            received.append(buffer, n);
+        }
+        return received;
+    }
+};
+
+// 命令的标准输出是终端，输出经从端的行规程转换后转发到会话
+TEST_F(ShellPtyTest, TerminalOutputTest) {
+    type("tty\r");
+    std::string out = read_until("\r\n$ ");
+    EXPECT_NE(out.find("/dev/pts/"), std::string::npos) << out;
+    EXPECT_NE(out.find("\r\n$ "), std::string::npos) << out;
+
+    // 标准错误也在同一个终端上
+    type("ls /nonexistent-dir-for-test\r");
+    out = read_until("$ ");
+    EXPECT_NE(out.find("nonexistent-dir-for-test"), std::string::npos) << out;
+}
+
+// 前台作业运行期间的按键写入伪终端，由行规程回显
+TEST_F(ShellPtyTest, InputTest) {
+    type("head -n 1\r");
+    read_until("\r\n");
+    ASSERT_TRUE(shell->has_foreground_job());
+    type("abc\r");
+    std::string out = read_until("$ ");
+    EXPECT_NE(out.find("abc\r\nabc\r\n$ "), std::string::npos) << out;
+    EXPECT_FALSE(shell->has_foreground_job());
+}
+
+// 窗口大小在建立伪终端时设置，变化时同步到运行中的作业
+TEST_F(ShellPtyTest, WindowSizeTest) {
+    shell->set_window_size(40, 100);
+    type("stty size\r");
+    std::string out = read_until("$ ");
+    EXPECT_NE(out.find("40 100"), std::string::npos) << out;
+
+    type("sh -c 'trap \"stty size; exit\" WINCH; echo ready; while :; do sleep 0.05; done'\r");
+    read_until("ready\r\n");
+    shell->set_window_size(30, 90);
+    out = read_until("$ ");
+    EXPECT_NE(out.find("30 90"), std::string::npos) << out;
+}
+
+// 合并重绘：输出洪水只发送少量的帧，结束后提示符接在最终画面之后
+TEST_F(ShellPtyTest, FastScrollTest) {
+    shell->set_fast_scroll(30);
+    type("seq 1 50000\r");
+    std::string out = read_until("$ ", 10000);
+    EXPECT_LT(out.size(), 100000u);
+    Screen screen(24, 80);
+    screen.feed(out);
+    EXPECT_EQ(screen.row_text(22), "50000");
+    EXPECT_EQ(screen.row_text(23), "$");
+}
+
+// 命令留下仍占着输出的后台孙进程：作业照常结束，单次poll_jobs不等待孙进程
+TEST_F(ShellPtyTest, OrphanedOutputTest) {
+    for (int mode = 0; mode < 3; ++mode) {
+        shell->set_pty_mode(mode != 2);
+        shell->set_fast_scroll(mode == 1 ? 30 : 0);
+        auto start = std::chrono::steady_clock::now();
+        auto longest = std::chrono::steady_clock::duration::zero();
+        type("sh -c 'echo started; sleep 3 &'\r");
+        std::string received;
+        while (received.find("started") == std::string::npos ||
+               received.find("$ ", received.find("started")) == std::string::npos) {
+            if (std::chrono::steady_clock::now() - start > std::chrono::seconds(2)) break;
+            auto before = std::chrono::steady_clock::now();
+            shell->poll_jobs();
+            longest = std::max(longest, std::chrono::steady_clock::now() - before);
+            struct pollfd pfd = {fds[0], POLLIN, 0};
+            if (poll(&pfd, 1, 5) <= 0) continue;
+            char buffer[4096];
+            ssize_t n = read(fds[0], buffer, sizeof(buffer));
+            if (n <= 0) break;
+            received.append(buffer, n);
+        }
+        size_t started = received.find("started");
+        ASSERT_NE(started, std::string::npos) << mode << ": " << received;
+        EXPECT_NE(received.find("$ ", started), std::string::npos) << mode << ": " << received;
+        EXPECT_FALSE(shell->has_foreground_job()) << mode;
+        EXPECT_LT(longest, std::chrono::milliseconds(50)) << mode;
+    }
+}
+
+// 旁路带回显时，得到与终端完全相同的内容：行编辑、命令输出和提示符
+TEST_F(ShellPtyTest, SessionTapTest) {
+    int tap[2];
+    ASSERT_EQ(pipe2(tap, O_CLOEXEC | O_NONBLOCK), 0);
+    shell->set_output_tap(tap[1], true);
+    type("echo hello\r");
+    std::string out = read_until("hello\r\n$ ");
+    type("ab\b");
+    out += read_until("\b");
+    shell->set_output_tap(-1);
+    std::string tapped;
+    char buffer[4096];
+    ssize_t n;
+    while ((n = read(tap[0], buffer, sizeof(buffer))) > 0) tapped.append(buffer, n);
+    close(tap[0]);
+    close(tap[1]);
+    EXPECT_NE(out.find("hello\r\n$ "), std::string::npos) << out;
+    EXPECT_EQ(tapped, out);
+}
+
+// 读出套接字中已有的全部输出
+static std::string drain(int fd) {
+    std::string received;
+    struct pollfd pfd = {fd, POLLIN, 0};
+    char buffer[4096];
+    while (poll(&pfd, 1, 50) > 0) {
+        ssize_t n = read(fd, buffer, sizeof(buffer));
+        if (n <= 0) break;
+        received.append(buffer, n);
+    }
+    return received;
+}
+
+// 粘贴：整段输入走可打印字符的快速路径，结果与逐字节输入相同
+TEST_F(ShellPtyTest, PasteTest) {
+    int other_fds[2];
+    ASSERT_EQ(socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, other_fds), 0);
+    Shell other(nullptr, other_fds[1]);
+    other.set_pty_mode(true);
+
+    // 行尾粘贴经过自动提示，左移后在行中粘贴超过16字节的内容
+    std::string paste = "hash -r\rha" "sh -r and pasted text\033[D\033[Dxy\bzz0123456789abcdefghijklmnop~";
+    type(paste);
+    for (char c : paste) other.test_handle_input(&c, 1);
+    EXPECT_EQ(shell->get_command_line(), other.get_command_line());
+    EXPECT_EQ(shell->get_command_line(), "hash -r and pasted texzz0123456789abcdefghijklmnop~xt");
+    EXPECT_EQ(shell->get_cursor_position(), other.get_cursor_position());
+
+    Screen pasted(24, 80);
+    Screen typed(24, 80);
+    pasted.feed("$ " + drain(fds[0]));  // 第一个提示符已在SetUp中读出
+    typed.feed(drain(other_fds[0]));
+    EXPECT_EQ(pasted.text(), typed.text());
+    EXPECT_EQ(pasted.cursor_col(), typed.cursor_col());
+    EXPECT_NE(pasted.row_text(pasted.cursor_row()).find("$ hash -r and pasted texzz0123456789abcdefghijklmnop~xt"),
+              std::string::npos);
+    close(other_fds[0]);
+    close(other_fds[1]);
+}
+
+// 按住按键：已收到的相同按键合并为一次编辑，结果与逐个处理相同，输出只有一次移动
+TEST_F(ShellPtyTest, KeyRepeatTest) {
+    int other_fds[2];
+    ASSERT_EQ(socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, other_fds), 0);
+    Shell other(nullptr, other_fds[1]);
+    other.set_pty_mode(true);
+    std::string typed_out = drain(other_fds[0]);
+
+    auto repeat = [](const std::string& key, int n) {
+        std::string keys;
+        for (int i = 0; i < n; i++) keys += key;
+        return keys;
+    };
+    std::string line;
+    for (int i = 0; i < 5; i++) line += "0123456789";
+    type("jobs\rhash -r\r" + line);
+    std::string out = drain(fds[0]);
+    for (char c : "jobs\rhash -r\r" + line) other.test_handle_input(&c, 1);
+
+    // 对照的会话逐个处理按键
+    auto one_by_one = [&other](const std::string& keys) {
+        size_t step = keys[0] == '\b' || keys[0] == 0x7F ? 1 : keys[2] == '3' ? 4 : 3;
+        for (size_t i = 0; i < keys.size(); i += step) other.test_handle_input(keys.data() + i, step);
+    };
+
+    // 40个左移合并为一个CSI序列
+    type(repeat("\033[D", 40));
+    one_by_one(repeat("\033[D", 40));
+    std::string moved = drain(fds[0]);
+    EXPECT_LE(moved.size(), 6u) << moved;
+    out += moved;
+    EXPECT_EQ(shell->get_cursor_position(), 10u);
+
+    std::string floods[] = {repeat("\033[C", 5), repeat("\b", 6), "\b\x7f", repeat("\033[3~", 4),
+                            repeat("\033[D", 60), repeat("\033[A", 2), repeat("\033[B", 3), repeat("\033[A", 5)};
+    for (const std::string& keys : floods) {
+        type(keys);
+        one_by_one(keys);
+        EXPECT_EQ(shell->get_command_line(), other.get_command_line()) << keys;
+        EXPECT_EQ(shell->get_cursor_position(), other.get_cursor_position()) << keys;
+    }
+    EXPECT_EQ(shell->get_command_line(), "jobs");
+
+    Screen coalesced(24, 80);
+    Screen typed(24, 80);
+    coalesced.feed("$ " + out + drain(fds[0]));
+    typed_out += drain(other_fds[0]);
+    typed.feed(typed_out);
+    EXPECT_EQ(coalesced.text(), typed.text());
+    EXPECT_EQ(coalesced.cursor_col(), typed.cursor_col());
+    close(other_fds[0]);
+    close(other_fds[1]);
+}
+
+// Ctrl+C仍由shell转换为信号
+TEST_F(ShellPtyTest, InterruptTest) {
+    type("sleep 5\r");
+    ASSERT_TRUE(shell->has_foreground_job());
+    auto start = std::chrono::steady_clock::now();
+    type("\x03");
+    read_until("$ ");
+    EXPECT_FALSE(shell->has_foreground_job());
+    EXPECT_LT(std::chrono::steady_clock::now() - start, std::chrono::seconds(2));
+}
+#endif
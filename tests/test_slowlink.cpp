@@ -0,0 +1,78 @@
+#include <gtest/gtest.h>
+#include "slowlink.h"
+#include <string>
+
+#ifdef __linux__
+
+// 不限速的链路上逐键回显，每次按键回应一个字节
+TEST(SlowLinkTest, TypingTest) {
+    SlowLinkSession session({0, 0});
+    ASSERT_TRUE(session.ok());
+    EXPECT_EQ(session.screen().row_text(0), "$");
+
+    session.type("echo", 5);
+    ASSERT_TRUE(session.wait_idle());
+    EXPECT_EQ(session.screen().row_text(0), "$ echo");
+    LinkReport report = session.report();
+    EXPECT_EQ(report.keystrokes, 4u);
+    EXPECT_EQ(report.bytes_up, 4u);
+    EXPECT_EQ(report.bytes_down, 4u);
+    EXPECT_EQ(report.redraws, 0u);
+    EXPECT_EQ(session.keystroke(2).output, "h");
+}
+
+// 回显时间至少为往返的传播延迟
+TEST(SlowLinkTest, LatencyTest) {
+    SlowLinkSession session({0, 50});
+    ASSERT_TRUE(session.ok());
+    KeystrokeStats stats = session.press("a");
+    EXPECT_EQ(stats.bytes, 1u);
+    EXPECT_GE(stats.echo_ms, 100);
+    EXPECT_LT(stats.echo_ms, 1000);
+}
+
+// 带宽限制：粘贴48个字节的往返各需200ms
+TEST(SlowLinkTest, BandwidthTest) {
+    SlowLinkSession session(LinkProfile::serial(2400));
+    ASSERT_TRUE(session.ok());
+    std::string paste(48, 'x');
+    KeystrokeStats stats = session.press(paste);
+    EXPECT_EQ(stats.bytes, 48u);
+    EXPECT_GE(stats.echo_ms, 395);
+    EXPECT_EQ(session.screen().row_text(0), "$ " + paste);
+}
+
+// 浏览历史整行重绘，行中插入不重绘；命令的输出归于回车
+TEST(SlowLinkTest, RedrawTest) {
+    SlowLinkSession session({0, 0});
+    ASSERT_TRUE(session.ok());
+    KeystrokeStats enter;
+    session.type("echo one", 0);
+    enter = session.press("\r");
+    EXPECT_NE(enter.output.find("one\r\n$ "), std::string::npos) << enter.output;
+    EXPECT_EQ(session.screen().row_text(2), "$");
+
+    EXPECT_TRUE(session.press("\033[A").redraw);
+    EXPECT_EQ(session.screen().row_text(2), "$ echo one");
+    session.press("\033[D");
+    KeystrokeStats insert = session.press("x");
+    EXPECT_FALSE(insert.redraw);
+    EXPECT_EQ(session.screen().row_text(2), "$ echo onxe");
+    EXPECT_EQ(session.report().redraws, 1u);
+}
+
+// 链路慢于打字时按键在途中堆积，shell一次读到的几次按键共用一个回应
+TEST(SlowLinkTest, TypeaheadTest) {
+    SlowLinkSession session({0, 100});
+    ASSERT_TRUE(session.ok());
+    session.type("abcdef", 10);
+    ASSERT_TRUE(session.wait_idle());
+    EXPECT_EQ(session.screen().row_text(0), "$ abcdef");
+    LinkReport report = session.report();
+    EXPECT_EQ(report.keystrokes, 6u);
+    EXPECT_EQ(report.bytes_down, 6u);
+    EXPECT_GE(report.mean_echo_ms, 200);
+    EXPECT_LT(report.max_echo_ms, 2000);
+}
+
+#endif
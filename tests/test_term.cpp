@@ -149,6 +149,17 @@ TEST_F(TermTest, KeyMapDifferentTypesTest) {
     EXPECT_EQ(seq, "\033[1;2]");
 }
 
+// 测试不分配内存的查找与get_vt100_sequence一致
+TEST_F(TermTest, KeyMapFindSequenceTest) {
+    KeyMap& key_map = KeyMap::instance();
+    EXPECT_EQ(key_map.find_sequence(0x48, KeyType::EXTENDED), "\033[A");
+    EXPECT_EQ(key_map.find_sequence(0x53, KeyType::EXTENDED), "\033[3~");
+    for (int c = 32; c < 256; c++) {
+        EXPECT_EQ(key_map.find_sequence(c, KeyType::NORMAL), key_map.get_vt100_sequence(c, KeyType::NORMAL));
+    }
+    EXPECT_TRUE(key_map.find_sequence(0x99, KeyType::EXTENDED).empty());
+}
+
 // 测试键映射的边界情况
 TEST_F(TermTest, KeyMapEdgeCasesTest) {
     KeyMap& key_map = KeyMap::instance();
@@ -0,0 +1,92 @@
+#include <gtest/gtest.h>
+#include "tracer.h"
+#include <string>
+#include <thread>
+
+// 数出导出的JSON中包含text的行
+static size_t count_lines(const std::string& trace, const std::string& text) {
+    size_t count = 0;
+    size_t start = 0;
+    while (start < trace.size()) {
+        size_t end = trace.find('\n', start);
+        if (end == std::string::npos) end = trace.size();
+        if (trace.compare(start, end - start, text) != 0 &&
+            trace.substr(start, end - start).find(text) != std::string::npos) {
+            count++;
+        }
+        start = end + 1;
+    }
+    return count;
+}
+
+class TracerTest : public ::testing::Test {
+protected:
+    void SetUp() override {
+        Tracer::enable(true);
+        Tracer::clear();
+    }
+    void TearDown() override {
+        Tracer::enable(false);
+        Tracer::clear();
+    }
+};
+
+// 每个线程一条命名的轨道，作用域事件成对出现
+TEST_F(TracerTest, TracksTest) {
+    std::thread term([] {
+        TRACE_THREAD("test-term");
+        TRACE_INSTANT("fifo_write", 3);
+    });
+    term.join();
+    TRACE_THREAD("test-shell");
+    {
+        TRACE_SCOPE("handle_input");
+        TRACE_INSTANT("fifo_read", 3);
+    }
+    TRACE_COUNTER("jobs", 2);
+
+    std::string trace = Tracer::chrome_trace();
+    EXPECT_EQ(trace.compare(0, 15, "{\"displayTimeUn"), 0);
+    EXPECT_EQ(trace.substr(trace.size() - 4), "\n]}\n");
+    EXPECT_EQ(count_lines(trace, "\"args\":{\"name\":\"test-term\"}"), 1u);
+    EXPECT_EQ(count_lines(trace, "\"args\":{\"name\":\"test-shell\"}"), 1u);
+    EXPECT_EQ(count_lines(trace, "\"ph\":\"B\""), 1u);
+    EXPECT_EQ(count_lines(trace, "\"ph\":\"E\""), 1u);
+    EXPECT_EQ(count_lines(trace, "\"name\":\"fifo_read\",\"s\":\"t\",\"args\":{\"value\":3}"), 1u);
+    EXPECT_EQ(count_lines(trace, "\"ph\":\"C\""), 1u);
+
+    // 两个线程的事件在不同的轨道上
+    size_t write = trace.find("fifo_write");
+    size_t read = trace.find("fifo_read");
+    ASSERT_NE(write, std::string::npos);
+    ASSERT_NE(read, std::string::npos);
+    size_t write_tid = trace.rfind("\"tid\":", write);
+    size_t read_tid = trace.rfind("\"tid\":", read);
+    EXPECT_NE(trace.substr(write_tid, 8), trace.substr(read_tid, 8));
+}
+
+// 环满后覆盖最早的事件，只导出最近的RING_EVENTS个
+TEST_F(TracerTest, OverflowTest) {
+    for (size_t i = 0; i < Tracer::RING_EVENTS + 100; i++) {
+        Tracer::record(Tracer::INSTANT, "tick", (int32_t)i);
+    }
+    std::string trace = Tracer::chrome_trace();
+    EXPECT_EQ(count_lines(trace, "\"name\":\"tick\""), Tracer::RING_EVENTS);
+    EXPECT_EQ(trace.find("\"value\":99}"), std::string::npos);
+    EXPECT_NE(trace.find("\"value\":100}"), std::string::npos);
+    EXPECT_NE(trace.find("\"value\":" + std::to_string(Tracer::RING_EVENTS + 99) + "}"), std::string::npos);
+}
+
+// 关闭时埋点不记录；clear之前的事件不再导出
+TEST_F(TracerTest, DisabledTest) {
+    TRACE_INSTANT("before", 0);
+    Tracer::clear();
+    Tracer::enable(false);
+    {
+        TRACE_SCOPE("off");
+        TRACE_INSTANT("off", 0);
+    }
+    std::string trace = Tracer::chrome_trace();
+    EXPECT_EQ(trace.find("\"before\""), std::string::npos);
+    EXPECT_EQ(trace.find("\"off\""), std::string::npos);
+}
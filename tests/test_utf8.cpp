@@ -0,0 +1,151 @@
+#include <gtest/gtest.h>
+#include "utf8.h"
+#include <random>
+#include <string>
+
+// 逐字符解码得到的合法前缀长度，作为对照
+static size_t reference_valid_length(const std::string& text) {
+    size_t i = 0;
+    uint32_t code;
+    while (i < text.size()) {
+        size_t n = utf8_decode(text.data() + i, text.size() - i, code);
+        if (n == 0) break;
+        i += n;
+    }
+    return i;
+}
+
+TEST(Utf8Test, WidthTest) {
+    EXPECT_EQ(codepoint_width('a'), 1u);
+    EXPECT_EQ(codepoint_width(0x07), 1u);       // 控制字符按1列
+    EXPECT_EQ(codepoint_width(0xE9), 1u);       // é
+    EXPECT_EQ(codepoint_width(0x4E2D), 2u);     // 中
+    EXPECT_EQ(codepoint_width(0x3000), 2u);     // 全角空格
+    EXPECT_EQ(codepoint_width(0xFF21), 2u);     // 全角A
+    EXPECT_EQ(codepoint_width(0xAC00), 2u);     // 가
+    EXPECT_EQ(codepoint_width(0x1F600), 2u);    // 表情符号
+    EXPECT_EQ(codepoint_width(0x20000), 2u);    // 扩展B区汉字
+    EXPECT_EQ(codepoint_width(0x0301), 0u);     // 组合重音符
+    EXPECT_EQ(codepoint_width(0x200D), 0u);     // 零宽连接符
+    EXPECT_EQ(codepoint_width(0xFE0F), 0u);     // 变体选择符
+    EXPECT_EQ(codepoint_width(0x1F3FB), 0u);    // 肤色修饰符在宽字符区间内
+    EXPECT_EQ(codepoint_width(0x303F), 1u);
+    EXPECT_EQ(codepoint_width(0x110000), 1u);
+}
+
+TEST(Utf8Test, DecodeTest) {
+    uint32_t code = 0;
+    EXPECT_EQ(utf8_decode("A", 1, code), 1u);
+    EXPECT_EQ(code, 'A');
+    EXPECT_EQ(utf8_decode("\xC3\xA9", 2, code), 2u);
+    EXPECT_EQ(code, 0xE9u);
+    EXPECT_EQ(utf8_decode("\xE4\xB8\xAD", 3, code), 3u);
+    EXPECT_EQ(code, 0x4E2Du);
+    EXPECT_EQ(utf8_decode("\xF0\x9F\x98\x80", 4, code), 4u);
+    EXPECT_EQ(code, 0x1F600u);
+
+    EXPECT_EQ(utf8_decode("\xE4\xB8", 2, code), 0u);            // 不完整
+    EXPECT_EQ(utf8_decode("\xC0\x80", 2, code), 0u);            // 过长编码
+    EXPECT_EQ(utf8_decode("\xE0\x80\xAF", 3, code), 0u);
+    EXPECT_EQ(utf8_decode("\xED\xA0\x80", 3, code), 0u);        // 代理区
+    EXPECT_EQ(utf8_decode("\xF4\x90\x80\x80", 4, code), 0u);    // 超出U+10FFFF
+    EXPECT_EQ(utf8_decode("\x80", 1, code), 0u);                // 单独的后续字节
+    EXPECT_EQ(utf8_decode("\xE4\x41\xAD", 3, code), 0u);
+    EXPECT_EQ(utf8_decode("\xFF", 1, code), 0u);
+}
+
+// 测试合法前缀的长度，包括整块ASCII的快速路径与多字节字符交界的情况
+TEST(Utf8Test, ValidLengthTest) {
+    std::string ascii(40, 'a');
+    EXPECT_EQ(utf8_valid_length(ascii.data(), ascii.size()), 40u);
+    std::string mixed = ascii + "中文目录/" + ascii + "\xC3\xA9";
+    EXPECT_EQ(utf8_valid_length(mixed.data(), mixed.size()), mixed.size());
+    std::string cut = mixed + "\xE4\xB8";
+    EXPECT_EQ(utf8_valid_length(cut.data(), cut.size()), mixed.size());
+    std::string bad = ascii + "\xFF" + ascii;
+    EXPECT_EQ(utf8_valid_length(bad.data(), bad.size()), 40u);
+
+    // 随机拼接合法字符和不合法字节，与逐字符解码比较
+    const char* pieces[] = {"a", "0123456789abcdef", "\xE4\xB8\xAD", "\xC3\xA9", "\xF0\x9F\x98\x80",
+                            "\xE4\xB8", "\x80", "\xC0\xAF", " ", "\xED\xA0\x80"};
+    std::mt19937 random(1);
+    for (int round = 0; round < 2000; round++) {
+        std::string text;
+        int count = random() % 12;
+        for (int i = 0; i < count; i++) {
+            // 多数是合法的片段，不合法的落在各个位置
+            size_t piece = random() % 20;
+            text += pieces[piece < 10 ? piece % 6 == 5 ? 0 : piece : piece % 10];
+        }
+        ASSERT_EQ(utf8_valid_length(text.data(), text.size()), reference_valid_length(text)) << text;
+    }
+}
+
+TEST(Utf8Test, TextWidthTest) {
+    EXPECT_EQ(text_width("ls"), 2u);
+    EXPECT_EQ(text_width("ls 中文"), 7u);
+    EXPECT_EQ(text_width("cafe\xCC\x81"), 4u);     // e加组合重音符
+    // 零宽连接符连起的表情符号序列占一个宽字符
+    EXPECT_EQ(text_width("\xF0\x9F\x91\xA8\xE2\x80\x8D\xF0\x9F\x91\xA9\xE2\x80\x8D\xF0\x9F\x91\xA7"), 2u);
+    EXPECT_EQ(text_width("\xFF"), 1u);              // 不合法的字节显示为替换字符
+}
+
+TEST(Utf8Test, LineWidthsTest) {
+    LineWidths widths;
+    std::string text = "ls \xE4\xB8\xAD" "e\xCC\x81/";  // "ls 中é/"，é由e和组合字符组成
+    widths.update(text);
+    EXPECT_EQ(widths.column(3), 3u);
+    EXPECT_EQ(widths.column(6), 5u);
+    EXPECT_EQ(widths.column(4), 3u);                // 字符内部的字节与开头同列
+    EXPECT_EQ(widths.column(text.size()), 7u);
+    EXPECT_TRUE(widths.boundary(3));
+    EXPECT_FALSE(widths.boundary(4));
+    EXPECT_FALSE(widths.boundary(7));               // 组合字符不是簇的开头
+    EXPECT_EQ(widths.next_boundary(3), 6u);
+    EXPECT_EQ(widths.next_boundary(6), 9u);
+    EXPECT_EQ(widths.prev_boundary(9), 6u);
+    EXPECT_EQ(widths.prev_boundary(6), 3u);
+    EXPECT_EQ(widths.prev_boundary(0), 0u);
+    EXPECT_EQ(widths.next_boundary(text.size()), text.size());
+
+    // 在行尾输入组合字符，接到前一个簇上
+    text += "a";
+    widths.invalidate(text.size() - 1);
+    widths.update(text);
+    text += "\xCC\x81";
+    widths.invalidate(text.size() - 2);
+    widths.update(text);
+    EXPECT_EQ(widths.column(text.size()), 8u);
+    EXPECT_FALSE(widths.boundary(text.size() - 2));
+}
+
+// 测试随机编辑后增量更新的结果与重新计算相同
+TEST(Utf8Test, IncrementalUpdateTest) {
+    const char* pieces[] = {"a", "\xE4\xB8\xAD", "\xCC\x81", "\xE2\x80\x8D", "\xF0\x9F\x98\x80", " ", "\xFF"};
+    std::mt19937 random(2);
+    LineWidths widths;
+    std::string text;
+    for (int round = 0; round < 3000; round++) {
+        widths.update(text);
+        // 在字节边界上插入或删除
+        size_t at = text.empty() ? 0 : random() % (text.size() + 1);
+        if (random() % 3 == 0 && !text.empty()) {
+            size_t count = std::min<size_t>(1 + random() % 4, text.size() - std::min(at, text.size() - 1));
+            at = std::min(at, text.size() - 1);
+            text.erase(at, count);
+        } else {
+            text.insert(at, pieces[random() % 7]);
+        }
+        if (text.size() > 60) text.clear();
+        widths.invalidate(at);
+        widths.update(text);
+
+        LineWidths fresh;
+        fresh.update(text);
+        for (size_t i = 0; i <= text.size(); i++) {
+            ASSERT_EQ(widths.column(i), fresh.column(i)) << round << " " << i;
+            ASSERT_EQ(widths.boundary(i), fresh.boundary(i)) << round << " " << i;
+        }
+        ASSERT_EQ(widths.column(text.size()), text_width(text));
+    }
+}
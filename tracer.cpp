@@ -0,0 +1,138 @@
+#include "tracer.h"
+#include <cstdio>
+#include <mutex>
+#include <vector>
+
+// 一个线程的轨道
+struct Tracer::Ring {
+    Event events[RING_EVENTS];
+    std::atomic<uint64_t> head;     // 写入过的事件总数，只由所属线程增加
+    std::atomic<uint64_t> start;    // clear时的head，之前的事件不再导出
+    std::string name;               // 轨道名，受registry_lock保护
+    int tid;
+};
+
+std::atomic<bool> Tracer::on(false);
+
+// 全部轨道，只在线程第一次记录和导出时加锁；线程结束后轨道保留到进程退出
+static std::mutex registry_lock;
+
+std::vector<Tracer::Ring*>& Tracer::registry() {
+    static std::vector<Ring*> rings;
+    return rings;
+}
+
+static uint64_t now_ns() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+Tracer::Ring* Tracer::thread_ring() {
+    static thread_local Ring* ring = nullptr;
+    if (!ring) {
+        ring = new Ring();
+        ring->head.store(0, std::memory_order_relaxed);
+        ring->start.store(0, std::memory_order_relaxed);
+        std::lock_guard<std::mutex> guard(registry_lock);
+        ring->tid = (int)registry().size() + 1;
+        ring->name = "thread " + std::to_string(ring->tid);
+        registry().push_back(ring);
+    }
+    return ring;
+}
+
+void Tracer::record(Phase phase, const char* name, int32_t arg) {
+    Ring* ring = thread_ring();
+    uint64_t index = ring->head.load(std::memory_order_relaxed);
+    Event& event = ring->events[index & (RING_EVENTS - 1)];
+    event.time = now_ns();
+    event.name = name;
+    event.arg = arg;
+    event.phase = phase;
+    ring->head.store(index + 1, std::memory_order_release);
+}
+
+void Tracer::set_thread_name(const char* name) {
+    Ring* ring = thread_ring();
+    std::lock_guard<std::mutex> guard(registry_lock);
+    ring->name = name;
+}
+
+void Tracer::clear() {
+    std::lock_guard<std::mutex> guard(registry_lock);
+    for (Ring* ring : registry()) {
+        ring->start.store(ring->head.load(std::memory_order_acquire), std::memory_order_relaxed);
+    }
+}
+
+// 名字中的引号、反斜杠和控制字符转义
+static void append_json_string(std::string& out, const char* text) {
+    out += '"';
+    for (const char* p = text; *p; p++) {
+        unsigned char c = *p;
+        if (c == '"' || c == '\\') {
+            out += '\\';
+            out += c;
+        } else if (c < 0x20) {
+            char escaped[8];
+            snprintf(escaped, sizeof(escaped), "\\u%04x", c);
+            out += escaped;
+        } else {
+            out += c;
+        }
+    }
+    out += '"';
+}
+
+std::string Tracer::chrome_trace() {
+    std::string out = "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[";
+    bool first = true;
+    char line[128];
+    std::lock_guard<std::mutex> guard(registry_lock);
+    std::vector<Event> events;
+    for (Ring* ring : registry()) {
+        // 轨道名
+        snprintf(line, sizeof(line), "%s\n{\"ph\":\"M\",\"pid\":1,\"tid\":%d,\"name\":\"thread_name\",\"args\":{\"name\":",
+                 first ? "" : ",", ring->tid);
+        out += line;
+        append_json_string(out, ring->name.c_str());
+        out += "}}";
+        first = false;
+
+        // 先复制再检查：复制期间被所属线程覆盖的事件丢掉
+        uint64_t head = ring->head.load(std::memory_order_acquire);
+        uint64_t from = ring->start.load(std::memory_order_relaxed);
+        if (head - from > RING_EVENTS) from = head - RING_EVENTS;
+        events.clear();
+        for (uint64_t i = from; i < head; i++) events.push_back(ring->events[i & (RING_EVENTS - 1)]);
+        uint64_t after = ring->head.load(std::memory_order_acquire);
+        size_t skip = after - from > RING_EVENTS ? after - from - RING_EVENTS : 0;
+
+        for (size_t i = skip; i < events.size(); i++) {
+            const Event& event = events[i];
+            snprintf(line, sizeof(line), ",\n{\"ph\":\"%c\",\"pid\":1,\"tid\":%d,\"ts\":%llu.%03u,\"name\":",
+                     event.phase, ring->tid, (unsigned long long)(event.time / 1000),
+                     (unsigned)(event.time % 1000));
+            out += line;
+            append_json_string(out, event.name);
+            if (event.phase == INSTANT) {
+                snprintf(line, sizeof(line), ",\"s\":\"t\",\"args\":{\"value\":%d}}", event.arg);
+            } else if (event.phase == COUNTER) {
+                snprintf(line, sizeof(line), ",\"args\":{\"value\":%d}}", event.arg);
+            } else {
+                snprintf(line, sizeof(line), "}");
+            }
+            out += line;
+        }
+    }
+    out += "\n]}\n";
+    return out;
+}
+
+bool Tracer::write_chrome_trace(const std::string& path) {
+    FILE* file = fopen(path.c_str(), "w");
+    if (!file) return false;
+    std::string trace = chrome_trace();
+    bool ok = fwrite(trace.data(), 1, trace.size(), file) == trace.size();
+    return fclose(file) == 0 && ok;
+}
@@ -0,0 +1,96 @@
+#ifndef _TRACER_H_
+#define _TRACER_H_
+
+#include <atomic>
+#include <chrono>
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+
+// 事件跟踪
+// 每个记录事件的线程有自己的环形缓冲区（一条轨道），只有该线程写入，记录时不加锁、
+// 不分配内存；满了覆盖最早的事件。事件是定长的二进制记录，名字是字符串常量的指针。
+// 导出为Chrome跟踪的JSON（chrome://tracing和Perfetto都可以打开），每个线程一条轨道。
+//
+// 埋点用下面的TRACE_*宏，只在定义了SHELL_TRACE（cmake -DENABLE_TRACE=ON）时展开，
+// 否则整个跟踪在编译期去掉。编译进来后还需要Tracer::enable(true)才开始记录
+class Tracer {
+public:
+    // 事件类型，取Chrome跟踪格式的ph字段
+    enum Phase : char {
+        BEGIN = 'B',
+        END = 'E',
+        INSTANT = 'i',
+        COUNTER = 'C'
+    };
+
+    static constexpr size_t RING_EVENTS = 8192;   // 每个线程保留的事件数
+
+    static bool enabled() { return on.load(std::memory_order_relaxed); }
+    static void enable(bool enabled) { on.store(enabled, std::memory_order_relaxed); }
+
+    // 记录一个事件，name必须是字符串常量（只保存指针）
+    static void record(Phase phase, const char* name, int32_t arg = 0);
+    // 给当前线程的轨道命名，同时建立它的缓冲区；线程开始时调用，之后的记录不再分配
+    static void set_thread_name(const char* name);
+
+    // 导出全部轨道为Chrome跟踪JSON；记录可以同时进行，正被覆盖的事件会丢掉
+    static std::string chrome_trace();
+    static bool write_chrome_trace(const std::string& path);
+    // 清空各轨道
+    static void clear();
+
+private:
+    // 一个事件，24字节
+    struct Event {
+        uint64_t time;      // steady_clock纳秒
+        const char* name;
+        int32_t arg;
+        char phase;
+    };
+
+    struct Ring;
+
+    static std::atomic<bool> on;
+    static Ring* thread_ring();
+    static std::vector<Ring*>& registry();
+};
+
+#ifdef SHELL_TRACE
+
+// 作用域事件：构造时BEGIN，析构时END
+class TraceScope {
+public:
+    explicit TraceScope(const char* name) : name(Tracer::enabled() ? name : nullptr) {
+        if (this->name) Tracer::record(Tracer::BEGIN, name);
+    }
+    ~TraceScope() {
+        if (name) Tracer::record(Tracer::END, name);
+    }
+    TraceScope(const TraceScope&) = delete;
+    TraceScope& operator=(const TraceScope&) = delete;
+
+private:
+    const char* name;
+};
+
+#define TRACE_CONCAT2(a, b) a##b
+#define TRACE_CONCAT(a, b) TRACE_CONCAT2(a, b)
+#define TRACE_SCOPE(name) TraceScope TRACE_CONCAT(trace_scope_, __LINE__)(name)
+#define TRACE_INSTANT(name, arg) \
+    do { if (Tracer::enabled()) Tracer::record(Tracer::INSTANT, name, arg); } while (0)
+#define TRACE_COUNTER(name, value) \
+    do { if (Tracer::enabled()) Tracer::record(Tracer::COUNTER, name, value); } while (0)
+#define TRACE_THREAD(name) Tracer::set_thread_name(name)
+
+#else
+
+#define TRACE_SCOPE(name) do { } while (0)
+#define TRACE_INSTANT(name, arg) do { } while (0)
+#define TRACE_COUNTER(name, value) do { } while (0)
+#define TRACE_THREAD(name) do { } while (0)
+
+#endif
+
+#endif
@@ -0,0 +1,239 @@
+#include "utf8.h"
+#include <cstring>
+#include <map>
+#include <array>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+namespace {
+
+struct WidthRange {
+    uint32_t first;
+    uint32_t last;
+};
+
+// 占2列的码点：East Asian Width为W或F的区间
+const WidthRange WIDE[] = {
+    {0x1100, 0x115F}, {0x231A, 0x231B}, {0x2329, 0x232A}, {0x23E9, 0x23EC}, {0x23F0, 0x23F0},
+    {0x23F3, 0x23F3}, {0x25FD, 0x25FE}, {0x2614, 0x2615}, {0x2648, 0x2653}, {0x267F, 0x267F},
+    {0x2693, 0x2693}, {0x26A1, 0x26A1}, {0x26AA, 0x26AB}, {0x26BD, 0x26BE}, {0x26C4, 0x26C5},
+    {0x26CE, 0x26CE}, {0x26D4, 0x26D4}, {0x26EA, 0x26EA}, {0x26F2, 0x26F3}, {0x26F5, 0x26F5},
+    {0x26FA, 0x26FA}, {0x26FD, 0x26FD}, {0x2705, 0x2705}, {0x270A, 0x270B}, {0x2728, 0x2728},
+    {0x274C, 0x274C}, {0x274E, 0x274E}, {0x2753, 0x2755}, {0x2757, 0x2757}, {0x2795, 0x2797},
+    {0x27B0, 0x27B0}, {0x27BF, 0x27BF}, {0x2B1B, 0x2B1C}, {0x2B50, 0x2B50}, {0x2B55, 0x2B55},
+    {0x2E80, 0x303E}, {0x3041, 0x33FF}, {0x3400, 0x4DBF}, {0x4E00, 0x9FFF}, {0xA000, 0xA4CF},
+    {0xA960, 0xA97F}, {0xAC00, 0xD7A3}, {0xF900, 0xFAFF}, {0xFE10, 0xFE19}, {0xFE30, 0xFE6F},
+    {0xFF00, 0xFF60}, {0xFFE0, 0xFFE6}, {0x16FE0, 0x16FE4}, {0x17000, 0x18AFF}, {0x1B000, 0x1B16F},
+    {0x1F004, 0x1F004}, {0x1F0CF, 0x1F0CF}, {0x1F18E, 0x1F18E}, {0x1F191, 0x1F19A},
+    {0x1F200, 0x1F202}, {0x1F210, 0x1F23B}, {0x1F240, 0x1F248}, {0x1F250, 0x1F251},
+    {0x1F260, 0x1F265}, {0x1F300, 0x1F64F}, {0x1F680, 0x1F6FF}, {0x1F900, 0x1F9FF},
+    {0x1FA70, 0x1FAFF}, {0x20000, 0x2FFFD}, {0x30000, 0x3FFFD},
+};
+
+// 占0列的码点：组合字符、韩文字母的中声和终声、零宽字符、变体选择符、肤色修饰符和标签
+// （在WIDE之后应用，覆盖其中的肤色修饰符）
+const WidthRange ZERO[] = {
+    {0x0300, 0x036F}, {0x0483, 0x0489}, {0x0591, 0x05BD}, {0x05BF, 0x05BF}, {0x05C1, 0x05C2},
+    {0x05C4, 0x05C5}, {0x05C7, 0x05C7}, {0x0610, 0x061A}, {0x064B, 0x065F}, {0x0670, 0x0670},
+    {0x06D6, 0x06DC}, {0x06DF, 0x06E4}, {0x06E7, 0x06E8}, {0x06EA, 0x06ED}, {0x0711, 0x0711},
+    {0x0730, 0x074A}, {0x07A6, 0x07B0}, {0x0900, 0x0902}, {0x093A, 0x093A}, {0x093C, 0x093C},
+    {0x0941, 0x0948}, {0x094D, 0x094D}, {0x0951, 0x0957}, {0x0962, 0x0963}, {0x0E31, 0x0E31},
+    {0x0E34, 0x0E3A}, {0x0E47, 0x0E4E}, {0x1160, 0x11FF}, {0x1AB0, 0x1AFF}, {0x1DC0, 0x1DFF},
+    {0x200B, 0x200F}, {0x202A, 0x202E}, {0x2060, 0x2064}, {0x20D0, 0x20FF}, {0x302A, 0x302D},
+    {0x3099, 0x309A}, {0xD7B0, 0xD7FF}, {0xFE00, 0xFE0F}, {0xFE20, 0xFE2F}, {0xFEFF, 0xFEFF},
+    {0x1F3FB, 0x1F3FF}, {0xE0000, 0xE0FFF},
+};
+
+const uint32_t CODE_LIMIT = 0x110000;
+const uint32_t ZERO_WIDTH_JOINER = 0x200D;
+
+// 两级宽度表
+struct WidthTable {
+    uint8_t block_of[CODE_LIMIT >> 8];
+    std::vector<std::array<uint8_t, 64>> blocks;    // 每块256个码点，每个2位
+
+    WidthTable() {
+        std::vector<uint8_t> widths(CODE_LIMIT, 1);
+        for (const WidthRange& range : WIDE) {
+            memset(&widths[range.first], 2, range.last - range.first + 1);
+        }
+        for (const WidthRange& range : ZERO) {
+            memset(&widths[range.first], 0, range.last - range.first + 1);
+        }
+        std::map<std::array<uint8_t, 64>, uint8_t> known;
+        for (uint32_t block = 0; block < (CODE_LIMIT >> 8); block++) {
+            std::array<uint8_t, 64> packed = {};
+            for (uint32_t i = 0; i < 256; i++) {
+                packed[i >> 2] |= widths[(block << 8) + i] << ((i & 3) * 2);
+            }
+            auto found = known.find(packed);
+            if (found == known.end()) {
+                found = known.emplace(packed, (uint8_t)blocks.size()).first;
+                blocks.push_back(packed);
+            }
+            block_of[block] = found->second;
+        }
+    }
+};
+
+const WidthTable& width_table() {
+    static const WidthTable table;
+    return table;
+}
+
+}  // namespace
+
+unsigned codepoint_width(uint32_t code) {
+    if (code >= 0x20 && code < 0x300) return 1;  // ASCII和拉丁字母不查表
+    if (code >= CODE_LIMIT) return 1;
+    const WidthTable& table = width_table();
+    uint8_t packed = table.blocks[table.block_of[code >> 8]][(code & 0xFF) >> 2];
+    return (packed >> ((code & 3) * 2)) & 3;
+}
+
+size_t utf8_sequence_length(unsigned char lead) {
+    if (lead < 0x80) return 1;
+    if (lead >= 0xC2 && lead <= 0xDF) return 2;
+    if (lead >= 0xE0 && lead <= 0xEF) return 3;
+    if (lead >= 0xF0 && lead <= 0xF4) return 4;
+    return 0;
+}
+
+size_t utf8_decode(const char* data, size_t len, uint32_t& code) {
+    static const uint32_t SMALLEST[] = {0, 0, 0x80, 0x800, 0x10000};
+    if (len == 0) return 0;
+    unsigned char lead = data[0];
+    size_t n = utf8_sequence_length(lead);
+    if (n == 0 || n > len) return 0;
+    if (n == 1) {
+        code = lead;
+        return 1;
+    }
+    uint32_t value = lead & (0x7F >> n);
+    for (size_t i = 1; i < n; i++) {
+        unsigned char byte = data[i];
+        if ((byte & 0xC0) != 0x80) return 0;
+        value = (value << 6) | (byte & 0x3F);
+    }
+    if (value < SMALLEST[n] || (value >= 0xD800 && value <= 0xDFFF) || value >= CODE_LIMIT) return 0;
+    code = value;
+    return n;
+}
+
+size_t utf8_valid_length(const char* data, size_t len) {
+    size_t i = 0;
+    while (i < len) {
+        if ((unsigned char)data[i] < 0x80) {
+#ifdef __SSE2__
+            // 整块都是ASCII时一次跳过16字节
+            while (i + 16 <= len && _mm_movemask_epi8(_mm_loadu_si128((const __m128i*)(data + i))) == 0) {
+                i += 16;
+            }
+            if (i >= len || (unsigned char)data[i] >= 0x80) continue;
+#endif
+            i++;
+            continue;
+        }
+        uint32_t code;
+        size_t n = utf8_decode(data + i, len - i, code);
+        if (n == 0) break;
+        i += n;
+    }
+    return i;
+}
+
+bool grapheme_extends(uint32_t prev, uint32_t code) {
+    if (prev == ZERO_WIDTH_JOINER) return true;
+    return code >= 0x300 && codepoint_width(code) == 0;
+}
+
+size_t text_width(std::string_view text) {
+    size_t width = 0;
+    unsigned cluster = 0;   // 当前簇的宽度
+    uint32_t prev = 0;
+    for (size_t i = 0; i < text.size();) {
+        uint32_t code;
+        size_t n = utf8_decode(text.data() + i, text.size() - i, code);
+        if (n == 0) {
+            code = 0xFFFD;  // 不合法的字节由终端显示为替换字符
+            n = 1;
+        }
+        unsigned w = codepoint_width(code);
+        if (i > 0 && grapheme_extends(prev, code)) {
+            if (w > cluster) {
+                width += w - cluster;
+                cluster = w;
+            }
+        } else {
+            width += w;
+            cluster = w;
+        }
+        prev = code;
+        i += n;
+    }
+    return width;
+}
+
+LineWidths::LineWidths(std::pmr::memory_resource* resource)
+    : columns(1, 0, resource), starts(1, 1, resource), valid(0) {}
+
+const uint32_t* LineWidths::update(std::string_view text) {
+    size_t n = text.size();
+    if (valid > n) valid = n;  // 文本变短时之后的内容一定已改动
+    if (valid == n && columns.size() == n + 1) return columns.data();
+
+    // 改动可能使之前3字节内开头的字符解码不同（如补全了不完整的字符），或接到前面的簇上，
+    // 从valid前4字节所在簇的开头算起：这个簇开头的字符和它之前的内容都不受影响
+    size_t i = valid > 4 ? valid - 4 : 0;
+    while (i > 0 && !starts[i]) i--;
+    columns.resize(n + 1);
+    starts.resize(n + 1);
+    uint32_t cluster_column = i > 0 ? columns[i] : 0;
+    unsigned cluster_width = 0;
+    uint32_t prev = 0;
+    bool first = true;
+    while (i < n) {
+        uint32_t code;
+        size_t k = utf8_decode(text.data() + i, n - i, code);
+        if (k == 0) {
+            code = 0xFFFD;
+            k = 1;
+        }
+        unsigned w = codepoint_width(code);
+        if (!first && grapheme_extends(prev, code)) {
+            if (w > cluster_width) cluster_width = w;
+            starts[i] = 0;
+        } else {
+            cluster_column += first ? 0 : cluster_width;
+            cluster_width = w;
+            starts[i] = 1;
+        }
+        for (size_t j = i; j < i + k; j++) {
+            columns[j] = cluster_column;
+            if (j > i) starts[j] = 0;
+        }
+        first = false;
+        prev = code;
+        i += k;
+    }
+    columns[n] = cluster_column + cluster_width;
+    starts[n] = 1;
+    valid = n;
+    return columns.data();
+}
+
+size_t LineWidths::prev_boundary(size_t offset) const {
+    if (offset == 0) return 0;
+    offset--;
+    while (offset > 0 && !starts[offset]) offset--;
+    return offset;
+}
+
+size_t LineWidths::next_boundary(size_t offset) const {
+    size_t end = columns.size() - 1;
+    if (offset >= end) return end;
+    offset++;
+    while (offset < end && !starts[offset]) offset++;
+    return offset;
+}
@@ -0,0 +1,64 @@
+#ifndef _UTF8_H_
+#define _UTF8_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+#include <vector>
+#include <memory_resource>
+
+// UTF-8文本的解码、验证和显示宽度
+// 宽度取自按码点建立的两级表：第一级按码点的高位（每256个码点一块）查块号，第二级每个
+// 码点2位，内容相同的块只存一份，第一次使用时由宽度区间表生成。中日韩文字、全角符号和
+// 表情符号等宽字符占2列，组合字符、零宽字符和变体选择符占0列，其余占1列（控制字符也按
+// 1列，与之前逐字节显示时相同）。
+
+// 码点占的列数
+unsigned codepoint_width(uint32_t code);
+
+// 以lead开头的UTF-8字符的字节数，lead不能作为开头时返回0
+size_t utf8_sequence_length(unsigned char lead);
+
+// 解码data开头的一个字符，返回字节数；不合法（过长编码、代理区、超出U+10FFFF）或不完整
+// 时返回0
+size_t utf8_decode(const char* data, size_t len, uint32_t& code);
+
+// data开头由完整且合法的UTF-8字符组成的最长前缀的字节数，ASCII部分每次检查16字节
+size_t utf8_valid_length(const char* data, size_t len);
+
+// code是否接在前一个码点prev之后组成同一个字形簇：组合字符等0列的码点，以及零宽连接符
+// 之后的码点（表情符号序列）
+bool grapheme_extends(uint32_t prev, uint32_t code);
+
+// 文本占的列数，字形簇的宽度取其中最宽的码点
+size_t text_width(std::string_view text);
+
+// 命令行的前缀宽度缓存
+// 记录每个字节偏移所在字形簇的起始列（簇内的字节与簇的开头相同）以及是否为簇的开头，
+// 列号换算和按簇移动光标都不必从行首扫描。编辑后用invalidate标记改动的位置，下次update
+// 从改动处所在的簇算到行尾，在行尾输入只计算新加的字符。
+class LineWidths {
+public:
+    explicit LineWidths(std::pmr::memory_resource* resource = std::pmr::get_default_resource());
+
+    // 文本从offset起有改动
+    void invalidate(size_t offset) {
+        if (offset < valid) valid = offset;
+    }
+    // 按text更新缓存，返回text.size()+1项的列号表（可用于EditLine）
+    const uint32_t* update(std::string_view text);
+
+    // 以下在update之后使用，offset不超过text.size()
+    size_t column(size_t offset) const { return columns[offset]; }
+    bool boundary(size_t offset) const { return starts[offset] != 0; }
+    // offset之前、之后最近的簇边界
+    size_t prev_boundary(size_t offset) const;
+    size_t next_boundary(size_t offset) const;
+
+private:
+    std::pmr::vector<uint32_t> columns;
+    std::pmr::vector<uint8_t> starts;   // 簇的开头为1，行尾也为1
+    size_t valid;                       // 前valid个字节的缓存有效
+};
+
+#endif